@@ -0,0 +1,411 @@
+/*
+ * apex_batch.c
+ * Contains the batched (SIMD lockstep) functional engine
+ *
+ * All lanes share one program. Each step picks the smallest PC among the
+ * running lanes and executes that instruction under a mask of the lanes
+ * sitting at it, so lanes whose branches diverged wait until the others
+ * catch up and reconverge. Arithmetic uses GCC vector extensions, which map
+ * onto AVX2 / AVX-512 registers in the clones selected at load time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "apex_batch.h"
+#include "apex_macros.h"
+
+/* Converts the PC(4000 series) into array index for code memory */
+static int
+get_code_memory_index_from_pc(const int pc)
+{
+    return (pc - 4000) / 4;
+}
+
+/* Picks new where mask is set and old elsewhere */
+static inline __attribute__((always_inline)) APEX_Lanes
+lanes_select(APEX_Lanes mask, APEX_Lanes new_val, APEX_Lanes old_val)
+{
+    return (mask & new_val) | (~mask & old_val);
+}
+
+/* Sets the condition codes of the masked lanes from an ALU result */
+static inline __attribute__((always_inline)) void
+lanes_set_flags(APEX_Batch *batch, APEX_Lanes mask, APEX_Lanes result)
+{
+    APEX_Lanes zero = (APEX_Lanes){0};
+
+    batch->z = lanes_select(mask, result == zero, batch->z);
+    batch->p = lanes_select(mask, result > zero, batch->p);
+    batch->n = lanes_select(mask, result < zero, batch->n);
+}
+
+/* Writes a register of the masked lanes */
+static inline __attribute__((always_inline)) void
+lanes_write_reg(APEX_Batch *batch, APEX_Lanes mask, int reg, APEX_Lanes value)
+{
+    batch->regs[reg] = lanes_select(mask, value, batch->regs[reg]);
+}
+
+/* Removes lanes from the run with the given status */
+static inline __attribute__((always_inline)) void
+lanes_retire(APEX_Batch *batch, APEX_Lanes mask, int status)
+{
+    int lane;
+
+    for (lane = 0; lane < APEX_BATCH_LANES; ++lane)
+    {
+        if (mask[lane])
+        {
+            batch->status[lane] = status;
+        }
+    }
+    batch->active &= ~mask;
+}
+
+/*
+ * Gathers data memory words of the masked lanes. Lanes with an address
+ * outside data memory are dropped from the mask and stopped.
+ */
+static inline __attribute__((always_inline)) APEX_Lanes
+lanes_load(APEX_Batch *batch, APEX_Lanes *mask, APEX_Lanes address)
+{
+    APEX_Lanes value = (APEX_Lanes){0};
+    APEX_Lanes bad = (APEX_Lanes){0};
+    int lane;
+
+    for (lane = 0; lane < APEX_BATCH_LANES; ++lane)
+    {
+        if (!(*mask)[lane])
+        {
+            continue;
+        }
+        if (address[lane] < 0 || address[lane] >= DATA_MEMORY_SIZE)
+        {
+            bad[lane] = -1;
+            continue;
+        }
+        value[lane] = batch->data_memory[address[lane]][lane];
+    }
+
+    lanes_retire(batch, bad, APEX_LANE_BAD_ADDRESS);
+    *mask &= ~bad;
+    return value;
+}
+
+/* Scatters one word per masked lane into data memory */
+static inline __attribute__((always_inline)) void
+lanes_store(APEX_Batch *batch, APEX_Lanes *mask, APEX_Lanes address,
+            APEX_Lanes value)
+{
+    APEX_Lanes bad = (APEX_Lanes){0};
+    int lane;
+
+    for (lane = 0; lane < APEX_BATCH_LANES; ++lane)
+    {
+        if (!(*mask)[lane])
+        {
+            continue;
+        }
+        if (address[lane] < 0 || address[lane] >= DATA_MEMORY_SIZE)
+        {
+            bad[lane] = -1;
+            continue;
+        }
+        batch->data_memory[address[lane]][lane] = value[lane];
+    }
+
+    lanes_retire(batch, bad, APEX_LANE_BAD_ADDRESS);
+    *mask &= ~bad;
+}
+
+/*
+ * Executes one instruction for the lanes in mask. Semantics follow the
+ * pipeline in apex_cpu.c: DIV is not implemented there and retires as a NOP,
+ * MOVC and memory instructions leave the condition codes untouched.
+ */
+static inline __attribute__((always_inline)) void
+lanes_execute(APEX_Batch *batch, const APEX_Instruction *ins, APEX_Lanes mask)
+{
+    APEX_Lanes four = (APEX_Lanes){0} + 4;
+    APEX_Lanes next_pc = batch->pc + four;
+    APEX_Lanes result, address, taken;
+
+    switch (ins->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        {
+            APEX_Lanes a = batch->regs[ins->rs1];
+            APEX_Lanes b = batch->regs[ins->rs2];
+
+            switch (ins->opcode)
+            {
+                case OPCODE_ADD: result = a + b; break;
+                case OPCODE_SUB: result = a - b; break;
+                case OPCODE_MUL: result = a * b; break;
+                case OPCODE_AND: result = a & b; break;
+                case OPCODE_OR: result = a | b; break;
+                default: result = a ^ b; break;
+            }
+            lanes_write_reg(batch, mask, ins->rd, result);
+            lanes_set_flags(batch, mask, result);
+            break;
+        }
+
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        {
+            result = (ins->opcode == OPCODE_ADDL)
+                         ? batch->regs[ins->rs1] + ins->imm
+                         : batch->regs[ins->rs1] - ins->imm;
+            lanes_write_reg(batch, mask, ins->rd, result);
+            lanes_set_flags(batch, mask, result);
+            break;
+        }
+
+        case OPCODE_MOVC:
+        {
+            lanes_write_reg(batch, mask, ins->rd, (APEX_Lanes){0} + ins->imm);
+            break;
+        }
+
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        {
+            APEX_Lanes base = batch->regs[ins->rs1];
+
+            address = base + ins->imm;
+            result = lanes_load(batch, &mask, address);
+            lanes_write_reg(batch, mask, ins->rd, result);
+            if (ins->opcode == OPCODE_LOADP)
+            {
+                /* The incremented base is written after rd, so it wins */
+                lanes_write_reg(batch, mask, ins->rs1, base + four);
+            }
+            break;
+        }
+
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+        {
+            APEX_Lanes base = batch->regs[ins->rs2];
+
+            address = base + ins->imm;
+            lanes_store(batch, &mask, address, batch->regs[ins->rs1]);
+            if (ins->opcode == OPCODE_STOREP)
+            {
+                lanes_write_reg(batch, mask, ins->rs2, base + four);
+            }
+            break;
+        }
+
+        case OPCODE_CML:
+        case OPCODE_CMP:
+        {
+            result = (ins->opcode == OPCODE_CML)
+                         ? batch->regs[ins->rs1] - ins->imm
+                         : batch->regs[ins->rs1] - batch->regs[ins->rs2];
+            lanes_set_flags(batch, mask, result);
+            break;
+        }
+
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        {
+            switch (ins->opcode)
+            {
+                case OPCODE_BZ: taken = batch->z; break;
+                case OPCODE_BNZ: taken = ~batch->z; break;
+                case OPCODE_BP: taken = batch->p; break;
+                case OPCODE_BNP: taken = ~batch->p; break;
+                case OPCODE_BN: taken = batch->n; break;
+                default: taken = ~batch->n; break;
+            }
+            next_pc = lanes_select(taken, batch->pc + ins->imm, next_pc);
+            break;
+        }
+
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+        {
+            APEX_Lanes target = batch->regs[ins->rs1] + ins->imm;
+
+            if (ins->opcode == OPCODE_JALR)
+            {
+                lanes_write_reg(batch, mask, ins->rd, next_pc);
+            }
+            next_pc = target;
+            break;
+        }
+
+        case OPCODE_HALT:
+        {
+            batch->insn_completed -= mask;
+            lanes_retire(batch, mask, APEX_LANE_HALTED);
+            return;
+        }
+
+        default:
+        {
+            /* NOP and DIV */
+            break;
+        }
+    }
+
+    /* Lanes a load or store dropped for a bad address are out of mask and
+     * did not complete the instruction */
+    batch->insn_completed -= mask;
+    batch->pc = lanes_select(mask, next_pc, batch->pc);
+}
+
+/*
+ * This function creates a batch with no lanes loaded
+ */
+APEX_Batch *
+APEX_batch_init(const APEX_Instruction *code_memory, int code_memory_size)
+{
+    APEX_Batch *batch;
+
+    if (!code_memory)
+    {
+        return NULL;
+    }
+
+    if (posix_memalign((void **)&batch, sizeof(APEX_Lanes), sizeof(APEX_Batch)))
+    {
+        return NULL;
+    }
+
+    memset(batch, 0, sizeof(APEX_Batch));
+    batch->pc = (APEX_Lanes){0} + 4000;
+    batch->code_memory = code_memory;
+    batch->code_memory_size = code_memory_size;
+    return batch;
+}
+
+/*
+ * This function copies an initial data memory image into a lane and marks
+ * the lane as running. A NULL image starts the lane with zeroed memory.
+ */
+void
+APEX_batch_load_lane(APEX_Batch *batch, int lane, const int *data_memory)
+{
+    int i;
+
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        batch->data_memory[i][lane] = data_memory ? data_memory[i] : 0;
+    }
+
+    batch->active[lane] = -1;
+    batch->status[lane] = APEX_LANE_RUNNING;
+}
+
+/*
+ * Batched simulation loop, runs until every lane has stopped or max_steps
+ * lockstep steps have been executed.
+ *
+ * The function is cloned per instruction set and the best clone for the host
+ * is picked once by the dynamic loader, so the lane vectors live in ymm/zmm
+ * registers where the hardware has them.
+ */
+__attribute__((target_clones("avx512f", "avx2", "default"))) void
+APEX_batch_run(APEX_Batch *batch, long max_steps)
+{
+    int lane, group_pc, index, diverged;
+    APEX_Lanes mask;
+
+    for (;;)
+    {
+        group_pc = INT_MAX;
+        diverged = FALSE;
+        for (lane = 0; lane < APEX_BATCH_LANES; ++lane)
+        {
+            if (!batch->active[lane])
+            {
+                continue;
+            }
+            if (group_pc != INT_MAX && batch->pc[lane] != group_pc)
+            {
+                diverged = TRUE;
+            }
+            if (batch->pc[lane] < group_pc)
+            {
+                group_pc = batch->pc[lane];
+            }
+        }
+
+        if (group_pc == INT_MAX)
+        {
+            /* All lanes stopped */
+            break;
+        }
+
+        if (batch->steps >= max_steps)
+        {
+            lanes_retire(batch, batch->active, APEX_LANE_STEP_LIMIT);
+            break;
+        }
+        batch->steps++;
+
+        /* Lanes sitting at a larger PC wait for this group to reconverge */
+        mask = diverged ? batch->active & (batch->pc == group_pc)
+                        : batch->active;
+
+        index = get_code_memory_index_from_pc(group_pc);
+        if ((group_pc - 4000) % 4 || index < 0
+            || index >= batch->code_memory_size)
+        {
+            lanes_retire(batch, mask, APEX_LANE_BAD_PC);
+            continue;
+        }
+
+        lanes_execute(batch, &batch->code_memory[index], mask);
+    }
+}
+
+/*
+ * This function copies the architectural state of one lane out of the batch.
+ * Either destination may be NULL.
+ */
+void
+APEX_batch_read_lane(const APEX_Batch *batch, int lane, int *regs,
+                     int *data_memory)
+{
+    int i;
+
+    if (regs)
+    {
+        for (i = 0; i < REG_FILE_SIZE; ++i)
+        {
+            regs[i] = batch->regs[i][lane];
+        }
+    }
+
+    if (data_memory)
+    {
+        for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+        {
+            data_memory[i] = batch->data_memory[i][lane];
+        }
+    }
+}
+
+/*
+ * This function deallocates the batch, code memory stays with the caller
+ */
+void
+APEX_batch_stop(APEX_Batch *batch)
+{
+    free(batch);
+}
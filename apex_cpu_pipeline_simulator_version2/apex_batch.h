@@ -0,0 +1,58 @@
+/*
+ * apex_batch.h
+ * Contains declarations of the batched (SIMD lockstep) functional engine
+ *
+ * One APEX program is executed for several data sets at once. Registers and
+ * data memory are kept as struct-of-arrays, one vector lane per instance, so
+ * every instruction is applied to all lanes with a single vector operation.
+ */
+#ifndef _APEX_BATCH_H_
+#define _APEX_BATCH_H_
+
+#include "apex_cpu.h"
+
+/* Number of instances executed in lockstep, 8 for AVX2 or 16 for AVX-512 */
+#ifndef APEX_BATCH_LANES
+#define APEX_BATCH_LANES 8
+#endif
+
+/* Upper bound on lockstep steps, protects against programs that never halt */
+#define APEX_BATCH_MAX_STEPS 100000000L
+
+/* Lane status values */
+#define APEX_LANE_IDLE 0x0
+#define APEX_LANE_RUNNING 0x1
+#define APEX_LANE_HALTED 0x2
+#define APEX_LANE_BAD_PC 0x3
+#define APEX_LANE_BAD_ADDRESS 0x4
+#define APEX_LANE_STEP_LIMIT 0x5
+
+/* One 32-bit integer per instance */
+typedef int APEX_Lanes __attribute__((vector_size(APEX_BATCH_LANES * sizeof(int))));
+
+/* Model of APEX_BATCH_LANES functional APEX instances */
+typedef struct APEX_Batch
+{
+    APEX_Lanes regs[REG_FILE_SIZE];          /* Integer register files */
+    APEX_Lanes pc;                           /* Program counters */
+    APEX_Lanes z;                            /* Condition codes, 0 or -1 */
+    APEX_Lanes p;
+    APEX_Lanes n;
+    APEX_Lanes active;                       /* -1 while the lane runs */
+    APEX_Lanes insn_completed;               /* Instructions retired */
+    APEX_Lanes data_memory[DATA_MEMORY_SIZE]; /* Data memory, word-major */
+    int status[APEX_BATCH_LANES];            /* APEX_LANE_* per lane */
+    long steps;                              /* Lockstep steps executed */
+    const APEX_Instruction *code_memory;     /* Shared, read-only */
+    int code_memory_size;
+} APEX_Batch;
+
+APEX_Batch *APEX_batch_init(const APEX_Instruction *code_memory,
+                            int code_memory_size);
+void APEX_batch_load_lane(APEX_Batch *batch, int lane, const int *data_memory);
+void APEX_batch_run(APEX_Batch *batch, long max_steps);
+void APEX_batch_read_lane(const APEX_Batch *batch, int lane, int *regs,
+                          int *data_memory);
+void APEX_batch_stop(APEX_Batch *batch);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * apex_bench.c
+ * Contains the benchmark runner
+ *
+ * A kernel is run once untimed to warm the caches and the allocator, then
+ * repeatedly with only the cycle loop on the clock, since creating the CPU
+ * is not simulation work. Each run is a fresh pipeline over the same code
+ * and data image, so every run simulates exactly the same cycles and only
+ * the host time varies. The final state is checked against the functional
+ * model so a faster simulator that is wrong does not pass for an
+ * improvement.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_bench.h"
+#include "apex_func.h"
+
+/* Sample mean and standard deviation of n values */
+static void
+mean_sd(const double *values, int n, double *mean, double *sd)
+{
+    double sum = 0.0, squares = 0.0;
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+        sum += values[i];
+    }
+    *mean = sum / n;
+    for (i = 0; i < n; ++i)
+    {
+        squares += (values[i] - *mean) * (values[i] - *mean);
+    }
+    *sd = n > 1 ? sqrt(squares / (n - 1)) : 0.0;
+}
+
+/* Runs one fresh pipeline to completion, returns the seconds it took or a
+ * negative value if it could not be created */
+static double
+timed_run(const APEX_Instruction *code_memory, int code_memory_size,
+          const int *data_memory, int forwarding, long max_cycles,
+          const APEX_Func *reference, APEX_Bench_Result *result)
+{
+    APEX_CPU *cpu = APEX_cpu_create_quiet(code_memory, code_memory_size, forwarding,
+                                          data_memory);
+    APEX_Cycle_Fn cycle;
+    int halted = FALSE;
+    double start, end;
+
+    if (!cpu)
+    {
+        return -1.0;
+    }
+
+    cycle = APEX_cpu_cycle_variant(cpu);
+    start = APEX_seconds(CLOCK_MONOTONIC);
+    while (cpu->clock < max_cycles && !(halted = cycle(cpu)))
+        ;
+    end = APEX_seconds(CLOCK_MONOTONIC);
+
+    result->cycles = cpu->clock;
+    result->instructions = cpu->insn_completed;
+    result->halted = halted;
+    result->correct = halted && reference->status == APEX_FUNC_HALTED
+                      && memcmp(cpu->regs, reference->regs, sizeof(cpu->regs)) == 0
+                      && memcmp(cpu->data_memory, reference->data_memory,
+                                sizeof(cpu->data_memory)) == 0;
+    APEX_cpu_stop(cpu);
+    return end - start;
+}
+
+/*
+ * Runs a kernel over one data image, once to warm up and then repeat
+ * times on the clock
+ *
+ * Returns 0 on success, -1 if a model could not be created
+ */
+int
+APEX_bench_run(const APEX_Instruction *code_memory, int code_memory_size,
+               const int *data_memory, int forwarding, int repeat,
+               long max_cycles, APEX_Bench_Result *result)
+{
+    APEX_Func *reference;
+    double seconds[repeat], cycles_rate[repeat], insns_rate[repeat];
+    int i;
+
+    reference = APEX_func_create(code_memory, code_memory_size, data_memory);
+    if (!reference)
+    {
+        return -1;
+    }
+    APEX_func_run(reference, APEX_FUNC_MAX_INSNS);
+
+    memset(result, 0, sizeof(APEX_Bench_Result));
+    for (i = -1; i < repeat; ++i)
+    {
+        double t = timed_run(code_memory, code_memory_size, data_memory, forwarding,
+                             max_cycles, reference, result);
+
+        if (t < 0.0)
+        {
+            APEX_func_destroy(reference);
+            return -1;
+        }
+        if (i < 0)
+        {
+            continue;
+        }
+        seconds[i] = t;
+        cycles_rate[i] = t > 0.0 ? result->cycles / t : 0.0;
+        insns_rate[i] = t > 0.0 ? result->instructions / t : 0.0;
+    }
+    APEX_func_destroy(reference);
+
+    mean_sd(seconds, repeat, &result->seconds_mean, &result->seconds_sd);
+    mean_sd(cycles_rate, repeat, &result->cycles_per_second_mean,
+            &result->cycles_per_second_sd);
+    mean_sd(insns_rate, repeat, &result->insns_per_second_mean,
+            &result->insns_per_second_sd);
+    return 0;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> bench [<option>...] <data_image>...".
+ * Options are repeat=<n>, forwarding=<none|ex|mem|all> and max_cycles=<n>.
+ * Prints one row per data image, or one for the program alone if none is
+ * given. Exits with 1 if a run did not halt or did not match the
+ * functional model.
+ */
+int
+APEX_bench_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Instruction *code_memory;
+    APEX_Bench_Result result;
+    APEX_Mode_Options options;
+    const char *images[argc > 0 ? argc : 1];
+    int data_memory[DATA_MEMORY_SIZE];
+    int code_memory_size, num_images = 0, repeat = APEX_BENCH_REPEAT, status = 0, i;
+
+    APEX_mode_defaults(&options, APEX_BENCH_MAX_CYCLES);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "repeat=", 7) == 0)
+        {
+            repeat = atoi(argv[i] + 7);
+        }
+        else if (strchr(argv[i], '=') == NULL)
+        {
+            images[num_images++] = argv[i];
+        }
+        else if (!APEX_mode_option(&options, "bench", argv[i]))
+        {
+            return 1;
+        }
+        else if (options.image)
+        {
+            /* data=<image> is one more image */
+            images[num_images++] = options.image;
+            options.image = NULL;
+        }
+    }
+    if (repeat < 1)
+    {
+        fprintf(stderr, "APEX_Error: repeat must be at least 1\n");
+        return 1;
+    }
+
+    code_memory = APEX_mode_load(filename, &options, &code_memory_size, NULL);
+    if (!code_memory)
+    {
+        return 1;
+    }
+
+    printf("APEX_BENCH: %s, forwarding=%s, %d runs after a warm-up\n", filename,
+           APEX_forwarding_name(options.forwarding), repeat);
+    printf("  %-24s %10s %10s %6s %18s %18s %18s  %s\n", "image", "cycles",
+           "insns", "IPC", "wall ms (sd)", "Mcycles/s (sd)", "MIPS (sd)", "check");
+    for (i = 0; i < (num_images ? num_images : 1); ++i)
+    {
+        const char *name = num_images ? images[i] : "(none)";
+        char wall[32], cycles_rate[32], insns_rate[32];
+
+        memset(data_memory, 0, sizeof(data_memory));
+        if (num_images && load_data_image(images[i], data_memory) < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to load data image %s\n", images[i]);
+            status = 1;
+            continue;
+        }
+        if (APEX_bench_run(code_memory, code_memory_size, data_memory, options.forwarding,
+                           repeat, options.max_cycles, &result) < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+            free(code_memory);
+            return 1;
+        }
+
+        snprintf(wall, sizeof(wall), "%.3f (%.3f)", result.seconds_mean * 1e3,
+                 result.seconds_sd * 1e3);
+        snprintf(cycles_rate, sizeof(cycles_rate), "%.2f (%.2f)",
+                 result.cycles_per_second_mean / 1e6, result.cycles_per_second_sd / 1e6);
+        snprintf(insns_rate, sizeof(insns_rate), "%.2f (%.2f)",
+                 result.insns_per_second_mean / 1e6, result.insns_per_second_sd / 1e6);
+        printf("  %-24s %10ld %10ld %6.3f %18s %18s %18s  %s\n", name, result.cycles,
+               result.instructions,
+               result.cycles ? (double)result.instructions / result.cycles : 0.0,
+               wall, cycles_rate, insns_rate,
+               !result.halted ? "cycle-limit" : result.correct ? "ok" : "MISMATCH");
+        if (!result.halted || !result.correct)
+        {
+            status = 1;
+        }
+    }
+
+    free(code_memory);
+    return status;
+}
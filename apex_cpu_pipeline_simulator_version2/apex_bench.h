@@ -0,0 +1,37 @@
+/*
+ * apex_bench.h
+ * Contains declarations of the benchmark runner
+ */
+#ifndef _APEX_BENCH_H_
+#define _APEX_BENCH_H_
+
+#include "apex_cpu.h"
+
+/* Timed runs per data image, after one untimed warm-up run */
+#define APEX_BENCH_REPEAT 10
+
+/* Cycle budget of one run; the kernels of the suite halt well within it */
+#define APEX_BENCH_MAX_CYCLES 100000000L
+
+/* Measurements of one kernel over one data image */
+typedef struct APEX_Bench_Result
+{
+    long cycles;                   /* Identical in every run */
+    long instructions;
+    int halted;                    /* FALSE if the cycle budget ran out */
+    int correct;                   /* Final registers and memory match the functional model */
+    double seconds_mean;
+    double seconds_sd;
+    double cycles_per_second_mean;
+    double cycles_per_second_sd;
+    double insns_per_second_mean;
+    double insns_per_second_sd;
+} APEX_Bench_Result;
+
+int APEX_bench_run(const APEX_Instruction *code_memory, int code_memory_size,
+                   const int *data_memory, int forwarding, int repeat,
+                   long max_cycles, APEX_Bench_Result *result);
+
+int APEX_bench_main(const char *filename, int argc, char const *argv[]);
+
+#endif
@@ -0,0 +1,403 @@
+/*
+ * apex_checkpoint.c
+ * Contains the checkpointed parallel simulation mode
+ *
+ * A functional pass drops an architectural checkpoint ahead of every
+ * interval of the run. The intervals are then simulated in detail on a
+ * pool, each in an empty pipeline warmed up on the instructions before it,
+ * and their cycles are stitched together. The pipeline keeps no state
+ * beyond its latches and scoreboard, so a short warm-up makes the stitched
+ * count exact; the overlap between intervals measures how far off it is.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_checkpoint.h"
+#include "apex_pool.h"
+
+typedef struct Checkpoint_Job
+{
+    APEX_Interval *intervals;
+    int forwarding;
+} Checkpoint_Job;
+
+/*
+ * Cycles the cpu until target instructions have retired
+ *
+ * Returns FALSE if the program halted first
+ */
+static int
+run_to(APEX_CPU *cpu, long target)
+{
+    APEX_Cycle_Fn cycle = APEX_cpu_cycle_variant(cpu);
+
+    while (cpu->insn_completed < target)
+    {
+        if (cycle(cpu))
+        {
+            return cpu->insn_completed >= target;
+        }
+    }
+    return TRUE;
+}
+
+/* Pool task, simulates one interval in detail */
+static void
+interval_task(void *context, int index)
+{
+    Checkpoint_Job *job = context;
+    APEX_Interval *interval = &job->intervals[index];
+    APEX_CPU *cpu;
+    long start, head_start, end, stall_cycles, branch_flushes;
+    double t = APEX_seconds(CLOCK_THREAD_CPUTIME_ID);
+
+    interval->status = APEX_INTERVAL_FAILED;
+    cpu = APEX_cpu_create_quiet(interval->checkpoint->code_memory,
+                                interval->checkpoint->code_memory_size, job->forwarding,
+                                NULL);
+    if (!cpu)
+    {
+        return;
+    }
+    APEX_func_load_cpu(interval->checkpoint, cpu);
+
+    if (run_to(cpu, interval->warmup))
+    {
+        start = cpu->clock;
+        stall_cycles = cpu->stall_cycles;
+        branch_flushes = cpu->branch_flushes;
+        head_start = cpu->clock;
+        if (run_to(cpu, interval->warmup + interval->head))
+        {
+            interval->head_cycles = cpu->clock - head_start;
+            if (run_to(cpu, interval->warmup + interval->num_insns))
+            {
+                end = cpu->clock;
+                interval->cycles = end - start;
+                interval->stall_cycles = cpu->stall_cycles - stall_cycles;
+                interval->branch_flushes = cpu->branch_flushes - branch_flushes;
+                if (run_to(cpu, interval->warmup + interval->num_insns + interval->overrun))
+                {
+                    interval->tail_cycles = cpu->clock - end;
+                    interval->status = APEX_INTERVAL_COMPLETE;
+                }
+            }
+        }
+    }
+
+    APEX_cpu_stop(cpu);
+    interval->seconds = APEX_seconds(CLOCK_THREAD_CPUTIME_ID) - t;
+}
+
+/*
+ * Runs the program functionally, checkpointing it warmup instructions
+ * before every multiple of interval instructions
+ *
+ * Returns the number of intervals, -1 on failure or if the program does
+ * not halt. num_insns is set to the length of the run.
+ */
+int
+APEX_checkpoint_take(const APEX_Instruction *code_memory, int code_memory_size,
+                     const int *data_memory, long interval, long warmup,
+                     APEX_Interval **intervals, long *num_insns)
+{
+    APEX_Interval *list = NULL, *grown;
+    APEX_Func *func;
+    long first, take, overrun;
+    int count = 0, max_count = 0, i;
+
+    func = APEX_func_create(code_memory, code_memory_size, data_memory);
+    if (!func || interval < 1 || warmup < 0)
+    {
+        free(func);
+        return -1;
+    }
+
+    for (first = 0; func->status == APEX_FUNC_RUNNING; first += interval)
+    {
+        take = first > warmup ? first - warmup : 0;
+        APEX_func_run(func, take - func->insn_completed);
+        if (func->status != APEX_FUNC_RUNNING
+            || func->insn_completed > APEX_FUNC_MAX_INSNS)
+        {
+            break;
+        }
+        if (count == max_count)
+        {
+            max_count = max_count ? 2 * max_count : 64;
+            grown = realloc(list, max_count * sizeof(APEX_Interval));
+            if (!grown)
+            {
+                break;
+            }
+            list = grown;
+        }
+        memset(&list[count], 0, sizeof(APEX_Interval));
+        list[count].checkpoint = APEX_func_clone(func);
+        if (!list[count].checkpoint)
+        {
+            break;
+        }
+        list[count].first_insn = first;
+        list[count].warmup = first - take;
+        count++;
+    }
+
+    /* Checkpoints taken in the warm-up of an interval past HALT are dropped */
+    *num_insns = func->insn_completed;
+    if (func->status != APEX_FUNC_HALTED)
+    {
+        APEX_checkpoint_free(list, count);
+        APEX_func_destroy(func);
+        return -1;
+    }
+    APEX_func_destroy(func);
+    while (count > 0 && list[count - 1].first_insn >= *num_insns)
+    {
+        APEX_func_destroy(list[--count].checkpoint);
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        list[i].num_insns = (i + 1 < count ? list[i + 1].first_insn : *num_insns)
+                            - list[i].first_insn;
+    }
+    overrun = warmup > APEX_CHECKPOINT_OVERRUN ? warmup : APEX_CHECKPOINT_OVERRUN;
+    for (i = 0; i < count; ++i)
+    {
+        list[i].overrun = i + 1 < count
+                              ? (overrun < list[i + 1].num_insns ? overrun : list[i + 1].num_insns)
+                              : 0;
+        list[i].head = i > 0 ? list[i - 1].overrun : 0;
+    }
+    *intervals = list;
+    return count;
+}
+
+/*
+ * Simulates every interval in detail on a pool of num_threads threads
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int
+APEX_checkpoint_simulate(APEX_Interval *intervals, int num_intervals,
+                         int forwarding, int num_threads)
+{
+    Checkpoint_Job job;
+
+    job.intervals = intervals;
+    job.forwarding = forwarding;
+    return APEX_pool_run(num_threads, num_intervals, interval_task, &job);
+}
+
+/*
+ * This function deallocates the intervals and their checkpoints
+ */
+void
+APEX_checkpoint_free(APEX_Interval *intervals, int num_intervals)
+{
+    int i;
+
+    for (i = 0; i < num_intervals; ++i)
+    {
+        APEX_func_destroy(intervals[i].checkpoint);
+    }
+    free(intervals);
+}
+
+/*
+ * Simulates the whole run in detail on this thread, for checking
+ *
+ * Returns its cycles, 0 if HALT did not retire within max_cycles or -1 if
+ * the cpu could not be created
+ */
+static long
+run_detailed(const APEX_Instruction *code_memory, int code_memory_size,
+             const int *data_memory, int forwarding, long max_cycles)
+{
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+    long cycles;
+    int halted = FALSE;
+
+    cpu = APEX_cpu_create_quiet(code_memory, code_memory_size, forwarding, data_memory);
+    if (!cpu)
+    {
+        return -1;
+    }
+    cycle = APEX_cpu_cycle_variant(cpu);
+    while (cpu->clock < max_cycles && !(halted = cycle(cpu)))
+        ;
+    cycles = halted ? cpu->clock : 0;
+    APEX_cpu_stop(cpu);
+    return cycles;
+}
+
+/* Checkpoints, simulates and stitches a loaded program */
+static int
+simulate_program(const char *filename, const APEX_Instruction *code_memory,
+                 int code_memory_size, const int *data_memory, int forwarding,
+                 long interval_insns, long warmup, int threads, int verify,
+                 long max_cycles)
+{
+    APEX_Interval *intervals, *iv;
+    long num_insns, cycles = 0, stall_cycles = 0, branch_flushes = 0;
+    long error = 0, bound = 0, detailed, delta;
+    int num_intervals, i;
+    double t, functional_seconds, wall_seconds, cpu_seconds = 0.0;
+
+    t = APEX_seconds(CLOCK_MONOTONIC);
+    num_intervals = APEX_checkpoint_take(code_memory, code_memory_size, data_memory,
+                                         interval_insns, warmup, &intervals,
+                                         &num_insns);
+    functional_seconds = APEX_seconds(CLOCK_MONOTONIC) - t;
+    if (num_intervals <= 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to checkpoint %s, it did not halt "
+                "within %ld instructions\n", filename, num_insns);
+        return 1;
+    }
+
+    t = APEX_seconds(CLOCK_MONOTONIC);
+    if (APEX_checkpoint_simulate(intervals, num_intervals, forwarding, threads) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to start parallel simulation\n");
+        APEX_checkpoint_free(intervals, num_intervals);
+        return 1;
+    }
+    wall_seconds = APEX_seconds(CLOCK_MONOTONIC) - t;
+
+    printf("APEX_CHECKPOINT: %s, %ld instructions, forwarding=%s, %d intervals "
+           "of %ld, warmup=%ld, threads=%d\n", filename, num_insns,
+           APEX_forwarding_name(forwarding), num_intervals, interval_insns,
+           warmup, threads);
+    printf("interval,first_insn,instructions,cycles,cpi,stall_cycles,"
+           "branch_flushes,warmup_error,seconds\n");
+    for (i = 0; i < num_intervals; ++i)
+    {
+        iv = &intervals[i];
+        if (iv->status != APEX_INTERVAL_COMPLETE)
+        {
+            fprintf(stderr, "APEX_Error: Unable to simulate interval %d\n", i);
+            APEX_checkpoint_free(intervals, num_intervals);
+            return 1;
+        }
+
+        /* The cold start of this interval against the warm run past the
+         * end of the previous one, over the same instructions */
+        delta = i > 0 ? iv->head_cycles - intervals[i - 1].tail_cycles : 0;
+        error += delta;
+        bound += delta < 0 ? -delta : delta;
+
+        cycles += iv->cycles;
+        stall_cycles += iv->stall_cycles;
+        branch_flushes += iv->branch_flushes;
+        cpu_seconds += iv->seconds;
+        printf("%d,%ld,%ld,%ld,%.4f,%ld,%ld,%+ld,%.6f\n", i, iv->first_insn,
+               iv->num_insns, iv->cycles, (double)iv->cycles / iv->num_insns,
+               iv->stall_cycles, iv->branch_flushes, delta, iv->seconds);
+    }
+    APEX_checkpoint_free(intervals, num_intervals);
+
+    printf("APEX_CHECKPOINT: %ld cycles, CPI %.4f, %ld stall cycles, %ld branch "
+           "flushes\n", cycles, (double)cycles / num_insns, stall_cycles,
+           branch_flushes);
+    printf("APEX_CHECKPOINT: warm-up error %+ld cycles (%+.4f%%), at most %ld\n",
+           error, 100.0 * error / cycles, bound);
+    printf("APEX_CHECKPOINT: %.6f s functional, %.6f s detailed on %d threads, "
+           "%.6f s of detailed work, %.1fx parallel speedup\n", functional_seconds,
+           wall_seconds, threads, cpu_seconds,
+           cpu_seconds / (functional_seconds + wall_seconds));
+
+    if (verify)
+    {
+        t = APEX_seconds(CLOCK_MONOTONIC);
+        detailed = run_detailed(code_memory, code_memory_size, data_memory, forwarding,
+                                max_cycles);
+        if (detailed < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+            return 1;
+        }
+        if (detailed == 0)
+        {
+            fprintf(stderr, "APEX_Error: No HALT within %ld cycles\n", max_cycles);
+            return 1;
+        }
+        printf("APEX_CHECKPOINT: detailed %ld cycles, stitched error %+ld, "
+               "%.6f s detailed\n", detailed, cycles - detailed,
+               APEX_seconds(CLOCK_MONOTONIC) - t);
+
+        /* Cold starts are all the stitching gets wrong, unless a pipeline
+         * settles later than the overrun or computes something else */
+        if (cycles - detailed != error)
+        {
+            printf("APEX_CHECKPOINT: stitched error is not the warm-up error\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> parallel <option>...". Options are
+ *   data=<image>   forwarding=<none|ex|mem|all>   interval=<n>   warmup=<n>
+ *   threads=<n>   verify   max_cycles=<n>, which bounds the detailed run of verify
+ */
+int
+APEX_checkpoint_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Instruction *code_memory;
+    int *data_memory;
+    APEX_Mode_Options options;
+    int code_memory_size, verify = FALSE, status, i;
+    int threads = APEX_pool_default_threads();
+    long interval = APEX_CHECKPOINT_INTERVAL, warmup = APEX_CHECKPOINT_WARMUP;
+
+    APEX_mode_defaults(&options, APEX_FUNC_MAX_INSNS);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "interval=", 9) == 0)
+        {
+            interval = atol(argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "warmup=", 7) == 0)
+        {
+            warmup = atol(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "threads=", 8) == 0)
+        {
+            threads = atoi(argv[i] + 8);
+        }
+        else if (strcmp(argv[i], "verify") == 0)
+        {
+            verify = TRUE;
+        }
+        else if (!APEX_mode_option(&options, "parallel", argv[i]))
+        {
+            return 1;
+        }
+    }
+    if (interval < 1 || warmup < 0 || threads < 1)
+    {
+        fprintf(stderr, "APEX_Error: Invalid interval parameters\n");
+        return 1;
+    }
+
+    data_memory = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    code_memory = data_memory ? APEX_mode_load(filename, &options, &code_memory_size,
+                                               data_memory) : NULL;
+    if (!code_memory)
+    {
+        free(data_memory);
+        return 1;
+    }
+
+    status = simulate_program(filename, code_memory, code_memory_size, data_memory,
+                              options.forwarding, interval, warmup, threads, verify,
+                              options.max_cycles);
+    free(data_memory);
+    free(code_memory);
+    return status;
+}
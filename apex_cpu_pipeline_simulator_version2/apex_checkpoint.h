@@ -0,0 +1,54 @@
+/*
+ * apex_checkpoint.h
+ * Contains declarations of the checkpointed parallel simulation mode
+ */
+#ifndef _APEX_CHECKPOINT_H_
+#define _APEX_CHECKPOINT_H_
+
+#include "apex_cpu.h"
+#include "apex_func.h"
+
+/* Defaults of the interval parameters */
+#define APEX_CHECKPOINT_INTERVAL 1000000 /* Instructions per interval */
+#define APEX_CHECKPOINT_WARMUP 1000      /* Instructions of warm-up overlap */
+#define APEX_CHECKPOINT_OVERRUN 64       /* Least overrun, many pipeline depths */
+
+/* Status of an interval */
+#define APEX_INTERVAL_PENDING 0x0
+#define APEX_INTERVAL_COMPLETE 0x1
+#define APEX_INTERVAL_FAILED 0x2
+
+/* A stretch of the run simulated in detail on its own. It starts from a
+ * checkpoint taken warmup instructions before first_insn, and goes on
+ * past its end for overrun instructions so that the next interval's
+ * warm-up can be checked against a pipeline that really was warm. The
+ * overrun is the warm-up but at least APEX_CHECKPOINT_OVERRUN, so a short
+ * or no warm-up is measured too. */
+typedef struct APEX_Interval
+{
+    APEX_Func *checkpoint;
+    long first_insn;               /* First instruction measured */
+    long num_insns;                /* Instructions measured */
+    long warmup;
+    long head;                     /* The overrun of the previous interval */
+    long overrun;
+
+    int status;                    /* APEX_INTERVAL_* */
+    long cycles;                   /* From the retirement before first_insn */
+    long stall_cycles;
+    long branch_flushes;
+    long head_cycles;              /* Of the first overrun-long stretch, cold */
+    long tail_cycles;              /* Of the overrun past the end, warm */
+    double seconds;                /* Processor time of the interval */
+} APEX_Interval;
+
+int APEX_checkpoint_take(const APEX_Instruction *code_memory, int code_memory_size,
+                         const int *data_memory, long interval, long warmup,
+                         APEX_Interval **intervals, long *num_insns);
+int APEX_checkpoint_simulate(APEX_Interval *intervals, int num_intervals,
+                             int forwarding, int num_threads);
+void APEX_checkpoint_free(APEX_Interval *intervals, int num_intervals);
+
+int APEX_checkpoint_main(const char *filename, int argc, char const *argv[]);
+
+#endif
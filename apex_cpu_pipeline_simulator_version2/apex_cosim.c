@@ -0,0 +1,522 @@
+/*
+ * apex_cosim.c
+ * Contains the lockstep co-simulator
+ *
+ * Two models of the same program, two pipelines with different forwarding
+ * or a pipeline and the functional model, are advanced one retirement at a
+ * time. The retired pcs, the stores and the register file must agree after
+ * every retirement; the first difference stops the run with a diff of both
+ * models and the pipeline latches of that cycle.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cosim.h"
+
+/*
+ * Creates the model named by kind: "func" for the functional model, or a
+ * forwarding policy for a pipeline
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int
+APEX_cosim_model_init(APEX_Cosim_Model *model, const char *kind,
+                      const APEX_Instruction *code_memory, int code_memory_size,
+                      const int *data_memory, long max_cycles)
+{
+    int forwarding;
+
+    memset(model, 0, sizeof(APEX_Cosim_Model));
+    model->max_cycles = max_cycles;
+    if (strcmp(kind, "func") == 0)
+    {
+        strcpy(model->name, "func");
+        model->func = APEX_func_create(code_memory, code_memory_size, data_memory);
+        return model->func ? 0 : -1;
+    }
+
+    forwarding = APEX_parse_forwarding(kind);
+    if (forwarding < 0)
+    {
+        return -1;
+    }
+    snprintf(model->name, sizeof(model->name), "forwarding=%s",
+             APEX_forwarding_name(forwarding));
+    model->cpu = APEX_cpu_create_quiet(code_memory, code_memory_size, forwarding,
+                                       data_memory);
+    if (!model->cpu)
+    {
+        return -1;
+    }
+    model->cycle = APEX_cpu_cycle_variant(model->cpu);
+    return 0;
+}
+
+static int
+func_retire(APEX_Cosim_Model *model, APEX_Cosim_Retired *retired)
+{
+    APEX_Func *func = model->func;
+    const APEX_Instruction *ins;
+    int index = (func->pc - 4000) / 4;
+
+    if (func->status != APEX_FUNC_RUNNING)
+    {
+        return FALSE;
+    }
+    if ((func->pc - 4000) % 4 || index < 0 || index >= func->code_memory_size)
+    {
+        model->stopped = TRUE;
+        model->reason = "bad-pc";
+        return FALSE;
+    }
+    ins = &func->code_memory[index];
+
+    retired->index = func->insn_completed;
+    retired->cycle = 0;
+    retired->pc = func->pc;
+    retired->opcode = ins->opcode;
+    retired->is_store = ins->opcode == OPCODE_STORE || ins->opcode == OPCODE_STOREP;
+    retired->address = func->regs[ins->rs2] + ins->imm;
+    retired->value = func->regs[ins->rs1];
+
+    APEX_func_step(func);
+    switch (func->status)
+    {
+        case APEX_FUNC_HALTED:
+            model->stopped = TRUE;
+            model->reason = "halted";
+            return TRUE;
+        case APEX_FUNC_BAD_ADDRESS:
+            model->stopped = TRUE;
+            model->reason = "bad-address";
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static int
+cpu_retire(APEX_Cosim_Model *model, APEX_Cosim_Retired *retired)
+{
+    APEX_CPU *cpu = model->cpu;
+    const CPU_Stage *stage = &cpu->writeback;
+    int completed = cpu->insn_completed;
+    int halted;
+
+    while (cpu->insn_completed == completed)
+    {
+        if (cpu->clock >= model->max_cycles)
+        {
+            model->stopped = TRUE;
+            model->reason = "cycle-limit";
+            return FALSE;
+        }
+
+        /* Writeback empties its latch and memory refills it within the
+         * cycle, so the retiring instruction is read beforehand */
+        if (stage->has_insn)
+        {
+            retired->pc = stage->pc;
+            retired->opcode = stage->opcode;
+            retired->is_store = stage->opcode == OPCODE_STORE
+                                || stage->opcode == OPCODE_STOREP;
+            retired->address = stage->memory_address;
+            retired->value = stage->rs1_value;
+        }
+        halted = model->cycle(cpu);
+        if (halted)
+        {
+            model->stopped = TRUE;
+            model->reason = "halted";
+        }
+    }
+    retired->index = completed;
+    retired->cycle = cpu->clock;
+    return TRUE;
+}
+
+/*
+ * Advances a model to its next retirement
+ *
+ * Returns TRUE if an instruction retired, FALSE if the model has stopped
+ */
+int
+APEX_cosim_retire(APEX_Cosim_Model *model, APEX_Cosim_Retired *retired)
+{
+    if (model->stopped)
+    {
+        return FALSE;
+    }
+    return model->cpu ? cpu_retire(model, retired) : func_retire(model, retired);
+}
+
+static const int *
+model_regs(const APEX_Cosim_Model *model)
+{
+    return model->cpu ? model->cpu->regs : model->func->regs;
+}
+
+static const int *
+model_memory(const APEX_Cosim_Model *model)
+{
+    return model->cpu ? model->cpu->data_memory : model->func->data_memory;
+}
+
+static const condition_code *
+model_cc(const APEX_Cosim_Model *model)
+{
+    return model->cpu ? &model->cpu->cc : &model->func->cc;
+}
+
+static const APEX_Instruction *
+model_instruction(const APEX_Cosim_Model *model, int pc)
+{
+    const APEX_Instruction *code = model->cpu ? model->cpu->code_memory
+                                              : model->func->code_memory;
+    int size = model->cpu ? model->cpu->code_memory_size
+                          : model->func->code_memory_size;
+    int index = (pc - 4000) / 4;
+
+    return ((pc - 4000) % 4 || index < 0 || index >= size) ? NULL : &code[index];
+}
+
+static void
+format_retired(char *buf, size_t size, const APEX_Cosim_Model *model,
+               const APEX_Cosim_Retired *retired)
+{
+    const APEX_Instruction *ins = model_instruction(model, retired->pc);
+    char text[64] = "?";
+
+    if (ins)
+    {
+        APEX_format_instruction(text, sizeof(text), ins);
+    }
+    snprintf(buf, size, "%d %s", retired->pc, text);
+}
+
+static void
+format_store(char *buf, size_t size, const APEX_Cosim_Retired *retired)
+{
+    if (retired->is_store)
+    {
+        snprintf(buf, size, "M%d=%d", retired->address, retired->value);
+    }
+    else
+    {
+        snprintf(buf, size, "-");
+    }
+}
+
+static void
+print_latches(const APEX_Cosim_Model *model, FILE *out)
+{
+    const char *names[] = {"Fetch", "Decode", "Execute", "Memory", "Writeback"};
+    const CPU_Stage *stages[5];
+    const APEX_Instruction *ins;
+    char text[64];
+    int i;
+
+    stages[0] = &model->cpu->fetch;
+    stages[1] = &model->cpu->decode;
+    stages[2] = &model->cpu->execute;
+    stages[3] = &model->cpu->memory;
+    stages[4] = &model->cpu->writeback;
+
+    fprintf(out, "  %s latches at cycle %d:\n", model->name, model->cpu->clock);
+    for (i = 0; i < 5; ++i)
+    {
+        ins = model_instruction(model, stages[i]->pc);
+        if (stages[i]->has_insn && ins)
+        {
+            APEX_format_instruction(text, sizeof(text), ins);
+            fprintf(out, "    %-10s pc(%d) %s%s\n", names[i], stages[i]->pc, text,
+                    stages[i]->stalled ? " STALLED" : "");
+        }
+        else
+        {
+            fprintf(out, "    %-10s (empty)\n", names[i]);
+        }
+    }
+}
+
+/* Prints every register, flag and data memory word that differs */
+static int
+diff_state(const APEX_Cosim_Model *a, const APEX_Cosim_Model *b, int final,
+           FILE *out)
+{
+    const int *ra = model_regs(a), *rb = model_regs(b);
+    const int *ma = model_memory(a), *mb = model_memory(b);
+    const condition_code *ca = model_cc(a), *cb = model_cc(b);
+    int i, differences = 0;
+
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (ra[i] != rb[i])
+        {
+            if (out)
+            {
+                fprintf(out, "  R%-14d %-24d %d\n", i, ra[i], rb[i]);
+            }
+            differences++;
+        }
+    }
+    if (!final)
+    {
+        return differences;
+    }
+
+    if (ca->z != cb->z || ca->p != cb->p || ca->n != cb->n)
+    {
+        if (out)
+        {
+            fprintf(out, "  %-15s z=%d p=%d n=%-14d z=%d p=%d n=%d\n", "flags",
+                    ca->z, ca->p, ca->n, cb->z, cb->p, cb->n);
+        }
+        differences++;
+    }
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (ma[i] != mb[i])
+        {
+            if (out)
+            {
+                fprintf(out, "  M%-14d %-24d %d\n", i, ma[i], mb[i]);
+            }
+            differences++;
+        }
+    }
+    return differences;
+}
+
+static int
+same_retired(const APEX_Cosim_Retired *a, const APEX_Cosim_Retired *b)
+{
+    return a->pc == b->pc && a->is_store == b->is_store
+           && (!a->is_store || (a->address == b->address && a->value == b->value));
+}
+
+static void
+print_divergence(const APEX_Cosim_Model *a, const APEX_Cosim_Model *b,
+                 const APEX_Cosim_Retired *ra, const APEX_Cosim_Retired *rb,
+                 int retired_a, int retired_b, long index, FILE *out)
+{
+    char ta[96], tb[96];
+
+    fprintf(out, "APEX_COSIM: first divergence at retirement %ld\n", index);
+    fprintf(out, "  %-15s %-24s %s\n", "model", a->name, b->name);
+    if (a->cpu || b->cpu)
+    {
+        snprintf(ta, sizeof(ta), "%d", a->cpu ? a->cpu->clock : 0);
+        snprintf(tb, sizeof(tb), "%d", b->cpu ? b->cpu->clock : 0);
+        fprintf(out, "  %-15s %-24s %s\n", "cycle", a->cpu ? ta : "-", b->cpu ? tb : "-");
+    }
+
+    if (retired_a)
+    {
+        format_retired(ta, sizeof(ta), a, ra);
+    }
+    else
+    {
+        snprintf(ta, sizeof(ta), "(%s)", a->reason);
+    }
+    if (retired_b)
+    {
+        format_retired(tb, sizeof(tb), b, rb);
+    }
+    else
+    {
+        snprintf(tb, sizeof(tb), "(%s)", b->reason);
+    }
+    fprintf(out, "  %-15s %-24s %s\n", "retired", ta, tb);
+
+    if (retired_a && retired_b && (ra->is_store || rb->is_store))
+    {
+        format_store(ta, sizeof(ta), ra);
+        format_store(tb, sizeof(tb), rb);
+        fprintf(out, "  %-15s %-24s %s\n", "store", ta, tb);
+    }
+    diff_state(a, b, !retired_a && !retired_b, out);
+
+    if (a->cpu)
+    {
+        print_latches(a, out);
+    }
+    if (b->cpu)
+    {
+        print_latches(b, out);
+    }
+}
+
+static int
+out_of_cycles(const APEX_Cosim_Model *model)
+{
+    return model->stopped && strcmp(model->reason, "cycle-limit") == 0;
+}
+
+/*
+ * Runs two models in lockstep until both stop, one runs out of cycles or
+ * they disagree. A model that runs out of cycles while the other halts
+ * has hung, which is a divergence. Details of a divergence go to out,
+ * which may be NULL.
+ *
+ * Returns the retirement at which the models first differ, or -1 if they
+ * agree all the way
+ */
+long
+APEX_cosim_run(APEX_Cosim_Model *a, APEX_Cosim_Model *b, FILE *out)
+{
+    APEX_Cosim_Retired ra, rb;
+    int retired_a, retired_b;
+    long index = 0;
+
+    memset(&ra, 0, sizeof(ra));
+    memset(&rb, 0, sizeof(rb));
+    while (TRUE)
+    {
+        retired_a = APEX_cosim_retire(a, &ra);
+        retired_b = APEX_cosim_retire(b, &rb);
+        if ((!retired_a && !retired_b) || out_of_cycles(a) || out_of_cycles(b))
+        {
+            break;
+        }
+        if (retired_a != retired_b || !same_retired(&ra, &rb)
+            || diff_state(a, b, FALSE, NULL))
+        {
+            if (out)
+            {
+                print_divergence(a, b, &ra, &rb, retired_a, retired_b, index, out);
+            }
+            return index;
+        }
+        index++;
+    }
+
+    /* When only one model ran out of cycles, let the other finish; if it
+     * halts, the first one has hung */
+    if (out_of_cycles(a) != out_of_cycles(b))
+    {
+        APEX_Cosim_Model *other = out_of_cycles(a) ? b : a;
+        APEX_Cosim_Retired scratch;
+        long extra = 0;
+
+        while (!other->stopped && extra++ < APEX_FUNC_MAX_INSNS
+               && APEX_cosim_retire(other, &scratch))
+            ;
+        if (other->stopped && !out_of_cycles(other))
+        {
+            if (out)
+            {
+                print_divergence(a, b, &ra, &rb, retired_a, retired_b, index, out);
+            }
+            return index;
+        }
+    }
+
+    /* A budget ends the comparison, there is nothing to settle, unless it
+     * was known to be enough and the model has hung */
+    if (out_of_cycles(a) || out_of_cycles(b))
+    {
+        if ((out_of_cycles(a) && a->must_halt) || (out_of_cycles(b) && b->must_halt))
+        {
+            if (out)
+            {
+                print_divergence(a, b, &ra, &rb, retired_a, retired_b, index, out);
+            }
+            return index;
+        }
+        return -1;
+    }
+
+    /* Both stopped together, the flags and memory are settled now */
+    if (strcmp(a->reason, b->reason) != 0 || diff_state(a, b, TRUE, NULL))
+    {
+        if (out)
+        {
+            print_divergence(a, b, &ra, &rb, FALSE, FALSE, index, out);
+        }
+        return index;
+    }
+    return -1;
+}
+
+void
+APEX_cosim_model_free(APEX_Cosim_Model *model)
+{
+    if (model->cpu)
+    {
+        APEX_cpu_stop(model->cpu);
+    }
+    if (model->func)
+    {
+        APEX_func_destroy(model->func);
+    }
+}
+
+/*
+ * Entry point of "apex_sim <input_file> cosim <option>...". Options are
+ * data=<image>, max_cycles=<n>, and the two models: forwarding=<policy>
+ * for the pipeline under test and ref=<func|policy> for the reference.
+ * Exits with 1 if they diverge.
+ */
+int
+APEX_cosim_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Instruction *code_memory;
+    APEX_Cosim_Model dut, ref;
+    APEX_Mode_Options options;
+    const char *dut_kind = "all", *ref_kind = "func";
+    int *data_memory;
+    int code_memory_size, i;
+    long index;
+
+    APEX_mode_defaults(&options, APEX_COSIM_MAX_CYCLES);
+    for (i = 0; i < argc; ++i)
+    {
+        /* Here forwarding= names a model, checked when it is created */
+        if (strncmp(argv[i], "forwarding=", 11) == 0)
+        {
+            dut_kind = argv[i] + 11;
+        }
+        else if (strncmp(argv[i], "ref=", 4) == 0)
+        {
+            ref_kind = argv[i] + 4;
+        }
+        else if (!APEX_mode_option(&options, "cosim", argv[i]))
+        {
+            return 1;
+        }
+    }
+
+    data_memory = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    code_memory = data_memory ? APEX_mode_load(filename, &options, &code_memory_size,
+                                               data_memory) : NULL;
+    if (!code_memory)
+    {
+        free(data_memory);
+        return 1;
+    }
+    if (APEX_cosim_model_init(&ref, ref_kind, code_memory, code_memory_size,
+                              data_memory, options.max_cycles) < 0
+        || strcmp(dut_kind, "func") == 0
+        || APEX_cosim_model_init(&dut, dut_kind, code_memory, code_memory_size,
+                                 data_memory, options.max_cycles) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unknown or unusable model %s or %s\n",
+                dut_kind, ref_kind);
+        return 1;
+    }
+
+    index = APEX_cosim_run(&dut, &ref, stdout);
+    if (index < 0)
+    {
+        printf("APEX_COSIM: %s and %s agree over %d retired instructions, %s\n",
+               dut.name, ref.name, dut.cpu->insn_completed,
+               out_of_cycles(&ref) ? ref.reason : dut.reason);
+    }
+
+    APEX_cosim_model_free(&dut);
+    APEX_cosim_model_free(&ref);
+    free(data_memory);
+    free(code_memory);
+    return index < 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/*
+ * apex_cosim.h
+ * Contains declarations of the lockstep co-simulator
+ */
+#ifndef _APEX_COSIM_H_
+#define _APEX_COSIM_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_func.h"
+
+/* Cycle budget of a pipeline model when the run does not set max_cycles */
+#define APEX_COSIM_MAX_CYCLES 100000000L
+
+/* One retired instruction, as a model reports it */
+typedef struct APEX_Cosim_Retired
+{
+    long index;                    /* Retirements before this one */
+    long cycle;                    /* Cycle it retired in, 0 for the functional model */
+    int pc;
+    int opcode;
+    int is_store;
+    int address;                   /* Data memory word a store wrote */
+    int value;
+} APEX_Cosim_Retired;
+
+/* Either a pipeline or the functional model, advanced one retirement at a
+ * time. Registers are compared after every retirement, flags and data
+ * memory at the end, since the pipeline sets them ahead of retirement. */
+typedef struct APEX_Cosim_Model
+{
+    char name[32];
+    APEX_CPU *cpu;                 /* NULL for the functional model */
+    APEX_Cycle_Fn cycle;           /* Variant of cpu */
+    APEX_Func *func;
+    long max_cycles;
+    int must_halt;                 /* TRUE if running out of max_cycles is a hang */
+    int stopped;                   /* TRUE once nothing more will retire */
+    const char *reason;            /* Why it stopped */
+} APEX_Cosim_Model;
+
+int APEX_cosim_model_init(APEX_Cosim_Model *model, const char *kind,
+                          const APEX_Instruction *code_memory,
+                          int code_memory_size, const int *data_memory,
+                          long max_cycles);
+int APEX_cosim_retire(APEX_Cosim_Model *model, APEX_Cosim_Retired *retired);
+void APEX_cosim_model_free(APEX_Cosim_Model *model);
+
+long APEX_cosim_run(APEX_Cosim_Model *a, APEX_Cosim_Model *b, FILE *out);
+
+int APEX_cosim_main(const char *filename, int argc, char const *argv[]);
+
+#endif
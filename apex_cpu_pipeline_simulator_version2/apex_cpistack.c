@@ -0,0 +1,365 @@
+/*
+ * apex_cpistack.c
+ * Contains the CPI stack
+ *
+ * Execute, memory and writeback never hold an instruction back, so a
+ * bubble in writeback is one that left decode three cycles earlier. The
+ * reason is known at that point: decode stalled on an operand, decode was
+ * squashed by a taken branch, or fetch had nothing to hand over. Tagging
+ * the slot there and counting the tag when it reaches writeback gives
+ * every cycle exactly one category.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpistack.h"
+#include "apex_observer.h"
+#include "apex_simpoint.h"
+
+static const char *category_names[APEX_CPI_CATEGORIES] = {
+    "retiring", "frontend", "bad_speculation", "data_hazard", "memory", "structural"};
+
+const char *
+APEX_cpistack_name(int category)
+{
+    return category >= 0 && category < APEX_CPI_CATEGORIES ? category_names[category]
+                                                           : "unknown";
+}
+
+static void
+charge(APEX_CPI_Stack *stack, int category, int pc)
+{
+    int index = (pc - 4000) / 4;
+
+    stack->totals[category]++;
+    if (pc >= 4000 && (pc - 4000) % 4 == 0 && index < stack->code_memory_size)
+    {
+        stack->per_pc[index][category]++;
+    }
+}
+
+/* Tags the slot leaving decode this cycle */
+static void
+tag_slot(APEX_CPI_Stack *stack, const APEX_CPU *cpu, APEX_CPI_Tag *tag)
+{
+    if (cpu->execute.has_insn)
+    {
+        tag->category = APEX_CPI_RETIRING;
+        tag->pc = cpu->execute.pc;
+        stack->refill_pc = -1;
+    }
+    else if (cpu->decode.has_insn && cpu->decode.stalled)
+    {
+        switch (APEX_observer_stall_cause(cpu, &cpu->decode))
+        {
+            case APEX_WAIT_LOAD:
+                tag->category = APEX_CPI_MEMORY;
+                break;
+            case APEX_WAIT_DEPENDENCY:
+                tag->category = APEX_CPI_DATA_HAZARD;
+                break;
+            default:
+                tag->category = APEX_CPI_STRUCTURAL;
+                break;
+        }
+        tag->pc = cpu->decode.pc;
+    }
+    else if (stack->flush_pc >= 0)
+    {
+        tag->category = APEX_CPI_BAD_SPECULATION;
+        tag->pc = stack->flush_pc;
+        stack->refill_pc = stack->flush_pc;
+    }
+    else
+    {
+        /* Refilling after a flush, filling at the start, or fetch stalled */
+        tag->category = APEX_CPI_FRONTEND;
+        tag->pc = stack->refill_pc >= 0 ? stack->refill_pc
+                  : cpu->decode.has_insn ? cpu->decode.pc
+                                         : cpu->pc;
+    }
+}
+
+static void
+on_event(void *context, const APEX_CPU *cpu, const APEX_Event *event)
+{
+    APEX_CPI_Stack *stack = context;
+    APEX_CPI_Tag *oldest;
+
+    switch (event->type)
+    {
+        case APEX_EVENT_RETIRE:
+            stack->retired_pc = event->latch->pc;
+            break;
+        case APEX_EVENT_FLUSH:
+            stack->flush_pc = event->latch->pc;
+            break;
+        case APEX_EVENT_CYCLE_END:
+            oldest = &stack->slots[stack->head];
+            if (stack->retired_pc >= 0)
+            {
+                charge(stack, APEX_CPI_RETIRING, stack->retired_pc);
+            }
+            else
+            {
+                /* A slot decode issued always retires, this is a safeguard */
+                charge(stack, oldest->category == APEX_CPI_RETIRING ? APEX_CPI_STRUCTURAL
+                                                                    : oldest->category,
+                       oldest->pc);
+            }
+            tag_slot(stack, cpu, oldest);
+            stack->head = (stack->head + 1) % 3;
+            stack->retired_pc = -1;
+            stack->flush_pc = -1;
+            break;
+    }
+}
+
+/*
+ * This function attaches a CPI stack to a cpu with an empty pipeline
+ */
+APEX_CPI_Stack *
+APEX_cpistack_create(APEX_CPU *cpu)
+{
+    APEX_CPI_Stack *stack = calloc(1, sizeof(APEX_CPI_Stack));
+    int i;
+
+    if (!stack)
+    {
+        return NULL;
+    }
+    stack->per_pc = calloc(cpu->code_memory_size + 1, sizeof(stack->per_pc[0]));
+    if (!stack->per_pc)
+    {
+        free(stack);
+        return NULL;
+    }
+    stack->code_memory_size = cpu->code_memory_size;
+    stack->retired_pc = -1;
+    stack->flush_pc = -1;
+    stack->refill_pc = -1;
+
+    /* The pipeline fills behind the first fetch */
+    for (i = 0; i < 3; ++i)
+    {
+        stack->slots[i].category = APEX_CPI_FRONTEND;
+        stack->slots[i].pc = cpu->pc;
+    }
+    if (APEX_observer_add(cpu,
+                          APEX_EVENT_MASK(APEX_EVENT_RETIRE) | APEX_EVENT_MASK(APEX_EVENT_FLUSH)
+                              | APEX_EVENT_MASK(APEX_EVENT_CYCLE_END),
+                          on_event, stack) < 0)
+    {
+        APEX_cpistack_destroy(stack);
+        return NULL;
+    }
+    return stack;
+}
+
+void
+APEX_cpistack_detach(APEX_CPI_Stack *stack, APEX_CPU *cpu)
+{
+    APEX_observer_remove(cpu, on_event, stack);
+}
+
+/* A run of code memory indexes sharing one basic block */
+typedef struct CPI_Region
+{
+    int first;
+    int last;
+    long cycles[APEX_CPI_CATEGORIES];
+    long total;
+} CPI_Region;
+
+/* Adds the per-pc counts up per basic block, returns the number of blocks */
+static int
+collect_regions(const APEX_CPI_Stack *stack, const APEX_CPU *cpu, CPI_Region *regions)
+{
+    int *block_of = malloc((stack->code_memory_size + 1) * sizeof(int));
+    int num_blocks, i, c, b;
+
+    if (!block_of)
+    {
+        return -1;
+    }
+    num_blocks = APEX_simpoint_blocks(cpu->code_memory, stack->code_memory_size, block_of);
+    memset(regions, 0, num_blocks * sizeof(CPI_Region));
+    for (i = stack->code_memory_size - 1; i >= 0; --i)
+    {
+        b = block_of[i];
+        if (i == stack->code_memory_size - 1 || block_of[i + 1] != b)
+        {
+            regions[b].last = i;
+        }
+        regions[b].first = i;
+        for (c = 0; c < APEX_CPI_CATEGORIES; ++c)
+        {
+            regions[b].cycles[c] += stack->per_pc[i][c];
+            regions[b].total += stack->per_pc[i][c];
+        }
+    }
+    free(block_of);
+    return num_blocks;
+}
+
+/*
+ * Prints the stack of the whole run and of every basic block that cycles
+ * were charged to, as text or as one JSON object
+ */
+void
+APEX_cpistack_print(const APEX_CPI_Stack *stack, const APEX_CPU *cpu,
+                    const char *program, int json, FILE *out)
+{
+    CPI_Region *regions = malloc((stack->code_memory_size + 1) * sizeof(CPI_Region));
+    long cycles = 0, insns = stack->totals[APEX_CPI_RETIRING];
+    int num_regions, printed = 0, i, c;
+
+    for (c = 0; c < APEX_CPI_CATEGORIES; ++c)
+    {
+        cycles += stack->totals[c];
+    }
+    num_regions = regions ? collect_regions(stack, cpu, regions) : -1;
+
+    if (json)
+    {
+        fprintf(out, "{\"program\": \"%s\", \"forwarding\": \"%s\", \"cycles\": %ld, "
+                "\"instructions\": %ld, \"cpi\": %.4f,\n \"stack\": {", program,
+                APEX_forwarding_name(cpu->forwarding), cycles, insns,
+                insns ? (double)cycles / insns : 0.0);
+        for (c = 0; c < APEX_CPI_CATEGORIES; ++c)
+        {
+            fprintf(out, "%s\"%s\": {\"cycles\": %ld, \"cpi\": %.4f}", c ? ", " : "",
+                    category_names[c], stack->totals[c],
+                    insns ? (double)stack->totals[c] / insns : 0.0);
+        }
+        fprintf(out, "},\n \"regions\": [");
+    }
+    else
+    {
+        fprintf(out, "APEX_CPISTACK: %s, forwarding=%s, %ld cycles, %ld instructions, "
+                "CPI %.4f\n", program, APEX_forwarding_name(cpu->forwarding), cycles,
+                insns, insns ? (double)cycles / insns : 0.0);
+        fprintf(out, "%-16s %10s %8s %8s\n", "category", "cycles", "cpi", "share");
+        for (c = 0; c < APEX_CPI_CATEGORIES; ++c)
+        {
+            fprintf(out, "%-16s %10ld %8.4f %7.2f%%\n", category_names[c],
+                    stack->totals[c], insns ? (double)stack->totals[c] / insns : 0.0,
+                    cycles ? 100.0 * stack->totals[c] / cycles : 0.0);
+        }
+        fprintf(out, "%-11s %9s %9s %8s", "region", "insns", "cycles", "cpi");
+        for (c = 0; c < APEX_CPI_CATEGORIES; ++c)
+        {
+            fprintf(out, " %15s", category_names[c]);
+        }
+        fprintf(out, "\n");
+    }
+
+    for (i = 0; i < num_regions; ++i)
+    {
+        const CPI_Region *r = &regions[i];
+        long region_insns = r->cycles[APEX_CPI_RETIRING];
+        double cpi = region_insns ? (double)r->total / region_insns : 0.0;
+
+        if (!r->total)
+        {
+            continue;
+        }
+        if (json)
+        {
+            fprintf(out, "%s\n  {\"first_pc\": %d, \"last_pc\": %d, \"instructions\": %ld, "
+                    "\"cycles\": %ld, \"cpi\": %.4f, \"stack\": {", printed ? "," : "",
+                    4000 + 4 * r->first, 4000 + 4 * r->last, region_insns, r->total, cpi);
+            for (c = 0; c < APEX_CPI_CATEGORIES; ++c)
+            {
+                fprintf(out, "%s\"%s\": %ld", c ? ", " : "", category_names[c],
+                        r->cycles[c]);
+            }
+            fprintf(out, "}}");
+        }
+        else
+        {
+            fprintf(out, "%5d-%-5d %9ld %9ld %8.4f", 4000 + 4 * r->first,
+                    4000 + 4 * r->last, region_insns, r->total, cpi);
+            for (c = 0; c < APEX_CPI_CATEGORIES; ++c)
+            {
+                fprintf(out, " %15ld", r->cycles[c]);
+            }
+            fprintf(out, "\n");
+        }
+        printed++;
+    }
+    if (json)
+    {
+        fprintf(out, "\n ]}\n");
+    }
+    free(regions);
+}
+
+/*
+ * This function deallocates a CPI stack, detach it from its cpu first
+ */
+void
+APEX_cpistack_destroy(APEX_CPI_Stack *stack)
+{
+    free(stack->per_pc);
+    free(stack);
+}
+
+/*
+ * Entry point of "apex_sim <input_file> cpistack <option>...". Options are
+ * data=<image>, forwarding=<none|ex|mem|all>, format=<text|json> and
+ * max_cycles=<n>. Exits with 1 if HALT did not retire.
+ */
+int
+APEX_cpistack_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Mode_Options options;
+    APEX_CPI_Stack *stack;
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+    int json = FALSE, halted = FALSE, i;
+
+    APEX_mode_defaults(&options, 100000000L);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "format=text") == 0)
+        {
+            json = FALSE;
+        }
+        else if (strcmp(argv[i], "format=json") == 0)
+        {
+            json = TRUE;
+        }
+        else if (!APEX_mode_option(&options, "cpistack", argv[i]))
+        {
+            return 1;
+        }
+    }
+
+    cpu = APEX_mode_cpu(filename, &options);
+    if (!cpu)
+    {
+        return 1;
+    }
+    stack = APEX_cpistack_create(cpu);
+    if (!stack)
+    {
+        fprintf(stderr, "APEX_Error: Unable to attach the CPI stack\n");
+        APEX_cpu_stop(cpu);
+        return 1;
+    }
+
+    cycle = APEX_cpu_cycle_variant(cpu);
+    while (cpu->clock < options.max_cycles && !(halted = cycle(cpu)))
+        ;
+    APEX_cpistack_detach(stack, cpu);
+    if (!halted)
+    {
+        fprintf(stderr, "APEX_Error: No HALT within %ld cycles\n", options.max_cycles);
+    }
+    APEX_cpistack_print(stack, cpu, filename, json, stdout);
+
+    APEX_cpistack_destroy(stack);
+    APEX_cpu_stop(cpu);
+    return halted ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+/*
+ * apex_cpistack.h
+ * Contains declarations of the CPI stack
+ */
+#ifndef _APEX_CPISTACK_H_
+#define _APEX_CPISTACK_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+/* What a cycle of the writeback stage went to */
+#define APEX_CPI_RETIRING 0x0          /* An instruction retired */
+#define APEX_CPI_FRONTEND 0x1          /* Fetch had nothing for decode */
+#define APEX_CPI_BAD_SPECULATION 0x2   /* Decode was squashed by a taken branch */
+#define APEX_CPI_DATA_HAZARD 0x3       /* Decode waited on a non-load producer */
+#define APEX_CPI_MEMORY 0x4            /* Decode waited on a load */
+#define APEX_CPI_STRUCTURAL 0x5        /* Decode stalled with no producer in flight */
+#define APEX_CPI_CATEGORIES 6
+
+/* The cause a writeback slot was tagged with when it left decode */
+typedef struct APEX_CPI_Tag
+{
+    int category;                  /* APEX_CPI_*, RETIRING if decode issued */
+    int pc;                        /* Instruction the slot is charged to */
+} APEX_CPI_Tag;
+
+/*
+ * Classifies every cycle of the writeback stage. Each cycle, the slot that
+ * leaves decode is tagged with why it holds an instruction or a bubble,
+ * and the tag follows the slot through execute and memory. Three cycles
+ * later writeback either retires the instruction or counts the bubble
+ * under its tag. Cycles are charged to the retiring instruction, the
+ * stalled one, or the branch that caused a flush, per pc.
+ */
+typedef struct APEX_CPI_Stack
+{
+    APEX_CPI_Tag slots[3];         /* Leaving decode 1, 2 and 3 cycles ago */
+    int head;                      /* Oldest slot */
+    int retired_pc;                /* Retired this cycle, -1 if none */
+    int flush_pc;                  /* Taken branch of this cycle, -1 if none */
+    int refill_pc;                 /* Branch fetch is refilling after, -1 if none */
+    int code_memory_size;
+    long totals[APEX_CPI_CATEGORIES];
+    long (*per_pc)[APEX_CPI_CATEGORIES]; /* Per code memory index */
+} APEX_CPI_Stack;
+
+APEX_CPI_Stack *APEX_cpistack_create(APEX_CPU *cpu);
+void APEX_cpistack_detach(APEX_CPI_Stack *stack, APEX_CPU *cpu);
+void APEX_cpistack_print(const APEX_CPI_Stack *stack, const APEX_CPU *cpu,
+                         const char *program, int json, FILE *out);
+void APEX_cpistack_destroy(APEX_CPI_Stack *stack);
+const char *APEX_cpistack_name(int category);
+
+int APEX_cpistack_main(const char *filename, int argc, char const *argv[]);
+
+#endif
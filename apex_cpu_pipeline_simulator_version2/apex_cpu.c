@@ -13,6 +13,8 @@
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
+#include "apex_observer.h"
+#include "apex_stagetime.h"
 
 /* Converts the PC(4000 series) into array index for code memory
  *
@@ -25,8 +27,11 @@ get_code_memory_index_from_pc(const int pc)
 }
 
 static void
-print_instruction(const CPU_Stage *stage)
+format_instruction(char *buf, size_t size, const CPU_Stage *stage)
 {
+    const char *opcode_str = stage->opcode_str ? stage->opcode_str : "";
+
+    buf[0] = '\0';
     switch (stage->opcode)
     {
         case OPCODE_ADD:
@@ -37,8 +42,8 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_OR:
         case OPCODE_XOR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->rs2);
+            snprintf(buf, size, "%s,R%d,R%d,R%d ", opcode_str, stage->rd, stage->rs1,
+                     stage->rs2);
             break;
         }
 
@@ -46,31 +51,31 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_SUBL:
         case OPCODE_JALR:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", opcode_str, stage->rd, stage->rs1,
+                     stage->imm);
             break;
         }
 
 
         case OPCODE_MOVC:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
+            snprintf(buf, size, "%s,R%d,#%d ", opcode_str, stage->rd, stage->imm);
             break;
         }
 
         case OPCODE_LOAD:
         case OPCODE_LOADP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", opcode_str, stage->rd, stage->rs1,
+                     stage->imm);
             break;
         }
 
         case OPCODE_STORE:
         case OPCODE_STOREP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->imm);
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", opcode_str, stage->rs1, stage->rs2,
+                     stage->imm);
             break;
         }
 
@@ -81,35 +86,60 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_BN:
         case OPCODE_BNN:
         {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
+            snprintf(buf, size, "%s,#%d ", opcode_str, stage->imm);
             break;
         }
 
 
         case OPCODE_HALT:
         {
-            printf("%s", stage->opcode_str);
+            snprintf(buf, size, "%s", opcode_str);
             break;
         }
         case OPCODE_NOP:
         {
-            printf("%s", stage->opcode_str);
+            snprintf(buf, size, "%s", opcode_str);
             break;
         }
         case OPCODE_CML:
         case OPCODE_JUMP:
         {
-            printf("%s,R%d,#%d", stage->opcode_str,stage->rs1,stage->imm);
+            snprintf(buf, size, "%s,R%d,#%d", opcode_str,stage->rs1,stage->imm);
             break;
         }
         case OPCODE_CMP:
         {
-            printf("%s,R%d,R%d", stage->opcode_str,stage->rs1,stage->rs2);
+            snprintf(buf, size, "%s,R%d,R%d", opcode_str,stage->rs1,stage->rs2);
             break;
         }
     }
 }
 
+static void
+print_instruction(const CPU_Stage *stage)
+{
+    char buf[192];
+
+    format_instruction(buf, sizeof(buf), stage);
+    printf("%s", buf);
+}
+
+/* Formats an instruction of code memory the way the stage printouts do */
+void
+APEX_format_instruction(char *buf, size_t size, const APEX_Instruction *ins)
+{
+    CPU_Stage stage;
+
+    memset(&stage, 0, sizeof(stage));
+    stage.opcode_str = ins->opcode_str;
+    stage.opcode = ins->opcode;
+    stage.rd = ins->rd;
+    stage.rs1 = ins->rs1;
+    stage.rs2 = ins->rs2;
+    stage.imm = ins->imm;
+    format_instruction(buf, size, &stage);
+}
+
 /* Debug function which prints the CPU stage content
  *
  * Note: You can edit this function to print in more detail
@@ -159,1135 +189,551 @@ print_reg_file(const APEX_CPU *cpu)
     printf("\n\n");
 }
 
+/* Debug function which prints a latch with its operand and result fields,
+ * used by the interactive debugger
+ */
+void
+APEX_print_latch(const char *name, const CPU_Stage *stage)
+{
+    printf("%-15s: ", name);
+    if (!stage->has_insn)
+    {
+        printf("(empty)\n");
+        return;
+    }
+
+    printf("pc(%d) ", stage->pc);
+    print_instruction(stage);
+    printf("\n%-17s rs1_value=%d(%s) rs2_value=%d(%s) result=%d address=%d%s\n",
+           "", stage->rs1_value, stage->rs1_f ? "ready" : "wait",
+           stage->rs2_value, stage->rs2_f ? "ready" : "wait",
+           stage->result_buffer, stage->memory_address,
+           stage->stalled ? " STALLED" : "");
+}
+
+/* Prints the register file, flags and written memory */
+void
+APEX_print_reg_file(const APEX_CPU *cpu)
+{
+    print_reg_file(cpu);
+}
+
 /*
- * Fetch Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Appends a store address to the log of the final memory dump. The log
+ * starts small and doubles up to DATA_MEMORY_SIZE entries; stores past that,
+ * or past a failed allocation, are not logged.
  */
-static void
-APEX_fetch(APEX_CPU *cpu)
+void
+APEX_cpu_log_store(APEX_CPU *cpu, int address)
 {
-    APEX_Instruction *current_ins;
+    int *log;
+    int size;
 
-    if (cpu->fetch.has_insn)
+    if (cpu->data_counter >= cpu->mem_address_size)
     {
-
-        /* This fetches new branch target instruction from next cycle */
-        if (cpu->fetch_from_next_cycle == TRUE)
+        if (cpu->mem_address_size >= DATA_MEMORY_SIZE)
         {
-            cpu->fetch_from_next_cycle = FALSE;
-
-            /* Skip this cycle*/
             return;
         }
-
-          /* Store current PC in fetch latch */
-          cpu->fetch.pc = cpu->pc;
-
-          /* Index into code memory using this pc and copy all instruction fields
-           * into fetch latch  */
-          current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-          strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-          cpu->fetch.opcode = current_ins->opcode;
-          cpu->fetch.rd = current_ins->rd;
-          cpu->fetch.rs1 = current_ins->rs1;
-          cpu->fetch.rs2 = current_ins->rs2;
-          cpu->fetch.imm = current_ins->imm;
-          if(cpu->fetch.stalled == 0){
-            /* Update PC for next instruction */
-            cpu->pc += 4;
-
-            /* Copy data from fetch latch to decode latch*/
-
-              cpu->decode = cpu->fetch;
+        size = cpu->mem_address_size ? 2 * cpu->mem_address_size : 64;
+        if (size > DATA_MEMORY_SIZE)
+        {
+            size = DATA_MEMORY_SIZE;
         }
-
-        if(cpu->fetch.stalled == 0){
-
-            /* Stop fetching new instructions if HALT is fetched */
-            if (cpu->fetch.opcode == OPCODE_HALT)
-            {
-                cpu->fetch.has_insn = FALSE;
-            }
+        log = realloc(cpu->mem_address, sizeof(int) * size);
+        if (!log)
+        {
+            return;
         }
-    if (ENABLE_DEBUG_MESSAGES)
-    {
-        print_stage_content("Fetch", &cpu->fetch);
-    }
+        cpu->mem_address = log;
+        cpu->mem_address_size = size;
     }
+    cpu->mem_address[cpu->data_counter++] = address;
+}
 
+/* Raises an event about a latch, for the observers that want it */
+static void
+observe(const APEX_CPU *cpu, int type, int stage, const CPU_Stage *latch)
+{
+    APEX_Event event;
 
+    if (!(cpu->observers->events & APEX_EVENT_MASK(type)))
+    {
+        return;
+    }
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.cycle = cpu->clock;
+    event.stage = stage;
+    event.latch = latch;
+    APEX_observer_notify(cpu, &event);
 }
 
-/*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
- */
 static void
-APEX_decode(APEX_CPU *cpu)
+observe_enter(const APEX_CPU *cpu, int stage, const CPU_Stage *latch)
 {
-    if (cpu->decode.has_insn)
+    if (latch->has_insn)
     {
+        observe(cpu, APEX_EVENT_STAGE_ENTER, stage, latch);
+    }
+}
 
+/* latch is the instruction the memory stage just passed to writeback */
+static void
+observe_memory(const APEX_CPU *cpu, const CPU_Stage *latch)
+{
+    APEX_Event event;
 
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode.opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
-
-                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f==0)
-                {
-                    cpu->decode.rs1_value=cpu->ex_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs1==cpu->mem_fb.reg && cpu->decode.rs1_f==0)
-                {
-                    cpu->decode.rs1_value=cpu->mem_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-
-                if (cpu->decode.rs1_f==0 && cpu->regs_writing[cpu->decode.rs1] == 0){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                }
-                // ---------------- rs1 done by now
-                if( cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f==0)
-                {
-                    cpu->decode.rs2_value=cpu->ex_fb.value;
-                    cpu->decode.rs2_f =1;
-
-                }
-                if(cpu->regs_writing[cpu->decode.rs2]==1 && cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f==0 )
-                {
-                    cpu->decode.rs2_value=cpu->mem_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f==0)
-                {
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs2_f = 1;
-                }
-
-                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
-                {
-                    cpu->regs_writing[cpu->decode.rd] = 1;
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-            }
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_JALR:
-            case OPCODE_LOAD:
-            {
-              
-
-                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->ex_fb.value;
-                    cpu->decode.rs1_f = 1;
-                  }
-
-                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->mem_fb.value;
-                    cpu->decode.rs1_f = 1;
-                  }
-                  if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs1_f = 1;
-                    }
-                if(cpu->decode.rs1_f){
-                    cpu->regs_writing[cpu->decode.rd] = 1;
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }}
-            case OPCODE_LOADP:
-            {
-
-                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->ex_fb.value;
-                    cpu->decode.rs1_f = 1;
-                    }
-
-                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0){
-                    cpu->decode.rs1_value = cpu->mem_fb.value;
-                    cpu->decode.rs1_f = 1;
-                    }
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                  }
-                if(cpu->decode.rs1_f){
-                    cpu->regs_writing[cpu->decode.rs1] = 1;
-                    cpu->regs_writing[cpu->decode.rd] = 1;
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-
-                }
-
-            case OPCODE_CML:
-            case OPCODE_JUMP:
-
-
-                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->ex_fb.value;
-                    cpu->decode.rs1_f = 1;}
-                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->mem_fb.value;
-                    cpu->decode.rs1_f = 1;}
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0 ){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                  }
-                if(cpu->decode.rs1_f){
-                    cpu->regs_writing[cpu->decode.rs1]=1;
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-
-
-
-            case OPCODE_STORE:
-            {
-                if( cpu->decode.rs1 == cpu->ex_fb.reg && cpu->decode.rs1_f ==0)
-                {
-                    cpu->decode.rs1_value=cpu->ex_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0)
-                {
-                    cpu->decode.rs2_value=cpu->ex_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0)
-                {
-                    cpu->decode.rs1_value=cpu->mem_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if( cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0)
-                {
-                    cpu->decode.rs2_value=cpu->mem_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                }
-                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0)
-                {
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs2_f = 1;
-                }
-                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
-                {
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-            }
-            case OPCODE_STOREP:
-            {
-                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 )
-                {
-                    cpu->decode.rs1_value=cpu->ex_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0  )
-                {
-                    cpu->decode.rs2_value=cpu->ex_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0  )
-                {
-                    cpu->decode.rs1_value=cpu->mem_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0  )
-                {
-                    cpu->decode.rs2_value=cpu->mem_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0 ){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                }
-                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0 )  // loadp ne pkda hai to ye kaese hua??
-                {
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs2_f = 1;
-                }
-
-                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
-                {
-                    
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-            }
-
-            case OPCODE_CMP:
-            {
-
-
-                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 )
-                {
-                    cpu->decode.rs1_value=cpu->ex_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0 )
-                {
-                    cpu->decode.rs2_value=cpu->ex_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 )
-                {
-                    cpu->decode.rs1_value=cpu->mem_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0 )
-                {
-                    cpu->decode.rs2_value=cpu->mem_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                }
-                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0)
-                {
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs2_f = 1;
-                }
-
-                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
-                {
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-            }
+    if (!(cpu->observers->events & APEX_EVENT_MASK(APEX_EVENT_MEMORY)))
+    {
+        return;
+    }
+    memset(&event, 0, sizeof(event));
+    switch (latch->opcode)
+    {
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+            event.value = latch->result_buffer;
+            break;
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            event.value = latch->rs1_value;
+            event.is_store = TRUE;
+            break;
+        default:
+            return;
+    }
+    event.type = APEX_EVENT_MEMORY;
+    event.cycle = cpu->clock;
+    event.stage = APEX_STAGE_MEMORY;
+    event.latch = latch;
+    event.address = latch->memory_address;
+    APEX_observer_notify(cpu, &event);
+}
 
-            case OPCODE_MOVC:
-            {
-                /* MOVC doesn't have register operands */
-                cpu->regs_writing[cpu->decode.rd] = 1;
-                break;
-            }
+/* latch is the branch or jump execute just passed to memory */
+static void
+observe_flush(const APEX_CPU *cpu, const CPU_Stage *latch)
+{
+    APEX_Event event;
 
-        }
+    if (!(cpu->observers->events & APEX_EVENT_MASK(APEX_EVENT_FLUSH)))
+    {
+        return;
+    }
+    memset(&event, 0, sizeof(event));
+    event.type = APEX_EVENT_FLUSH;
+    event.cycle = cpu->clock;
+    event.stage = APEX_STAGE_EXECUTE;
+    event.latch = latch;
+    event.address = cpu->pc;
+    APEX_observer_notify(cpu, &event);
+}
 
-        /* Copy data from decode latch to execute latch*/
+/* latch is the instruction decode just issued to execute */
+static void
+observe_forward(const APEX_CPU *cpu, const CPU_Stage *latch)
+{
+    APEX_Event event;
+    int operand, source;
 
-        if (cpu->decode.stalled == 0){
-          cpu->execute = cpu->decode;
-          cpu->fetch.stalled = 0;
-        }
-        else{
-          cpu->fetch.stalled = 1;
-        }
-        if (ENABLE_DEBUG_MESSAGES)
+    if (!(cpu->observers->events & APEX_EVENT_MASK(APEX_EVENT_FORWARD)))
+    {
+        return;
+    }
+    for (operand = 0; operand < 2; ++operand)
+    {
+        source = operand ? latch->rs2_src : latch->rs1_src;
+        if (source != OPERAND_EX_FB && source != OPERAND_MEM_FB)
         {
-            print_stage_content("Decode/RF", &cpu->decode);
+            continue;
         }
+        memset(&event, 0, sizeof(event));
+        event.type = APEX_EVENT_FORWARD;
+        event.cycle = cpu->clock;
+        event.stage = APEX_STAGE_DECODE;
+        event.latch = latch;
+        event.reg = operand ? latch->rs2 : latch->rs1;
+        event.source = source;
+        event.value = operand ? latch->rs2_value : latch->rs1_value;
+        APEX_observer_notify(cpu, &event);
     }
-
 }
 
 /*
- * Execute Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Returns TRUE if the instruction in stage updates reg when it retires,
+ * including the base register LOADP and STOREP increment
  */
-static void
-APEX_execute(APEX_CPU *cpu)
+int
+APEX_writes_register(const CPU_Stage *stage, int reg)
 {
-    if (cpu->execute.has_insn)
+    switch (stage->opcode)
     {
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
-        {
-
-          case OPCODE_ADD:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value + cpu->execute.rs2_value;
-              cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-
-              break;
-          }
-          case OPCODE_ADDL:
-          {
-
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-
-              break;
-          }
-          case OPCODE_SUB:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value - cpu->execute.rs2_value;
-                   cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-
-              /* Set the zero flag based on the result buffer */
-             if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-
-              break;
-          }
-          case OPCODE_SUBL:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value - cpu->execute.imm;
-                   cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-
-              break;
-          }
-          case OPCODE_MUL:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value * cpu->execute.rs2_value;
-             cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-              break;
-          }
-          case OPCODE_AND:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value&cpu->execute.rs2_value;
-                 cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-
-              break;
-          }
-          case OPCODE_OR:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value | cpu->execute.rs2_value;
-                  cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-
-              break;
-          }
-          case OPCODE_XOR:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
-              cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-
-              break;
-          }
-            case OPCODE_LOAD:
-            {
-
-              if(cpu->regs_writing[cpu->execute.rd] == 0){
-                cpu->regs_writing[cpu->execute.rd] = 1;
-              }
-                cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                break;
-            }
-            case OPCODE_LOADP:
-            {
-
-              // if regs_writing was over-written
-
-              if(cpu->regs_writing[cpu->execute.rd] == 0){
-                cpu->regs_writing[cpu->execute.rd] = 1;
-              }
-              if(cpu->regs_writing[cpu->execute.rs1] == 0){
-                cpu->regs_writing[cpu->execute.rs1] = 1;
-              }
-
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->execute.rs1_value=cpu->execute.rs1_value+4;
-                cpu->ex_fb.reg = cpu->execute.rs2;
-                cpu->ex_fb.value = cpu->execute.rs2_value;
-                break;
-            }
-            case OPCODE_STORE:
-            {
-
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-                cpu->mem_address[cpu->data_counter++] = cpu->execute.memory_address;
-                break;
-            }
-            case OPCODE_STOREP:
-            {
-              if(cpu->regs_writing[cpu->execute.rs2] == 0){
-                cpu->regs_writing[cpu->execute.rs2] = 1;
-              }
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-                cpu->execute.rs2_value =cpu->execute.rs2_value +4;
-                cpu->ex_fb.reg = cpu->execute.rs2;
-                cpu->ex_fb.value = cpu->execute.rs2_value;
-                cpu->mem_address[cpu->data_counter++] = cpu->execute.memory_address;
-                break;
-            }
-            case OPCODE_BZ:
-            {
-                if (cpu->zero_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-
-            case OPCODE_BNZ:
-            {
-                if (cpu->zero_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-            case OPCODE_BN:
-            {
-                if (cpu->cc.n == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-            case OPCODE_BNN:
-            {
-                if (cpu->cc.n == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-            case OPCODE_BP:
-            {
-                if (cpu->cc.p == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-            case OPCODE_BNP:
-            {
-                if (cpu->cc.p == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-            case OPCODE_JUMP:
-            {
-                /* Calculate new PC, and send it to fetch unit */
-                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
-
-                /* Since we are using reverse callbacks for pipeline stages,
-                    * this will prevent the new instruction from being fetched in the current cycle*/
-                cpu->fetch_from_next_cycle = TRUE;
-
-                /* Flush previous stages */
-                cpu->decode.has_insn = FALSE;
-
-                /* Make sure fetch stage is enabled to start fetching from new PC */
-                cpu->fetch.has_insn = TRUE;
-
-                break;
-            }
-            case OPCODE_JALR:
-            {   
-                if(cpu->regs_writing[cpu->memory.rd] == 0){
-                  cpu->regs_writing[cpu->memory.rd] = 1;
-                }
-
-                /* Calculate new PC, and send it to fetch unit */
-                cpu->execute.result_buffer = cpu->execute.pc + 4;
-                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
-
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_LOAD:
+        case OPCODE_MOVC:
+        case OPCODE_JALR:
+            return stage->rd == reg;
+        case OPCODE_LOADP:
+            return stage->rd == reg || stage->rs1 == reg;
+        case OPCODE_STOREP:
+            return stage->rs2 == reg;
+        default:
+            return FALSE;
+    }
+}
 
-                /* Since we are using reverse callbacks for pipeline stages,
-                    * this will prevent the new instruction from being fetched in the current cycle*/
-                cpu->fetch_from_next_cycle = TRUE;
+/* Every combination of debug output, forwarding paths and observers is
+ * compiled as a variant of its own from apex_cpu_stages.h */
+#define APEX_VARIANT _quiet_none
+#define APEX_VARIANT_DEBUG FALSE
+#define APEX_VARIANT_FORWARDING FORWARD_NONE
+#define APEX_VARIANT_OBSERVED FALSE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _quiet_ex
+#define APEX_VARIANT_DEBUG FALSE
+#define APEX_VARIANT_FORWARDING FORWARD_EX
+#define APEX_VARIANT_OBSERVED FALSE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _quiet_mem
+#define APEX_VARIANT_DEBUG FALSE
+#define APEX_VARIANT_FORWARDING FORWARD_MEM
+#define APEX_VARIANT_OBSERVED FALSE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _quiet_all
+#define APEX_VARIANT_DEBUG FALSE
+#define APEX_VARIANT_FORWARDING FORWARD_ALL
+#define APEX_VARIANT_OBSERVED FALSE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _debug_none
+#define APEX_VARIANT_DEBUG TRUE
+#define APEX_VARIANT_FORWARDING FORWARD_NONE
+#define APEX_VARIANT_OBSERVED FALSE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _debug_ex
+#define APEX_VARIANT_DEBUG TRUE
+#define APEX_VARIANT_FORWARDING FORWARD_EX
+#define APEX_VARIANT_OBSERVED FALSE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _debug_mem
+#define APEX_VARIANT_DEBUG TRUE
+#define APEX_VARIANT_FORWARDING FORWARD_MEM
+#define APEX_VARIANT_OBSERVED FALSE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _debug_all
+#define APEX_VARIANT_DEBUG TRUE
+#define APEX_VARIANT_FORWARDING FORWARD_ALL
+#define APEX_VARIANT_OBSERVED FALSE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _quiet_none_observed
+#define APEX_VARIANT_DEBUG FALSE
+#define APEX_VARIANT_FORWARDING FORWARD_NONE
+#define APEX_VARIANT_OBSERVED TRUE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _quiet_ex_observed
+#define APEX_VARIANT_DEBUG FALSE
+#define APEX_VARIANT_FORWARDING FORWARD_EX
+#define APEX_VARIANT_OBSERVED TRUE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _quiet_mem_observed
+#define APEX_VARIANT_DEBUG FALSE
+#define APEX_VARIANT_FORWARDING FORWARD_MEM
+#define APEX_VARIANT_OBSERVED TRUE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _quiet_all_observed
+#define APEX_VARIANT_DEBUG FALSE
+#define APEX_VARIANT_FORWARDING FORWARD_ALL
+#define APEX_VARIANT_OBSERVED TRUE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _debug_none_observed
+#define APEX_VARIANT_DEBUG TRUE
+#define APEX_VARIANT_FORWARDING FORWARD_NONE
+#define APEX_VARIANT_OBSERVED TRUE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _debug_ex_observed
+#define APEX_VARIANT_DEBUG TRUE
+#define APEX_VARIANT_FORWARDING FORWARD_EX
+#define APEX_VARIANT_OBSERVED TRUE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _debug_mem_observed
+#define APEX_VARIANT_DEBUG TRUE
+#define APEX_VARIANT_FORWARDING FORWARD_MEM
+#define APEX_VARIANT_OBSERVED TRUE
+#include "apex_cpu_stages.h"
+
+#define APEX_VARIANT _debug_all_observed
+#define APEX_VARIANT_DEBUG TRUE
+#define APEX_VARIANT_FORWARDING FORWARD_ALL
+#define APEX_VARIANT_OBSERVED TRUE
+#include "apex_cpu_stages.h"
+
+/* Indexed by having observers, debug_messages, then the FORWARD_* policy */
+static const APEX_Cycle_Fn cycle_variants[2][2][FORWARD_ALL + 1] = {
+    {
+        {APEX_cycle_quiet_none, APEX_cycle_quiet_ex,
+         APEX_cycle_quiet_mem, APEX_cycle_quiet_all},
+        {APEX_cycle_debug_none, APEX_cycle_debug_ex,
+         APEX_cycle_debug_mem, APEX_cycle_debug_all},
+    },
+    {
+        {APEX_cycle_quiet_none_observed, APEX_cycle_quiet_ex_observed,
+         APEX_cycle_quiet_mem_observed, APEX_cycle_quiet_all_observed},
+        {APEX_cycle_debug_none_observed, APEX_cycle_debug_ex_observed,
+         APEX_cycle_debug_mem_observed, APEX_cycle_debug_all_observed},
+    },
+};
 
-                /* Flush previous stages */
-                cpu->decode.has_insn = FALSE;
+/*
+ * This function fills in the default run-time configuration, which is the
+ * behaviour selected by the flags in apex_macros.h
+ */
+void
+APEX_config_default(APEX_Config *config)
+{
+    config->forwarding = FORWARD_ALL;
+    config->debug_messages = ENABLE_DEBUG_MESSAGES;
+    config->single_step = ENABLE_SINGLE_STEP;
+}
 
-                /* Make sure fetch stage is enabled to start fetching from new PC */
-                cpu->fetch.has_insn = TRUE;
+/*
+ * Returns the time of clock in seconds, CLOCK_MONOTONIC for wall time or a
+ * CPU time clock so that speedups hold on a loaded host
+ */
+double
+APEX_seconds(clockid_t clock)
+{
+    struct timespec ts;
 
-                break;
-            }
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-            case OPCODE_MOVC:
-            {
-              if(cpu->regs_writing[cpu->execute.rd] == 0){
-                cpu->regs_writing[cpu->execute.rd] = 1;
-              }
-                cpu->execute.result_buffer = cpu->execute.imm;
-                cpu->ex_fb.reg= cpu->execute.rd;
-                cpu->ex_fb.value = cpu->execute.result_buffer;
-                break;
-            }
-            case OPCODE_CML:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value-cpu->execute.imm;
-
-                if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                else if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                else if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-                break;
-            }
-            case OPCODE_CMP:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value-cpu->execute.rs2_value;
-
-                if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                else if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                else if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+static const char *forwarding_str[] = {"none", "ex", "mem", "all"};
 
-                break;
-            }
-        }
+/*
+ * Returns the name of a FORWARD_* policy, as accepted by APEX_parse_forwarding
+ */
+const char *
+APEX_forwarding_name(int forwarding)
+{
+    return forwarding >= 0 && forwarding <= FORWARD_ALL ? forwarding_str[forwarding] : "?";
+}
 
-        /* Copy data from execute latch to memory latch*/
-        cpu->memory = cpu->execute;
-        cpu->execute.has_insn = FALSE;
+/*
+ * Returns the FORWARD_* policy called name, or -1 if there is none
+ */
+int
+APEX_parse_forwarding(const char *name)
+{
+    int i;
 
-         if (ENABLE_DEBUG_MESSAGES)
+    for (i = 0; i <= FORWARD_ALL; ++i)
+    {
+        if (strcmp(name, forwarding_str[i]) == 0)
         {
-            print_stage_content("Execute", &cpu->execute);
+            return i;
         }
     }
-
+    return -1;
 }
 
 /*
- * Memory Stage of APEX Pipeline
+ * This function creates an APEX cpu on top of an already parsed program. The
+ * code memory is only read, so any number of cpus may share it; it stays
+ * owned by the caller.
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
-APEX_memory(APEX_CPU *cpu)
+APEX_CPU *
+APEX_cpu_create(const APEX_Instruction *code_memory, int code_memory_size,
+                const APEX_Config *config)
 {
-    if (cpu->memory.has_insn)
-    {
-        switch (cpu->memory.opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            {
-
-                /* No work for ADD */
-                if(cpu->regs_writing[cpu->memory.rd] == 0){
-                  cpu->regs_writing[cpu->memory.rd] = 1;
-                }
-                cpu->mem_fb.reg= cpu->memory.rd;
-                cpu->mem_fb.value = cpu->memory.result_buffer;
-                break;
-            }
-            case OPCODE_MOVC:{
-              if(cpu->regs_writing[cpu->memory.rd] == 0){
-                cpu->regs_writing[cpu->memory.rd] = 1;
-              }
-              cpu->mem_fb.reg= cpu->memory.rd;
-              cpu->mem_fb.value = cpu->memory.result_buffer;
-                break;
-            }
+    APEX_CPU *cpu;
 
-            case OPCODE_LOAD:{
-              if(cpu->regs_writing[cpu->memory.rd] == 0){
-                cpu->regs_writing[cpu->memory.rd] = 1;
-              }
-                /* Read from data memory */
-                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-                cpu->mem_fb.reg= cpu->memory.rd;
-                cpu->mem_fb.value = cpu->memory.result_buffer;
-                break;
-            }
-            case OPCODE_LOADP:
-            {
-              if(cpu->regs_writing[cpu->memory.rd] == 0){
-                cpu->regs_writing[cpu->memory.rd] = 1;
-              }
-              if(cpu->regs_writing[cpu->memory.rs1] == 0){
-                cpu->regs_writing[cpu->memory.rs1] = 1;
-              }
-                /* Read from data memory */
-                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-                cpu->mem_fb.reg= cpu->memory.rd;
-                cpu->mem_fb.value = cpu->memory.result_buffer;
-                break;
-            }
+    if (!code_memory || !config)
+    {
+        return NULL;
+    }
 
-            case OPCODE_STORE:
-            {
+    cpu = calloc(1, sizeof(APEX_CPU));
 
-                /* Read from data memory */
-                cpu->data_memory[cpu->memory.memory_address]= cpu->memory.rs1_value;
-                cpu->mem_fb.reg= -1;
-                cpu->mem_fb.value = 0;
-                break;
-            }
-            case OPCODE_STOREP:
-            {
+    if (!cpu)
+    {
+        return NULL;
+    }
 
-              if(cpu->regs_writing[cpu->memory.rs2] == 0){
-                cpu->regs_writing[cpu->memory.rs2] = 1;
-              }
+    /* Initialize PC, Registers and all pipeline stages */
+    cpu->pc = 4000;
+    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
+    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+    cpu->single_step = config->single_step;
+    cpu->debug_messages = config->debug_messages;
+    cpu->forwarding = config->forwarding;
+    cpu->code_memory = code_memory;
+    cpu->code_memory_size = code_memory_size;
+    cpu->data_counter = 0;
 
-                /* Read from data memory */
-                cpu->data_memory[cpu->memory.memory_address]= cpu->memory.rs1_value;
-                cpu->mem_fb.reg= -1;
-                cpu->mem_fb.value = 0;
-                break;
-            }
-            case OPCODE_JALR:
-            {
-                if(cpu->regs_writing[cpu->memory.rd] == 0){
-                  cpu->regs_writing[cpu->memory.rd] = 1;
-                }
-            }
-            case OPCODE_JUMP:
-            {
-                break;
-            }
-        }
+    /* To start fetch stage */
+    cpu->fetch.has_insn = TRUE;
+    return cpu;
+}
 
-        /* Copy data from memory latch to writeback latch*/
-        cpu->writeback = cpu->memory;
-        cpu->memory.has_insn = FALSE;
+/*
+ * Creates a cpu that neither prints nor waits for input, as every mode
+ * other than the interactive one runs. data_memory, if not NULL, holds
+ * DATA_MEMORY_SIZE words the cpu starts with.
+ */
+APEX_CPU *
+APEX_cpu_create_quiet(const APEX_Instruction *code_memory, int code_memory_size,
+                      int forwarding, const int *data_memory)
+{
+    APEX_Config config;
+    APEX_CPU *cpu;
 
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            print_stage_content("Memory", &cpu->memory);
-        }
+    APEX_config_default(&config);
+    config.debug_messages = FALSE;
+    config.single_step = FALSE;
+    config.forwarding = forwarding;
+    cpu = APEX_cpu_create(code_memory, code_memory_size, &config);
+    if (cpu && data_memory)
+    {
+        memcpy(cpu->data_memory, data_memory, sizeof(cpu->data_memory));
     }
+    return cpu;
+}
 
+/*
+ * Defaults of the options APEX_mode_option parses: no data image, full
+ * forwarding and the mode's own cycle limit
+ */
+void
+APEX_mode_defaults(APEX_Mode_Options *options, long max_cycles)
+{
+    options->image = NULL;
+    options->forwarding = FORWARD_ALL;
+    options->max_cycles = max_cycles;
 }
 
 /*
- * Writeback Stage of APEX Pipeline
+ * Parses an option every mode that runs one program takes: data=<image>,
+ * forwarding=<none|ex|mem|all> or max_cycles=<n>. A mode tries its own
+ * options first and hands the rest to this.
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns TRUE if it was one of them, FALSE after reporting it otherwise
  */
-static int
-APEX_writeback(APEX_CPU *cpu)
+int
+APEX_mode_option(APEX_Mode_Options *options, const char *mode, const char *option)
 {
-    if (cpu->writeback.has_insn)
+    if (strncmp(option, "data=", 5) == 0)
+    {
+        options->image = option + 5;
+    }
+    else if (strncmp(option, "max_cycles=", 11) == 0)
+    {
+        options->max_cycles = atol(option + 11);
+    }
+    else if (strncmp(option, "forwarding=", 11) == 0)
     {
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
+        if ((options->forwarding = APEX_parse_forwarding(option + 11)) < 0)
         {
-          case OPCODE_ADD:
-          case OPCODE_ADDL:
-          case OPCODE_SUB:
-          case OPCODE_SUBL:
-          case OPCODE_MUL:
-          case OPCODE_AND:
-          case OPCODE_OR:
-          case OPCODE_XOR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-                break;
-            }
-
-            case OPCODE_LOAD:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-
-                break;
-            }
-            case OPCODE_LOADP:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs[cpu->writeback.rs1]=cpu->writeback.rs1_value;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-                cpu->regs_writing[cpu->writeback.rs1] =0;
-                break;
-            }
-            case OPCODE_STOREP:
-            {
-                cpu->regs[cpu->writeback.rs2]=cpu->writeback.rs2_value;
-                cpu->regs_writing[cpu->writeback.rs2] = 0;
-                break;
-            }
-
-            case OPCODE_MOVC:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-                break;
-            }
-            case OPCODE_JALR:
-            {
-                cpu->regs[cpu->writeback.rd]= cpu->writeback.result_buffer;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-                break;
-            }
+            fprintf(stderr, "APEX_Error: Unknown forwarding policy %s\n", option + 11);
+            return FALSE;
         }
+    }
+    else
+    {
+        fprintf(stderr, "APEX_Error: Unknown %s option %s\n", mode, option);
+        return FALSE;
+    }
+    return TRUE;
+}
 
-        cpu->insn_completed++;
-        cpu->writeback.has_insn = FALSE;
+/*
+ * Loads the program of a mode and, if data_memory is not NULL, its data
+ * image into those DATA_MEMORY_SIZE words, zeroed first
+ *
+ * Returns the code memory, owned by the caller, or NULL after reporting
+ * what could not be loaded
+ */
+APEX_Instruction *
+APEX_mode_load(const char *filename, const APEX_Mode_Options *options,
+               int *code_memory_size, int *data_memory)
+{
+    APEX_Instruction *code_memory = create_code_memory(filename, code_memory_size);
 
-         if (ENABLE_DEBUG_MESSAGES)
+    if (!code_memory)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+        return NULL;
+    }
+    if (data_memory)
+    {
+        memset(data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+        if (options->image && load_data_image(options->image, data_memory) < 0)
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            fprintf(stderr, "APEX_Error: Unable to load data image %s\n", options->image);
+            free(code_memory);
+            return NULL;
         }
-        if (cpu->writeback.opcode == OPCODE_HALT)
-            {
-                /* Stop the APEX simulator */
-                return TRUE;
-            }
-
     }
+    return code_memory;
+}
+
+/*
+ * Loads the program and data image of a mode into a quiet cpu, which owns
+ * the code memory
+ *
+ * Returns NULL after reporting what could not be loaded
+ */
+APEX_CPU *
+APEX_mode_cpu(const char *filename, const APEX_Mode_Options *options)
+{
+    APEX_Instruction *code_memory;
+    APEX_CPU *cpu;
+    int code_memory_size;
 
-    /* Default */
-    return 0;
+    code_memory = APEX_mode_load(filename, options, &code_memory_size, NULL);
+    if (!code_memory)
+    {
+        return NULL;
+    }
+    cpu = APEX_cpu_create_quiet(code_memory, code_memory_size, options->forwarding, NULL);
+    if (!cpu)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+        free(code_memory);
+        return NULL;
+    }
+    cpu->owns_code_memory = TRUE;
+    if (options->image && load_data_image(options->image, cpu->data_memory) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load data image %s\n", options->image);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    return cpu;
 }
 
 /*
@@ -1298,37 +744,33 @@ APEX_writeback(APEX_CPU *cpu)
 APEX_CPU *
 APEX_cpu_init(const char *filename)
 {
-    int i;
+    int i, code_memory_size;
     APEX_CPU *cpu;
+    APEX_Instruction *code_memory;
+    APEX_Config config;
 
     if (!filename)
     {
         return NULL;
     }
 
-    cpu = calloc(1, sizeof(APEX_CPU));
-
-    if (!cpu)
+    /* Parse input file and create code memory */
+    code_memory = create_code_memory(filename, &code_memory_size);
+    if (!code_memory)
     {
         return NULL;
     }
 
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
-    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
-
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-    if (!cpu->code_memory)
+    APEX_config_default(&config);
+    cpu = APEX_cpu_create(code_memory, code_memory_size, &config);
+    if (!cpu)
     {
-        free(cpu);
+        free(code_memory);
         return NULL;
     }
+    cpu->owns_code_memory = TRUE;
 
-    cpu->data_counter = 0;
-    if (ENABLE_DEBUG_MESSAGES)
+    if (cpu->debug_messages)
     {
         fprintf(stderr,
                 "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
@@ -1346,35 +788,49 @@ APEX_cpu_init(const char *filename)
         }
     }
 
-    /* To start fetch stage */
-    cpu->fetch.has_insn = TRUE;
     return cpu;
 }
 
+/*
+ * Returns the cycle function specialised for the current settings of a
+ * CPU. Loops that do not change the settings while they run call it once
+ * and then the variant directly; it stays valid until debug_messages,
+ * forwarding or the observers change.
+ */
+APEX_Cycle_Fn
+APEX_cpu_cycle_variant(const APEX_CPU *cpu)
+{
+    return cycle_variants[cpu->observers ? 1 : 0][cpu->debug_messages ? 1 : 0]
+                         [cpu->forwarding & FORWARD_ALL];
+}
+
+/*
+ * Simulates one clock cycle with the variant for the current settings, for
+ * callers that may change them between cycles
+ *
+ * Returns TRUE once HALT has retired
+ */
+int
+APEX_cpu_cycle(APEX_CPU *cpu)
+{
+    return APEX_cpu_cycle_variant(cpu)(cpu);
+}
+
 /*
  * APEX CPU simulation loop
  *
  * Note: You are free to edit this function according to your implementation
  */
 void simulate_cpu_for_cycles(APEX_CPU *cpu, int num_cycles) {
-    for (int cycle = 1; cycle <= num_cycles; cycle++) {
-        if (ENABLE_DEBUG_MESSAGES) {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cycle);
-            printf("--------------------------------------------\n");
-        }
+    APEX_Cycle_Fn cycle_fn = APEX_cpu_cycle_variant(cpu);
 
-        if (APEX_writeback(cpu)) {
+    for (int cycle = 1; cycle <= num_cycles; cycle++) {
+        if (cycle_fn(cpu)) {
             /* Halt in writeback stage */
             printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cycle, cpu->insn_completed);
             break;
         }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
         print_reg_file(cpu);
 
     }
@@ -1383,28 +839,17 @@ void simulate_cpu_for_cycles(APEX_CPU *cpu, int num_cycles) {
 void
 APEX_cpu_run(APEX_CPU *cpu)
 {
+    APEX_Cycle_Fn cycle = APEX_cpu_cycle_variant(cpu);
     char user_prompt_val;
-    cpu->clock=1;
+
     while (TRUE)
     {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
-        }
-
-        if (APEX_writeback(cpu))
+        if (cycle(cpu))
         {
             /* Halt in writeback stage */
             printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
             break;
         }
-        
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
 
         print_reg_file(cpu);
         
@@ -1419,8 +864,6 @@ APEX_cpu_run(APEX_CPU *cpu)
                 break;
             }
         }
-
-        cpu->clock++;
     }
 }
 
@@ -1432,6 +875,11 @@ APEX_cpu_run(APEX_CPU *cpu)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
-    free(cpu->code_memory);
+    if (cpu->owns_code_memory)
+    {
+        free((void *)cpu->code_memory);
+    }
+    free(cpu->mem_address);
+    APEX_observer_destroy(cpu);
     free(cpu);
 }
@@ -9,8 +9,13 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include <stddef.h>
+#include <time.h>
+
 #include "apex_macros.h"
 
+struct APEX_Observers;
+
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
 {
@@ -40,7 +45,7 @@ typedef struct forward_bus
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
+    const char *opcode_str;        /* Points into code memory */
     int opcode;
     int rs1;
     int rs2;
@@ -50,33 +55,57 @@ typedef struct CPU_Stage
     int imm;
     int rs1_value;
     int rs2_value;
+    int rs1_src;                   /* OPERAND_* that supplied rs1_value */
+    int rs2_src;
     int result_buffer;
     int memory_address;
     int has_insn;
     int stalled;
 } CPU_Stage;
 
-/* Model of APEX CPU */
+/* Run-time configuration of the pipeline */
+typedef struct APEX_Config
+{
+    int forwarding;                /* FORWARD_* paths visible to decode */
+    int debug_messages;            /* Print stage contents every cycle */
+    int single_step;               /* Wait for user input after every cycle */
+} APEX_Config;
+
+/* Options every mode that runs one program takes, see APEX_mode_option */
+typedef struct APEX_Mode_Options
+{
+    const char *image;             /* data=<image>, NULL for zeroed memory */
+    int forwarding;                /* forwarding=<none|ex|mem|all> */
+    long max_cycles;               /* max_cycles=<n> */
+} APEX_Mode_Options;
+
+/* Model of APEX CPU
+ *
+ * Fields are grouped by how often the cycle loop touches them, so the state
+ * of every cycle sits in a few cache lines at the front: the hot scalars,
+ * the register file and the latches. Settings and the run owner's fields
+ * come next, then data memory, which only loads and stores reach. The store
+ * address log is kept out of line and only allocated by the first store,
+ * like the observers by the first one added.
+ */
 typedef struct APEX_CPU
 {
     int pc;                        /* Current program counter */
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
-    int regs[REG_FILE_SIZE];       /* Integer register file */
-    int regs_writing[REG_FILE_SIZE];//for knowing which register is writing currently
-    int code_memory_size;          /* Number of instruction in the input file */
-    APEX_Instruction *code_memory; /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
-    int single_step;               /* Wait for user input after every cycle */
-    int simulate;
+    int stall_cycles;              /* Cycles decode held an instruction back */
+    int branch_flushes;            /* Taken branches and jumps */
     int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int fetch_from_next_cycle;
+    int data_counter;              /* Entries in the store address log */
     condition_code cc;            /*condition code flag for cmp,cml {1 (+), 0 (-)}*/
     forward_bus fb;
     struct forward_bus ex_fb;  //excution stage forward bus
     struct forward_bus mem_fb; //memory stage forward bus
-    int mem_address[DATA_MEMORY_SIZE];
-    int data_counter;
+    const APEX_Instruction *code_memory; /* Code Memory, may be shared */
+    int code_memory_size;          /* Number of instruction in the input file */
+    int regs[REG_FILE_SIZE];       /* Integer register file */
+    int regs_writing[REG_FILE_SIZE];//for knowing which register is writing currently
 
     /* Pipeline stages */
     CPU_Stage fetch;
@@ -84,12 +113,53 @@ typedef struct APEX_CPU
     CPU_Stage execute;
     CPU_Stage memory;
     CPU_Stage writeback;
+
+    /* Cold: settings and bookkeeping, read outside the cycle */
+    int single_step;               /* Wait for user input after every cycle */
+    int debug_messages;            /* Print stage contents every cycle */
+    int forwarding;                /* FORWARD_* paths visible to decode */
+    int owns_code_memory;          /* Free code memory in APEX_cpu_stop */
+    int simulate;
+
+    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+
+    /* Store addresses in execution order, for the final memory dump. The
+     * log only grows and is shared by copies of the cpu, which read it up
+     * to their own data_counter */
+    int *mem_address;
+    int mem_address_size;          /* Entries allocated */
+
+    struct APEX_Observers *observers; /* NULL without observers */
 } APEX_CPU;
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
+int load_data_image(const char *filename, int *data_memory);
+void APEX_config_default(APEX_Config *config);
+double APEX_seconds(clockid_t clock);
+const char *APEX_forwarding_name(int forwarding);
+int APEX_parse_forwarding(const char *name);
+void APEX_mode_defaults(APEX_Mode_Options *options, long max_cycles);
+int APEX_mode_option(APEX_Mode_Options *options, const char *mode, const char *option);
+APEX_Instruction *APEX_mode_load(const char *filename, const APEX_Mode_Options *options,
+                                 int *code_memory_size, int *data_memory);
+APEX_CPU *APEX_mode_cpu(const char *filename, const APEX_Mode_Options *options);
 APEX_CPU *APEX_cpu_init(const char *filename);
+APEX_CPU *APEX_cpu_create(const APEX_Instruction *code_memory,
+                          int code_memory_size, const APEX_Config *config);
+APEX_CPU *APEX_cpu_create_quiet(const APEX_Instruction *code_memory, int code_memory_size,
+                                int forwarding, const int *data_memory);
+/* One clock cycle of a pipeline variant, TRUE once HALT has retired */
+typedef int (*APEX_Cycle_Fn)(APEX_CPU *cpu);
+
+APEX_Cycle_Fn APEX_cpu_cycle_variant(const APEX_CPU *cpu);
+int APEX_cpu_cycle(APEX_CPU *cpu);
 void APEX_cpu_run(APEX_CPU *cpu);
 void APEX_cpu_stop(APEX_CPU *cpu);
+void APEX_cpu_log_store(APEX_CPU *cpu, int address);
 void simulate_cpu_for_cycles(APEX_CPU *cpu, int num_cycles);
+void APEX_format_instruction(char *buf, size_t size, const APEX_Instruction *ins);
+void APEX_print_latch(const char *name, const CPU_Stage *stage);
+void APEX_print_reg_file(const APEX_CPU *cpu);
+int APEX_writes_register(const CPU_Stage *stage, int reg);
 
 #endif
@@ -0,0 +1,1300 @@
+/*
+ * apex_cpu_stages.h
+ * Contains the APEX pipeline stages, as a template of one variant
+ *
+ * apex_cpu.c includes this file once for every combination of the features
+ * the stages would otherwise test at run time, with
+ *   APEX_VARIANT              suffix of the function names of the variant
+ *   APEX_VARIANT_DEBUG        TRUE to print the stage contents every cycle
+ *   APEX_VARIANT_FORWARDING   FORWARD_* paths decode may read
+ *   APEX_VARIANT_OBSERVED     TRUE to raise events for the cpu's observers
+ * defined, so a feature a variant leaves out is not even compiled into it.
+ * There is no include guard on purpose.
+ */
+
+#define VARIANT_PASTE2(name, suffix) name##suffix
+#define VARIANT_PASTE(name, suffix) VARIANT_PASTE2(name, suffix)
+#define VARIANT(name) VARIANT_PASTE(name, APEX_VARIANT)
+
+/*
+ * Fetch Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+VARIANT(APEX_fetch)(APEX_CPU *cpu)
+{
+    const APEX_Instruction *current_ins;
+
+    if (cpu->fetch.has_insn)
+    {
+
+        /* This fetches new branch target instruction from next cycle */
+        if (cpu->fetch_from_next_cycle == TRUE)
+        {
+            cpu->fetch_from_next_cycle = FALSE;
+
+            /* Skip this cycle*/
+            return;
+        }
+
+          /* Store current PC in fetch latch */
+          cpu->fetch.pc = cpu->pc;
+
+          /* Index into code memory using this pc and copy all instruction fields
+           * into fetch latch  */
+          current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
+          cpu->fetch.opcode_str = current_ins->opcode_str;
+          cpu->fetch.opcode = current_ins->opcode;
+          cpu->fetch.rd = current_ins->rd;
+          cpu->fetch.rs1 = current_ins->rs1;
+          cpu->fetch.rs2 = current_ins->rs2;
+          cpu->fetch.imm = current_ins->imm;
+          if(cpu->fetch.stalled == 0){
+            /* Update PC for next instruction */
+            cpu->pc += 4;
+
+            /* Copy data from fetch latch to decode latch*/
+
+              cpu->decode = cpu->fetch;
+        }
+
+        if(cpu->fetch.stalled == 0){
+
+            /* Stop fetching new instructions if HALT is fetched */
+            if (cpu->fetch.opcode == OPCODE_HALT)
+            {
+                cpu->fetch.has_insn = FALSE;
+            }
+        }
+#if APEX_VARIANT_DEBUG
+        print_stage_content("Fetch", &cpu->fetch);
+#endif
+    }
+
+
+}
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+VARIANT(APEX_decode)(APEX_CPU *cpu)
+{
+    if (cpu->decode.has_insn)
+    {
+
+
+        /* Read operands from register file based on the instruction type */
+        switch (cpu->decode.opcode)
+        {
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MUL:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_XOR:
+            {
+
+                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f==0)
+                {
+                    cpu->decode.rs1_value=cpu->ex_fb.value;
+                    cpu->decode.rs1_src = OPERAND_EX_FB;
+                    cpu->decode.rs1_f =1;
+                }
+                if(cpu->decode.rs1==cpu->mem_fb.reg && cpu->decode.rs1_f==0)
+                {
+                    cpu->decode.rs1_value=cpu->mem_fb.value;
+                    cpu->decode.rs1_src = OPERAND_MEM_FB;
+                    cpu->decode.rs1_f =1;
+                }
+
+                if (cpu->decode.rs1_f==0 && cpu->regs_writing[cpu->decode.rs1] == 0){
+                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                  cpu->decode.rs1_src = OPERAND_RF;
+                  cpu->decode.rs1_f = 1;
+                }
+                // ---------------- rs1 done by now
+                if( cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f==0)
+                {
+                    cpu->decode.rs2_value=cpu->ex_fb.value;
+                    cpu->decode.rs2_src = OPERAND_EX_FB;
+                    cpu->decode.rs2_f =1;
+
+                }
+                if(cpu->regs_writing[cpu->decode.rs2]==1 && cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f==0 )
+                {
+                    cpu->decode.rs2_value=cpu->mem_fb.value;
+                    cpu->decode.rs2_src = OPERAND_MEM_FB;
+                    cpu->decode.rs2_f =1;
+                }
+                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f==0)
+                {
+                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+                    cpu->decode.rs2_src = OPERAND_RF;
+                    cpu->decode.rs2_f = 1;
+                }
+
+                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
+                {
+                    cpu->regs_writing[cpu->decode.rd] = 1;
+                    cpu->decode.stalled = 0;
+                    break;
+                }
+
+                else{
+                  cpu->decode.stalled = 1;
+                  break;
+                }
+            }
+            case OPCODE_ADDL:
+            case OPCODE_SUBL:
+            case OPCODE_JALR:
+            case OPCODE_LOAD:
+            {
+              
+
+                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
+                    cpu->decode.rs1_value = cpu->ex_fb.value;
+                    cpu->decode.rs1_src = OPERAND_EX_FB;
+                    cpu->decode.rs1_f = 1;
+                  }
+
+                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 ){
+                    cpu->decode.rs1_value = cpu->mem_fb.value;
+                    cpu->decode.rs1_src = OPERAND_MEM_FB;
+                    cpu->decode.rs1_f = 1;
+                  }
+                  if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
+                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                    cpu->decode.rs1_src = OPERAND_RF;
+                    cpu->decode.rs1_f = 1;
+                    }
+                if(cpu->decode.rs1_f){
+                    cpu->regs_writing[cpu->decode.rd] = 1;
+                    cpu->decode.stalled = 0;
+                    break;
+                }
+                else{
+                  cpu->decode.stalled = 1;
+                  break;
+                }}
+            case OPCODE_LOADP:
+            {
+
+                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
+                    cpu->decode.rs1_value = cpu->ex_fb.value;
+                    cpu->decode.rs1_src = OPERAND_EX_FB;
+                    cpu->decode.rs1_f = 1;
+                    }
+
+                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0){
+                    cpu->decode.rs1_value = cpu->mem_fb.value;
+                    cpu->decode.rs1_src = OPERAND_MEM_FB;
+                    cpu->decode.rs1_f = 1;
+                    }
+                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
+                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                  cpu->decode.rs1_src = OPERAND_RF;
+                  cpu->decode.rs1_f = 1;
+                  }
+                if(cpu->decode.rs1_f){
+                    cpu->regs_writing[cpu->decode.rs1] = 1;
+                    cpu->regs_writing[cpu->decode.rd] = 1;
+                    cpu->decode.stalled = 0;
+                    break;
+                }
+                else{
+                  cpu->decode.stalled = 1;
+                  break;
+                }
+
+                }
+
+            case OPCODE_CML:
+            case OPCODE_JUMP:
+
+
+                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
+                    cpu->decode.rs1_value = cpu->ex_fb.value;
+                    cpu->decode.rs1_src = OPERAND_EX_FB;
+                    cpu->decode.rs1_f = 1;}
+                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 ){
+                    cpu->decode.rs1_value = cpu->mem_fb.value;
+                    cpu->decode.rs1_src = OPERAND_MEM_FB;
+                    cpu->decode.rs1_f = 1;}
+                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0 ){
+                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                  cpu->decode.rs1_src = OPERAND_RF;
+                  cpu->decode.rs1_f = 1;
+                  }
+                if(cpu->decode.rs1_f){
+                    cpu->regs_writing[cpu->decode.rs1]=1;
+                    cpu->decode.stalled = 0;
+                    break;
+                }
+
+                else{
+                  cpu->decode.stalled = 1;
+                  break;
+                }
+
+
+
+            case OPCODE_STORE:
+            {
+                if( cpu->decode.rs1 == cpu->ex_fb.reg && cpu->decode.rs1_f ==0)
+                {
+                    cpu->decode.rs1_value=cpu->ex_fb.value;
+                    cpu->decode.rs1_src = OPERAND_EX_FB;
+                    cpu->decode.rs1_f =1;
+                }
+                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0)
+                {
+                    cpu->decode.rs2_value=cpu->ex_fb.value;
+                    cpu->decode.rs2_src = OPERAND_EX_FB;
+                    cpu->decode.rs2_f =1;
+                }
+                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0)
+                {
+                    cpu->decode.rs1_value=cpu->mem_fb.value;
+                    cpu->decode.rs1_src = OPERAND_MEM_FB;
+                    cpu->decode.rs1_f =1;
+                }
+                if( cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0)
+                {
+                    cpu->decode.rs2_value=cpu->mem_fb.value;
+                    cpu->decode.rs2_src = OPERAND_MEM_FB;
+                    cpu->decode.rs2_f =1;
+                }
+                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
+                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                  cpu->decode.rs1_src = OPERAND_RF;
+                  cpu->decode.rs1_f = 1;
+                }
+                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0)
+                {
+                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+                    cpu->decode.rs2_src = OPERAND_RF;
+                    cpu->decode.rs2_f = 1;
+                }
+                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
+                {
+                    cpu->decode.stalled = 0;
+                    break;
+                }
+                else{
+                  cpu->decode.stalled = 1;
+                  break;
+                }
+            }
+            case OPCODE_STOREP:
+            {
+                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 )
+                {
+                    cpu->decode.rs1_value=cpu->ex_fb.value;
+                    cpu->decode.rs1_src = OPERAND_EX_FB;
+                    cpu->decode.rs1_f =1;
+                }
+                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0  )
+                {
+                    cpu->decode.rs2_value=cpu->ex_fb.value;
+                    cpu->decode.rs2_src = OPERAND_EX_FB;
+                    cpu->decode.rs2_f =1;
+                }
+                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0  )
+                {
+                    cpu->decode.rs1_value=cpu->mem_fb.value;
+                    cpu->decode.rs1_src = OPERAND_MEM_FB;
+                    cpu->decode.rs1_f =1;
+                }
+                if(cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0  )
+                {
+                    cpu->decode.rs2_value=cpu->mem_fb.value;
+                    cpu->decode.rs2_src = OPERAND_MEM_FB;
+                    cpu->decode.rs2_f =1;
+                }
+                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0 ){
+                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                  cpu->decode.rs1_src = OPERAND_RF;
+                  cpu->decode.rs1_f = 1;
+                }
+                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0 )  // loadp ne pkda hai to ye kaese hua??
+                {
+                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+                    cpu->decode.rs2_src = OPERAND_RF;
+                    cpu->decode.rs2_f = 1;
+                }
+
+                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
+                {
+                    
+                    cpu->decode.stalled = 0;
+                    break;
+                }
+                else{
+                  cpu->decode.stalled = 1;
+                  break;
+                }
+            }
+
+            case OPCODE_CMP:
+            {
+
+
+                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 )
+                {
+                    cpu->decode.rs1_value=cpu->ex_fb.value;
+                    cpu->decode.rs1_src = OPERAND_EX_FB;
+                    cpu->decode.rs1_f =1;
+                }
+                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0 )
+                {
+                    cpu->decode.rs2_value=cpu->ex_fb.value;
+                    cpu->decode.rs2_src = OPERAND_EX_FB;
+                    cpu->decode.rs2_f =1;
+                }
+                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 )
+                {
+                    cpu->decode.rs1_value=cpu->mem_fb.value;
+                    cpu->decode.rs1_src = OPERAND_MEM_FB;
+                    cpu->decode.rs1_f =1;
+                }
+                if(cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0 )
+                {
+                    cpu->decode.rs2_value=cpu->mem_fb.value;
+                    cpu->decode.rs2_src = OPERAND_MEM_FB;
+                    cpu->decode.rs2_f =1;
+                }
+                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
+                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                  cpu->decode.rs1_src = OPERAND_RF;
+                  cpu->decode.rs1_f = 1;
+                }
+                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0)
+                {
+                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+                    cpu->decode.rs2_src = OPERAND_RF;
+                    cpu->decode.rs2_f = 1;
+                }
+
+                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
+                {
+                    cpu->decode.stalled = 0;
+                    break;
+                }
+                else{
+                  cpu->decode.stalled = 1;
+                  break;
+                }
+            }
+
+            case OPCODE_MOVC:
+            {
+                /* MOVC doesn't have register operands */
+                cpu->regs_writing[cpu->decode.rd] = 1;
+                break;
+            }
+
+        }
+
+        /* Copy data from decode latch to execute latch*/
+
+        if (cpu->decode.stalled == 0){
+          cpu->execute = cpu->decode;
+          cpu->fetch.stalled = 0;
+        }
+        else{
+          cpu->fetch.stalled = 1;
+        }
+#if APEX_VARIANT_DEBUG
+        print_stage_content("Decode/RF", &cpu->decode);
+#endif
+    }
+
+}
+
+/*
+ * Execute Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+VARIANT(APEX_execute)(APEX_CPU *cpu)
+{
+    if (cpu->execute.has_insn)
+    {
+        /* Execute logic based on instruction type */
+        switch (cpu->execute.opcode)
+        {
+
+          case OPCODE_ADD:
+          {
+            if(cpu->regs_writing[cpu->execute.rd] == 0){
+              cpu->regs_writing[cpu->execute.rd] = 1;
+            }
+              cpu->execute.result_buffer
+                  = cpu->execute.rs1_value + cpu->execute.rs2_value;
+              cpu->ex_fb.reg= cpu->execute.rd;
+              cpu->ex_fb.value = cpu->execute.result_buffer;
+              /* Set the zero flag based on the result buffer */
+              if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+
+              break;
+          }
+          case OPCODE_ADDL:
+          {
+
+            if(cpu->regs_writing[cpu->execute.rd] == 0){
+              cpu->regs_writing[cpu->execute.rd] = 1;
+            }
+              cpu->execute.result_buffer
+                  = cpu->execute.rs1_value + cpu->execute.imm;
+                cpu->ex_fb.reg= cpu->execute.rd;
+              cpu->ex_fb.value = cpu->execute.result_buffer;
+              /* Set the zero flag based on the result buffer */
+              if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+
+              break;
+          }
+          case OPCODE_SUB:
+          {
+            if(cpu->regs_writing[cpu->execute.rd] == 0){
+              cpu->regs_writing[cpu->execute.rd] = 1;
+            }
+              cpu->execute.result_buffer
+                  = cpu->execute.rs1_value - cpu->execute.rs2_value;
+                   cpu->ex_fb.reg= cpu->execute.rd;
+              cpu->ex_fb.value = cpu->execute.result_buffer;
+
+              /* Set the zero flag based on the result buffer */
+             if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+
+              break;
+          }
+          case OPCODE_SUBL:
+          {
+            if(cpu->regs_writing[cpu->execute.rd] == 0){
+              cpu->regs_writing[cpu->execute.rd] = 1;
+            }
+              cpu->execute.result_buffer
+                  = cpu->execute.rs1_value - cpu->execute.imm;
+                   cpu->ex_fb.reg= cpu->execute.rd;
+              cpu->ex_fb.value = cpu->execute.result_buffer;
+
+              /* Set the zero flag based on the result buffer */
+              if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+
+              break;
+          }
+          case OPCODE_MUL:
+          {
+            if(cpu->regs_writing[cpu->execute.rd] == 0){
+              cpu->regs_writing[cpu->execute.rd] = 1;
+            }
+              cpu->execute.result_buffer
+                  = cpu->execute.rs1_value * cpu->execute.rs2_value;
+             cpu->ex_fb.reg= cpu->execute.rd;
+              cpu->ex_fb.value = cpu->execute.result_buffer;
+              /* Set the zero flag based on the result buffer */
+              if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+              break;
+          }
+          case OPCODE_AND:
+          {
+            if(cpu->regs_writing[cpu->execute.rd] == 0){
+              cpu->regs_writing[cpu->execute.rd] = 1;
+            }
+
+              cpu->execute.result_buffer
+                  = cpu->execute.rs1_value&cpu->execute.rs2_value;
+                 cpu->ex_fb.reg= cpu->execute.rd;
+              cpu->ex_fb.value = cpu->execute.result_buffer;
+              /* Set the zero flag based on the result buffer */
+              if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+
+              break;
+          }
+          case OPCODE_OR:
+          {
+            if(cpu->regs_writing[cpu->execute.rd] == 0){
+              cpu->regs_writing[cpu->execute.rd] = 1;
+            }
+              cpu->execute.result_buffer
+                  = cpu->execute.rs1_value | cpu->execute.rs2_value;
+                  cpu->ex_fb.reg= cpu->execute.rd;
+              cpu->ex_fb.value = cpu->execute.result_buffer;
+              /* Set the zero flag based on the result buffer */
+              if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+
+              break;
+          }
+          case OPCODE_XOR:
+          {
+            if(cpu->regs_writing[cpu->execute.rd] == 0){
+              cpu->regs_writing[cpu->execute.rd] = 1;
+            }
+              cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
+              cpu->ex_fb.reg= cpu->execute.rd;
+              cpu->ex_fb.value = cpu->execute.result_buffer;
+              /* Set the zero flag based on the result buffer */
+              if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+
+              break;
+          }
+            case OPCODE_LOAD:
+            {
+
+              if(cpu->regs_writing[cpu->execute.rd] == 0){
+                cpu->regs_writing[cpu->execute.rd] = 1;
+              }
+                cpu->execute.memory_address
+                    = cpu->execute.rs1_value + cpu->execute.imm;
+                break;
+            }
+            case OPCODE_LOADP:
+            {
+
+              // if regs_writing was over-written
+
+              if(cpu->regs_writing[cpu->execute.rd] == 0){
+                cpu->regs_writing[cpu->execute.rd] = 1;
+              }
+              if(cpu->regs_writing[cpu->execute.rs1] == 0){
+                cpu->regs_writing[cpu->execute.rs1] = 1;
+              }
+
+                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
+                cpu->execute.rs1_value=cpu->execute.rs1_value+4;
+                cpu->ex_fb.reg = cpu->execute.rs2;
+                cpu->ex_fb.value = cpu->execute.rs2_value;
+                break;
+            }
+            case OPCODE_STORE:
+            {
+
+                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
+                APEX_cpu_log_store(cpu, cpu->execute.memory_address);
+                break;
+            }
+            case OPCODE_STOREP:
+            {
+              if(cpu->regs_writing[cpu->execute.rs2] == 0){
+                cpu->regs_writing[cpu->execute.rs2] = 1;
+              }
+                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
+                cpu->execute.rs2_value =cpu->execute.rs2_value +4;
+                cpu->ex_fb.reg = cpu->execute.rs2;
+                cpu->ex_fb.value = cpu->execute.rs2_value;
+                APEX_cpu_log_store(cpu, cpu->execute.memory_address);
+                break;
+            }
+            case OPCODE_BZ:
+            {
+                if (cpu->zero_flag == TRUE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    cpu->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    cpu->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    cpu->fetch.has_insn = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_BNZ:
+            {
+                if (cpu->zero_flag == FALSE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    cpu->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    cpu->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    cpu->fetch.has_insn = TRUE;
+                }
+                break;
+            }
+            case OPCODE_BN:
+            {
+                if (cpu->cc.n == TRUE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    cpu->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    cpu->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    cpu->fetch.has_insn = TRUE;
+                }
+                break;
+            }
+            case OPCODE_BNN:
+            {
+                if (cpu->cc.n == FALSE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    cpu->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    cpu->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    cpu->fetch.has_insn = TRUE;
+                }
+                break;
+            }
+            case OPCODE_BP:
+            {
+                if (cpu->cc.p == TRUE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    cpu->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    cpu->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    cpu->fetch.has_insn = TRUE;
+                }
+                break;
+            }
+            case OPCODE_BNP:
+            {
+                if (cpu->cc.p == FALSE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    cpu->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    cpu->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    cpu->fetch.has_insn = TRUE;
+                }
+                break;
+            }
+            case OPCODE_JUMP:
+            {
+                /* Calculate new PC, and send it to fetch unit */
+                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
+
+                /* Since we are using reverse callbacks for pipeline stages,
+                    * this will prevent the new instruction from being fetched in the current cycle*/
+                cpu->fetch_from_next_cycle = TRUE;
+
+                /* Flush previous stages */
+                cpu->decode.has_insn = FALSE;
+
+                /* Make sure fetch stage is enabled to start fetching from new PC */
+                cpu->fetch.has_insn = TRUE;
+
+                break;
+            }
+            case OPCODE_JALR:
+            {   
+                if(cpu->regs_writing[cpu->memory.rd] == 0){
+                  cpu->regs_writing[cpu->memory.rd] = 1;
+                }
+
+                /* Calculate new PC, and send it to fetch unit */
+                cpu->execute.result_buffer = cpu->execute.pc + 4;
+                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
+
+
+                /* Since we are using reverse callbacks for pipeline stages,
+                    * this will prevent the new instruction from being fetched in the current cycle*/
+                cpu->fetch_from_next_cycle = TRUE;
+
+                /* Flush previous stages */
+                cpu->decode.has_insn = FALSE;
+
+                /* Make sure fetch stage is enabled to start fetching from new PC */
+                cpu->fetch.has_insn = TRUE;
+
+                break;
+            }
+
+            case OPCODE_MOVC:
+            {
+              if(cpu->regs_writing[cpu->execute.rd] == 0){
+                cpu->regs_writing[cpu->execute.rd] = 1;
+              }
+                cpu->execute.result_buffer = cpu->execute.imm;
+                cpu->ex_fb.reg= cpu->execute.rd;
+                cpu->ex_fb.value = cpu->execute.result_buffer;
+                break;
+            }
+            case OPCODE_CML:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value-cpu->execute.imm;
+
+                if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                else if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                else if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+                break;
+            }
+            case OPCODE_CMP:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value-cpu->execute.rs2_value;
+
+                if(cpu->execute.result_buffer<0){
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = TRUE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+                else if(cpu->execute.result_buffer>0){
+                    cpu->cc.p = TRUE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = FALSE;
+                    cpu->zero_flag = FALSE;
+                }
+
+                /* Set the zero flag based on the result buffer */
+                else if (cpu->execute.result_buffer == 0)
+                {
+                    cpu->cc.p = FALSE;
+                    cpu->cc.n = FALSE;
+                    cpu->cc.z = TRUE;
+                    cpu->zero_flag = TRUE;
+                }
+
+                break;
+            }
+        }
+
+        /* Without the EX forwarding path decode never sees this bus. Nor
+         * may it take an older value of this result off the MEM bus: it
+         * has to stall until this instruction leaves memory */
+#if !(APEX_VARIANT_FORWARDING & FORWARD_EX)
+        cpu->ex_fb.reg = -1;
+        if (APEX_writes_register(&cpu->execute, cpu->mem_fb.reg))
+        {
+            cpu->mem_fb.reg = -1;
+        }
+#endif
+
+        /* Copy data from execute latch to memory latch*/
+        cpu->memory = cpu->execute;
+        cpu->execute.has_insn = FALSE;
+
+#if APEX_VARIANT_DEBUG
+        print_stage_content("Execute", &cpu->execute);
+#endif
+    }
+
+}
+
+/*
+ * Memory Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+VARIANT(APEX_memory)(APEX_CPU *cpu)
+{
+    if (cpu->memory.has_insn)
+    {
+        switch (cpu->memory.opcode)
+        {
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MUL:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_XOR:
+            case OPCODE_ADDL:
+            case OPCODE_SUBL:
+            {
+
+                /* No work for ADD */
+                if(cpu->regs_writing[cpu->memory.rd] == 0){
+                  cpu->regs_writing[cpu->memory.rd] = 1;
+                }
+                cpu->mem_fb.reg= cpu->memory.rd;
+                cpu->mem_fb.value = cpu->memory.result_buffer;
+                break;
+            }
+            case OPCODE_MOVC:{
+              if(cpu->regs_writing[cpu->memory.rd] == 0){
+                cpu->regs_writing[cpu->memory.rd] = 1;
+              }
+              cpu->mem_fb.reg= cpu->memory.rd;
+              cpu->mem_fb.value = cpu->memory.result_buffer;
+                break;
+            }
+
+            case OPCODE_LOAD:{
+              if(cpu->regs_writing[cpu->memory.rd] == 0){
+                cpu->regs_writing[cpu->memory.rd] = 1;
+              }
+                /* Read from data memory */
+                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
+                cpu->mem_fb.reg= cpu->memory.rd;
+                cpu->mem_fb.value = cpu->memory.result_buffer;
+                break;
+            }
+            case OPCODE_LOADP:
+            {
+              if(cpu->regs_writing[cpu->memory.rd] == 0){
+                cpu->regs_writing[cpu->memory.rd] = 1;
+              }
+              if(cpu->regs_writing[cpu->memory.rs1] == 0){
+                cpu->regs_writing[cpu->memory.rs1] = 1;
+              }
+                /* Read from data memory */
+                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
+                cpu->mem_fb.reg= cpu->memory.rd;
+                cpu->mem_fb.value = cpu->memory.result_buffer;
+                break;
+            }
+
+            case OPCODE_STORE:
+            {
+
+                /* Read from data memory */
+                cpu->data_memory[cpu->memory.memory_address]= cpu->memory.rs1_value;
+                cpu->mem_fb.reg= -1;
+                cpu->mem_fb.value = 0;
+                break;
+            }
+            case OPCODE_STOREP:
+            {
+
+              if(cpu->regs_writing[cpu->memory.rs2] == 0){
+                cpu->regs_writing[cpu->memory.rs2] = 1;
+              }
+
+                /* Read from data memory */
+                cpu->data_memory[cpu->memory.memory_address]= cpu->memory.rs1_value;
+                cpu->mem_fb.reg= -1;
+                cpu->mem_fb.value = 0;
+                break;
+            }
+            case OPCODE_JALR:
+            {
+                if(cpu->regs_writing[cpu->memory.rd] == 0){
+                  cpu->regs_writing[cpu->memory.rd] = 1;
+                }
+            }
+            case OPCODE_JUMP:
+            {
+                break;
+            }
+        }
+
+        /* Without the MEM forwarding path decode never sees this bus */
+#if !(APEX_VARIANT_FORWARDING & FORWARD_MEM)
+        cpu->mem_fb.reg = -1;
+#endif
+
+        /* Copy data from memory latch to writeback latch*/
+        cpu->writeback = cpu->memory;
+        cpu->memory.has_insn = FALSE;
+
+#if APEX_VARIANT_DEBUG
+        print_stage_content("Memory", &cpu->memory);
+#endif
+    }
+
+}
+
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+VARIANT(APEX_writeback)(APEX_CPU *cpu)
+{
+    if (cpu->writeback.has_insn)
+    {
+        /* Write result to register file based on instruction type */
+        switch (cpu->writeback.opcode)
+        {
+          case OPCODE_ADD:
+          case OPCODE_ADDL:
+          case OPCODE_SUB:
+          case OPCODE_SUBL:
+          case OPCODE_MUL:
+          case OPCODE_AND:
+          case OPCODE_OR:
+          case OPCODE_XOR:
+            {
+                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+                break;
+            }
+
+            case OPCODE_LOAD:
+            {
+                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+
+                break;
+            }
+            case OPCODE_LOADP:
+            {
+                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                cpu->regs[cpu->writeback.rs1]=cpu->writeback.rs1_value;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+                cpu->regs_writing[cpu->writeback.rs1] =0;
+                break;
+            }
+            case OPCODE_STOREP:
+            {
+                cpu->regs[cpu->writeback.rs2]=cpu->writeback.rs2_value;
+                cpu->regs_writing[cpu->writeback.rs2] = 0;
+                break;
+            }
+
+            case OPCODE_MOVC:
+            {
+                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+                break;
+            }
+            case OPCODE_JALR:
+            {
+                cpu->regs[cpu->writeback.rd]= cpu->writeback.result_buffer;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+                break;
+            }
+        }
+
+        cpu->insn_completed++;
+        cpu->writeback.has_insn = FALSE;
+
+#if APEX_VARIANT_DEBUG
+        print_stage_content("Writeback", &cpu->writeback);
+#endif
+        if (cpu->writeback.opcode == OPCODE_HALT)
+            {
+                /* Stop the APEX simulator */
+                return TRUE;
+            }
+
+    }
+
+    /* Default */
+    return 0;
+}
+
+/*
+ * Simulates one clock cycle of this variant. Stages are called in reverse
+ * order so that every stage consumes the latch its predecessor filled in
+ * the previous cycle.
+ *
+ * Returns TRUE once HALT has retired
+ */
+static int
+VARIANT(APEX_cycle)(APEX_CPU *cpu)
+{
+    int halted;
+#if APEX_VARIANT_OBSERVED
+    int retiring = cpu->writeback.has_insn;
+    int accessing, decoding;
+#endif
+
+    cpu->clock++;
+
+#if APEX_VARIANT_DEBUG
+    printf("--------------------------------------------\n");
+    printf("Clock Cycle #: %d\n", cpu->clock);
+    printf("--------------------------------------------\n");
+#endif
+#if APEX_VARIANT_OBSERVED
+    observe(cpu, APEX_EVENT_CYCLE_START, -1, NULL);
+    observe_enter(cpu, APEX_STAGE_WRITEBACK, &cpu->writeback);
+#endif
+
+    APEX_STAGETIME_CALL(APEX_STAGETIME_WRITEBACK, &cpu->writeback,
+                        halted = VARIANT(APEX_writeback)(cpu));
+#if APEX_VARIANT_OBSERVED
+    if (retiring)
+    {
+        observe(cpu, APEX_EVENT_RETIRE, APEX_STAGE_WRITEBACK, &cpu->writeback);
+    }
+#endif
+    if (halted)
+    {
+        /* Halt in writeback stage */
+#if APEX_VARIANT_OBSERVED
+        observe(cpu, APEX_EVENT_CYCLE_END, -1, NULL);
+#endif
+        return TRUE;
+    }
+
+#if APEX_VARIANT_OBSERVED
+    accessing = cpu->memory.has_insn;
+    observe_enter(cpu, APEX_STAGE_MEMORY, &cpu->memory);
+#endif
+    APEX_STAGETIME_CALL(APEX_STAGETIME_MEMORY, &cpu->memory,
+                        VARIANT(APEX_memory)(cpu));
+#if APEX_VARIANT_OBSERVED
+    if (accessing)
+    {
+        observe_memory(cpu, &cpu->writeback);
+    }
+    observe_enter(cpu, APEX_STAGE_EXECUTE, &cpu->execute);
+#endif
+    APEX_STAGETIME_CALL(APEX_STAGETIME_EXECUTE, &cpu->execute,
+                        VARIANT(APEX_execute)(cpu));
+
+    /* Execute raises this for every taken branch or jump */
+    if (cpu->fetch_from_next_cycle)
+    {
+        cpu->branch_flushes++;
+#if APEX_VARIANT_OBSERVED
+        observe_flush(cpu, &cpu->memory);
+#endif
+    }
+
+#if APEX_VARIANT_OBSERVED
+    decoding = cpu->decode.has_insn;
+    observe_enter(cpu, APEX_STAGE_DECODE, &cpu->decode);
+#endif
+    APEX_STAGETIME_CALL(APEX_STAGETIME_DECODE, &cpu->decode,
+                        VARIANT(APEX_decode)(cpu));
+    if (cpu->decode.has_insn && cpu->decode.stalled)
+    {
+        cpu->stall_cycles++;
+#if APEX_VARIANT_OBSERVED
+        observe(cpu, APEX_EVENT_STALL, APEX_STAGE_DECODE, &cpu->decode);
+#endif
+    }
+#if APEX_VARIANT_OBSERVED
+    else if (decoding)
+    {
+        /* Issued, the instruction is in the execute latch now */
+        observe_forward(cpu, &cpu->execute);
+    }
+    observe_enter(cpu, APEX_STAGE_FETCH, &cpu->fetch);
+#endif
+
+    APEX_STAGETIME_CALL(APEX_STAGETIME_FETCH, &cpu->fetch,
+                        VARIANT(APEX_fetch)(cpu));
+#if APEX_VARIANT_OBSERVED
+    observe(cpu, APEX_EVENT_CYCLE_END, -1, NULL);
+#endif
+    return FALSE;
+}
+
+#undef VARIANT
+#undef VARIANT_PASTE
+#undef VARIANT_PASTE2
+#undef APEX_VARIANT
+#undef APEX_VARIANT_DEBUG
+#undef APEX_VARIANT_FORWARDING
+#undef APEX_VARIANT_OBSERVED
@@ -0,0 +1,775 @@
+/*
+ * apex_debugger.c
+ * Contains the interactive APEX debugger
+ *
+ * The debugger drives the pipeline one APEX_cpu_cycle at a time. All
+ * breakpoint, watchpoint and run-until checks sit behind the single armed
+ * flag, so running with nothing set costs one predictable branch per cycle.
+ * With a journal attached every cycle is also recorded, which lets the
+ * session step back, jump to any cycle and run in reverse.
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_debugger.h"
+#include "apex_macros.h"
+
+static const char *stage_names[] = {"fetch", "decode", "execute", "memory",
+                                    "writeback"};
+
+static const CPU_Stage *
+stage_latch(const APEX_CPU *cpu, int stage)
+{
+    switch (stage)
+    {
+        case APEX_STAGE_FETCH: return &cpu->fetch;
+        case APEX_STAGE_DECODE: return &cpu->decode;
+        case APEX_STAGE_EXECUTE: return &cpu->execute;
+        case APEX_STAGE_MEMORY: return &cpu->memory;
+        default: return &cpu->writeback;
+    }
+}
+
+static int
+parse_stage(const char *name)
+{
+    int i;
+
+    for (i = APEX_STAGE_FETCH; i <= APEX_STAGE_WRITEBACK; ++i)
+    {
+        if (strcmp(name, stage_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int
+is_store(const CPU_Stage *stage)
+{
+    return stage->opcode == OPCODE_STORE || stage->opcode == OPCODE_STOREP;
+}
+
+static int
+eval_cond(const char *op, int lhs, int rhs)
+{
+    if (strcmp(op, "==") == 0) return lhs == rhs;
+    if (strcmp(op, "!=") == 0) return lhs != rhs;
+    if (strcmp(op, "<") == 0) return lhs < rhs;
+    if (strcmp(op, "<=") == 0) return lhs <= rhs;
+    if (strcmp(op, ">") == 0) return lhs > rhs;
+    if (strcmp(op, ">=") == 0) return lhs >= rhs;
+    return FALSE;
+}
+
+/* Recomputes the armed flag after any change to the checks */
+static void
+debugger_rearm(APEX_Debugger *dbg)
+{
+    dbg->armed = dbg->num_breaks > 0 || dbg->num_watches > 0
+                 || dbg->until_retired >= 0 || dbg->until_stage >= 0;
+}
+
+/*
+ * Evaluates every check after a cycle. retired_pc is the pc of the
+ * instruction that retired in that cycle or -1; store_old is the value the
+ * store in the memory stage overwrote. All breakpoints and watchpoints that
+ * fire are recorded, the reason is a breakpoint if any fired.
+ */
+static int
+debugger_check(APEX_Debugger *dbg, int retired_pc, int store_old)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    const CPU_Stage *latch;
+    int i;
+
+    dbg->num_break_hits = 0;
+    dbg->num_watch_hits = 0;
+
+    if (retired_pc >= 0)
+    {
+        for (i = 0; i < dbg->num_breaks; ++i)
+        {
+            const APEX_Breakpoint *bp = &dbg->breaks[i];
+
+            if (bp->pc == retired_pc
+                && (!bp->has_cond
+                    || eval_cond(bp->op, cpu->regs[bp->reg], bp->value)))
+            {
+                dbg->break_hits[dbg->num_break_hits++] = i;
+            }
+        }
+    }
+
+    /* The memory stage hands its instruction to the writeback latch */
+    if (dbg->num_watches > 0 && cpu->writeback.has_insn
+        && is_store(&cpu->writeback))
+    {
+        for (i = 0; i < dbg->num_watches; ++i)
+        {
+            if (cpu->writeback.memory_address >= dbg->watches[i].lo
+                && cpu->writeback.memory_address <= dbg->watches[i].hi)
+            {
+                dbg->watch_hits[dbg->num_watch_hits++] = i;
+                dbg->watch_address = cpu->writeback.memory_address;
+                dbg->watch_old_value = store_old;
+            }
+        }
+    }
+
+    if (dbg->num_break_hits > 0)
+    {
+        return APEX_STOP_BREAK;
+    }
+    if (dbg->num_watch_hits > 0)
+    {
+        return APEX_STOP_WATCH;
+    }
+
+    if (dbg->until_retired >= 0 && cpu->insn_completed >= dbg->until_retired)
+    {
+        return APEX_STOP_UNTIL;
+    }
+
+    if (dbg->until_stage >= 0)
+    {
+        latch = stage_latch(cpu, dbg->until_stage);
+        if (latch->has_insn && latch->pc == dbg->until_pc)
+        {
+            return APEX_STOP_UNTIL;
+        }
+    }
+
+    return APEX_STOP_NONE;
+}
+
+/* Values the checks need from the state before a cycle */
+static void
+capture_before_cycle(const APEX_CPU *cpu, int *retired_pc, int *store_old)
+{
+    *retired_pc = cpu->writeback.has_insn ? cpu->writeback.pc : -1;
+    if (cpu->memory.has_insn && is_store(&cpu->memory)
+        && cpu->memory.memory_address >= 0
+        && cpu->memory.memory_address < DATA_MEMORY_SIZE)
+    {
+        *store_old = cpu->data_memory[cpu->memory.memory_address];
+    }
+}
+
+/* Refreshes the halted flag after the journal moved the cpu */
+static void
+debugger_sync(APEX_Debugger *dbg)
+{
+    dbg->halted = dbg->journal->halt_cycle >= 0
+                  && dbg->cpu->clock >= dbg->journal->halt_cycle;
+}
+
+/*
+ * This function sets up a debugging session on cpu
+ */
+void
+APEX_debugger_init(APEX_Debugger *dbg, APEX_CPU *cpu)
+{
+    memset(dbg, 0, sizeof(APEX_Debugger));
+    dbg->cpu = cpu;
+    dbg->until_retired = -1;
+    dbg->until_stage = -1;
+}
+
+/*
+ * Runs at most max_cycles cycles, or until a check fires or HALT retires.
+ * Run-until conditions are one-shot and cleared on return.
+ *
+ * Returns the APEX_STOP_* reason
+ */
+int
+APEX_debugger_run(APEX_Debugger *dbg, long max_cycles)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    int retired_pc = -1, store_old = 0, reason = APEX_STOP_COUNT;
+    long n;
+
+    if (dbg->halted)
+    {
+        return APEX_STOP_HALT;
+    }
+
+    debugger_rearm(dbg);
+    for (n = 0; n < max_cycles; ++n)
+    {
+        if (__builtin_expect(dbg->armed, 0))
+        {
+            capture_before_cycle(cpu, &retired_pc, &store_old);
+        }
+
+        if (dbg->journal ? APEX_journal_step(dbg->journal, cpu)
+                         : APEX_cpu_cycle(cpu))
+        {
+            dbg->halted = TRUE;
+            reason = APEX_STOP_HALT;
+            break;
+        }
+
+        if (__builtin_expect(dbg->armed, 0))
+        {
+            reason = debugger_check(dbg, retired_pc, store_old);
+            if (reason != APEX_STOP_NONE)
+            {
+                break;
+            }
+            reason = APEX_STOP_COUNT;
+        }
+    }
+
+    dbg->until_retired = -1;
+    dbg->until_stage = -1;
+    debugger_rearm(dbg);
+    return reason;
+}
+
+/*
+ * Runs backwards one cycle at a time until the most recent cycle that wrote
+ * R<reg>, or stored to Memory[address], or, with both negative, fired a
+ * breakpoint or watchpoint. The cpu is left just after that cycle, as if a
+ * forward run had stopped there. The cycle that led to the current state is
+ * not considered, so repeated calls keep going back. Needs a journal.
+ *
+ * Returns the APEX_STOP_* reason
+ */
+int
+APEX_debugger_reverse(APEX_Debugger *dbg, int reg, int address)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    APEX_Journal *journal = dbg->journal;
+    int retired_pc = -1, store_old = 0, first = TRUE, candidate, reason;
+
+    for (;;)
+    {
+        if (APEX_journal_back(journal, cpu, 1) == 0)
+        {
+            if (cpu->clock <= journal->initial->cycle)
+            {
+                debugger_sync(dbg);
+                return APEX_STOP_START;
+            }
+            /* Off the end of the ring, rebuild it from a checkpoint */
+            APEX_journal_goto(journal, cpu, cpu->clock - 1);
+        }
+
+        if (first)
+        {
+            first = FALSE;
+            continue;
+        }
+        if (reg >= 0)
+        {
+            candidate = cpu->writeback.has_insn
+                        && APEX_writes_register(&cpu->writeback, reg);
+        }
+        else if (address >= 0)
+        {
+            candidate = cpu->memory.has_insn && is_store(&cpu->memory)
+                        && cpu->memory.memory_address == address;
+        }
+        else
+        {
+            candidate = (dbg->num_breaks > 0 && cpu->writeback.has_insn)
+                        || (dbg->num_watches > 0 && cpu->memory.has_insn
+                            && is_store(&cpu->memory));
+        }
+        if (!candidate)
+        {
+            continue;
+        }
+
+        capture_before_cycle(cpu, &retired_pc, &store_old);
+        APEX_journal_step(journal, cpu);
+        debugger_sync(dbg);
+        if (reg >= 0 || address >= 0)
+        {
+            return APEX_STOP_UNTIL;
+        }
+        reason = debugger_check(dbg, retired_pc, store_old);
+        if (reason == APEX_STOP_BREAK || reason == APEX_STOP_WATCH)
+        {
+            return reason;
+        }
+        APEX_journal_back(journal, cpu, 1);
+    }
+}
+
+static void
+print_stop(const APEX_Debugger *dbg, int reason)
+{
+    const APEX_CPU *cpu = dbg->cpu;
+    int i;
+
+    switch (reason)
+    {
+        case APEX_STOP_HALT:
+            printf("HALT retired");
+            break;
+        case APEX_STOP_BREAK:
+        case APEX_STOP_WATCH:
+            /* Every point that fired in the cycle, one line each */
+            for (i = 0; i < dbg->num_break_hits; ++i)
+            {
+                printf("%sBreakpoint %d, pc(%d) retired", i > 0 ? ",\n" : "",
+                       dbg->break_hits[i], dbg->breaks[dbg->break_hits[i]].pc);
+            }
+            for (i = 0; i < dbg->num_watch_hits; ++i)
+            {
+                printf("%sWatchpoint %d, Memory[%d] %d -> %d by pc(%d)",
+                       i > 0 || dbg->num_break_hits > 0 ? ",\n" : "",
+                       dbg->watch_hits[i], dbg->watch_address, dbg->watch_old_value,
+                       cpu->data_memory[dbg->watch_address], cpu->writeback.pc);
+            }
+            break;
+        case APEX_STOP_UNTIL:
+            printf("Condition reached");
+            break;
+        case APEX_STOP_START:
+            printf("Start of history");
+            break;
+        default:
+            printf("Stopped");
+            break;
+    }
+    printf(", cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+}
+
+static void
+print_latches(const APEX_CPU *cpu)
+{
+    APEX_print_latch("Fetch", &cpu->fetch);
+    APEX_print_latch("Decode/RF", &cpu->decode);
+    APEX_print_latch("Execute", &cpu->execute);
+    APEX_print_latch("Memory", &cpu->memory);
+    APEX_print_latch("Writeback", &cpu->writeback);
+}
+
+static void
+print_buses(const APEX_CPU *cpu)
+{
+    printf("EX  forward bus: R%d = %d\n", cpu->ex_fb.reg, cpu->ex_fb.value);
+    printf("MEM forward bus: R%d = %d\n", cpu->mem_fb.reg, cpu->mem_fb.value);
+    printf("Registers being written:");
+    for (int i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (cpu->regs_writing[i])
+        {
+            printf(" R%d", i);
+        }
+    }
+    printf("\n");
+}
+
+static void
+print_points(const APEX_Debugger *dbg)
+{
+    int i;
+
+    for (i = 0; i < dbg->num_breaks; ++i)
+    {
+        const APEX_Breakpoint *bp = &dbg->breaks[i];
+
+        printf("Breakpoint %d: pc(%d)", i, bp->pc);
+        if (bp->has_cond)
+        {
+            printf(" if R%d %s %d", bp->reg, bp->op, bp->value);
+        }
+        printf("\n");
+    }
+    for (i = 0; i < dbg->num_watches; ++i)
+    {
+        printf("Watchpoint %d: Memory[%d..%d]\n", i, dbg->watches[i].lo,
+               dbg->watches[i].hi);
+    }
+}
+
+static void
+print_help(void)
+{
+    printf("  break <pc> [if R<n> <==|!=|<|<=|>|>=> <value>]  stop when pc retires\n"
+           "  watch <addr> [<last_addr>]   stop when a store writes the range\n"
+           "  delete [break|watch] [<n>]   remove one or all points\n"
+           "  info                         list breakpoints and watchpoints\n"
+           "  run [<cycles>] | continue    run until a point fires or HALT\n"
+           "  step [<cycles>]              run a number of cycles (default 1)\n"
+           "  until retire <count>         run until <count> instructions retired\n"
+           "  until <stage> <pc>           run until the stage latch holds pc\n"
+           "  regs | latches | buses       show registers, stage latches, forwarding\n"
+           "  mem <addr> [<count>]         show data memory words\n"
+           "  back [<cycles>]              undo cycles (default 1)\n"
+           "  goto <cycle>                 move to the end of a cycle, either way\n"
+           "  rcontinue [R<n> | M<addr>]   run backwards to the last write of R<n>\n"
+           "                               or Memory[addr], or to a point firing\n"
+           "  journal [off | <ring_words> [<interval> [<checkpoints>]]]\n"
+           "                               show or configure the undo history\n"
+           "  trace on|off                 print stage contents every simulated cycle\n"
+           "  quit\n");
+}
+
+static void
+cmd_break(APEX_Debugger *dbg, const char *args)
+{
+    APEX_Breakpoint bp;
+    int n;
+
+    memset(&bp, 0, sizeof(bp));
+    n = sscanf(args, "%d if R%d %2s %d", &bp.pc, &bp.reg, bp.op, &bp.value);
+    if (n != 1 && n != 4)
+    {
+        printf("Usage: break <pc> [if R<n> <op> <value>]\n");
+        return;
+    }
+    if (n == 4 && (bp.reg < 0 || bp.reg >= REG_FILE_SIZE))
+    {
+        printf("Invalid register R%d\n", bp.reg);
+        return;
+    }
+    if (dbg->num_breaks == APEX_DBG_MAX_POINTS)
+    {
+        printf("Too many breakpoints\n");
+        return;
+    }
+    bp.has_cond = (n == 4);
+    dbg->breaks[dbg->num_breaks++] = bp;
+    printf("Breakpoint %d at pc(%d)\n", dbg->num_breaks - 1, bp.pc);
+}
+
+static void
+cmd_watch(APEX_Debugger *dbg, const char *args)
+{
+    APEX_Watchpoint wp;
+    int n = sscanf(args, "%d %d", &wp.lo, &wp.hi);
+
+    if (n < 1)
+    {
+        printf("Usage: watch <addr> [<last_addr>]\n");
+        return;
+    }
+    if (n == 1)
+    {
+        wp.hi = wp.lo;
+    }
+    if (dbg->num_watches == APEX_DBG_MAX_POINTS)
+    {
+        printf("Too many watchpoints\n");
+        return;
+    }
+    dbg->watches[dbg->num_watches++] = wp;
+    printf("Watchpoint %d on Memory[%d..%d]\n", dbg->num_watches - 1, wp.lo,
+           wp.hi);
+}
+
+static void
+cmd_delete(APEX_Debugger *dbg, const char *args)
+{
+    char kind[16] = "";
+    int n = -1;
+
+    sscanf(args, "%15s %d", kind, &n);
+    if (strcmp(kind, "break") == 0 && n >= 0 && n < dbg->num_breaks)
+    {
+        memmove(&dbg->breaks[n], &dbg->breaks[n + 1],
+                (dbg->num_breaks - n - 1) * sizeof(APEX_Breakpoint));
+        dbg->num_breaks--;
+    }
+    else if (strcmp(kind, "watch") == 0 && n >= 0 && n < dbg->num_watches)
+    {
+        memmove(&dbg->watches[n], &dbg->watches[n + 1],
+                (dbg->num_watches - n - 1) * sizeof(APEX_Watchpoint));
+        dbg->num_watches--;
+    }
+    else if (strcmp(kind, "break") == 0)
+    {
+        dbg->num_breaks = 0;
+    }
+    else if (strcmp(kind, "watch") == 0)
+    {
+        dbg->num_watches = 0;
+    }
+    else
+    {
+        dbg->num_breaks = 0;
+        dbg->num_watches = 0;
+    }
+}
+
+static int
+cmd_until(APEX_Debugger *dbg, const char *args)
+{
+    char what[16] = "";
+    int value;
+
+    if (sscanf(args, "%15s %d", what, &value) != 2)
+    {
+        printf("Usage: until retire <count> | until <stage> <pc>\n");
+        return FALSE;
+    }
+
+    if (strcmp(what, "retire") == 0)
+    {
+        dbg->until_retired = value;
+        return TRUE;
+    }
+
+    dbg->until_stage = parse_stage(what);
+    if (dbg->until_stage < 0)
+    {
+        printf("Unknown stage %s\n", what);
+        return FALSE;
+    }
+    dbg->until_pc = value;
+    return TRUE;
+}
+
+static void
+cmd_mem(const APEX_CPU *cpu, const char *args)
+{
+    int addr, count = 1, i;
+
+    if (sscanf(args, "%d %d", &addr, &count) < 1)
+    {
+        printf("Usage: mem <addr> [<count>]\n");
+        return;
+    }
+    for (i = addr; i < addr + count; ++i)
+    {
+        if (i >= 0 && i < DATA_MEMORY_SIZE)
+        {
+            printf("Memory[%d]= %d\n", i, cpu->data_memory[i]);
+        }
+    }
+}
+
+static int
+need_journal(const APEX_Debugger *dbg)
+{
+    if (!dbg->journal)
+    {
+        printf("Journal is off, enable it with journal <ring_words>\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+cmd_rcontinue(APEX_Debugger *dbg, const char *args)
+{
+    int reg = -1, address = -1;
+
+    args += strspn(args, " \t");
+    if ((*args == 'R' && sscanf(args, "R%d", &reg) == 1
+         && (reg < 0 || reg >= REG_FILE_SIZE))
+        || (*args == 'M' && sscanf(args, "M%d", &address) != 1))
+    {
+        printf("Usage: rcontinue [R<n> | M<addr>]\n");
+        return;
+    }
+    print_stop(dbg, APEX_debugger_reverse(dbg, reg, address));
+}
+
+static void
+cmd_journal(APEX_Debugger *dbg, const char *args)
+{
+    const APEX_Journal *journal = dbg->journal;
+    long ring_words = 0;
+    int interval = 0, checkpoints = 0;
+
+    if (strstr(args, "off"))
+    {
+        if (journal)
+        {
+            APEX_journal_destroy(dbg->journal);
+            dbg->journal = NULL;
+        }
+        return;
+    }
+
+    if (sscanf(args, "%ld %d %d", &ring_words, &interval, &checkpoints) >= 1)
+    {
+        /* History restarts here, the new ring shares nothing with the old */
+        if (dbg->journal)
+        {
+            APEX_journal_destroy(dbg->journal);
+        }
+        dbg->journal = APEX_journal_create(dbg->cpu, ring_words, interval,
+                                           checkpoints);
+        if (!dbg->journal)
+        {
+            printf("Unable to allocate the journal\n");
+        }
+        journal = dbg->journal;
+    }
+
+    if (!journal)
+    {
+        printf("Journal off\n");
+        return;
+    }
+    printf("Journal: cycles %d..%d in ring, %ld of %ld words, "
+           "%d checkpoints every %d cycles (max %d), history from cycle %d\n",
+           journal->base_cycle, journal->head_cycle,
+           APEX_journal_words_used(journal), journal->capacity,
+           journal->num_checkpoints, journal->checkpoint_interval,
+           journal->max_checkpoints, journal->initial->cycle);
+}
+
+/*
+ * Interactive debugger loop, reads commands from stdin until quit or EOF
+ */
+int
+APEX_debugger_main(APEX_CPU *cpu)
+{
+    APEX_Debugger dbg;
+    char line[256], cmd[32];
+    const char *args;
+    long cycles;
+    int reason;
+
+    APEX_debugger_init(&dbg, cpu);
+    cpu->single_step = FALSE;
+    cpu->debug_messages = FALSE;
+    dbg.journal = APEX_journal_create(cpu, APEX_JOURNAL_RING_WORDS,
+                                      APEX_JOURNAL_CHECKPOINT_INTERVAL,
+                                      APEX_JOURNAL_MAX_CHECKPOINTS);
+    printf("APEX debugger, type help for commands\n");
+
+    for (;;)
+    {
+        printf("(apex) ");
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), stdin))
+        {
+            break;
+        }
+
+        cmd[0] = '\0';
+        sscanf(line, "%31s", cmd);
+        args = line + strspn(line, " \t");
+        args += strcspn(args, " \t\n");
+
+        if (cmd[0] == '\0')
+        {
+            continue;
+        }
+        else if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0)
+        {
+            break;
+        }
+        else if (strcmp(cmd, "help") == 0)
+        {
+            print_help();
+        }
+        else if (strcmp(cmd, "break") == 0 || strcmp(cmd, "b") == 0)
+        {
+            cmd_break(&dbg, args);
+        }
+        else if (strcmp(cmd, "watch") == 0)
+        {
+            cmd_watch(&dbg, args);
+        }
+        else if (strcmp(cmd, "delete") == 0)
+        {
+            cmd_delete(&dbg, args);
+        }
+        else if (strcmp(cmd, "info") == 0)
+        {
+            print_points(&dbg);
+        }
+        else if (strcmp(cmd, "run") == 0 || strcmp(cmd, "continue") == 0
+                 || strcmp(cmd, "c") == 0)
+        {
+            cycles = strtol(args, NULL, 10);
+            reason = APEX_debugger_run(&dbg, cycles > 0 ? cycles : LONG_MAX);
+            print_stop(&dbg, reason);
+        }
+        else if (strcmp(cmd, "step") == 0 || strcmp(cmd, "s") == 0)
+        {
+            cycles = strtol(args, NULL, 10);
+            reason = APEX_debugger_run(&dbg, cycles > 0 ? cycles : 1);
+            print_stop(&dbg, reason);
+        }
+        else if (strcmp(cmd, "until") == 0)
+        {
+            if (cmd_until(&dbg, args))
+            {
+                reason = APEX_debugger_run(&dbg, LONG_MAX);
+                print_stop(&dbg, reason);
+            }
+        }
+        else if (strcmp(cmd, "back") == 0)
+        {
+            if (need_journal(&dbg))
+            {
+                cycles = strtol(args, NULL, 10);
+                cycles = cpu->clock - (cycles > 0 ? cycles : 1);
+                if (cycles < dbg.journal->initial->cycle)
+                {
+                    cycles = dbg.journal->initial->cycle;
+                }
+                APEX_journal_goto(dbg.journal, cpu, (int)cycles);
+                debugger_sync(&dbg);
+                print_stop(&dbg, cpu->clock > dbg.journal->initial->cycle
+                                     ? APEX_STOP_COUNT : APEX_STOP_START);
+            }
+        }
+        else if (strcmp(cmd, "goto") == 0)
+        {
+            if (need_journal(&dbg))
+            {
+                APEX_journal_goto(dbg.journal, cpu, (int)strtol(args, NULL, 10));
+                debugger_sync(&dbg);
+                print_stop(&dbg, dbg.halted ? APEX_STOP_HALT : APEX_STOP_COUNT);
+            }
+        }
+        else if (strcmp(cmd, "rcontinue") == 0 || strcmp(cmd, "rc") == 0)
+        {
+            if (need_journal(&dbg))
+            {
+                cmd_rcontinue(&dbg, args);
+            }
+        }
+        else if (strcmp(cmd, "journal") == 0)
+        {
+            cmd_journal(&dbg, args);
+        }
+        else if (strcmp(cmd, "regs") == 0)
+        {
+            APEX_print_reg_file(cpu);
+        }
+        else if (strcmp(cmd, "latches") == 0)
+        {
+            print_latches(cpu);
+        }
+        else if (strcmp(cmd, "buses") == 0)
+        {
+            print_buses(cpu);
+        }
+        else if (strcmp(cmd, "mem") == 0)
+        {
+            cmd_mem(cpu, args);
+        }
+        else if (strcmp(cmd, "trace") == 0)
+        {
+            cpu->debug_messages = (strstr(args, "on") != NULL);
+        }
+        else
+        {
+            printf("Unknown command %s, type help for commands\n", cmd);
+        }
+    }
+
+    printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n",
+           cpu->clock, cpu->insn_completed);
+    if (dbg.journal)
+    {
+        APEX_journal_destroy(dbg.journal);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * apex_debugger.h
+ * Contains declarations of the interactive APEX debugger
+ */
+#ifndef _APEX_DEBUGGER_H_
+#define _APEX_DEBUGGER_H_
+
+#include "apex_cpu.h"
+#include "apex_journal.h"
+
+/* Breakpoints and watchpoints of each kind */
+#define APEX_DBG_MAX_POINTS 64
+
+/* Reasons for the debugger to hand control back to the user */
+#define APEX_STOP_NONE 0x0
+#define APEX_STOP_COUNT 0x1        /* Requested number of cycles done */
+#define APEX_STOP_HALT 0x2         /* HALT retired */
+#define APEX_STOP_BREAK 0x3        /* Breakpoint hit */
+#define APEX_STOP_WATCH 0x4        /* Watched memory written */
+#define APEX_STOP_UNTIL 0x5        /* run-until condition met */
+#define APEX_STOP_START 0x6        /* Reverse run reached the start of history */
+
+/* Stops when the instruction at pc retires and the optional register
+ * condition R<reg> <op> <value> holds afterwards */
+typedef struct APEX_Breakpoint
+{
+    int pc;
+    int has_cond;
+    int reg;
+    char op[3];
+    int value;
+} APEX_Breakpoint;
+
+/* Stops when a store writes any address in [lo, hi] */
+typedef struct APEX_Watchpoint
+{
+    int lo;
+    int hi;
+} APEX_Watchpoint;
+
+/* State of a debugging session */
+typedef struct APEX_Debugger
+{
+    APEX_CPU *cpu;
+    APEX_Breakpoint breaks[APEX_DBG_MAX_POINTS];
+    int num_breaks;
+    APEX_Watchpoint watches[APEX_DBG_MAX_POINTS];
+    int num_watches;
+    int until_retired;             /* run-until retire count, -1 if unset */
+    int until_stage;               /* run-until stage holds until_pc */
+    int until_pc;
+    int armed;                     /* Any check above is active */
+    int halted;
+    int break_hits[APEX_DBG_MAX_POINTS]; /* Breakpoints that fired in the last cycle */
+    int num_break_hits;
+    int watch_hits[APEX_DBG_MAX_POINTS]; /* Watchpoints that fired in the last cycle */
+    int num_watch_hits;
+    int watch_address;             /* Address written when a watch fired */
+    int watch_old_value;
+    APEX_Journal *journal;         /* Undo history, NULL runs forward only */
+} APEX_Debugger;
+
+void APEX_debugger_init(APEX_Debugger *dbg, APEX_CPU *cpu);
+int APEX_debugger_run(APEX_Debugger *dbg, long max_cycles);
+int APEX_debugger_reverse(APEX_Debugger *dbg, int reg, int address);
+int APEX_debugger_main(APEX_CPU *cpu);
+
+#endif
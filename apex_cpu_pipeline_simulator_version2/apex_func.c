@@ -0,0 +1,277 @@
+/*
+ * apex_func.c
+ * Contains the scalar functional model
+ *
+ * Semantics follow the pipeline in apex_cpu.c, like the batch engine does:
+ * DIV retires as a NOP, MOVC and memory instructions leave the condition
+ * codes alone, and LOADP writes its incremented base after rd.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_func.h"
+
+static void
+set_flags(APEX_Func *func, int result)
+{
+    func->cc.z = result == 0;
+    func->cc.p = result > 0;
+    func->cc.n = result < 0;
+}
+
+static int
+valid_address(APEX_Func *func, int address)
+{
+    if (address < 0 || address >= DATA_MEMORY_SIZE)
+    {
+        func->status = APEX_FUNC_BAD_ADDRESS;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * This function creates a functional instance at the first instruction. A
+ * NULL image starts it with zeroed data memory.
+ */
+APEX_Func *
+APEX_func_create(const APEX_Instruction *code_memory, int code_memory_size,
+                 const int *data_memory)
+{
+    APEX_Func *func = calloc(1, sizeof(APEX_Func));
+
+    if (!func)
+    {
+        return NULL;
+    }
+    func->pc = 4000;
+    func->status = APEX_FUNC_RUNNING;
+    func->code_memory = code_memory;
+    func->code_memory_size = code_memory_size;
+    if (data_memory)
+    {
+        memcpy(func->data_memory, data_memory, sizeof(func->data_memory));
+    }
+    return func;
+}
+
+/*
+ * This function copies an instance, as a checkpoint of its state
+ */
+APEX_Func *
+APEX_func_clone(const APEX_Func *func)
+{
+    APEX_Func *clone = malloc(sizeof(APEX_Func));
+
+    if (clone)
+    {
+        memcpy(clone, func, sizeof(APEX_Func));
+    }
+    return clone;
+}
+
+/*
+ * Executes one instruction
+ *
+ * Returns FALSE once the instance has stopped, see status for why
+ */
+int
+APEX_func_step(APEX_Func *func)
+{
+    const APEX_Instruction *ins;
+    int index = (func->pc - 4000) / 4;
+    int next_pc = func->pc + 4;
+    int result, address, taken;
+
+    if (func->status != APEX_FUNC_RUNNING)
+    {
+        return FALSE;
+    }
+    if ((func->pc - 4000) % 4 || index < 0 || index >= func->code_memory_size)
+    {
+        func->status = APEX_FUNC_BAD_PC;
+        return FALSE;
+    }
+    ins = &func->code_memory[index];
+
+    switch (ins->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        {
+            int a = func->regs[ins->rs1];
+            int b = func->regs[ins->rs2];
+
+            switch (ins->opcode)
+            {
+                case OPCODE_ADD: result = a + b; break;
+                case OPCODE_SUB: result = a - b; break;
+                case OPCODE_MUL: result = a * b; break;
+                case OPCODE_AND: result = a & b; break;
+                case OPCODE_OR: result = a | b; break;
+                default: result = a ^ b; break;
+            }
+            func->regs[ins->rd] = result;
+            set_flags(func, result);
+            break;
+        }
+
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        {
+            result = (ins->opcode == OPCODE_ADDL)
+                         ? func->regs[ins->rs1] + ins->imm
+                         : func->regs[ins->rs1] - ins->imm;
+            func->regs[ins->rd] = result;
+            set_flags(func, result);
+            break;
+        }
+
+        case OPCODE_MOVC:
+        {
+            func->regs[ins->rd] = ins->imm;
+            break;
+        }
+
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        {
+            int base = func->regs[ins->rs1];
+
+            address = base + ins->imm;
+            if (!valid_address(func, address))
+            {
+                return FALSE;
+            }
+            func->regs[ins->rd] = func->data_memory[address];
+            if (ins->opcode == OPCODE_LOADP)
+            {
+                func->regs[ins->rs1] = base + 4;
+            }
+            break;
+        }
+
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+        {
+            int base = func->regs[ins->rs2];
+
+            address = base + ins->imm;
+            if (!valid_address(func, address))
+            {
+                return FALSE;
+            }
+            func->data_memory[address] = func->regs[ins->rs1];
+            if (ins->opcode == OPCODE_STOREP)
+            {
+                func->regs[ins->rs2] = base + 4;
+            }
+            break;
+        }
+
+        case OPCODE_CML:
+        case OPCODE_CMP:
+        {
+            result = (ins->opcode == OPCODE_CML)
+                         ? func->regs[ins->rs1] - ins->imm
+                         : func->regs[ins->rs1] - func->regs[ins->rs2];
+            set_flags(func, result);
+            break;
+        }
+
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        {
+            switch (ins->opcode)
+            {
+                case OPCODE_BZ: taken = func->cc.z; break;
+                case OPCODE_BNZ: taken = !func->cc.z; break;
+                case OPCODE_BP: taken = func->cc.p; break;
+                case OPCODE_BNP: taken = !func->cc.p; break;
+                case OPCODE_BN: taken = func->cc.n; break;
+                default: taken = !func->cc.n; break;
+            }
+            if (taken)
+            {
+                next_pc = func->pc + ins->imm;
+            }
+            break;
+        }
+
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+        {
+            int target = func->regs[ins->rs1] + ins->imm;
+
+            if (ins->opcode == OPCODE_JALR)
+            {
+                func->regs[ins->rd] = next_pc;
+            }
+            next_pc = target;
+            break;
+        }
+
+        case OPCODE_HALT:
+        {
+            func->insn_completed++;
+            func->status = APEX_FUNC_HALTED;
+            return FALSE;
+        }
+
+        default:
+        {
+            /* NOP and DIV */
+            break;
+        }
+    }
+
+    func->insn_completed++;
+    func->pc = next_pc;
+    return TRUE;
+}
+
+/*
+ * Executes up to max_insns instructions
+ *
+ * Returns the number of instructions retired
+ */
+long
+APEX_func_run(APEX_Func *func, long max_insns)
+{
+    long start = func->insn_completed;
+
+    while (func->insn_completed - start < max_insns && APEX_func_step(func))
+        ;
+    return func->insn_completed - start;
+}
+
+/*
+ * Copies the architectural state into a cpu with an empty pipeline, which
+ * then fetches from the next instruction of the functional instance
+ */
+void
+APEX_func_load_cpu(const APEX_Func *func, APEX_CPU *cpu)
+{
+    cpu->pc = func->pc;
+    memcpy(cpu->regs, func->regs, sizeof(cpu->regs));
+    memcpy(cpu->data_memory, func->data_memory, sizeof(cpu->data_memory));
+    cpu->cc = func->cc;
+    cpu->zero_flag = func->cc.z;
+}
+
+/*
+ * This function deallocates a functional instance
+ */
+void
+APEX_func_destroy(APEX_Func *func)
+{
+    free(func);
+}
@@ -0,0 +1,45 @@
+/*
+ * apex_func.h
+ * Contains declarations of the scalar functional model
+ *
+ * The functional model executes one instruction per step with no pipeline
+ * at all. It is the fast-forward engine of the sampling modes and the
+ * reference the pipeline is checked against.
+ */
+#ifndef _APEX_FUNC_H_
+#define _APEX_FUNC_H_
+
+#include "apex_cpu.h"
+
+/* Status values, numbered like the APEX_LANE_* of the batch engine */
+#define APEX_FUNC_RUNNING 0x1
+#define APEX_FUNC_HALTED 0x2
+#define APEX_FUNC_BAD_PC 0x3
+#define APEX_FUNC_BAD_ADDRESS 0x4
+
+/* Instructions a functional run may take before the program is taken not
+ * to halt */
+#define APEX_FUNC_MAX_INSNS 1000000000L
+
+/* Architectural state of one APEX instance */
+typedef struct APEX_Func
+{
+    int pc;
+    int regs[REG_FILE_SIZE];
+    condition_code cc;
+    int status;                    /* APEX_FUNC_* */
+    long insn_completed;           /* Instructions retired, HALT included */
+    const APEX_Instruction *code_memory; /* Shared, read-only */
+    int code_memory_size;
+    int data_memory[DATA_MEMORY_SIZE];
+} APEX_Func;
+
+APEX_Func *APEX_func_create(const APEX_Instruction *code_memory,
+                            int code_memory_size, const int *data_memory);
+APEX_Func *APEX_func_clone(const APEX_Func *func);
+int APEX_func_step(APEX_Func *func);
+long APEX_func_run(APEX_Func *func, long max_insns);
+void APEX_func_load_cpu(const APEX_Func *func, APEX_CPU *cpu);
+void APEX_func_destroy(APEX_Func *func);
+
+#endif
@@ -0,0 +1,672 @@
+/*
+ * apex_fuzz.c
+ * Contains the differential fuzzer
+ *
+ * Programs are generated straight into code memory: constants for every
+ * register, then a body of random instructions run a few times by a
+ * counted loop, then HALT. Sources are drawn from recent producers at a
+ * chosen distance to exercise the hazard and forwarding logic, branches
+ * only jump forward within the body and memory instructions stay inside
+ * data memory, so every program halts and a pipeline that does not has
+ * hung. Each one is run through the co-simulator against a reference, and
+ * the programs that diverge are shrunk to the fewest instructions that
+ * still do.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_fuzz.h"
+#include "apex_cosim.h"
+#include "apex_pool.h"
+
+typedef struct APEX_Fuzz
+{
+    const APEX_Fuzz_Config *config;
+    const char *dut;
+    const char *ref;
+    long *divergence;              /* Per program, -1 if it agreed */
+    long *retired;                 /* Per program, by the pipeline under test */
+} APEX_Fuzz;
+
+static const int alu_opcodes[] = {OPCODE_ADD, OPCODE_SUB, OPCODE_MUL, OPCODE_AND,
+                                  OPCODE_OR, OPCODE_XOR, OPCODE_ADDL, OPCODE_SUBL,
+                                  OPCODE_MOVC, OPCODE_CMP, OPCODE_CML};
+static const int branch_opcodes[] = {OPCODE_BZ, OPCODE_BNZ, OPCODE_BP,
+                                     OPCODE_BNP, OPCODE_BN, OPCODE_BNN};
+static const int memory_opcodes[] = {OPCODE_LOAD, OPCODE_STORE, OPCODE_LOADP,
+                                     OPCODE_STOREP};
+
+static unsigned long
+mix(unsigned long x)
+{
+    x += 0x9e3779b97f4a7c15UL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+    return x ^ (x >> 31);
+}
+
+/* Returns a number in [0, n) */
+static int
+random_below(unsigned long *state, int n)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (int)(((*state * 0x2545f4914f6cdd1dUL) >> 33) % (unsigned long)n);
+}
+
+static const char *
+opcode_name(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD: return "ADD";
+        case OPCODE_SUB: return "SUB";
+        case OPCODE_MUL: return "MUL";
+        case OPCODE_AND: return "AND";
+        case OPCODE_OR: return "OR";
+        case OPCODE_XOR: return "EXOR";
+        case OPCODE_MOVC: return "MOVC";
+        case OPCODE_LOAD: return "LOAD";
+        case OPCODE_STORE: return "STORE";
+        case OPCODE_BZ: return "BZ";
+        case OPCODE_BNZ: return "BNZ";
+        case OPCODE_ADDL: return "ADDL";
+        case OPCODE_SUBL: return "SUBL";
+        case OPCODE_LOADP: return "LOADP";
+        case OPCODE_STOREP: return "STOREP";
+        case OPCODE_CML: return "CML";
+        case OPCODE_CMP: return "CMP";
+        case OPCODE_BP: return "BP";
+        case OPCODE_BNP: return "BNP";
+        case OPCODE_BN: return "BN";
+        case OPCODE_BNN: return "BNN";
+        case OPCODE_HALT: return "HALT";
+        default: return "NOP";
+    }
+}
+
+static void
+set_instruction(APEX_Instruction *ins, int opcode, int rd, int rs1, int rs2, int imm)
+{
+    strcpy(ins->opcode_str, opcode_name(opcode));
+    ins->opcode = opcode;
+    ins->rd = rd;
+    ins->rs1 = rs1;
+    ins->rs2 = rs2;
+    ins->imm = imm;
+}
+
+static int
+is_branch(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/* Draws a source register, from the producer some distance back or at random */
+static int
+pick_source(const APEX_Fuzz_Config *config, unsigned long *state,
+            const int *dest, int position)
+{
+    int d;
+
+    if (random_below(state, 100) < config->dependency)
+    {
+        d = 1 + random_below(state, config->distance);
+        if (position - d >= 0 && dest[position - d] >= 0)
+        {
+            return dest[position - d];
+        }
+    }
+    return random_below(state, APEX_FUZZ_DATA_REGS);
+}
+
+void
+APEX_fuzz_config_default(APEX_Fuzz_Config *config)
+{
+    config->length = APEX_FUZZ_LENGTH;
+    config->distance = APEX_FUZZ_DISTANCE;
+    config->dependency = APEX_FUZZ_DEPENDENCY;
+    config->branches = APEX_FUZZ_BRANCHES;
+    config->memory = APEX_FUZZ_MEMORY;
+    config->alias = APEX_FUZZ_ALIAS;
+    config->loop = APEX_FUZZ_LOOP;
+    config->seed = 1;
+}
+
+/* Instructions a generated program may take */
+int
+APEX_fuzz_max_size(const APEX_Fuzz_Config *config)
+{
+    return APEX_FUZZ_DATA_REGS + 3 + config->length + 3;
+}
+
+/*
+ * Generates program number index of the configuration into code, which
+ * must hold APEX_fuzz_max_size instructions. The same seed and index
+ * always give the same program.
+ *
+ * Returns the number of instructions
+ */
+int
+APEX_fuzz_generate(const APEX_Fuzz_Config *config, unsigned long index,
+                   APEX_Instruction *code)
+{
+    unsigned long state = mix(config->seed ^ mix(index + 1));
+    int dest[config->length > 0 ? config->length : 1];
+    int base[2], post[2] = {0, 0};
+    int loop = config->loop > 1, size = 0, first, limit, i, r, opcode, b;
+    int runs = loop ? config->loop : 1;
+
+    /* Two base pointers, overlapping or far apart */
+    base[0] = 1000 + 4 * random_below(&state, 16);
+    base[1] = random_below(&state, 100) < config->alias
+                  ? base[0] + 4 * (random_below(&state, 9) - 4)
+                  : base[0] + 1500;
+
+    for (i = 0; i < APEX_FUZZ_DATA_REGS; ++i)
+    {
+        set_instruction(&code[size++], OPCODE_MOVC, i, 0, 0,
+                        random_below(&state, 129) - 64);
+    }
+    set_instruction(&code[size++], OPCODE_MOVC, APEX_FUZZ_BASE_A, 0, 0, base[0]);
+    set_instruction(&code[size++], OPCODE_MOVC, APEX_FUZZ_BASE_B, 0, 0, base[1]);
+    if (loop)
+    {
+        set_instruction(&code[size++], OPCODE_MOVC, APEX_FUZZ_COUNTER, 0, 0,
+                        config->loop);
+    }
+
+    /* Branches may land on the loop decrement or on HALT, never on the
+     * loop branch */
+    first = size;
+    limit = first + config->length;
+    for (i = 0; i < config->length; ++i)
+    {
+        APEX_Instruction *ins = &code[size++];
+
+        dest[i] = -1;
+        r = random_below(&state, 100);
+        if (r < config->branches)
+        {
+            opcode = branch_opcodes[random_below(&state, 6)];
+            set_instruction(ins, opcode, 0, 0, 0,
+                            4 * (1 + random_below(&state, limit - (first + i) < 8
+                                                              ? limit - (first + i) : 8)));
+            continue;
+        }
+        if (r < config->branches + config->memory)
+        {
+            opcode = memory_opcodes[random_below(&state, 4)];
+            b = random_below(&state, 2);
+
+            /* Post-increments are kept from walking off data memory */
+            if ((opcode == OPCODE_LOADP || opcode == OPCODE_STOREP)
+                && base[b] + 4 * runs * (post[b] + 1) + 15 >= DATA_MEMORY_SIZE)
+            {
+                opcode = opcode == OPCODE_LOADP ? OPCODE_LOAD : OPCODE_STORE;
+            }
+            if (opcode == OPCODE_LOADP || opcode == OPCODE_STOREP)
+            {
+                post[b]++;
+            }
+            if (opcode == OPCODE_LOAD || opcode == OPCODE_LOADP)
+            {
+                dest[i] = random_below(&state, APEX_FUZZ_DATA_REGS);
+                set_instruction(ins, opcode, dest[i], APEX_FUZZ_BASE_A + b, 0,
+                                random_below(&state, 24) - 8);
+            }
+            else
+            {
+                set_instruction(ins, opcode, 0,
+                                pick_source(config, &state, dest, i),
+                                APEX_FUZZ_BASE_A + b, random_below(&state, 24) - 8);
+            }
+            continue;
+        }
+
+        opcode = alu_opcodes[random_below(&state, 11)];
+        switch (opcode)
+        {
+            case OPCODE_ADDL:
+            case OPCODE_SUBL:
+                dest[i] = random_below(&state, APEX_FUZZ_DATA_REGS);
+                set_instruction(ins, opcode, dest[i], pick_source(config, &state, dest, i),
+                                0, random_below(&state, 33) - 16);
+                break;
+            case OPCODE_MOVC:
+                dest[i] = random_below(&state, APEX_FUZZ_DATA_REGS);
+                set_instruction(ins, opcode, dest[i], 0, 0, random_below(&state, 129) - 64);
+                break;
+            case OPCODE_CML:
+                set_instruction(ins, opcode, 0, pick_source(config, &state, dest, i), 0,
+                                random_below(&state, 33) - 16);
+                break;
+            case OPCODE_CMP:
+                set_instruction(ins, opcode, 0, pick_source(config, &state, dest, i),
+                                pick_source(config, &state, dest, i), 0);
+                break;
+            default:
+                dest[i] = random_below(&state, APEX_FUZZ_DATA_REGS);
+                set_instruction(ins, opcode, dest[i], pick_source(config, &state, dest, i),
+                                pick_source(config, &state, dest, i), 0);
+                break;
+        }
+    }
+
+    if (loop)
+    {
+        set_instruction(&code[size++], OPCODE_SUBL, APEX_FUZZ_COUNTER,
+                        APEX_FUZZ_COUNTER, 0, 1);
+        set_instruction(&code[size], OPCODE_BNZ, 0, 0, 0, 4 * (first - size));
+        size++;
+    }
+    set_instruction(&code[size++], OPCODE_HALT, 0, 0, 0, 0);
+    return size;
+}
+
+/* Every instruction retires at most once per iteration of the loop, plus
+ * once before it for the constants */
+static long
+cycle_budget(const APEX_Instruction *code, int size)
+{
+    long iterations = 1;
+    int i;
+
+    for (i = 0; i < size; ++i)
+    {
+        if (code[i].opcode == OPCODE_MOVC && code[i].rd == APEX_FUZZ_COUNTER
+            && code[i].imm > 1)
+        {
+            iterations = code[i].imm;
+        }
+    }
+    return APEX_FUZZ_CYCLES_PER_INSTRUCTION * (long)size * (iterations + 1);
+}
+
+/*
+ * Runs one program through both models. Generated programs always halt,
+ * so a pipeline that runs out of cycles has hung and diverges too.
+ *
+ * Returns the retirement of the first divergence, -1 if the models agree
+ * and -2 if they could not be created
+ */
+static long
+run_program(const APEX_Instruction *code, int size, const char *dut,
+            const char *ref, long *retired, FILE *out)
+{
+    APEX_Cosim_Model a, b;
+    long max_cycles = cycle_budget(code, size), index;
+
+    if (APEX_cosim_model_init(&a, dut, code, size, NULL, max_cycles) < 0)
+    {
+        return -2;
+    }
+    if (APEX_cosim_model_init(&b, ref, code, size, NULL, max_cycles) < 0)
+    {
+        APEX_cosim_model_free(&a);
+        return -2;
+    }
+    a.must_halt = TRUE;
+    b.must_halt = TRUE;
+    index = APEX_cosim_run(&a, &b, out);
+    if (retired)
+    {
+        *retired = a.cpu ? a.cpu->insn_completed : a.func->insn_completed;
+    }
+    APEX_cosim_model_free(&a);
+    APEX_cosim_model_free(&b);
+    return index;
+}
+
+/* Pool task, generates and checks one program */
+static void
+fuzz_program(void *context, int index)
+{
+    APEX_Fuzz *fuzz = context;
+    APEX_Instruction *code = malloc(sizeof(APEX_Instruction)
+                                    * APEX_fuzz_max_size(fuzz->config));
+    int size;
+
+    if (!code)
+    {
+        fuzz->divergence[index] = -2;
+        return;
+    }
+    size = APEX_fuzz_generate(fuzz->config, index, code);
+    fuzz->divergence[index] = run_program(code, size, fuzz->dut, fuzz->ref,
+                                          &fuzz->retired[index], NULL);
+    free(code);
+}
+
+/* Removes instruction i, retargeting the branches around it */
+static void
+delete_instruction(APEX_Instruction *code, int size, int i)
+{
+    int j, target, new_j, new_target;
+
+    for (j = 0; j < size; ++j)
+    {
+        if (j == i || !is_branch(code[j].opcode))
+        {
+            continue;
+        }
+        target = j + code[j].imm / 4;
+        new_j = j - (j > i);
+        new_target = target - (target > i);
+        code[j].imm = 4 * (new_target - new_j);
+    }
+    memmove(&code[i], &code[i + 1], sizeof(APEX_Instruction) * (size - i - 1));
+}
+
+/* HALT, the loop and the bases keep every variant halting and in bounds */
+static int
+is_scaffolding(const APEX_Instruction *ins)
+{
+    return ins->opcode == OPCODE_HALT
+           || ((ins->opcode == OPCODE_MOVC || ins->opcode == OPCODE_SUBL)
+               && ins->rd >= APEX_FUZZ_DATA_REGS)
+           || (is_branch(ins->opcode) && ins->imm < 0);
+}
+
+static int
+still_fails(const APEX_Instruction *code, int size, const char *dut, const char *ref)
+{
+    return run_program(code, size, dut, ref, NULL, NULL) >= 0;
+}
+
+/*
+ * Shrinks a failing program. Ever smaller runs of instructions, apart
+ * from the scaffolding, are turned into NOPs, which keeps every branch
+ * offset, as long as the models still diverge. Then the NOPs are deleted
+ * one at a time where the divergence survives without them, since removing
+ * one also moves the timing.
+ *
+ * Returns the new number of instructions
+ */
+int
+APEX_fuzz_minimize(APEX_Instruction *code, int size, const char *dut, const char *ref)
+{
+    APEX_Instruction *trial = malloc(sizeof(APEX_Instruction) * size);
+    int chunk = size / 2, start, i, changed;
+
+    if (!trial)
+    {
+        return size;
+    }
+
+    while (chunk >= 1)
+    {
+        changed = FALSE;
+        for (start = 0; start < size; start += chunk)
+        {
+            int touched = FALSE;
+
+            memcpy(trial, code, sizeof(APEX_Instruction) * size);
+            for (i = start; i < start + chunk && i < size; ++i)
+            {
+                if (trial[i].opcode != OPCODE_NOP && !is_scaffolding(&trial[i]))
+                {
+                    set_instruction(&trial[i], OPCODE_NOP, 0, 0, 0, 0);
+                    touched = TRUE;
+                }
+            }
+            if (touched && still_fails(trial, size, dut, ref))
+            {
+                memcpy(code, trial, sizeof(APEX_Instruction) * size);
+                changed = TRUE;
+            }
+        }
+        if (!changed)
+        {
+            chunk /= 2;
+        }
+    }
+
+    for (i = size - 1; i >= 0; --i)
+    {
+        if (code[i].opcode != OPCODE_NOP)
+        {
+            continue;
+        }
+        memcpy(trial, code, sizeof(APEX_Instruction) * size);
+        delete_instruction(trial, size, i);
+        if (still_fails(trial, size - 1, dut, ref))
+        {
+            memcpy(code, trial, sizeof(APEX_Instruction) * (size - 1));
+            size--;
+        }
+    }
+
+    free(trial);
+    return size;
+}
+
+/*
+ * Writes a program in the input file syntax
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int
+APEX_fuzz_write(const char *path, const APEX_Instruction *code, int size)
+{
+    FILE *fp = fopen(path, "w");
+    char buf[192];
+    int i;
+
+    if (!fp)
+    {
+        return -1;
+    }
+    for (i = 0; i < size; ++i)
+    {
+        APEX_format_instruction(buf, sizeof(buf), &code[i]);
+        fprintf(fp, "%s\n", buf);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+static double
+cpu_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Shrinks, saves and shows one failing program */
+static void
+report_failure(const APEX_Fuzz *fuzz, const char *prefix, int index)
+{
+    APEX_Instruction *code = malloc(sizeof(APEX_Instruction)
+                                    * APEX_fuzz_max_size(fuzz->config));
+    char path[1024];
+    int size, minimized;
+
+    if (!code)
+    {
+        return;
+    }
+    size = APEX_fuzz_generate(fuzz->config, index, code);
+    minimized = APEX_fuzz_minimize(code, size, fuzz->dut, fuzz->ref);
+    snprintf(path, sizeof(path), "%s-%lu-%d.asm", prefix, fuzz->config->seed, index);
+    if (APEX_fuzz_write(path, code, minimized) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", path);
+        free(code);
+        return;
+    }
+
+    printf("APEX_FUZZ: program %d diverged at retirement %ld, %d instructions "
+           "minimised to %d in %s\n", index, fuzz->divergence[index], size,
+           minimized, path);
+    printf("APEX_FUZZ: replay with: apex_sim %s cosim forwarding=%s ref=%s max_cycles=%ld\n",
+           path, fuzz->dut, fuzz->ref, cycle_budget(code, minimized));
+    run_program(code, minimized, fuzz->dut, fuzz->ref, NULL, stdout);
+    free(code);
+}
+
+/*
+ * Entry point of "apex_sim <prefix> fuzz <option>...". Options are
+ *   count=<n>   seed=<n>   threads=<n>   reports=<n>
+ *   length=<n>   distance=<n>   dependency=<percent>   branches=<percent>
+ *   memory=<percent>   alias=<percent>   loop=<iterations>
+ *   forwarding=<none|ex|mem|all>   ref=<func|none|ex|mem|all>
+ * Minimised failing programs are written to <prefix>-<seed>-<program>.asm,
+ * and the cosim command that replays each one is printed.
+ * Exits with 1 if any program diverged.
+ */
+int
+APEX_fuzz_main(const char *prefix, int argc, char const *argv[])
+{
+    APEX_Fuzz_Config config;
+    APEX_Fuzz fuzz;
+    const char *dut = "all", *ref = "func";
+    int count = APEX_FUZZ_COUNT, threads = APEX_pool_default_threads();
+    int reports = APEX_FUZZ_REPORTS, failures = 0, reported = 0, i;
+    long instructions = 0;
+    double t, seconds;
+    struct timespec start, end;
+
+    APEX_fuzz_config_default(&config);
+    for (i = 0; i < argc; ++i)
+    {
+        const char *value = strchr(argv[i], '=');
+
+        if (!value)
+        {
+            fprintf(stderr, "APEX_Error: Unknown fuzz option %s\n", argv[i]);
+            return 1;
+        }
+        value++;
+        if (strncmp(argv[i], "count=", 6) == 0)
+        {
+            count = atoi(value);
+        }
+        else if (strncmp(argv[i], "seed=", 5) == 0)
+        {
+            config.seed = strtoul(value, NULL, 10);
+        }
+        else if (strncmp(argv[i], "threads=", 8) == 0)
+        {
+            threads = atoi(value);
+        }
+        else if (strncmp(argv[i], "reports=", 8) == 0)
+        {
+            reports = atoi(value);
+        }
+        else if (strncmp(argv[i], "length=", 7) == 0)
+        {
+            config.length = atoi(value);
+        }
+        else if (strncmp(argv[i], "distance=", 9) == 0)
+        {
+            config.distance = atoi(value);
+        }
+        else if (strncmp(argv[i], "dependency=", 11) == 0)
+        {
+            config.dependency = atoi(value);
+        }
+        else if (strncmp(argv[i], "branches=", 9) == 0)
+        {
+            config.branches = atoi(value);
+        }
+        else if (strncmp(argv[i], "memory=", 7) == 0)
+        {
+            config.memory = atoi(value);
+        }
+        else if (strncmp(argv[i], "alias=", 6) == 0)
+        {
+            config.alias = atoi(value);
+        }
+        else if (strncmp(argv[i], "loop=", 5) == 0)
+        {
+            config.loop = atoi(value);
+        }
+        else if (strncmp(argv[i], "forwarding=", 11) == 0)
+        {
+            dut = value;
+        }
+        else if (strncmp(argv[i], "ref=", 4) == 0)
+        {
+            ref = value;
+        }
+        else
+        {
+            fprintf(stderr, "APEX_Error: Unknown fuzz option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (count <= 0 || config.length <= 0 || config.distance <= 0 || config.loop < 0
+        || APEX_parse_forwarding(dut) < 0
+        || (strcmp(ref, "func") != 0 && APEX_parse_forwarding(ref) < 0))
+    {
+        fprintf(stderr, "APEX_Error: Invalid fuzz configuration\n");
+        return 1;
+    }
+
+    fuzz.config = &config;
+    fuzz.dut = dut;
+    fuzz.ref = ref;
+    fuzz.divergence = calloc(count, sizeof(long));
+    fuzz.retired = calloc(count, sizeof(long));
+    if (!fuzz.divergence || !fuzz.retired)
+    {
+        return 1;
+    }
+
+    t = cpu_seconds();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (APEX_pool_run(threads, count, fuzz_program, &fuzz) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to start fuzzing\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = cpu_seconds() - t;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (fuzz.divergence[i] == -2)
+        {
+            fprintf(stderr, "APEX_Error: Unable to run program %d\n", i);
+            return 1;
+        }
+        instructions += fuzz.retired[i];
+        failures += fuzz.divergence[i] >= 0;
+    }
+
+    printf("APEX_FUZZ: %d programs, seed %lu, forwarding=%s against %s, %d diverged, "
+           "%ld instructions retired\n", count, config.seed, APEX_forwarding_name(
+           APEX_parse_forwarding(dut)), ref, failures, instructions);
+    printf("APEX_FUZZ: %.3f s, %.0f programs/s per core, %.3f s wall\n", seconds,
+           seconds > 0.0 ? count / seconds : 0.0,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    for (i = 0; i < count && reported < reports; ++i)
+    {
+        if (fuzz.divergence[i] >= 0)
+        {
+            report_failure(&fuzz, prefix, i);
+            reported++;
+        }
+    }
+
+    free(fuzz.divergence);
+    free(fuzz.retired);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * apex_fuzz.h
+ * Contains declarations of the differential fuzzer
+ */
+#ifndef _APEX_FUZZ_H_
+#define _APEX_FUZZ_H_
+
+#include "apex_cpu.h"
+
+/* Generator defaults */
+#define APEX_FUZZ_LENGTH 32        /* Instructions in the loop body */
+#define APEX_FUZZ_DISTANCE 3       /* Farthest producer a source is drawn from */
+#define APEX_FUZZ_DEPENDENCY 70    /* Percent of sources drawn from producers */
+#define APEX_FUZZ_BRANCHES 10      /* Percent of forward conditional branches */
+#define APEX_FUZZ_MEMORY 20        /* Percent of loads and stores */
+#define APEX_FUZZ_ALIAS 50         /* Percent of programs with overlapping bases */
+#define APEX_FUZZ_LOOP 4           /* Iterations of the body */
+#define APEX_FUZZ_COUNT 10000      /* Programs per run */
+
+/* Cycles any retirement may take. A pipeline that runs past this many
+ * cycles per instruction the program can retire has hung. */
+#define APEX_FUZZ_CYCLES_PER_INSTRUCTION 16
+
+/* Failing programs minimised and reported per run */
+#define APEX_FUZZ_REPORTS 3
+
+/* Registers the body computes with are R0 to APEX_FUZZ_DATA_REGS - 1. The
+ * bases and the loop counter are above them so nothing overwrites them. */
+#define APEX_FUZZ_DATA_REGS 16
+#define APEX_FUZZ_BASE_A 28
+#define APEX_FUZZ_BASE_B 29
+#define APEX_FUZZ_COUNTER 31
+
+typedef struct APEX_Fuzz_Config
+{
+    int length;
+    int distance;
+    int dependency;
+    int branches;
+    int memory;
+    int alias;
+    int loop;
+    unsigned long seed;
+} APEX_Fuzz_Config;
+
+void APEX_fuzz_config_default(APEX_Fuzz_Config *config);
+int APEX_fuzz_max_size(const APEX_Fuzz_Config *config);
+int APEX_fuzz_generate(const APEX_Fuzz_Config *config, unsigned long index,
+                       APEX_Instruction *code);
+int APEX_fuzz_minimize(APEX_Instruction *code, int size, const char *dut,
+                       const char *ref);
+int APEX_fuzz_write(const char *path, const APEX_Instruction *code, int size);
+
+int APEX_fuzz_main(const char *prefix, int argc, char const *argv[]);
+
+#endif
@@ -0,0 +1,1212 @@
+/*
+ * apex_gdb.c
+ * Contains the GDB remote serial protocol stub
+ *
+ * The stub serves one client over a loopback TCP port or a Unix socket. The
+ * pc it reports is that of the oldest instruction still in the pipeline,
+ * i.e. the next one to retire, and the register file is the retired state,
+ * so a stop looks like a stop before that instruction executes. Data word N
+ * is at byte address 4N, little endian.
+ *
+ * While continuing, the socket is only polled every APEX_GDB_POLL_CYCLES
+ * cycles. After the client detaches the program runs on with plain
+ * APEX_cpu_cycle calls under a watchdog, and the stub is out of the loop
+ * entirely.
+ */
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "apex_gdb.h"
+#include "apex_macros.h"
+#include "apex_watchdog.h"
+
+/* Why a resume handed control back to the client */
+#define GDB_STOP_STEP 0x0
+#define GDB_STOP_BREAK 0x1
+#define GDB_STOP_WATCH 0x2
+#define GDB_STOP_INTERRUPT 0x3
+#define GDB_STOP_HALT 0x4
+#define GDB_STOP_START 0x5         /* Reverse run reached the start of history */
+#define GDB_STOP_GONE 0x6          /* Client closed the connection */
+
+/* Outcome of one packet */
+#define GDB_SERVE 0x0
+#define GDB_DETACH 0x1
+#define GDB_KILL 0x2
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int
+hex_value(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Registers travel as 8 hex digits, least significant byte first */
+static char *
+put_word(char *out, unsigned value)
+{
+    int i;
+
+    for (i = 0; i < 4; ++i, value >>= 8)
+    {
+        *out++ = hex_digits[(value >> 4) & 0xf];
+        *out++ = hex_digits[value & 0xf];
+    }
+    return out;
+}
+
+static int
+get_word(const char *in, unsigned *value)
+{
+    int i, hi, lo;
+
+    *value = 0;
+    for (i = 0; i < 4; ++i)
+    {
+        hi = hex_value(in[2 * i]);
+        lo = hex_value(in[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+        {
+            return FALSE;
+        }
+        *value |= (unsigned)(hi << 4 | lo) << (8 * i);
+    }
+    return TRUE;
+}
+
+static void
+hex_encode(char *out, const char *text)
+{
+    for (; *text; ++text)
+    {
+        *out++ = hex_digits[((unsigned char)*text) >> 4];
+        *out++ = hex_digits[*text & 0xf];
+    }
+    *out = '\0';
+}
+
+static void
+hex_decode(char *out, int size, const char *hex)
+{
+    int n = 0;
+
+    while (n < size - 1 && hex_value(hex[0]) >= 0 && hex_value(hex[1]) >= 0)
+    {
+        out[n++] = (char)(hex_value(hex[0]) << 4 | hex_value(hex[1]));
+        hex += 2;
+    }
+    out[n] = '\0';
+}
+
+/* pc of the next instruction to retire */
+static int
+gdb_pc(const APEX_CPU *cpu)
+{
+    if (cpu->writeback.has_insn) return cpu->writeback.pc;
+    if (cpu->memory.has_insn) return cpu->memory.pc;
+    if (cpu->execute.has_insn) return cpu->execute.pc;
+    if (cpu->decode.has_insn) return cpu->decode.pc;
+    return cpu->pc;
+}
+
+/* Restarts the pipeline at pc, dropping every in-flight instruction */
+static void
+gdb_redirect(APEX_CPU *cpu, int pc)
+{
+    memset(&cpu->decode, 0, sizeof(CPU_Stage));
+    memset(&cpu->execute, 0, sizeof(CPU_Stage));
+    memset(&cpu->memory, 0, sizeof(CPU_Stage));
+    memset(&cpu->writeback, 0, sizeof(CPU_Stage));
+    memset(cpu->regs_writing, 0, sizeof(cpu->regs_writing));
+    cpu->ex_fb.reg = -1;
+    cpu->mem_fb.reg = -1;
+    cpu->fetch.stalled = 0;
+    cpu->fetch.has_insn = TRUE;
+    cpu->fetch_from_next_cycle = FALSE;
+    cpu->pc = pc;
+}
+
+/*
+ * Called after the client changed the cpu behind the journal's back. The
+ * in-flight instructions read their operands or stored their data before
+ * the change, so they are squashed and fetched again. A halted cpu has
+ * none, and stays halted across the reset.
+ */
+static void
+gdb_state_written(APEX_Gdb *gdb)
+{
+    APEX_CPU *cpu = gdb->cpu;
+
+    if (!gdb->halted)
+    {
+        gdb_redirect(cpu, gdb_pc(cpu));
+    }
+    if (gdb->journal)
+    {
+        APEX_journal_reset(gdb->journal, cpu);
+        if (gdb->halted)
+        {
+            gdb->journal->halt_cycle = cpu->clock;
+        }
+    }
+}
+
+static void
+gdb_sync_halted(APEX_Gdb *gdb)
+{
+    if (gdb->journal)
+    {
+        gdb->halted = gdb->journal->halt_cycle >= 0
+                      && gdb->cpu->clock >= gdb->journal->halt_cycle;
+    }
+}
+
+/*
+ * Packet layer
+ */
+static int
+gdb_getc(APEX_Gdb *gdb)
+{
+    ssize_t n;
+
+    if (gdb->in_pos == gdb->in_len)
+    {
+        n = recv(gdb->fd, gdb->in, sizeof(gdb->in), 0);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        gdb->in_len = (int)n;
+        gdb->in_pos = 0;
+    }
+    return (unsigned char)gdb->in[gdb->in_pos++];
+}
+
+static int
+gdb_write(APEX_Gdb *gdb, const char *data, size_t length)
+{
+    ssize_t n;
+
+    while (length > 0)
+    {
+        n = send(gdb->fd, data, length, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return FALSE;
+        }
+        data += n;
+        length -= n;
+    }
+    return TRUE;
+}
+
+static int
+gdb_send(APEX_Gdb *gdb, const char *data)
+{
+    static char frame[sizeof(((APEX_Gdb *)0)->reply) + 4];
+    unsigned char sum = 0;
+    size_t length = strlen(data), i;
+    int c;
+
+    frame[0] = '$';
+    for (i = 0; i < length; ++i)
+    {
+        frame[i + 1] = data[i];
+        sum += (unsigned char)data[i];
+    }
+    frame[length + 1] = '#';
+    frame[length + 2] = hex_digits[sum >> 4];
+    frame[length + 3] = hex_digits[sum & 0xf];
+
+    for (;;)
+    {
+        if (!gdb_write(gdb, frame, length + 4))
+        {
+            return FALSE;
+        }
+        if (gdb->no_ack)
+        {
+            return TRUE;
+        }
+        do
+        {
+            c = gdb_getc(gdb);
+        } while (c != '+' && c != '-' && c >= 0);
+        if (c != '-')
+        {
+            return c == '+';
+        }
+    }
+}
+
+/*
+ * Reads one packet into gdb->packet. A lone Ctrl-C comes back as "\003".
+ *
+ * Returns FALSE when the client has gone away
+ */
+static int
+gdb_receive(APEX_Gdb *gdb)
+{
+    unsigned char sum;
+    int c, n, check;
+
+    for (;;)
+    {
+        do
+        {
+            c = gdb_getc(gdb);
+            if (c == 0x03)
+            {
+                strcpy(gdb->packet, "\003");
+                return TRUE;
+            }
+        } while (c != '$' && c >= 0);
+        if (c < 0)
+        {
+            return FALSE;
+        }
+
+        sum = 0;
+        n = 0;
+        while ((c = gdb_getc(gdb)) >= 0 && c != '#')
+        {
+            sum += (unsigned char)c;
+            if (c == '}')
+            {
+                c = gdb_getc(gdb);
+                sum += (unsigned char)c;
+                c ^= 0x20;
+            }
+            if (n < APEX_GDB_PACKET_SIZE)
+            {
+                gdb->packet[n++] = (char)c;
+            }
+        }
+        if (c < 0)
+        {
+            return FALSE;
+        }
+        gdb->packet[n] = '\0';
+        check = hex_value(gdb_getc(gdb)) << 4;
+        check |= hex_value(gdb_getc(gdb));
+
+        if (gdb->no_ack)
+        {
+            return TRUE;
+        }
+        if (check == sum)
+        {
+            return gdb_write(gdb, "+", 1);
+        }
+        if (!gdb_write(gdb, "-", 1))
+        {
+            return FALSE;
+        }
+    }
+}
+
+/* Non-blocking check for a Ctrl-C sent while the target runs */
+static int
+gdb_poll_interrupt(APEX_Gdb *gdb)
+{
+    struct pollfd pfd = {gdb->fd, POLLIN, 0};
+    int c;
+
+    if (gdb->in_pos == gdb->in_len && poll(&pfd, 1, 0) <= 0)
+    {
+        return GDB_STOP_STEP;
+    }
+    c = gdb_getc(gdb);
+    if (c < 0)
+    {
+        return GDB_STOP_GONE;
+    }
+    return c == 0x03 ? GDB_STOP_INTERRUPT : GDB_STOP_STEP;
+}
+
+/*
+ * Execution control
+ */
+static int
+gdb_cycle(APEX_Gdb *gdb)
+{
+    int halted = gdb->journal ? APEX_journal_step(gdb->journal, gdb->cpu)
+                              : APEX_cpu_cycle(gdb->cpu);
+
+    if (halted)
+    {
+        gdb->halted = TRUE;
+    }
+    return halted;
+}
+
+static int
+is_breakpoint(const APEX_Gdb *gdb, int pc)
+{
+    int i;
+
+    for (i = 0; i < gdb->num_breaks; ++i)
+    {
+        if (gdb->breaks[i] == pc)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static int
+is_store(const CPU_Stage *stage)
+{
+    return stage->has_insn
+           && (stage->opcode == OPCODE_STORE || stage->opcode == OPCODE_STOREP);
+}
+
+/* Checks a store leaving stage for the watched ranges */
+static int
+is_watched_store(APEX_Gdb *gdb, const CPU_Stage *stage)
+{
+    int i;
+
+    if (!is_store(stage))
+    {
+        return FALSE;
+    }
+    for (i = 0; i < gdb->num_watches; ++i)
+    {
+        if (stage->memory_address >= gdb->watch_lo[i]
+            && stage->memory_address <= gdb->watch_hi[i])
+        {
+            gdb->watch_hit = stage->memory_address;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Runs until a breakpoint pc becomes the next to retire, a watched word is
+ * stored, HALT retires or the client interrupts.
+ */
+static int
+gdb_continue(APEX_Gdb *gdb)
+{
+    APEX_CPU *cpu = gdb->cpu;
+    int last_pc = gdb_pc(cpu), pc, reason, countdown = APEX_GDB_POLL_CYCLES;
+
+    if (gdb->halted)
+    {
+        return GDB_STOP_HALT;
+    }
+
+    for (;;)
+    {
+        if (gdb_cycle(gdb))
+        {
+            return GDB_STOP_HALT;
+        }
+
+        if (gdb->num_breaks > 0 || gdb->num_watches > 0)
+        {
+            /* Stores are done once they reach the writeback latch */
+            if (gdb->num_watches > 0 && is_watched_store(gdb, &cpu->writeback))
+            {
+                return GDB_STOP_WATCH;
+            }
+            pc = gdb_pc(cpu);
+            if (pc != last_pc && is_breakpoint(gdb, pc))
+            {
+                return GDB_STOP_BREAK;
+            }
+            last_pc = pc;
+        }
+
+        if (--countdown == 0)
+        {
+            countdown = APEX_GDB_POLL_CYCLES;
+            reason = gdb_poll_interrupt(gdb);
+            if (reason != GDB_STOP_STEP)
+            {
+                return reason;
+            }
+        }
+    }
+}
+
+/* Runs until one more instruction retires */
+static int
+gdb_step(APEX_Gdb *gdb)
+{
+    APEX_CPU *cpu = gdb->cpu;
+    int retired = cpu->insn_completed, reason, countdown = APEX_GDB_POLL_CYCLES;
+
+    if (gdb->halted)
+    {
+        return GDB_STOP_HALT;
+    }
+
+    while (cpu->insn_completed == retired)
+    {
+        if (gdb_cycle(gdb))
+        {
+            return GDB_STOP_HALT;
+        }
+        if (--countdown == 0)
+        {
+            countdown = APEX_GDB_POLL_CYCLES;
+            reason = gdb_poll_interrupt(gdb);
+            if (reason != GDB_STOP_STEP)
+            {
+                return reason;
+            }
+        }
+    }
+    return GDB_STOP_STEP;
+}
+
+/* Undoes one cycle, rebuilding the ring from a checkpoint when it runs out.
+ * Returns FALSE at the start of history. */
+static int
+gdb_back(APEX_Gdb *gdb)
+{
+    APEX_CPU *cpu = gdb->cpu;
+
+    if (APEX_journal_back(gdb->journal, cpu, 1) == 0)
+    {
+        if (cpu->clock <= gdb->journal->initial->cycle)
+        {
+            return FALSE;
+        }
+        APEX_journal_goto(gdb->journal, cpu, cpu->clock - 1);
+    }
+    return TRUE;
+}
+
+/* Mirror of gdb_continue: stops at the latest earlier state a forward
+ * continue would have stopped in, not counting the current one */
+static int
+gdb_reverse_continue(APEX_Gdb *gdb)
+{
+    APEX_CPU *cpu = gdb->cpu;
+    int next_pc = gdb_pc(cpu), pc, reason = GDB_STOP_START, first = TRUE;
+    int countdown = APEX_GDB_POLL_CYCLES;
+
+    while (gdb_back(gdb))
+    {
+        pc = gdb_pc(cpu);
+        if (first)
+        {
+            first = FALSE;
+        }
+        else if (gdb->num_watches > 0 && is_watched_store(gdb, &cpu->memory))
+        {
+            reason = GDB_STOP_WATCH;
+        }
+        else if (next_pc != pc && is_breakpoint(gdb, next_pc))
+        {
+            reason = GDB_STOP_BREAK;
+        }
+        if (reason != GDB_STOP_START)
+        {
+            APEX_journal_step(gdb->journal, cpu);
+            break;
+        }
+        next_pc = pc;
+
+        if (--countdown == 0)
+        {
+            countdown = APEX_GDB_POLL_CYCLES;
+            reason = gdb_poll_interrupt(gdb);
+            if (reason != GDB_STOP_STEP)
+            {
+                break;
+            }
+            reason = GDB_STOP_START;
+        }
+    }
+    gdb_sync_halted(gdb);
+    return reason;
+}
+
+/* Mirror of gdb_step: back to the state right after the previous retire */
+static int
+gdb_reverse_step(APEX_Gdb *gdb)
+{
+    APEX_CPU *cpu = gdb->cpu;
+    int target = cpu->insn_completed - 1, reason = GDB_STOP_STEP;
+
+    /* Back past the cycle that retired instruction number target */
+    while (cpu->insn_completed >= target)
+    {
+        if (!gdb_back(gdb))
+        {
+            reason = GDB_STOP_START;
+            break;
+        }
+    }
+    if (reason == GDB_STOP_STEP)
+    {
+        APEX_journal_step(gdb->journal, cpu);
+    }
+    gdb_sync_halted(gdb);
+    return reason;
+}
+
+static void
+gdb_stop_reply(APEX_Gdb *gdb, int reason)
+{
+    switch (reason)
+    {
+        case GDB_STOP_WATCH:
+            sprintf(gdb->reply, "T05watch:%x;thread:1;", gdb->watch_hit * 4);
+            break;
+        case GDB_STOP_INTERRUPT:
+            strcpy(gdb->reply, "T02thread:1;");
+            break;
+        case GDB_STOP_START:
+            strcpy(gdb->reply, "T05replaylog:begin;thread:1;");
+            break;
+        case GDB_STOP_HALT:
+            hex_encode(gdb->reply + 1, "HALT retired\n");
+            gdb->reply[0] = 'O';
+            gdb_send(gdb, gdb->reply);
+            /* Fall through */
+        default:
+            strcpy(gdb->reply, "T05thread:1;");
+            break;
+    }
+}
+
+/*
+ * Packet handlers, each leaves its answer in gdb->reply
+ */
+static unsigned
+gdb_read_reg(const APEX_CPU *cpu, int n)
+{
+    if (n == APEX_GDB_PC_REGNUM)
+    {
+        return (unsigned)gdb_pc(cpu);
+    }
+    if (n == APEX_GDB_FLAGS_REGNUM)
+    {
+        return (cpu->cc.z ? 1 : 0) | (cpu->cc.p ? 2 : 0) | (cpu->cc.n ? 4 : 0);
+    }
+    return (unsigned)cpu->regs[n];
+}
+
+static int
+gdb_write_reg(APEX_Gdb *gdb, int n, unsigned value)
+{
+    APEX_CPU *cpu = gdb->cpu;
+    int pc = (int)value;
+
+    if (n == APEX_GDB_PC_REGNUM)
+    {
+        if (pc == gdb_pc(cpu))
+        {
+            return TRUE;
+        }
+        if (pc < 4000 || pc >= 4000 + 4 * cpu->code_memory_size || pc % 4 != 0)
+        {
+            return FALSE;
+        }
+        gdb_redirect(cpu, pc);
+        gdb->halted = FALSE;
+    }
+    else if (n == APEX_GDB_FLAGS_REGNUM)
+    {
+        cpu->cc.z = (value & 1) != 0;
+        cpu->cc.p = (value & 2) != 0;
+        cpu->cc.n = (value & 4) != 0;
+        cpu->zero_flag = cpu->cc.z;
+    }
+    else if (n >= 0 && n < REG_FILE_SIZE)
+    {
+        cpu->regs[n] = (int)value;
+    }
+    else
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+handle_read_regs(APEX_Gdb *gdb)
+{
+    char *out = gdb->reply;
+    int n;
+
+    for (n = 0; n < APEX_GDB_NUM_REGS; ++n)
+    {
+        out = put_word(out, gdb_read_reg(gdb->cpu, n));
+    }
+    *out = '\0';
+}
+
+static void
+handle_write_regs(APEX_Gdb *gdb, const char *args)
+{
+    unsigned value;
+    int n, ok = TRUE;
+
+    for (n = 0; n < APEX_GDB_NUM_REGS && ok; ++n)
+    {
+        ok = get_word(args + 8 * n, &value) && gdb_write_reg(gdb, n, value);
+    }
+    gdb_state_written(gdb);
+    strcpy(gdb->reply, ok ? "OK" : "E01");
+}
+
+static void
+handle_read_reg(APEX_Gdb *gdb, const char *args)
+{
+    int n = (int)strtol(args, NULL, 16);
+
+    if (n < 0 || n >= APEX_GDB_NUM_REGS)
+    {
+        strcpy(gdb->reply, "E01");
+        return;
+    }
+    *put_word(gdb->reply, gdb_read_reg(gdb->cpu, n)) = '\0';
+}
+
+static void
+handle_write_reg(APEX_Gdb *gdb, const char *args)
+{
+    char *value_hex;
+    unsigned value;
+    int n = (int)strtol(args, &value_hex, 16);
+
+    if (*value_hex != '=' || !get_word(value_hex + 1, &value)
+        || !gdb_write_reg(gdb, n, value))
+    {
+        strcpy(gdb->reply, "E01");
+        return;
+    }
+    gdb_state_written(gdb);
+    strcpy(gdb->reply, "OK");
+}
+
+static void
+handle_read_mem(APEX_Gdb *gdb, const char *args)
+{
+    const APEX_CPU *cpu = gdb->cpu;
+    char *out = gdb->reply, *end;
+    long addr = strtol(args, &end, 16), length = 0, i;
+    unsigned byte;
+
+    if (*end == ',')
+    {
+        length = strtol(end + 1, NULL, 16);
+    }
+    if (length > APEX_GDB_PACKET_SIZE / 2)
+    {
+        length = APEX_GDB_PACKET_SIZE / 2;
+    }
+
+    for (i = addr; i < addr + length && i >= 0 && i < 4L * DATA_MEMORY_SIZE; ++i)
+    {
+        byte = ((unsigned)cpu->data_memory[i / 4] >> (8 * (i % 4))) & 0xff;
+        *out++ = hex_digits[byte >> 4];
+        *out++ = hex_digits[byte & 0xf];
+    }
+    *out = '\0';
+    if (out == gdb->reply && length > 0)
+    {
+        strcpy(gdb->reply, "E01");
+    }
+}
+
+static void
+handle_write_mem(APEX_Gdb *gdb, const char *args)
+{
+    APEX_CPU *cpu = gdb->cpu;
+    char *end;
+    long addr = strtol(args, &end, 16), length = 0, i;
+    unsigned word;
+    int hi, lo;
+
+    if (*end == ',')
+    {
+        length = strtol(end + 1, &end, 16);
+    }
+    if (*end != ':' || addr < 0 || addr + length > 4L * DATA_MEMORY_SIZE)
+    {
+        strcpy(gdb->reply, "E01");
+        return;
+    }
+
+    for (i = 0, ++end; i < length; ++i, end += 2)
+    {
+        hi = hex_value(end[0]);
+        lo = hex_value(end[1]);
+        if (hi < 0 || lo < 0)
+        {
+            strcpy(gdb->reply, "E01");
+            return;
+        }
+        word = (unsigned)cpu->data_memory[(addr + i) / 4];
+        word &= ~(0xffu << (8 * ((addr + i) % 4)));
+        word |= (unsigned)(hi << 4 | lo) << (8 * ((addr + i) % 4));
+        cpu->data_memory[(addr + i) / 4] = (int)word;
+    }
+    gdb_state_written(gdb);
+    strcpy(gdb->reply, "OK");
+}
+
+/* Z and z packets: type 0/1 breakpoints, type 2 write watchpoints */
+static void
+handle_point(APEX_Gdb *gdb, const char *args, int insert)
+{
+    char *end;
+    int type = (int)strtol(args, &end, 10), i;
+    long addr = 0, length = 4;
+
+    if (*end == ',')
+    {
+        addr = strtol(end + 1, &end, 16);
+    }
+    if (*end == ',')
+    {
+        length = strtol(end + 1, NULL, 16);
+    }
+
+    if (type == 0 || type == 1)
+    {
+        for (i = 0; i < gdb->num_breaks && gdb->breaks[i] != addr; ++i)
+            ;
+        if (insert && i == gdb->num_breaks)
+        {
+            if (gdb->num_breaks == APEX_GDB_MAX_POINTS)
+            {
+                strcpy(gdb->reply, "E01");
+                return;
+            }
+            gdb->breaks[gdb->num_breaks++] = (int)addr;
+        }
+        else if (!insert && i < gdb->num_breaks)
+        {
+            gdb->breaks[i] = gdb->breaks[--gdb->num_breaks];
+        }
+    }
+    else if (type == 2)
+    {
+        int lo = (int)(addr / 4), hi = (int)((addr + (length > 0 ? length : 1) - 1) / 4);
+
+        for (i = 0; i < gdb->num_watches
+                    && (gdb->watch_lo[i] != lo || gdb->watch_hi[i] != hi); ++i)
+            ;
+        if (insert && i == gdb->num_watches)
+        {
+            if (gdb->num_watches == APEX_GDB_MAX_POINTS)
+            {
+                strcpy(gdb->reply, "E01");
+                return;
+            }
+            gdb->watch_lo[gdb->num_watches] = lo;
+            gdb->watch_hi[gdb->num_watches++] = hi;
+
+            /* A store in the writeback latch is done and would not be
+             * checked again, so it runs again */
+            if (!gdb->halted && is_store(&gdb->cpu->writeback))
+            {
+                gdb_state_written(gdb);
+            }
+        }
+        else if (!insert && i < gdb->num_watches)
+        {
+            --gdb->num_watches;
+            gdb->watch_lo[i] = gdb->watch_lo[gdb->num_watches];
+            gdb->watch_hi[i] = gdb->watch_hi[gdb->num_watches];
+        }
+    }
+    else
+    {
+        gdb->reply[0] = '\0'; /* Read and access watchpoints unsupported */
+        return;
+    }
+    strcpy(gdb->reply, "OK");
+}
+
+static void
+handle_target_xml(APEX_Gdb *gdb, const char *args)
+{
+    static char xml[4096];
+    static int xml_length;
+    long offset, length;
+    char *end;
+    int n;
+
+    if (xml_length == 0)
+    {
+        xml_length = sprintf(xml,
+                             "<?xml version=\"1.0\"?>\n"
+                             "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+                             "<target version=\"1.0\">\n"
+                             "<feature name=\"org.apex.cpu\">\n");
+        for (n = 0; n < REG_FILE_SIZE; ++n)
+        {
+            xml_length += sprintf(xml + xml_length,
+                                  "<reg name=\"r%d\" bitsize=\"32\" type=\"int32\" regnum=\"%d\"/>\n",
+                                  n, n);
+        }
+        xml_length += sprintf(xml + xml_length,
+                              "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\" regnum=\"%d\"/>\n"
+                              "<reg name=\"flags\" bitsize=\"32\" type=\"int32\" regnum=\"%d\"/>\n"
+                              "</feature>\n</target>\n",
+                              APEX_GDB_PC_REGNUM, APEX_GDB_FLAGS_REGNUM);
+    }
+
+    offset = strtol(args, &end, 16);
+    length = *end == ',' ? strtol(end + 1, NULL, 16) : 0;
+    if (length > APEX_GDB_PACKET_SIZE - 1)
+    {
+        length = APEX_GDB_PACKET_SIZE - 1;
+    }
+    if (offset >= xml_length)
+    {
+        strcpy(gdb->reply, "l");
+        return;
+    }
+    if (offset + length > xml_length)
+    {
+        length = xml_length - offset;
+    }
+    gdb->reply[0] = offset + length < xml_length ? 'm' : 'l';
+    memcpy(gdb->reply + 1, xml + offset, length);
+    gdb->reply[length + 1] = '\0';
+}
+
+/* monitor commands, answered as hex encoded console text */
+static void
+handle_monitor(APEX_Gdb *gdb, const char *hex)
+{
+    APEX_CPU *cpu = gdb->cpu;
+    char command[256], text[256], word[32] = "";
+    long count = 1, n;
+
+    hex_decode(command, sizeof(command), hex);
+    sscanf(command, "%31s %ld", word, &count);
+
+    if (strcmp(word, "cycle") == 0)
+    {
+        for (n = 0; n < count && !gdb->halted; ++n)
+        {
+            gdb_cycle(gdb);
+        }
+    }
+    else if (strcmp(word, "goto") == 0 && gdb->journal)
+    {
+        APEX_journal_goto(gdb->journal, cpu, (int)count);
+        gdb_sync_halted(gdb);
+    }
+    else if (strcmp(word, "stats") != 0)
+    {
+        hex_encode(gdb->reply, "monitor cycle [<n>] | goto <cycle> | stats\n");
+        return;
+    }
+
+    snprintf(text, sizeof(text),
+             "cycles = %d instructions = %d stall_cycles = %d branch_flushes = %d%s\n",
+             cpu->clock, cpu->insn_completed, cpu->stall_cycles,
+             cpu->branch_flushes, gdb->halted ? " (halted)" : "");
+    hex_encode(gdb->reply, text);
+}
+
+static void
+handle_query(APEX_Gdb *gdb, const char *packet)
+{
+    if (strncmp(packet, "qSupported", 10) == 0)
+    {
+        sprintf(gdb->reply, "PacketSize=%x;QStartNoAckMode+;qXfer:features:read+%s",
+                APEX_GDB_PACKET_SIZE,
+                gdb->journal ? ";ReverseStep+;ReverseContinue+" : "");
+    }
+    else if (strncmp(packet, "qXfer:features:read:target.xml:", 31) == 0)
+    {
+        handle_target_xml(gdb, packet + 31);
+    }
+    else if (strncmp(packet, "qRcmd,", 6) == 0)
+    {
+        handle_monitor(gdb, packet + 6);
+    }
+    else if (strcmp(packet, "qAttached") == 0)
+    {
+        strcpy(gdb->reply, "1");
+    }
+    else if (strcmp(packet, "qC") == 0)
+    {
+        strcpy(gdb->reply, "QC1");
+    }
+    else if (strcmp(packet, "qfThreadInfo") == 0)
+    {
+        strcpy(gdb->reply, "m1");
+    }
+    else if (strcmp(packet, "qsThreadInfo") == 0)
+    {
+        strcpy(gdb->reply, "l");
+    }
+    else if (strcmp(packet, "qOffsets") == 0)
+    {
+        strcpy(gdb->reply, "Text=0;Data=0;Bss=0");
+    }
+    else if (strncmp(packet, "qSymbol", 7) == 0)
+    {
+        strcpy(gdb->reply, "OK");
+    }
+}
+
+static int
+gdb_handle(APEX_Gdb *gdb)
+{
+    const char *packet = gdb->packet;
+    int reason;
+
+    gdb->reply[0] = '\0';
+    switch (packet[0])
+    {
+        case '\003':
+        case '?':
+            gdb_stop_reply(gdb, packet[0] == '?' ? GDB_STOP_STEP : GDB_STOP_INTERRUPT);
+            break;
+        case 'g':
+            handle_read_regs(gdb);
+            break;
+        case 'G':
+            handle_write_regs(gdb, packet + 1);
+            break;
+        case 'p':
+            handle_read_reg(gdb, packet + 1);
+            break;
+        case 'P':
+            handle_write_reg(gdb, packet + 1);
+            break;
+        case 'm':
+            handle_read_mem(gdb, packet + 1);
+            break;
+        case 'M':
+            handle_write_mem(gdb, packet + 1);
+            break;
+        case 'Z':
+        case 'z':
+            handle_point(gdb, packet + 1, packet[0] == 'Z');
+            break;
+        case 'c':
+        case 's':
+            reason = packet[0] == 'c' ? gdb_continue(gdb) : gdb_step(gdb);
+            if (reason == GDB_STOP_GONE)
+            {
+                return GDB_DETACH;
+            }
+            gdb_stop_reply(gdb, reason);
+            break;
+        case 'b':
+            if (gdb->journal && (packet[1] == 'c' || packet[1] == 's'))
+            {
+                reason = packet[1] == 'c' ? gdb_reverse_continue(gdb)
+                                          : gdb_reverse_step(gdb);
+                if (reason == GDB_STOP_GONE)
+                {
+                    return GDB_DETACH;
+                }
+                gdb_stop_reply(gdb, reason);
+            }
+            break;
+        case 'q':
+            handle_query(gdb, packet);
+            break;
+        case 'Q':
+            if (strcmp(packet, "QStartNoAckMode") == 0)
+            {
+                gdb_send(gdb, "OK");
+                gdb->no_ack = TRUE;
+                return GDB_SERVE;
+            }
+            break;
+        case 'H':
+        case 'T':
+            strcpy(gdb->reply, "OK");
+            break;
+        case 'D':
+            gdb_send(gdb, "OK");
+            return GDB_DETACH;
+        case 'k':
+            return GDB_KILL;
+        case 'v':
+            if (strcmp(packet, "vKill") == 0 || strncmp(packet, "vKill;", 6) == 0)
+            {
+                gdb_send(gdb, "OK");
+                return GDB_KILL;
+            }
+            break;
+    }
+
+    if (!gdb_send(gdb, gdb->reply))
+    {
+        return GDB_DETACH;
+    }
+    return GDB_SERVE;
+}
+
+/*
+ * Opens the listening socket for "<port>" on the loopback interface or
+ * "unix:<path>". Returns the descriptor or -1.
+ */
+static int
+gdb_listen(const char *endpoint)
+{
+    int fd, one = 1;
+
+    if (strncmp(endpoint, "unix:", 5) == 0)
+    {
+        struct sockaddr_un addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, endpoint + 5, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(addr.sun_path);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(fd, 1) < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_in addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((unsigned short)atoi(endpoint));
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(fd, 1) < 0)
+        {
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/*
+ * Waits for one client on endpoint and serves it. Once the client detaches
+ * the program runs to completion, unless the watchdog finds it looping or
+ * still running APEX_GDB_DETACH_CYCLES later; a kill request stops it where
+ * it is.
+ */
+int
+APEX_gdb_main(APEX_CPU *cpu, const char *endpoint)
+{
+    APEX_Gdb *gdb;
+    APEX_Watchdog *watchdog;
+    APEX_Cycle_Fn cycle;
+    int listen_fd, one = 1, outcome = GDB_SERVE;
+
+    listen_fd = gdb_listen(endpoint);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to listen on %s\n", endpoint);
+        return 1;
+    }
+
+    gdb = calloc(1, sizeof(APEX_Gdb));
+    if (!gdb)
+    {
+        close(listen_fd);
+        return 1;
+    }
+    gdb->cpu = cpu;
+    cpu->single_step = FALSE;
+    cpu->debug_messages = FALSE;
+    gdb->journal = APEX_journal_create(cpu, APEX_JOURNAL_RING_WORDS,
+                                       APEX_JOURNAL_CHECKPOINT_INTERVAL,
+                                       APEX_JOURNAL_MAX_CHECKPOINTS);
+
+    fprintf(stderr, "APEX_GDB: Waiting for a client on %s\n", endpoint);
+    gdb->fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    if (strncmp(endpoint, "unix:", 5) == 0)
+    {
+        unlink(endpoint + 5);
+    }
+    if (gdb->fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to accept a client\n");
+        outcome = GDB_KILL;
+    }
+    else
+    {
+        setsockopt(gdb->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fprintf(stderr, "APEX_GDB: Client attached\n");
+    }
+
+    while (outcome == GDB_SERVE)
+    {
+        outcome = gdb_receive(gdb) ? gdb_handle(gdb) : GDB_DETACH;
+    }
+    if (gdb->fd >= 0)
+    {
+        close(gdb->fd);
+    }
+
+    if (outcome == GDB_DETACH && !gdb->halted)
+    {
+        watchdog = APEX_watchdog_create(cpu, cpu->clock + APEX_GDB_DETACH_CYCLES, 0.0);
+        if (!watchdog)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize watchdog\n");
+            outcome = GDB_KILL;
+        }
+        else
+        {
+            fprintf(stderr, "APEX_GDB: Client detached, running to completion\n");
+            cycle = APEX_cpu_cycle_variant(cpu);
+            while (!cycle(cpu))
+            {
+                if (APEX_watchdog_check(watchdog, cpu) != APEX_WATCHDOG_RUNNING)
+                {
+                    APEX_watchdog_print(watchdog, cpu, stderr);
+                    outcome = GDB_KILL;
+                    break;
+                }
+            }
+            APEX_watchdog_destroy(watchdog);
+        }
+    }
+    if (outcome == GDB_DETACH)
+    {
+        printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n",
+               cpu->clock, cpu->insn_completed);
+    }
+    else
+    {
+        printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n",
+               cpu->clock, cpu->insn_completed);
+    }
+
+    if (gdb->journal)
+    {
+        APEX_journal_destroy(gdb->journal);
+    }
+    free(gdb);
+    return 0;
+}
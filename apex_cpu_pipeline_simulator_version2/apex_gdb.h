@@ -0,0 +1,49 @@
+/*
+ * apex_gdb.h
+ * Contains declarations of the GDB remote serial protocol stub
+ */
+#ifndef _APEX_GDB_H_
+#define _APEX_GDB_H_
+
+#include "apex_cpu.h"
+#include "apex_journal.h"
+
+#define APEX_GDB_MAX_POINTS 64
+#define APEX_GDB_PACKET_SIZE 4096
+
+/* Cycles between checks for a Ctrl-C from the client while continuing */
+#define APEX_GDB_POLL_CYCLES 4096
+
+/* Cycles the program may run on after the client detaches */
+#define APEX_GDB_DETACH_CYCLES 100000000L
+
+/* Register numbers seen by the client: R0-R31, then pc and the flags word
+ * (bit 0 zero, bit 1 positive, bit 2 negative) */
+#define APEX_GDB_PC_REGNUM REG_FILE_SIZE
+#define APEX_GDB_FLAGS_REGNUM (REG_FILE_SIZE + 1)
+#define APEX_GDB_NUM_REGS (REG_FILE_SIZE + 2)
+
+/* State of one client connection */
+typedef struct APEX_Gdb
+{
+    APEX_CPU *cpu;
+    APEX_Journal *journal;         /* For reverse step and continue */
+    int fd;
+    int no_ack;                    /* QStartNoAckMode accepted */
+    int halted;
+    int breaks[APEX_GDB_MAX_POINTS];
+    int num_breaks;
+    int watch_lo[APEX_GDB_MAX_POINTS]; /* Data words, inclusive */
+    int watch_hi[APEX_GDB_MAX_POINTS];
+    int num_watches;
+    int watch_hit;                 /* Word stored to when a watch fired */
+    char in[APEX_GDB_PACKET_SIZE];
+    int in_len;
+    int in_pos;
+    char packet[APEX_GDB_PACKET_SIZE + 1];
+    char reply[2 * APEX_GDB_PACKET_SIZE + 8];
+} APEX_Gdb;
+
+int APEX_gdb_main(APEX_CPU *cpu, const char *endpoint);
+
+#endif
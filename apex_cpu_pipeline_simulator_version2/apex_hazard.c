@@ -0,0 +1,595 @@
+/*
+ * apex_hazard.c
+ * Contains the static hazard and critical path analyser
+ *
+ * The analysis walks code memory in order, as if every branch fell
+ * through, and schedules each instruction at the first cycle decode could
+ * read all its operands. An operand is on the EX bus from one cycle after
+ * its producer issued, on the MEM bus from two cycles after, each until
+ * a later instruction drives that bus, and in the register file from
+ * three cycles after, once writeback has run. Which buses apply depends on
+ * the producer and on the forwarding paths. A JUMP, JALR or HALT ends the
+ * path.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_hazard.h"
+#include "apex_simpoint.h"
+
+/*
+ * Returns the cycles after its producer issued that decode can read a
+ * value of the kind given, if no later instruction drives the buses
+ */
+int
+APEX_hazard_ready(int value, int forwarding)
+{
+    if ((forwarding & FORWARD_EX) && (value == APEX_HAZARD_ALU || value == APEX_HAZARD_EX_ONLY))
+    {
+        return 1;
+    }
+    if ((forwarding & FORWARD_MEM) && (value == APEX_HAZARD_ALU || value == APEX_HAZARD_LOAD))
+    {
+        return 2;
+    }
+    return 3;
+}
+
+/* TRUE if executing the instruction drives the EX bus */
+static int
+drives_ex_bus(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_MOVC:
+        case OPCODE_LOADP:
+        case OPCODE_STOREP:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/* TRUE if the memory stage drives or clears the MEM bus for the instruction */
+static int
+drives_mem_bus(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_MOVC:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/*
+ * Tells if decode can read the value producer p wrote at cycle c, when
+ * the instructions between p and the reader issued at the cycles in issue
+ */
+static int
+readable(const APEX_Instruction *code_memory, const int *issue, int p, int reader,
+         int value, int forwarding, int c)
+{
+    int on_ex = (forwarding & FORWARD_EX) && (value == APEX_HAZARD_ALU || value == APEX_HAZARD_EX_ONLY)
+                && c >= issue[p] + 1;
+    int on_mem = (forwarding & FORWARD_MEM) && (value == APEX_HAZARD_ALU || value == APEX_HAZARD_LOAD)
+                 && c >= issue[p] + 2;
+    int q;
+
+    if (c >= issue[p] + 3)
+    {
+        return TRUE;
+    }
+    for (q = p + 1; q < reader; ++q)
+    {
+        if (drives_ex_bus(code_memory[q].opcode) && issue[q] + 1 <= c)
+        {
+            on_ex = FALSE;
+        }
+        if (drives_mem_bus(code_memory[q].opcode) && issue[q] + 2 <= c)
+        {
+            on_mem = FALSE;
+        }
+    }
+    return on_ex || on_mem;
+}
+
+/*
+ * Fills in the registers decode reads as rs1 and rs2, -1 for none
+ */
+void
+APEX_hazard_reads(const APEX_Instruction *ins, int regs[2])
+{
+    regs[0] = regs[1] = -1;
+    switch (ins->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+        case OPCODE_CMP:
+            regs[1] = ins->rs2;
+            /* Fall through */
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_CML:
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+            regs[0] = ins->rs1;
+            break;
+    }
+}
+
+/*
+ * Fills in the registers an instruction writes and their APEX_HAZARD_*
+ * kinds
+ *
+ * Returns how many it writes
+ */
+int
+APEX_hazard_writes(const APEX_Instruction *ins, int regs[2], int values[2])
+{
+    switch (ins->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_MOVC:
+            regs[0] = ins->rd;
+            values[0] = APEX_HAZARD_ALU;
+            return 1;
+        case OPCODE_LOAD:
+            regs[0] = ins->rd;
+            values[0] = APEX_HAZARD_LOAD;
+            return 1;
+        case OPCODE_LOADP:
+            regs[0] = ins->rd;
+            values[0] = APEX_HAZARD_LOAD;
+            regs[1] = ins->rs1;
+            values[1] = APEX_HAZARD_RF;
+            return 2;
+        case OPCODE_STOREP:
+            regs[0] = ins->rs2;
+            values[0] = APEX_HAZARD_EX_ONLY;
+            return 1;
+        case OPCODE_JALR:
+            regs[0] = ins->rd;
+            values[0] = APEX_HAZARD_RF;
+            return 1;
+    }
+    return 0;
+}
+
+static int
+is_branch(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static int
+ends_path(int opcode)
+{
+    return opcode == OPCODE_JUMP || opcode == OPCODE_JALR || opcode == OPCODE_HALT;
+}
+
+/*
+ * Returns the cycle decode issues the instruction at index on the
+ * fall-through path, given the cycles the ones before it issued at
+ */
+int
+APEX_hazard_issue(const APEX_Instruction *code_memory, const int *issue, int index,
+                  int forwarding)
+{
+    int reads[2], writes[2], kinds[2], producer[2], value[2];
+    int num_writes, cycle, waiting, p, s, w;
+
+    if (index == 0 || ends_path(code_memory[index - 1].opcode))
+    {
+        return 0;
+    }
+
+    /* Decode issues at most one a cycle, so a producer three or more
+     * instructions back is in the register file by then */
+    APEX_hazard_reads(&code_memory[index], reads);
+    for (s = 0; s < 2; ++s)
+    {
+        producer[s] = value[s] = -1;
+        for (p = index - 1; reads[s] >= 0 && producer[s] < 0 && p >= 0 && p >= index - 3
+                            && !ends_path(code_memory[p].opcode); --p)
+        {
+            num_writes = APEX_hazard_writes(&code_memory[p], writes, kinds);
+            for (w = 0; w < num_writes; ++w)
+            {
+                if (writes[w] == reads[s])
+                {
+                    producer[s] = p;
+                    value[s] = kinds[w];
+                }
+            }
+        }
+    }
+
+    cycle = issue[index - 1] + 1;
+    do
+    {
+        waiting = FALSE;
+        for (s = 0; s < 2; ++s)
+        {
+            if (producer[s] >= 0
+                && !readable(code_memory, issue, producer[s], index, value[s], forwarding,
+                             cycle))
+            {
+                waiting = TRUE;
+            }
+        }
+        cycle += waiting;
+    } while (waiting);
+    return cycle;
+}
+
+/*
+ * Builds the dependency graph of a program and predicts its decode stalls
+ * and critical paths for the forwarding paths given
+ *
+ * Returns NULL if memory ran out
+ */
+APEX_Hazard *
+APEX_hazard_analyze(const APEX_Instruction *code_memory, int code_memory_size,
+                    int forwarding)
+{
+    APEX_Hazard *hazard = calloc(1, sizeof(APEX_Hazard));
+    int writer[REG_FILE_SIZE], value[REG_FILE_SIZE];
+    int *block_of = NULL, *issue = NULL;
+    int reads[2], writes[2], kinds[2], num_writes, start, i, s, w, p, b, ready;
+
+    if (!hazard)
+    {
+        return NULL;
+    }
+    hazard->code_memory = code_memory;
+    hazard->code_memory_size = code_memory_size;
+    hazard->forwarding = forwarding;
+    hazard->entries = calloc(code_memory_size + 1, sizeof(APEX_Hazard_Entry));
+    hazard->blocks = calloc(code_memory_size + 1, sizeof(APEX_Hazard_Block));
+    block_of = malloc((code_memory_size + 1) * sizeof(int));
+    issue = malloc((code_memory_size + 1) * sizeof(int));
+    if (!hazard->entries || !hazard->blocks || !block_of || !issue)
+    {
+        free(block_of);
+        free(issue);
+        APEX_hazard_destroy(hazard);
+        return NULL;
+    }
+    hazard->num_blocks = APEX_simpoint_blocks(code_memory, code_memory_size, block_of);
+    for (b = 0; b < hazard->num_blocks; ++b)
+    {
+        hazard->blocks[b].first = -1;
+    }
+    for (i = 0; i < code_memory_size; ++i)
+    {
+        b = i + code_memory[i].imm / 4;
+        if (is_branch(code_memory[i].opcode) && b >= 0 && b < code_memory_size)
+        {
+            hazard->entries[b].branch_target = TRUE;
+        }
+    }
+
+    for (i = 0; i < code_memory_size; ++i)
+    {
+        APEX_Hazard_Entry *entry = &hazard->entries[i];
+        APEX_Hazard_Block *block = &hazard->blocks[block_of[i]];
+
+        start = i == 0 || ends_path(code_memory[i - 1].opcode);
+        if (start)
+        {
+            for (s = 0; s < REG_FILE_SIZE; ++s)
+            {
+                writer[s] = -1;
+            }
+        }
+        entry->block = block_of[i];
+        if (block->first < 0)
+        {
+            block->first = i;
+        }
+        block->last = i;
+
+        /* The block's dataflow bound only counts producers inside it */
+        APEX_hazard_reads(&code_memory[i], reads);
+        for (s = 0; s < 2; ++s)
+        {
+            entry->producer[s] = -1;
+            entry->distance[s] = 0;
+            if (reads[s] < 0 || reads[s] >= REG_FILE_SIZE || (p = writer[reads[s]]) < 0)
+            {
+                continue;
+            }
+            ready = APEX_hazard_ready(value[reads[s]], forwarding);
+            entry->producer[s] = p;
+            entry->distance[s] = i - p;
+            if (block_of[p] == block_of[i] && hazard->entries[p].depth + ready > entry->depth)
+            {
+                entry->depth = hazard->entries[p].depth + ready;
+            }
+        }
+
+        issue[i] = APEX_hazard_issue(code_memory, issue, i, forwarding);
+        entry->stall = start ? issue[i] : issue[i] - issue[i - 1] - 1;
+        if (entry->depth + 1 > block->critical_path)
+        {
+            block->critical_path = entry->depth + 1;
+        }
+
+        num_writes = APEX_hazard_writes(&code_memory[i], writes, kinds);
+        for (w = 0; w < num_writes; ++w)
+        {
+            if (writes[w] >= 0 && writes[w] < REG_FILE_SIZE)
+            {
+                writer[writes[w]] = i;
+                value[writes[w]] = kinds[w];
+            }
+        }
+    }
+
+    /* A path only ends at the end of a block, so blocks share one schedule */
+    for (b = 0; b < hazard->num_blocks; ++b)
+    {
+        if (hazard->blocks[b].first >= 0)
+        {
+            hazard->blocks[b].cycles = issue[hazard->blocks[b].last]
+                                       - issue[hazard->blocks[b].first] + 1;
+        }
+    }
+    free(block_of);
+    free(issue);
+    return hazard;
+}
+
+static void
+print_distance(char *buf, size_t size, const APEX_Hazard_Entry *entry, int s)
+{
+    if (entry->producer[s] < 0)
+    {
+        snprintf(buf, size, "-");
+    }
+    else
+    {
+        snprintf(buf, size, "%d@%d", entry->distance[s], 4000 + 4 * entry->producer[s]);
+    }
+}
+
+static const APEX_Hazard *sort_hazard;
+static const APEX_Profile *sort_profile;
+
+static long
+disagreement(int index)
+{
+    long predicted = sort_hazard->entries[index].stall
+                     * sort_profile->entries[index].executed;
+
+    return labs(predicted - sort_profile->entries[index].stall_cycles);
+}
+
+static int
+compare_disagreement(const void *a, const void *b)
+{
+    long da = disagreement(*(const int *)a), db = disagreement(*(const int *)b);
+
+    if (da != db)
+    {
+        return da < db ? 1 : -1;
+    }
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Prints the analysis per instruction and per basic block. With a profile
+ * of a simulated run, the predicted stalls are compared with the cycles
+ * each instruction really stalled.
+ */
+void
+APEX_hazard_print(const APEX_Hazard *hazard, const APEX_Profile *profile, FILE *out)
+{
+    const APEX_Hazard_Entry *entry;
+    char text[192], rs1[24], rs2[24];
+    long predicted = 0, simulated = 0, executed;
+    int *order, num_disagreeing = 0, i;
+
+    fprintf(out, "APEX_HAZARD: %d instructions, %d basic blocks, forwarding=%s\n",
+            hazard->code_memory_size, hazard->num_blocks,
+            APEX_forwarding_name(hazard->forwarding));
+    fprintf(out, "%-5s %5s %10s %10s %5s %5s", "pc", "block", "rs1 raw", "rs2 raw",
+            "stall", "depth");
+    if (profile)
+    {
+        fprintf(out, " %9s %9s %9s", "executed", "predicted", "simulated");
+    }
+    fprintf(out, "  %s\n", "instruction");
+
+    for (i = 0; i < hazard->code_memory_size; ++i)
+    {
+        entry = &hazard->entries[i];
+        APEX_format_instruction(text, sizeof(text), &hazard->code_memory[i]);
+        print_distance(rs1, sizeof(rs1), entry, 0);
+        print_distance(rs2, sizeof(rs2), entry, 1);
+        fprintf(out, "%-5d %5d %10s %10s %5d %5d", 4000 + 4 * i, entry->block, rs1, rs2,
+                entry->stall, entry->depth);
+        if (profile)
+        {
+            executed = profile->entries[i].executed;
+            fprintf(out, " %9ld %9ld %9ld", executed, entry->stall * executed,
+                    profile->entries[i].stall_cycles);
+            predicted += entry->stall * executed;
+            simulated += profile->entries[i].stall_cycles;
+            num_disagreeing += entry->stall * executed != profile->entries[i].stall_cycles;
+        }
+        fprintf(out, "  %s\n", text);
+    }
+
+    fprintf(out, "%-5s %5s %5s %6s %13s %6s\n", "block", "first", "last", "insns",
+            "critical_path", "cycles");
+    for (i = 0; i < hazard->num_blocks; ++i)
+    {
+        const APEX_Hazard_Block *block = &hazard->blocks[i];
+
+        fprintf(out, "%-5d %5d %5d %6d %13d %6d\n", i, 4000 + 4 * block->first,
+                4000 + 4 * block->last, block->last - block->first + 1,
+                block->critical_path, block->cycles);
+    }
+
+    if (!profile)
+    {
+        return;
+    }
+    fprintf(out, "APEX_HAZARD: predicted %ld stall cycles, simulated %ld, %d "
+            "instructions disagree\n", predicted, simulated, num_disagreeing);
+    order = malloc((hazard->code_memory_size + 1) * sizeof(int));
+    if (!order || num_disagreeing == 0)
+    {
+        free(order);
+        return;
+    }
+    for (i = 0; i < hazard->code_memory_size; ++i)
+    {
+        order[i] = i;
+    }
+    sort_hazard = hazard;
+    sort_profile = profile;
+    qsort(order, hazard->code_memory_size, sizeof(int), compare_disagreement);
+    for (i = 0; i < hazard->code_memory_size && i < APEX_HAZARD_REPORTED
+                && disagreement(order[i]) > 0; ++i)
+    {
+        entry = &hazard->entries[order[i]];
+        APEX_format_instruction(text, sizeof(text), &hazard->code_memory[order[i]]);
+        fprintf(out, "APEX_HAZARD: %d predicted %ld simulated %ld  %s%s\n",
+                4000 + 4 * order[i], entry->stall * profile->entries[order[i]].executed,
+                profile->entries[order[i]].stall_cycles, text,
+                entry->branch_target ? " (branch target)" : "");
+    }
+    free(order);
+}
+
+/*
+ * This function deallocates an analysis
+ */
+void
+APEX_hazard_destroy(APEX_Hazard *hazard)
+{
+    free(hazard->entries);
+    free(hazard->blocks);
+    free(hazard);
+}
+
+/*
+ * Entry point of "apex_sim <input_file> hazards <option>...". Options are
+ * data=<image>, forwarding=<none|ex|mem|all>, max_cycles=<n> and static,
+ * which prints the analysis without simulating. Exits with 1 if HALT did
+ * not retire.
+ */
+int
+APEX_hazard_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Mode_Options options;
+    APEX_Hazard *hazard;
+    APEX_Profile *profile;
+    APEX_CPU *cpu;
+    int simulate = TRUE, halted = FALSE, i;
+
+    APEX_mode_defaults(&options, 100000000L);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "static") == 0)
+        {
+            simulate = FALSE;
+        }
+        else if (!APEX_mode_option(&options, "hazards", argv[i]))
+        {
+            return 1;
+        }
+    }
+
+    cpu = APEX_mode_cpu(filename, &options);
+    if (!cpu)
+    {
+        return 1;
+    }
+    hazard = APEX_hazard_analyze(cpu->code_memory, cpu->code_memory_size, options.forwarding);
+    if (!hazard)
+    {
+        fprintf(stderr, "APEX_Error: Unable to analyze %s\n", filename);
+        APEX_cpu_stop(cpu);
+        return 1;
+    }
+    if (!simulate)
+    {
+        APEX_hazard_print(hazard, NULL, stdout);
+        APEX_hazard_destroy(hazard);
+        APEX_cpu_stop(cpu);
+        return 0;
+    }
+
+    profile = APEX_profile_create(cpu);
+    if (!profile)
+    {
+        fprintf(stderr, "APEX_Error: Unable to attach the profiler\n");
+        APEX_hazard_destroy(hazard);
+        APEX_cpu_stop(cpu);
+        return 1;
+    }
+
+    while (cpu->clock < options.max_cycles && !(halted = APEX_profile_cycle(profile, cpu)))
+        ;
+    if (!halted)
+    {
+        fprintf(stderr, "APEX_Error: No HALT within %ld cycles\n", options.max_cycles);
+    }
+    APEX_hazard_print(hazard, profile, stdout);
+
+    APEX_profile_destroy(profile);
+    APEX_hazard_destroy(hazard);
+    APEX_cpu_stop(cpu);
+    return halted ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+/*
+ * apex_hazard.h
+ * Contains declarations of the static hazard and critical path analyser
+ */
+#ifndef _APEX_HAZARD_H_
+#define _APEX_HAZARD_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_profile.h"
+
+/* Disagreements between prediction and simulation listed, worst first */
+#define APEX_HAZARD_REPORTED 10
+
+/* How a written register becomes readable by decode */
+#define APEX_HAZARD_ALU 0x0            /* EX bus, MEM bus, register file */
+#define APEX_HAZARD_LOAD 0x1           /* MEM bus, register file */
+#define APEX_HAZARD_EX_ONLY 0x2        /* EX bus, register file */
+#define APEX_HAZARD_RF 0x3             /* Register file */
+
+/* What the analysis knows about one static instruction */
+typedef struct APEX_Hazard_Entry
+{
+    int block;                     /* Basic block it belongs to */
+    int producer[2];               /* Index of the last writer of rs1/rs2 on
+                                    * the fall-through path, -1 if none */
+    int distance[2];               /* RAW distance to it in instructions */
+    int stall;                     /* Predicted decode stall per execution */
+    int depth;                     /* Earliest issue within its block on
+                                    * dataflow alone, in cycles */
+    int branch_target;             /* TRUE if a branch can reach it; the
+                                    * taken path is not predicted */
+} APEX_Hazard_Entry;
+
+typedef struct APEX_Hazard_Block
+{
+    int first;
+    int last;
+    int critical_path;             /* Cycles from first to last issue plus one,
+                                    * with unlimited issue width */
+    int cycles;                    /* Predicted for in-order single issue */
+} APEX_Hazard_Block;
+
+typedef struct APEX_Hazard
+{
+    const APEX_Instruction *code_memory;
+    int code_memory_size;
+    int forwarding;                /* FORWARD_* the prediction is for */
+    int num_blocks;
+    APEX_Hazard_Entry *entries;    /* One per code memory slot */
+    APEX_Hazard_Block *blocks;
+} APEX_Hazard;
+
+void APEX_hazard_reads(const APEX_Instruction *ins, int regs[2]);
+int APEX_hazard_writes(const APEX_Instruction *ins, int regs[2], int values[2]);
+int APEX_hazard_ready(int value, int forwarding);
+int APEX_hazard_issue(const APEX_Instruction *code_memory, const int *issue, int index,
+                      int forwarding);
+APEX_Hazard *APEX_hazard_analyze(const APEX_Instruction *code_memory,
+                                 int code_memory_size, int forwarding);
+void APEX_hazard_print(const APEX_Hazard *hazard, const APEX_Profile *profile,
+                       FILE *out);
+void APEX_hazard_destroy(APEX_Hazard *hazard);
+
+int APEX_hazard_main(const char *filename, int argc, char const *argv[]);
+
+#endif
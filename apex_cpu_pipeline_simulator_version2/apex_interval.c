@@ -0,0 +1,509 @@
+/*
+ * apex_interval.c
+ * Contains the interval statistics time series
+ *
+ * An observer counts the events of the current interval and closes it at
+ * the end of the cycle that completes it. A closed interval becomes a CSV
+ * row or a binary record in the block being filled. Full blocks go to a
+ * writer thread through a queue the cycle loop only trylocks: when the
+ * thread holds the lock the block waits in a pending list for the next
+ * interval, and a fresh block is taken from the spares or allocated.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_interval.h"
+#include "apex_observer.h"
+
+static int
+get_code_memory_index_from_pc(const int pc)
+{
+    return (pc - 4000) / 4;
+}
+
+/* Charges a decode stall to what decode waits on */
+static void
+count_stall(APEX_Interval_Record *record, const APEX_CPU *cpu, const CPU_Stage *stalled)
+{
+    switch (APEX_observer_stall_cause(cpu, stalled))
+    {
+        case APEX_WAIT_LOAD:
+            record->stall_load++;
+            break;
+        case APEX_WAIT_DEPENDENCY:
+            record->stall_dependency++;
+            break;
+        default:
+            record->stall_other++;
+            break;
+    }
+}
+
+/* Hands the pending blocks to the writer thread and takes back the written
+ * ones, unless the thread holds the queue right now */
+static void
+try_handoff(APEX_Interval_Series *interval)
+{
+    APEX_Interval_Block *spare;
+
+    if (!interval->pending)
+    {
+        return;
+    }
+    if (pthread_mutex_trylock(&interval->lock) != 0)
+    {
+        interval->handoffs_deferred++;
+        return;
+    }
+    *interval->queue_tail = interval->pending;
+    interval->queue_tail = interval->pending_tail;
+    interval->pending = NULL;
+    interval->pending_tail = &interval->pending;
+    spare = interval->recycled;
+    interval->recycled = NULL;
+    pthread_cond_signal(&interval->changed);
+    pthread_mutex_unlock(&interval->lock);
+
+    while (spare)
+    {
+        APEX_Interval_Block *next = spare->next;
+
+        spare->next = interval->spare;
+        interval->spare = spare;
+        spare = next;
+    }
+}
+
+/* Moves the block being filled to the pending list and starts another */
+static void
+next_block(APEX_Interval_Series *interval)
+{
+    APEX_Interval_Block *block = interval->spare;
+
+    if (block)
+    {
+        interval->spare = block->next;
+    }
+    else if (!(block = malloc(sizeof(APEX_Interval_Block))))
+    {
+        /* Out of memory, the rows of the full block are dropped */
+        interval->error = TRUE;
+        interval->block->bytes = 0;
+        return;
+    }
+
+    interval->block->next = NULL;
+    *interval->pending_tail = interval->block;
+    interval->pending_tail = &interval->block->next;
+    block->bytes = 0;
+    interval->block = block;
+    try_handoff(interval);
+}
+
+static void
+put(APEX_Interval_Series *interval, const void *data, size_t bytes)
+{
+    if (interval->block->bytes + bytes > APEX_INTERVAL_BLOCK_SIZE)
+    {
+        next_block(interval);
+    }
+    memcpy(interval->block->data + interval->block->bytes, data, bytes);
+    interval->block->bytes += bytes;
+}
+
+/* Closes the current interval at the cycle the cpu is at */
+static void
+emit(APEX_Interval_Series *interval, const APEX_CPU *cpu)
+{
+    APEX_Interval_Record *record = &interval->current;
+    char row[512];
+    int i, hot = -1, n;
+
+    record->cycles = cpu->clock - record->first_cycle;
+    record->instructions = cpu->insn_completed - interval->start_insns;
+    for (i = 0; i < interval->num_touched; ++i)
+    {
+        int index = interval->touched[i];
+
+        if (hot < 0 || interval->retired[index] > interval->retired[hot])
+        {
+            hot = index;
+        }
+        interval->retired[index] = 0;
+    }
+    interval->num_touched = 0;
+    record->hot_pc = hot >= 0 ? 4000 + 4 * hot : -1;
+
+    if (interval->format == APEX_INTERVAL_BINARY)
+    {
+        put(interval, record, sizeof(APEX_Interval_Record));
+    }
+    else
+    {
+        n = snprintf(row, sizeof(row),
+                     "%ld,%ld,%ld,%ld,%.4f,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%d,%d\n",
+                     record->index, record->first_cycle, record->cycles,
+                     record->instructions,
+                     record->cycles ? (double)record->instructions / record->cycles : 0.0,
+                     record->stall_load, record->stall_dependency, record->stall_other,
+                     record->flushes, record->forward_ex, record->forward_mem,
+                     record->loads, record->stores, record->last_pc, record->hot_pc);
+        put(interval, row, n);
+    }
+
+    i = record->index;
+    memset(record, 0, sizeof(APEX_Interval_Record));
+    record->index = i + 1;
+    record->first_cycle = cpu->clock;
+    record->last_pc = -1;
+    interval->start_insns = cpu->insn_completed;
+}
+
+static void
+on_event(void *context, const APEX_CPU *cpu, const APEX_Event *event)
+{
+    APEX_Interval_Series *interval = context;
+    APEX_Interval_Record *record = &interval->current;
+    int index;
+
+    switch (event->type)
+    {
+        case APEX_EVENT_RETIRE:
+            record->last_pc = event->latch->pc;
+            index = get_code_memory_index_from_pc(event->latch->pc);
+            if (index >= 0 && index < interval->code_memory_size
+                && interval->retired[index]++ == 0)
+            {
+                interval->touched[interval->num_touched++] = index;
+            }
+            break;
+        case APEX_EVENT_STALL:
+            count_stall(record, cpu, event->latch);
+            break;
+        case APEX_EVENT_FLUSH:
+            record->flushes++;
+            break;
+        case APEX_EVENT_FORWARD:
+            if (event->source == OPERAND_EX_FB)
+            {
+                record->forward_ex++;
+            }
+            else
+            {
+                record->forward_mem++;
+            }
+            break;
+        case APEX_EVENT_MEMORY:
+            if (event->is_store)
+            {
+                record->stores++;
+            }
+            else
+            {
+                record->loads++;
+            }
+            break;
+        case APEX_EVENT_CYCLE_END:
+            if (interval->unit == APEX_INTERVAL_CYCLES
+                    ? cpu->clock - record->first_cycle >= interval->length
+                    : cpu->insn_completed - interval->start_insns >= interval->length)
+            {
+                emit(interval, cpu);
+            }
+            break;
+    }
+}
+
+/* Writes queued blocks in order until told to stop with nothing queued */
+static void *
+writer_thread(void *context)
+{
+    APEX_Interval_Series *interval = context;
+    APEX_Interval_Block *blocks, *block, *written;
+
+    pthread_mutex_lock(&interval->lock);
+    while (TRUE)
+    {
+        while (!interval->queue && !interval->stop)
+        {
+            pthread_cond_wait(&interval->changed, &interval->lock);
+        }
+        if (!interval->queue)
+        {
+            break;
+        }
+        blocks = interval->queue;
+        interval->queue = NULL;
+        interval->queue_tail = &interval->queue;
+        pthread_mutex_unlock(&interval->lock);
+
+        written = NULL;
+        while (blocks)
+        {
+            block = blocks;
+            blocks = block->next;
+            if (fwrite(block->data, block->bytes, 1, interval->file) != 1 && block->bytes)
+            {
+                interval->error = TRUE;
+            }
+            block->next = written;
+            written = block;
+        }
+
+        pthread_mutex_lock(&interval->lock);
+        while (written)
+        {
+            block = written;
+            written = block->next;
+            block->next = interval->recycled;
+            interval->recycled = block;
+        }
+    }
+    pthread_mutex_unlock(&interval->lock);
+    return NULL;
+}
+
+static void
+free_blocks(APEX_Interval_Block *block)
+{
+    while (block)
+    {
+        APEX_Interval_Block *next = block->next;
+
+        free(block);
+        block = next;
+    }
+}
+
+static void
+interval_free(APEX_Interval_Series *interval)
+{
+    free_blocks(interval->block);
+    free_blocks(interval->pending);
+    free_blocks(interval->spare);
+    free_blocks(interval->recycled);
+    free(interval->retired);
+    free(interval->touched);
+    if (interval->file)
+    {
+        fclose(interval->file);
+    }
+    free(interval);
+}
+
+/*
+ * This function starts a time series of cpu in the file at path, one entry
+ * per length cycles or retired instructions
+ */
+APEX_Interval_Series *
+APEX_interval_create(APEX_CPU *cpu, const char *path, int unit, long length, int format)
+{
+    APEX_Interval_Series *interval = calloc(1, sizeof(APEX_Interval_Series));
+    APEX_Interval_Header header;
+
+    if (!interval)
+    {
+        return NULL;
+    }
+    interval->unit = unit;
+    interval->format = format;
+    interval->length = length > 0 ? length : APEX_INTERVAL_LENGTH;
+    interval->code_memory_size = cpu->code_memory_size;
+    interval->current.first_cycle = cpu->clock;
+    interval->current.last_pc = -1;
+    interval->start_insns = cpu->insn_completed;
+    interval->pending_tail = &interval->pending;
+    interval->queue_tail = &interval->queue;
+    interval->retired = calloc(cpu->code_memory_size + 1, sizeof(int));
+    interval->touched = malloc((cpu->code_memory_size + 1) * sizeof(int));
+    interval->block = malloc(sizeof(APEX_Interval_Block));
+    interval->file = fopen(path, format == APEX_INTERVAL_BINARY ? "wb" : "w");
+    if (!interval->retired || !interval->touched || !interval->block || !interval->file)
+    {
+        interval_free(interval);
+        return NULL;
+    }
+    interval->block->next = NULL;
+    interval->block->bytes = 0;
+
+    if (format == APEX_INTERVAL_BINARY)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "APEXIVL1", 8);
+        header.record_size = sizeof(APEX_Interval_Record);
+        header.unit = unit;
+        header.length = interval->length;
+        fwrite(&header, sizeof(header), 1, interval->file);
+    }
+    else
+    {
+        fprintf(interval->file, "interval,first_cycle,cycles,instructions,ipc,"
+                "stall_load,stall_dependency,stall_other,flushes,forward_ex,"
+                "forward_mem,loads,stores,last_pc,hot_pc\n");
+    }
+
+    pthread_mutex_init(&interval->lock, NULL);
+    pthread_cond_init(&interval->changed, NULL);
+    if (pthread_create(&interval->thread, NULL, writer_thread, interval) != 0)
+    {
+        pthread_mutex_destroy(&interval->lock);
+        pthread_cond_destroy(&interval->changed);
+        interval_free(interval);
+        return NULL;
+    }
+    if (APEX_observer_add(cpu,
+                          APEX_EVENT_MASK(APEX_EVENT_RETIRE) | APEX_EVENT_MASK(APEX_EVENT_STALL)
+                              | APEX_EVENT_MASK(APEX_EVENT_FLUSH)
+                              | APEX_EVENT_MASK(APEX_EVENT_FORWARD)
+                              | APEX_EVENT_MASK(APEX_EVENT_MEMORY)
+                              | APEX_EVENT_MASK(APEX_EVENT_CYCLE_END),
+                          on_event, interval) < 0)
+    {
+        interval->stop = TRUE;
+        pthread_cond_signal(&interval->changed);
+        pthread_join(interval->thread, NULL);
+        pthread_mutex_destroy(&interval->lock);
+        pthread_cond_destroy(&interval->changed);
+        interval_free(interval);
+        return NULL;
+    }
+    return interval;
+}
+
+/*
+ * Closes the last, partial interval, waits for the writer and detaches
+ * from the cpu
+ *
+ * Returns the number of intervals written, -1 if the file is incomplete
+ */
+int
+APEX_interval_close(APEX_Interval_Series *interval, APEX_CPU *cpu)
+{
+    long count;
+    int error;
+
+    APEX_observer_remove(cpu, on_event, interval);
+    if (cpu->clock > interval->current.first_cycle)
+    {
+        emit(interval, cpu);
+    }
+    count = interval->current.index;
+
+    if (interval->block->bytes)
+    {
+        next_block(interval);
+    }
+    pthread_mutex_lock(&interval->lock);
+    *interval->queue_tail = interval->pending;
+    if (interval->pending)
+    {
+        interval->queue_tail = interval->pending_tail;
+    }
+    interval->pending = NULL;
+    interval->stop = TRUE;
+    pthread_cond_signal(&interval->changed);
+    pthread_mutex_unlock(&interval->lock);
+    pthread_join(interval->thread, NULL);
+    pthread_mutex_destroy(&interval->lock);
+    pthread_cond_destroy(&interval->changed);
+
+    if (fflush(interval->file) != 0)
+    {
+        interval->error = TRUE;
+    }
+    error = interval->error;
+    interval_free(interval);
+    return error ? -1 : (int)count;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> intervals <output_file> <option>...".
+ * Options are data=<image>, forwarding=<none|ex|mem|all>, cycles=<n> or
+ * insns=<n> for the interval length, format=<csv|binary> and
+ * max_cycles=<n>. Runs quietly and exits with 1 if HALT did not retire or
+ * the file could not be written.
+ */
+int
+APEX_interval_main(const char *filename, const char *path, int argc, char const *argv[])
+{
+    APEX_Mode_Options options;
+    APEX_Interval_Series *interval;
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+    int unit = APEX_INTERVAL_CYCLES, format = APEX_INTERVAL_CSV, halted = FALSE, count, i;
+    long length = APEX_INTERVAL_LENGTH, deferred;
+
+    APEX_mode_defaults(&options, 100000000L);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "cycles=", 7) == 0)
+        {
+            unit = APEX_INTERVAL_CYCLES;
+            length = atol(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "insns=", 6) == 0)
+        {
+            unit = APEX_INTERVAL_INSNS;
+            length = atol(argv[i] + 6);
+        }
+        else if (strcmp(argv[i], "format=csv") == 0)
+        {
+            format = APEX_INTERVAL_CSV;
+        }
+        else if (strcmp(argv[i], "format=binary") == 0)
+        {
+            format = APEX_INTERVAL_BINARY;
+        }
+        else if (!APEX_mode_option(&options, "intervals", argv[i]))
+        {
+            return 1;
+        }
+    }
+    if (length < 1)
+    {
+        fprintf(stderr, "APEX_Error: Interval length must be at least 1\n");
+        return 1;
+    }
+
+    cpu = APEX_mode_cpu(filename, &options);
+    if (!cpu)
+    {
+        return 1;
+    }
+
+    interval = APEX_interval_create(cpu, path, unit, length, format);
+    if (!interval)
+    {
+        fprintf(stderr, "APEX_Error: Unable to create %s\n", path);
+        APEX_cpu_stop(cpu);
+        return 1;
+    }
+
+    cycle = APEX_cpu_cycle_variant(cpu);
+    while (cpu->clock < options.max_cycles && !(halted = cycle(cpu)))
+        ;
+    deferred = interval->handoffs_deferred;
+    count = APEX_interval_close(interval, cpu);
+
+    if (halted)
+    {
+        printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n",
+               cpu->clock, cpu->insn_completed);
+    }
+    else
+    {
+        fprintf(stderr, "APEX_Error: No HALT within %ld cycles\n", options.max_cycles);
+    }
+    if (count < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", path);
+    }
+    else
+    {
+        printf("APEX_INTERVAL: %d intervals of %ld %s to %s, %ld handovers deferred\n",
+               count, length, unit == APEX_INTERVAL_CYCLES ? "cycles" : "instructions",
+               path, deferred);
+    }
+    APEX_cpu_stop(cpu);
+    return halted && count >= 0 ? 0 : 1;
+}
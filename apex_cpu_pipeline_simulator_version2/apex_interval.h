@@ -0,0 +1,105 @@
+/*
+ * apex_interval.h
+ * Contains declarations of the interval statistics time series
+ */
+#ifndef _APEX_INTERVAL_H_
+#define _APEX_INTERVAL_H_
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+/* Default interval length */
+#define APEX_INTERVAL_LENGTH 10000
+
+/* What an interval is counted in */
+#define APEX_INTERVAL_CYCLES 0x0
+#define APEX_INTERVAL_INSNS 0x1
+
+/* Output formats */
+#define APEX_INTERVAL_CSV 0x0
+#define APEX_INTERVAL_BINARY 0x1
+
+/* Bytes per output block handed to the writer thread */
+#define APEX_INTERVAL_BLOCK_SIZE (64 * 1024)
+
+/* Counters of one interval, also the record of a binary file */
+typedef struct APEX_Interval_Record
+{
+    long index;
+    long first_cycle;              /* The interval covers the cycles after it */
+    long cycles;
+    long instructions;
+    long stall_load;               /* Decode waited on a load's result */
+    long stall_dependency;         /* ... on any other instruction in flight */
+    long stall_other;              /* ... on a register nothing in flight writes */
+    long flushes;
+    long forward_ex;               /* Operands issued off the EX bus */
+    long forward_mem;              /* ... and off the MEM bus */
+    long loads;
+    long stores;
+    int last_pc;                   /* Last instruction retired, -1 if none */
+    int hot_pc;                    /* Instruction retired most often, -1 if none */
+} APEX_Interval_Record;
+
+/* Header of a binary file, followed by the records */
+typedef struct APEX_Interval_Header
+{
+    char magic[8];                 /* "APEXIVL1" */
+    int record_size;
+    int unit;                      /* APEX_INTERVAL_CYCLES or _INSNS */
+    long length;
+} APEX_Interval_Header;
+
+typedef struct APEX_Interval_Block
+{
+    struct APEX_Interval_Block *next;
+    size_t bytes;
+    char data[APEX_INTERVAL_BLOCK_SIZE];
+} APEX_Interval_Block;
+
+/*
+ * Snapshots the counters of a cpu every length cycles or retired
+ * instructions. Rows are formatted into blocks that a background thread
+ * writes; the cycle loop only ever trylocks the queue, and keeps blocks it
+ * could not hand over until the next time, so a slow disk costs memory
+ * instead of stalling the simulation.
+ */
+typedef struct APEX_Interval_Series
+{
+    int unit;
+    int format;
+    long length;
+    APEX_Interval_Record current;
+    long start_insns;              /* insn_completed when current began */
+    int *retired;                  /* Per code memory index, this interval */
+    int *touched;                  /* Indexes retired is non-zero at */
+    int num_touched;
+    int code_memory_size;
+
+    FILE *file;
+    APEX_Interval_Block *block;    /* Being filled */
+    APEX_Interval_Block *pending;  /* Full, not handed over yet */
+    APEX_Interval_Block **pending_tail;
+    APEX_Interval_Block *spare;    /* Empty, owned by the producer */
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    APEX_Interval_Block *queue;    /* Full, for the writer thread */
+    APEX_Interval_Block **queue_tail;
+    APEX_Interval_Block *recycled; /* Written, back from the thread */
+    int stop;
+    int error;
+    long handoffs_deferred;        /* Handovers that found the queue busy */
+} APEX_Interval_Series;
+
+APEX_Interval_Series *APEX_interval_create(APEX_CPU *cpu, const char *path, int unit,
+                                    long length, int format);
+int APEX_interval_close(APEX_Interval_Series *interval, APEX_CPU *cpu);
+
+int APEX_interval_main(const char *filename, const char *path, int argc,
+                       char const *argv[]);
+
+#endif
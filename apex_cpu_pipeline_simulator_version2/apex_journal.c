@@ -0,0 +1,375 @@
+/*
+ * apex_journal.c
+ * Contains the undo journal used for reverse execution
+ *
+ * Each cycle records the words of APEX_CPU it changed. Data memory is left
+ * out of the per-cycle compare: only a store in the memory stage can touch
+ * it, so that word is captured individually. The store address log needs no
+ * record at all, it only grows and every copy reads it up to its own
+ * data_counter, which is compared. Stepping back applies records in
+ * reverse, long jumps restore the nearest checkpoint and simulate forward
+ * from there.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_journal.h"
+#include "apex_macros.h"
+
+/* APEX_CPU is read and patched as an array of 32-bit words */
+typedef unsigned apex_word __attribute__((may_alias));
+
+#define CPU_WORDS (sizeof(APEX_CPU) / sizeof(apex_word))
+#define WORD_OFFSET(field) (offsetof(APEX_CPU, field) / sizeof(apex_word))
+
+#define RUN_HEADER(offset, count) (((unsigned)(offset) << 16) | (unsigned)(count))
+#define RUN_OFFSET(header) ((header) >> 16)
+#define RUN_COUNT(header) ((header) & 0xffff)
+
+/* Words of APEX_CPU compared every cycle, all those before data memory */
+#define COMPARED_WORDS WORD_OFFSET(data_memory)
+
+static unsigned
+ring_get(const APEX_Journal *journal, long pos)
+{
+    return journal->ring[pos % journal->capacity];
+}
+
+static void
+ring_put(APEX_Journal *journal, long pos, unsigned value)
+{
+    journal->ring[pos % journal->capacity] = value;
+}
+
+/* XORs one record into the cpu, which undoes or redoes it */
+static void
+journal_apply(APEX_Journal *journal, APEX_CPU *cpu, long start)
+{
+    apex_word *words = (apex_word *)cpu;
+    long pos = start + 2;
+    long end = start + 2 + ring_get(journal, start);
+    unsigned header, i;
+
+    while (pos < end)
+    {
+        header = ring_get(journal, pos++);
+        for (i = 0; i < RUN_COUNT(header); ++i)
+        {
+            words[RUN_OFFSET(header) + i] ^= ring_get(journal, pos++);
+        }
+    }
+}
+
+/* Keeps settings the user changes between cycles out of time travel, and
+ * the live store address log and observers */
+static void
+journal_restore(APEX_CPU *cpu, const APEX_CPU *saved)
+{
+    int single_step = cpu->single_step;
+    int debug_messages = cpu->debug_messages;
+    int *mem_address = cpu->mem_address;
+    int mem_address_size = cpu->mem_address_size;
+    struct APEX_Observers *observers = cpu->observers;
+
+    *cpu = *saved;
+    cpu->single_step = single_step;
+    cpu->debug_messages = debug_messages;
+    cpu->mem_address = mem_address;      /* Saved copies may hold a stale one */
+    cpu->mem_address_size = mem_address_size;
+    cpu->observers = observers;
+}
+
+static APEX_Checkpoint *
+journal_find_checkpoint(APEX_Journal *journal, int cycle)
+{
+    APEX_Checkpoint *best = journal->initial;
+    int i;
+
+    for (i = 0; i < journal->num_checkpoints; ++i)
+    {
+        APEX_Checkpoint *cp = &journal->checkpoints[i];
+
+        if (cp->cycle <= cycle && cp->cycle > best->cycle)
+        {
+            best = cp;
+        }
+    }
+    return best;
+}
+
+static void
+journal_save_checkpoint(APEX_Journal *journal, const APEX_CPU *cpu)
+{
+    APEX_Checkpoint *cp;
+    int i;
+
+    for (i = 0; i < journal->num_checkpoints; ++i)
+    {
+        if (journal->checkpoints[i].cycle == cpu->clock)
+        {
+            return; /* Replaying over a cycle that already has one */
+        }
+    }
+
+    cp = &journal->checkpoints[journal->next_checkpoint];
+    cp->cycle = cpu->clock;
+    cp->cpu = *cpu;
+    journal->next_checkpoint = (journal->next_checkpoint + 1) % journal->max_checkpoints;
+    if (journal->num_checkpoints < journal->max_checkpoints)
+    {
+        journal->num_checkpoints++;
+    }
+}
+
+/* Empties the ring and makes the cpu the new head of history */
+static void
+journal_clear_ring(APEX_Journal *journal, const APEX_CPU *cpu)
+{
+    journal->tail = journal->head = journal->cur;
+    journal->base_cycle = journal->head_cycle = cpu->clock;
+    *journal->shadow = *cpu;
+}
+
+/* Appends the record built in scratch, evicting the oldest as needed */
+static void
+journal_append(APEX_Journal *journal, const APEX_CPU *cpu, long length)
+{
+    long total = length + 3, i;
+
+    if (total > journal->capacity)
+    {
+        /* A single cycle larger than the ring, history restarts here */
+        journal_clear_ring(journal, cpu);
+        return;
+    }
+
+    while (journal->head + total - journal->tail > journal->capacity)
+    {
+        journal->base_cycle = (int)ring_get(journal, journal->tail + 1);
+        journal->tail += ring_get(journal, journal->tail) + 3;
+    }
+
+    ring_put(journal, journal->head, (unsigned)length);
+    ring_put(journal, journal->head + 1, (unsigned)cpu->clock);
+    for (i = 0; i < length; ++i)
+    {
+        ring_put(journal, journal->head + 2 + i, journal->scratch[i]);
+    }
+    ring_put(journal, journal->head + 2 + length, (unsigned)length);
+
+    journal->head += total;
+    journal->cur = journal->head;
+    journal->head_cycle = cpu->clock;
+}
+
+/* Simulates one cycle and records what it changed */
+static int
+journal_live_cycle(APEX_Journal *journal, APEX_CPU *cpu)
+{
+    apex_word *words = (apex_word *)cpu;
+    apex_word *shadow = (apex_word *)journal->shadow;
+    long length = 0, w, run;
+    int halted;
+
+    journal->store_address = -1;
+    if (cpu->memory.has_insn
+        && (cpu->memory.opcode == OPCODE_STORE || cpu->memory.opcode == OPCODE_STOREP)
+        && cpu->memory.memory_address >= 0
+        && cpu->memory.memory_address < DATA_MEMORY_SIZE)
+    {
+        journal->store_address = cpu->memory.memory_address;
+        journal->store_old = cpu->data_memory[journal->store_address];
+    }
+
+    halted = APEX_cpu_cycle(cpu);
+
+    for (w = 0; w < (long)COMPARED_WORDS; ++w)
+    {
+        if (words[w] == shadow[w])
+        {
+            continue;
+        }
+        run = length++;
+        while (w < (long)COMPARED_WORDS && words[w] != shadow[w]
+               && RUN_COUNT(length - run) < 0xffff)
+        {
+            journal->scratch[length++] = words[w] ^ shadow[w];
+            shadow[w] = words[w];
+            w++;
+        }
+        journal->scratch[run] = RUN_HEADER(w - (length - run - 1), length - run - 1);
+        w--; /* Resume the scan at the word that ended the run */
+    }
+
+    if (journal->store_address >= 0
+        && cpu->data_memory[journal->store_address] != journal->store_old)
+    {
+        journal->scratch[length++] = RUN_HEADER(WORD_OFFSET(data_memory) + journal->store_address, 1);
+        journal->scratch[length++] = (unsigned)(cpu->data_memory[journal->store_address] ^ journal->store_old);
+    }
+
+    journal_append(journal, cpu, length);
+
+    if (halted)
+    {
+        journal->halt_cycle = cpu->clock;
+    }
+    if (cpu->clock % journal->checkpoint_interval == 0)
+    {
+        journal_save_checkpoint(journal, cpu);
+    }
+    return halted;
+}
+
+/*
+ * This function starts a history at the current state of cpu
+ */
+APEX_Journal *
+APEX_journal_create(const APEX_CPU *cpu, long ring_words,
+                    int checkpoint_interval, int max_checkpoints)
+{
+    APEX_Journal *journal = calloc(1, sizeof(APEX_Journal));
+
+    if (!journal)
+    {
+        return NULL;
+    }
+
+    journal->capacity = ring_words > 0 ? ring_words : APEX_JOURNAL_RING_WORDS;
+    journal->checkpoint_interval = checkpoint_interval > 0 ? checkpoint_interval
+                                                           : APEX_JOURNAL_CHECKPOINT_INTERVAL;
+    journal->max_checkpoints = max_checkpoints > 0 ? max_checkpoints
+                                                   : APEX_JOURNAL_MAX_CHECKPOINTS;
+    journal->ring = malloc(journal->capacity * sizeof(unsigned));
+    journal->scratch = malloc((2 * CPU_WORDS + 8) * sizeof(unsigned));
+    journal->shadow = malloc(sizeof(APEX_CPU));
+    journal->initial = malloc(sizeof(APEX_Checkpoint));
+    journal->checkpoints = malloc(journal->max_checkpoints * sizeof(APEX_Checkpoint));
+    if (!journal->ring || !journal->scratch || !journal->shadow
+        || !journal->initial || !journal->checkpoints)
+    {
+        APEX_journal_destroy(journal);
+        return NULL;
+    }
+
+    APEX_journal_reset(journal, cpu);
+    return journal;
+}
+
+/*
+ * Drops all history and starts again from the current state of cpu. Needed
+ * whenever the cpu is changed by anything but a simulated cycle.
+ */
+void
+APEX_journal_reset(APEX_Journal *journal, const APEX_CPU *cpu)
+{
+    journal->cur = journal->head;
+    journal_clear_ring(journal, cpu);
+    journal->halt_cycle = -1;
+    journal->num_checkpoints = 0;
+    journal->next_checkpoint = 0;
+    journal->initial->cycle = cpu->clock;
+    journal->initial->cpu = *cpu;
+}
+
+/*
+ * Moves forward one cycle, replaying recorded history when the cpu is behind
+ * the newest recorded cycle and simulating otherwise.
+ *
+ * Returns TRUE if HALT retires in that cycle
+ */
+int
+APEX_journal_step(APEX_Journal *journal, APEX_CPU *cpu)
+{
+    if (journal->cur < journal->head)
+    {
+        journal_apply(journal, cpu, journal->cur);
+        journal->cur += ring_get(journal, journal->cur) + 3;
+        return cpu->clock == journal->halt_cycle;
+    }
+
+    if (cpu->clock != journal->head_cycle)
+    {
+        /* Moved past the ring by a checkpoint restore, record from here */
+        journal_clear_ring(journal, cpu);
+    }
+    return journal_live_cycle(journal, cpu);
+}
+
+/*
+ * Undoes up to cycles cycles from the ring.
+ *
+ * Returns the number of cycles undone, less than asked at the ring's start
+ */
+int
+APEX_journal_back(APEX_Journal *journal, APEX_CPU *cpu, int cycles)
+{
+    int done = 0;
+    long start;
+
+    while (done < cycles && journal->cur > journal->tail)
+    {
+        start = journal->cur - ring_get(journal, journal->cur - 1) - 3;
+        journal_apply(journal, cpu, start);
+        journal->cur = start;
+        done++;
+    }
+    return done;
+}
+
+/*
+ * Moves the cpu to the end of the given cycle, through the ring when it is
+ * covered and from the nearest earlier checkpoint otherwise.
+ *
+ * Returns the cycle reached, which is earlier if HALT retires first
+ */
+int
+APEX_journal_goto(APEX_Journal *journal, APEX_CPU *cpu, int cycle)
+{
+    APEX_Checkpoint *cp;
+
+    if (cycle < cpu->clock)
+    {
+        if (cycle >= journal->base_cycle)
+        {
+            APEX_journal_back(journal, cpu, cpu->clock - cycle);
+        }
+        else
+        {
+            cp = journal_find_checkpoint(journal, cycle);
+            journal_restore(cpu, &cp->cpu);
+            journal->cur = journal->head;
+            journal_clear_ring(journal, cpu);
+        }
+    }
+
+    while (cpu->clock < cycle && cpu->clock != journal->halt_cycle)
+    {
+        APEX_journal_step(journal, cpu);
+    }
+    return cpu->clock;
+}
+
+/*
+ * Words of the ring holding history, for reporting
+ */
+long
+APEX_journal_words_used(const APEX_Journal *journal)
+{
+    return journal->head - journal->tail;
+}
+
+/*
+ * This function deallocates the journal
+ */
+void
+APEX_journal_destroy(APEX_Journal *journal)
+{
+    free(journal->ring);
+    free(journal->scratch);
+    free(journal->shadow);
+    free(journal->initial);
+    free(journal->checkpoints);
+    free(journal);
+}
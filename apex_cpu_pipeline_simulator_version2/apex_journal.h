@@ -0,0 +1,66 @@
+/*
+ * apex_journal.h
+ * Contains declarations of the undo journal used for reverse execution
+ */
+#ifndef _APEX_JOURNAL_H_
+#define _APEX_JOURNAL_H_
+
+#include "apex_cpu.h"
+
+/* Defaults: 4M words (16 MB) of deltas, a checkpoint every 4096 cycles and
+ * 64 checkpoints (about 1 MB) besides the pinned initial state */
+#define APEX_JOURNAL_RING_WORDS (4L << 20)
+#define APEX_JOURNAL_CHECKPOINT_INTERVAL 4096
+#define APEX_JOURNAL_MAX_CHECKPOINTS 64
+
+/* Full copy of the cpu taken at the end of a cycle */
+typedef struct APEX_Checkpoint
+{
+    int cycle;
+    APEX_CPU cpu;
+} APEX_Checkpoint;
+
+/*
+ * History of one cpu. Every cycle appends one record to a ring of words:
+ *
+ *   [length] [cycle] { [offset << 16 | count] [xor]*count }* [length]
+ *
+ * where offsets are word offsets into APEX_CPU and each xor is old ^ new, so
+ * a record can be applied in either direction. The ring covers the cycles
+ * (base_cycle, head_cycle]; older cycles are rebuilt from the checkpoints.
+ */
+typedef struct APEX_Journal
+{
+    unsigned *ring;
+    long capacity;                 /* Words in the ring */
+    long tail;                     /* Oldest record, positions grow forever */
+    long head;                     /* One past the newest record */
+    long cur;                      /* Boundary matching the cpu's cycle */
+    int base_cycle;
+    int head_cycle;
+    int halt_cycle;                /* Cycle HALT retired in, -1 if not yet */
+
+    APEX_CPU *shadow;              /* Cpu words as of head_cycle */
+    unsigned *scratch;             /* Record being built */
+
+    APEX_Checkpoint *initial;      /* State before the first cycle, pinned */
+    APEX_Checkpoint *checkpoints;  /* Ring of the most recent checkpoints */
+    int max_checkpoints;
+    int num_checkpoints;
+    int next_checkpoint;
+    int checkpoint_interval;
+
+    int store_address;             /* Captured before each live cycle */
+    int store_old;
+} APEX_Journal;
+
+APEX_Journal *APEX_journal_create(const APEX_CPU *cpu, long ring_words,
+                                  int checkpoint_interval, int max_checkpoints);
+int APEX_journal_step(APEX_Journal *journal, APEX_CPU *cpu);
+int APEX_journal_back(APEX_Journal *journal, APEX_CPU *cpu, int cycles);
+int APEX_journal_goto(APEX_Journal *journal, APEX_CPU *cpu, int cycle);
+void APEX_journal_reset(APEX_Journal *journal, const APEX_CPU *cpu);
+long APEX_journal_words_used(const APEX_Journal *journal);
+void APEX_journal_destroy(APEX_Journal *journal);
+
+#endif
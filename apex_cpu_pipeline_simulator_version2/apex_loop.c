@@ -0,0 +1,638 @@
+/*
+ * apex_loop.c
+ * Contains the steady-state loop extrapolator
+ *
+ * The pipeline has no caches or predictors, so once its timing state at a
+ * back-edge recurs and the next iteration takes the same path, that
+ * iteration costs exactly what the previous one did. After a few such
+ * iterations in detail, the functional model runs the following ones,
+ * checking every pc against the recorded path, and the counters advance by
+ * the per-iteration deltas. The pipeline is then set to the state it
+ * would have reached and simulation goes on in detail.
+ *
+ * Detection costs a signature at every back-edge and, while tracking, a
+ * functional step per instruction and a state comparison per back-edge.
+ * The shadow starts from a copy of data memory, after which only the words
+ * either side stored to are compared or copied back.
+ * A loop that takes APEX_LOOP_PATIENCE back-edges without being
+ * extrapolated has its next back-edges skipped, twice as many after each
+ * further miss, so loops that never settle cost little.
+ *
+ * Values stay in flight across a back-edge: the instruction in writeback
+ * and the forwarding buses. The writeback latch is rewritten from the
+ * functional state; a bus is only carried over if it held the value of
+ * its register, or did not change, at every back-edge seen in detail.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_loop.h"
+
+static void
+make_signature(const APEX_CPU *cpu, APEX_Loop_Signature *sig)
+{
+    memset(sig, 0, sizeof(APEX_Loop_Signature));
+    sig->pc = cpu->pc;
+    sig->fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+    sig->fetch_pc = cpu->fetch.pc;
+    sig->fetch_has_insn = cpu->fetch.has_insn;
+    sig->fetch_stalled = cpu->fetch.stalled;
+    sig->decode_has_insn = cpu->decode.has_insn;
+    sig->decode_stalled = cpu->decode.stalled;
+    sig->execute_has_insn = cpu->execute.has_insn;
+    sig->memory_pc = cpu->memory.pc;
+    sig->writeback_has_insn = cpu->writeback.has_insn;
+    sig->writeback_pc = cpu->writeback.has_insn ? cpu->writeback.pc : 0;
+    sig->ex_fb_reg = cpu->ex_fb.reg;
+    sig->mem_fb_reg = cpu->mem_fb.reg;
+    memcpy(sig->regs_writing, cpu->regs_writing, sizeof(sig->regs_writing));
+}
+
+/* Register writes a latch makes in writeback, as APEX_writeback does them */
+static void
+apply_writeback(int *regs, const CPU_Stage *stage)
+{
+    if (!stage->has_insn)
+    {
+        return;
+    }
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_LOAD:
+        case OPCODE_MOVC:
+        case OPCODE_JALR:
+            regs[stage->rd] = stage->result_buffer;
+            break;
+        case OPCODE_LOADP:
+            regs[stage->rd] = stage->result_buffer;
+            regs[stage->rs1] = stage->rs1_value;
+            break;
+        case OPCODE_STOREP:
+            regs[stage->rs2] = stage->rs2_value;
+            break;
+    }
+}
+
+/* Rewrites a writeback latch so that it writes what regs already holds */
+static void
+patch_writeback(CPU_Stage *stage, const int *regs)
+{
+    if (!stage->has_insn)
+    {
+        return;
+    }
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_LOAD:
+        case OPCODE_MOVC:
+        case OPCODE_JALR:
+            stage->result_buffer = regs[stage->rd];
+            break;
+        case OPCODE_LOADP:
+            stage->result_buffer = regs[stage->rd];
+            stage->rs1_value = regs[stage->rs1];
+            break;
+        case OPCODE_STOREP:
+            stage->rs2_value = regs[stage->rs2];
+            break;
+    }
+}
+
+/* Architectural registers once the latches past execute have retired */
+static void
+retired_regs(const APEX_CPU *cpu, int *regs)
+{
+    memcpy(regs, cpu->regs, sizeof(cpu->regs));
+    apply_writeback(regs, &cpu->writeback);
+    apply_writeback(regs, &cpu->memory);
+}
+
+static void
+read_counters(const APEX_CPU *cpu, APEX_Loop_Delta *counters)
+{
+    counters->clock = cpu->clock;
+    counters->insn_completed = cpu->insn_completed;
+    counters->stall_cycles = cpu->stall_cycles;
+    counters->branch_flushes = cpu->branch_flushes;
+}
+
+/* Loads the shadow with the state of the cpu at a back-edge */
+static void
+start_tracking(APEX_Loop *loop, const APEX_CPU *cpu)
+{
+    APEX_Func *shadow = loop->shadow;
+
+    retired_regs(cpu, shadow->regs);
+    memcpy(shadow->data_memory, cpu->data_memory, sizeof(shadow->data_memory));
+    shadow->cc = cpu->cc;
+    shadow->pc = cpu->pc;
+    shadow->status = APEX_FUNC_RUNNING;
+    loop->tracking = TRUE;
+    loop->matches = 0;
+    loop->period_length = 0;
+    loop->num_stored = 0;
+}
+
+/* TRUE if the shadow holds the architectural state of the cpu. Memory
+ * matched at the previous back-edge, so only the words stored since can
+ * differ. */
+static int
+shadow_matches(const APEX_Loop *loop, const APEX_CPU *cpu)
+{
+    int regs[REG_FILE_SIZE];
+    int i;
+
+    retired_regs(cpu, regs);
+    if (loop->shadow->pc != cpu->pc
+        || loop->shadow->cc.z != cpu->cc.z || loop->shadow->cc.p != cpu->cc.p
+        || loop->shadow->cc.n != cpu->cc.n
+        || memcmp(loop->shadow->regs, regs, sizeof(regs)) != 0)
+    {
+        return FALSE;
+    }
+    for (i = 0; i < loop->num_stored; ++i)
+    {
+        if (loop->shadow->data_memory[loop->stored[i]] != cpu->data_memory[loop->stored[i]])
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Notes the address a store is about to write, if it is in data memory */
+static void
+note_store(APEX_Loop *loop, const CPU_Stage *stage, int address)
+{
+    if ((stage->opcode == OPCODE_STORE || stage->opcode == OPCODE_STOREP)
+        && address >= 0 && address < DATA_MEMORY_SIZE)
+    {
+        if (loop->num_stored == 2 * APEX_LOOP_MAX_PATH)
+        {
+            loop->tracking = FALSE;
+            return;
+        }
+        loop->stored[loop->num_stored++] = address;
+    }
+}
+
+/*
+ * Runs one more iteration of the period on the shadow
+ *
+ * Returns the number of stores it made, or -1 with the shadow rolled back
+ * if the iteration left the period
+ */
+static int
+shadow_iteration(APEX_Loop *loop)
+{
+    APEX_Func *shadow = loop->shadow;
+    const APEX_Instruction *ins;
+    int regs[REG_FILE_SIZE];
+    condition_code cc = shadow->cc;
+    long insn_completed = shadow->insn_completed;
+    int pc = shadow->pc, stores = 0, address, i;
+
+    memcpy(regs, shadow->regs, sizeof(regs));
+    for (i = 0; i < loop->period_length; ++i)
+    {
+        if (shadow->pc != loop->period[i])
+        {
+            break;
+        }
+        ins = &shadow->code_memory[(shadow->pc - 4000) / 4];
+        if (ins->opcode == OPCODE_STORE || ins->opcode == OPCODE_STOREP)
+        {
+            address = shadow->regs[ins->rs2] + ins->imm;
+            if (address >= 0 && address < DATA_MEMORY_SIZE)
+            {
+                loop->undo_address[stores] = address;
+                loop->undo_value[stores++] = shadow->data_memory[address];
+            }
+        }
+        if (!APEX_func_step(shadow))
+        {
+            break;
+        }
+    }
+    if (i == loop->period_length && shadow->pc == loop->period[0])
+    {
+        return stores;
+    }
+
+    while (stores > 0)
+    {
+        stores--;
+        shadow->data_memory[loop->undo_address[stores]] = loop->undo_value[stores];
+    }
+    memcpy(shadow->regs, regs, sizeof(regs));
+    shadow->cc = cc;
+    shadow->pc = pc;
+    shadow->insn_completed = insn_completed;
+    shadow->status = APEX_FUNC_RUNNING;
+    return -1;
+}
+
+/* Runs the rest of a confirmed loop on the shadow and moves the cpu there */
+static void
+extrapolate(APEX_Loop *loop, APEX_CPU *cpu)
+{
+    forward_bus *bus[2] = {&cpu->ex_fb, &cpu->mem_fb};
+    long limit = -1, k = 0;
+    int stores, b, i;
+
+    if (loop->delta.clock <= 0)
+    {
+        return;
+    }
+    for (b = 0; b < 2; ++b)
+    {
+        if (bus[b]->reg >= 0 && bus[b]->reg < REG_FILE_SIZE
+            && !loop->bus_arch[b] && !loop->bus_const[b])
+        {
+            return;
+        }
+    }
+    if (loop->max_clock > 0)
+    {
+        limit = (loop->max_clock - cpu->clock) / loop->delta.clock;
+    }
+
+    while ((limit < 0 || k < limit) && (stores = shadow_iteration(loop)) >= 0)
+    {
+        /* Execute logs store addresses for the final memory dump */
+        for (i = 0; i < stores; ++i)
+        {
+            APEX_cpu_log_store(cpu, loop->undo_address[i]);
+            cpu->data_memory[loop->undo_address[i]] =
+                loop->shadow->data_memory[loop->undo_address[i]];
+        }
+        k++;
+    }
+    if (k == 0)
+    {
+        return;
+    }
+
+    cpu->clock += k * loop->delta.clock;
+    cpu->insn_completed += k * loop->delta.insn_completed;
+    cpu->stall_cycles += k * loop->delta.stall_cycles;
+    cpu->branch_flushes += k * loop->delta.branch_flushes;
+    memcpy(cpu->regs, loop->shadow->regs, sizeof(cpu->regs));
+    cpu->cc = loop->shadow->cc;
+    cpu->zero_flag = cpu->cc.z;
+    patch_writeback(&cpu->writeback, cpu->regs);
+    for (b = 0; b < 2; ++b)
+    {
+        if (bus[b]->reg >= 0 && bus[b]->reg < REG_FILE_SIZE && loop->bus_arch[b])
+        {
+            bus[b]->value = cpu->regs[bus[b]->reg];
+        }
+    }
+
+    loop->loops++;
+    loop->iterations += k;
+    loop->cycles += k * loop->delta.clock;
+}
+
+/* Called at the end of every cycle that redirected fetch backwards */
+static void
+back_edge(APEX_Loop *loop, APEX_CPU *cpu)
+{
+    forward_bus *bus[2] = {&cpu->ex_fb, &cpu->mem_fb};
+    APEX_Loop_Signature sig;
+    APEX_Loop_Delta now, delta;
+    APEX_Loop_Edge *edge;
+    long iterations = loop->iterations;
+    int periodic, same, arch, constant, *path, b, index = (cpu->pc - 4000) / 4;
+
+    if (index < 0 || index >= loop->num_edges)
+    {
+        return;
+    }
+    edge = &loop->edges[index];
+    if (edge->skip > 0)
+    {
+        edge->skip--;
+        loop->tracking = FALSE;
+        loop->have_last = FALSE;
+        return;
+    }
+
+    make_signature(cpu, &sig);
+    read_counters(cpu, &now);
+
+    if (loop->tracking)
+    {
+        if (!shadow_matches(loop, cpu))
+        {
+            loop->tracking = FALSE;
+        }
+        else
+        {
+            delta.clock = now.clock - loop->counters.clock;
+            delta.insn_completed = now.insn_completed - loop->counters.insn_completed;
+            delta.stall_cycles = now.stall_cycles - loop->counters.stall_cycles;
+            delta.branch_flushes = now.branch_flushes - loop->counters.branch_flushes;
+            periodic = memcmp(&sig, &loop->start, sizeof(sig)) == 0;
+            same = periodic && loop->period_length == loop->path_length
+                   && memcmp(loop->period, loop->path,
+                             loop->path_length * sizeof(int)) == 0
+                   && memcmp(&delta, &loop->delta, sizeof(delta)) == 0;
+
+            for (b = 0; b < 2; ++b)
+            {
+                arch = bus[b]->reg >= 0 && bus[b]->reg < REG_FILE_SIZE
+                       && bus[b]->value == loop->shadow->regs[bus[b]->reg];
+                constant = bus[b]->reg == loop->bus[b].reg
+                           && bus[b]->value == loop->bus[b].value;
+                loop->bus_arch[b] = (same ? loop->bus_arch[b] : TRUE) && arch;
+                loop->bus_const[b] = (same ? loop->bus_const[b] : TRUE) && constant;
+            }
+            loop->matches = same ? loop->matches + 1 : periodic;
+
+            path = loop->period;
+            loop->period = loop->path;
+            loop->path = path;
+            loop->period_length = loop->path_length;
+            loop->delta = delta;
+
+            if (loop->matches >= APEX_LOOP_CONFIRM)
+            {
+                extrapolate(loop, cpu);
+                loop->matches = 0;
+                read_counters(cpu, &now);
+            }
+        }
+    }
+    else if (loop->have_last && memcmp(&sig, &loop->last, sizeof(sig)) == 0)
+    {
+        /* The timing state recurred, follow the next iterations */
+        start_tracking(loop, cpu);
+    }
+
+    if (loop->iterations != iterations)
+    {
+        edge->misses = 0;
+        edge->backoff = APEX_LOOP_BACKOFF;
+    }
+    else if (++edge->misses >= APEX_LOOP_PATIENCE)
+    {
+        /* Not settling, leave it alone for a while */
+        edge->misses = 0;
+        edge->skip = edge->backoff;
+        edge->backoff *= 2;
+        loop->tracking = FALSE;
+    }
+
+    loop->last = sig;
+    loop->have_last = TRUE;
+    if (loop->tracking)
+    {
+        loop->start = sig;
+        loop->counters = now;
+        loop->bus[0] = cpu->ex_fb;
+        loop->bus[1] = cpu->mem_fb;
+        loop->path_length = 0;
+        loop->num_stored = 0;
+    }
+}
+
+/*
+ * This function creates an extrapolator for a cpu with debug messages and
+ * single stepping off. max_clock bounds extrapolation, 0 for none.
+ */
+APEX_Loop *
+APEX_loop_create(const APEX_CPU *cpu, long max_clock)
+{
+    APEX_Loop *loop = calloc(1, sizeof(APEX_Loop));
+    int i;
+
+    if (!loop)
+    {
+        return NULL;
+    }
+    loop->max_clock = max_clock;
+    loop->cycle = APEX_cpu_cycle_variant(cpu);
+    loop->num_edges = cpu->code_memory_size;
+    loop->edges = calloc(cpu->code_memory_size > 0 ? cpu->code_memory_size : 1,
+                         sizeof(APEX_Loop_Edge));
+    loop->shadow = APEX_func_create(cpu->code_memory, cpu->code_memory_size, NULL);
+    loop->path = malloc(APEX_LOOP_MAX_PATH * sizeof(int));
+    loop->period = malloc(APEX_LOOP_MAX_PATH * sizeof(int));
+    loop->stored = malloc(2 * APEX_LOOP_MAX_PATH * sizeof(int));
+    loop->undo_address = malloc(APEX_LOOP_MAX_PATH * sizeof(int));
+    loop->undo_value = malloc(APEX_LOOP_MAX_PATH * sizeof(int));
+    if (!loop->edges || !loop->shadow || !loop->path || !loop->period || !loop->stored
+        || !loop->undo_address || !loop->undo_value)
+    {
+        APEX_loop_destroy(loop);
+        return NULL;
+    }
+    for (i = 0; i < loop->num_edges; ++i)
+    {
+        loop->edges[i].backoff = APEX_LOOP_BACKOFF;
+    }
+    return loop;
+}
+
+/*
+ * Simulates one clock cycle, then extrapolates the rest of the loop if the
+ * cycle ended a confirmed steady-state iteration
+ *
+ * Returns TRUE once HALT has retired
+ */
+int
+APEX_loop_cycle(APEX_Loop *loop, APEX_CPU *cpu)
+{
+    const APEX_Instruction *ins;
+    int flushes = cpu->branch_flushes;
+
+    if (loop->cycle(cpu))
+    {
+        return TRUE;
+    }
+
+    /* Follow every instruction decode issues, in program order, and the
+     * addresses both sides store to. A store in the memory latch writes in
+     * the next cycle, before the iteration's back-edge is seen. */
+    if (loop->tracking && cpu->memory.has_insn)
+    {
+        note_store(loop, &cpu->memory, cpu->memory.memory_address);
+    }
+    if (loop->tracking && cpu->execute.has_insn)
+    {
+        if (loop->path_length == APEX_LOOP_MAX_PATH || loop->shadow->pc != cpu->execute.pc)
+        {
+            loop->tracking = FALSE;
+        }
+        else
+        {
+            ins = &loop->shadow->code_memory[(cpu->execute.pc - 4000) / 4];
+            note_store(loop, &cpu->execute, loop->shadow->regs[ins->rs2] + ins->imm);
+            if (!APEX_func_step(loop->shadow))
+            {
+                loop->tracking = FALSE;
+            }
+            else
+            {
+                loop->path[loop->path_length++] = cpu->execute.pc;
+            }
+        }
+    }
+
+    if (cpu->branch_flushes != flushes && cpu->pc <= cpu->memory.pc)
+    {
+        back_edge(loop, cpu);
+    }
+    return FALSE;
+}
+
+/*
+ * This function deallocates an extrapolator
+ */
+void
+APEX_loop_destroy(APEX_Loop *loop)
+{
+    if (loop->shadow)
+    {
+        APEX_func_destroy(loop->shadow);
+    }
+    free(loop->edges);
+    free(loop->path);
+    free(loop->period);
+    free(loop->stored);
+    free(loop->undo_address);
+    free(loop->undo_value);
+    free(loop);
+}
+
+/* Compares an extrapolated run against the detailed one, field by field */
+static int
+same_result(const APEX_CPU *a, const APEX_CPU *b)
+{
+    return a->clock == b->clock && a->insn_completed == b->insn_completed
+           && a->stall_cycles == b->stall_cycles
+           && a->branch_flushes == b->branch_flushes
+           && memcmp(a->regs, b->regs, sizeof(a->regs)) == 0
+           && memcmp(a->data_memory, b->data_memory, sizeof(a->data_memory)) == 0
+           && a->cc.z == b->cc.z && a->cc.p == b->cc.p && a->cc.n == b->cc.n;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> extrapolate <option>...". Options
+ * are data=<image>, forwarding=<none|ex|mem|all>, max_cycles=<n> and
+ * verify, which also runs the program in detail and compares the counters
+ * and the final architectural state.
+ */
+int
+APEX_loop_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Instruction *code_memory;
+    APEX_CPU *cpu, *detailed;
+    APEX_Loop *loop;
+    APEX_Mode_Options options;
+    APEX_Cycle_Fn cycle;
+    int *data_memory;
+    int code_memory_size, forwarding, verify = FALSE, halted = FALSE, status = 0, i;
+    long max_cycles;
+    double t, seconds, detailed_seconds;
+
+    APEX_mode_defaults(&options, APEX_FUNC_MAX_INSNS);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "verify") == 0)
+        {
+            verify = TRUE;
+        }
+        else if (!APEX_mode_option(&options, "extrapolate", argv[i]))
+        {
+            return 1;
+        }
+    }
+    forwarding = options.forwarding;
+    max_cycles = options.max_cycles;
+
+    data_memory = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    code_memory = data_memory ? APEX_mode_load(filename, &options, &code_memory_size,
+                                               data_memory) : NULL;
+    if (!code_memory)
+    {
+        free(data_memory);
+        return 1;
+    }
+
+    cpu = APEX_cpu_create_quiet(code_memory, code_memory_size, forwarding, data_memory);
+    loop = cpu ? APEX_loop_create(cpu, max_cycles) : NULL;
+    if (!loop)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+        return 1;
+    }
+
+    t = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    while (cpu->clock < max_cycles && !(halted = APEX_loop_cycle(loop, cpu)))
+        ;
+    seconds = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID) - t;
+
+    printf("APEX_LOOP: %s, forwarding=%s, %s, cycles = %d instructions = %d, "
+           "%d stall cycles, %d branch flushes\n", filename,
+           APEX_forwarding_name(forwarding), halted ? "halted" : "cycle-limit",
+           cpu->clock, cpu->insn_completed, cpu->stall_cycles, cpu->branch_flushes);
+    printf("APEX_LOOP: %ld loops extrapolated over %ld iterations, %ld cycles "
+           "(%.2f%%), %.6f s\n", loop->loops, loop->iterations, loop->cycles,
+           cpu->clock ? 100.0 * loop->cycles / cpu->clock : 0.0, seconds);
+
+    if (verify)
+    {
+        detailed = APEX_cpu_create_quiet(code_memory, code_memory_size, forwarding, data_memory);
+        if (!detailed)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+            return 1;
+        }
+        cycle = APEX_cpu_cycle_variant(detailed);
+        t = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID);
+        while (detailed->clock < cpu->clock && !cycle(detailed))
+            ;
+        detailed_seconds = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID) - t;
+
+        if (same_result(cpu, detailed))
+        {
+            printf("APEX_LOOP: matches the detailed run, %.6f s detailed, "
+                   "%.1fx speedup\n", detailed_seconds,
+                   seconds > 0.0 ? detailed_seconds / seconds : 0.0);
+        }
+        else
+        {
+            printf("APEX_LOOP: differs from the detailed run, cycles = %d "
+                   "instructions = %d, %d stall cycles, %d branch flushes\n",
+                   detailed->clock, detailed->insn_completed,
+                   detailed->stall_cycles, detailed->branch_flushes);
+            status = 1;
+        }
+        APEX_cpu_stop(detailed);
+    }
+
+    APEX_loop_destroy(loop);
+    APEX_cpu_stop(cpu);
+    free(data_memory);
+    free(code_memory);
+    return status;
+}
@@ -0,0 +1,103 @@
+/*
+ * apex_loop.h
+ * Contains declarations of the steady-state loop extrapolator
+ */
+#ifndef _APEX_LOOP_H_
+#define _APEX_LOOP_H_
+
+#include "apex_cpu.h"
+#include "apex_func.h"
+
+/* Identical iterations seen in detail before the rest are extrapolated */
+#define APEX_LOOP_CONFIRM 2
+
+/* Longest iteration followed, in instructions */
+#define APEX_LOOP_MAX_PATH 4096
+
+/* Back-edges a loop may take without being extrapolated before detection
+ * skips it, and the first number of its back-edges skipped. Each further
+ * miss doubles the skip. */
+#define APEX_LOOP_PATIENCE 8
+#define APEX_LOOP_BACKOFF 16
+
+/* Timing state of the pipeline at the end of a cycle that redirected fetch
+ * backwards. Together with the path of the next iteration it fixes the
+ * timing of that iteration; values only matter through the path. */
+typedef struct APEX_Loop_Signature
+{
+    int pc;                        /* Fetch target */
+    int fetch_from_next_cycle;
+    int fetch_pc;
+    int fetch_has_insn;
+    int fetch_stalled;
+    int decode_has_insn;
+    int decode_stalled;
+    int execute_has_insn;
+    int memory_pc;                 /* The redirecting instruction */
+    int writeback_pc;
+    int writeback_has_insn;
+    int ex_fb_reg;
+    int mem_fb_reg;
+    int regs_writing[REG_FILE_SIZE];
+} APEX_Loop_Signature;
+
+/* Deltas of the counters over one iteration */
+typedef struct APEX_Loop_Delta
+{
+    long clock;
+    long insn_completed;
+    long stall_cycles;
+    long branch_flushes;
+} APEX_Loop_Delta;
+
+/* Detection budget of the loop closed by the back-edges to one pc */
+typedef struct APEX_Loop_Edge
+{
+    int misses;                    /* Back-edges since it was last extrapolated */
+    long skip;                     /* Back-edges still to skip */
+    long backoff;                  /* Back-edges the next miss skips */
+} APEX_Loop_Edge;
+
+typedef struct APEX_Loop
+{
+    APEX_Loop_Signature last;      /* At the previous backward redirect */
+    int have_last;
+    long max_clock;                /* Never extrapolate past this cycle */
+    APEX_Cycle_Fn cycle;           /* Variant of the cpu */
+    APEX_Loop_Edge *edges;         /* By back-edge target, one per instruction */
+    int num_edges;
+
+    /* While tracking, a functional shadow follows the pipeline through the
+     * iteration and checks its architectural state at the back-edges */
+    int tracking;
+    APEX_Func *shadow;
+    APEX_Loop_Signature start;     /* At the start of the iteration */
+    APEX_Loop_Delta counters;      /* At the start of the iteration */
+    int *path;                     /* pcs issued to execute, in order */
+    int path_length;
+    int *stored;                   /* Addresses stored to in the iteration */
+    int num_stored;
+    int *period;                   /* Path of the previous iteration */
+    int period_length;
+    APEX_Loop_Delta delta;         /* Of the previous iteration */
+    int matches;                   /* Identical periodic iterations in a row */
+    int bus_arch[2];               /* EX/MEM bus held its register's value */
+    int bus_const[2];              /* EX/MEM bus did not change */
+    forward_bus bus[2];            /* At the start of the iteration */
+
+    /* Extrapolation undo state */
+    int *undo_address;
+    int *undo_value;
+
+    long loops;                    /* Times iterations were extrapolated */
+    long iterations;               /* Iterations extrapolated */
+    long cycles;                   /* Cycles extrapolated */
+} APEX_Loop;
+
+APEX_Loop *APEX_loop_create(const APEX_CPU *cpu, long max_clock);
+int APEX_loop_cycle(APEX_Loop *loop, APEX_CPU *cpu);
+void APEX_loop_destroy(APEX_Loop *loop);
+
+int APEX_loop_main(const char *filename, int argc, char const *argv[]);
+
+#endif
@@ -48,6 +48,27 @@
 
 
 
+/* Forwarding paths into the decode stage */
+#define FORWARD_NONE 0x0
+#define FORWARD_EX 0x1
+#define FORWARD_MEM 0x2
+#define FORWARD_ALL (FORWARD_EX | FORWARD_MEM)
+
+/* Where decode found an operand */
+#define OPERAND_NONE 0x0
+#define OPERAND_RF 0x1
+#define OPERAND_EX_FB 0x2
+#define OPERAND_MEM_FB 0x3
+#define NUM_OPERAND_SOURCES 4
+
+/* Pipeline stages, in the order of the CPU_Stage latches */
+#define APEX_STAGE_FETCH 0x0
+#define APEX_STAGE_DECODE 0x1
+#define APEX_STAGE_EXECUTE 0x2
+#define APEX_STAGE_MEMORY 0x3
+#define APEX_STAGE_WRITEBACK 0x4
+#define APEX_NUM_STAGES 5
+
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 1
 
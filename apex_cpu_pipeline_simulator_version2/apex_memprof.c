@@ -0,0 +1,460 @@
+/*
+ * apex_memprof.c
+ * Contains the data memory access profiler
+ *
+ * Like the pipeline profiler this wraps APEX_cpu_cycle: the memory latch
+ * before a cycle holds the load or store APEX_memory performs in it. Every
+ * access feeds the stride tracker of its instruction, the LRU reuse
+ * distance histograms and the working set of the current interval.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_memprof.h"
+
+static int
+is_memory_access(int opcode)
+{
+    return opcode == OPCODE_LOAD || opcode == OPCODE_LOADP
+           || opcode == OPCODE_STORE || opcode == OPCODE_STOREP;
+}
+
+static int
+reuse_bucket(int distance)
+{
+    int bucket = 0;
+
+    while (distance > 0)
+    {
+        bucket++;
+        distance >>= 1;
+    }
+    return bucket < APEX_REUSE_COLD ? bucket : APEX_REUSE_COLD - 1;
+}
+
+static void
+tree_add(APEX_Memprof *memprof, long time, int delta)
+{
+    for (; time <= APEX_REUSE_CLOCK; time += time & -time)
+    {
+        memprof->tree[time] += delta;
+    }
+}
+
+static int
+tree_prefix(const APEX_Memprof *memprof, long time)
+{
+    int sum = 0;
+
+    for (; time > 0; time -= time & -time)
+    {
+        sum += memprof->tree[time];
+    }
+    return sum;
+}
+
+static const long *sort_times;
+
+static int
+compare_time(const void *a, const void *b)
+{
+    long ta = sort_times[*(const int *)a], tb = sort_times[*(const int *)b];
+
+    return ta < tb ? -1 : ta > tb;
+}
+
+/* Renumbers the last access times 1..distinct, keeping their order, once
+ * the clock reaches the end of the tree */
+static void
+reuse_compact(APEX_Memprof *memprof)
+{
+    int *blocks = malloc(sizeof(int) * memprof->num_blocks);
+    int i, n = 0;
+
+    for (i = 0; i < memprof->num_blocks; ++i)
+    {
+        if (memprof->last_time[i])
+        {
+            blocks[n++] = i;
+        }
+    }
+    sort_times = memprof->last_time;
+    qsort(blocks, n, sizeof(int), compare_time);
+
+    memset(memprof->tree, 0, sizeof(int) * (APEX_REUSE_CLOCK + 1));
+    for (i = 0; i < n; ++i)
+    {
+        memprof->last_time[blocks[i]] = i + 1;
+        tree_add(memprof, i + 1, 1);
+    }
+    memprof->now = n;
+    free(blocks);
+}
+
+/* Returns the number of distinct blocks touched since block was last
+ * touched, or -1 on its first touch */
+static int
+reuse_access(APEX_Memprof *memprof, int block)
+{
+    int distance = -1;
+
+    if (memprof->now == APEX_REUSE_CLOCK)
+    {
+        reuse_compact(memprof);
+    }
+    memprof->now++;
+
+    if (memprof->last_time[block])
+    {
+        distance = memprof->distinct - tree_prefix(memprof, memprof->last_time[block]);
+        tree_add(memprof, memprof->last_time[block], -1);
+    }
+    else
+    {
+        memprof->distinct++;
+    }
+    tree_add(memprof, memprof->now, 1);
+    memprof->last_time[block] = memprof->now;
+    return distance;
+}
+
+static void
+stride_update(APEX_Memprof_Entry *entry, int stride)
+{
+    int i;
+
+    for (i = 0; i < APEX_STRIDE_SLOTS; ++i)
+    {
+        if (entry->stride_counts[i] > 0 && entry->strides[i] == stride)
+        {
+            entry->stride_counts[i]++;
+            return;
+        }
+    }
+    for (i = 0; i < APEX_STRIDE_SLOTS; ++i)
+    {
+        if (entry->stride_counts[i] == 0)
+        {
+            entry->strides[i] = stride;
+            entry->stride_counts[i] = 1;
+            return;
+        }
+    }
+    for (i = 0; i < APEX_STRIDE_SLOTS; ++i)
+    {
+        entry->stride_counts[i]--;
+    }
+}
+
+/* Slot of the most frequent stride, -1 if none is known */
+static int
+stride_dominant(const APEX_Memprof_Entry *entry)
+{
+    int i, best = -1;
+
+    for (i = 0; i < APEX_STRIDE_SLOTS; ++i)
+    {
+        if (entry->stride_counts[i] > 0
+            && (best < 0 || entry->stride_counts[i] > entry->stride_counts[best]))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static int
+interval_reserve(APEX_Memprof *memprof, int interval)
+{
+    APEX_Memprof_Interval *grown;
+    int size;
+
+    if (interval >= memprof->max_intervals)
+    {
+        size = memprof->max_intervals ? memprof->max_intervals : 64;
+        while (size <= interval)
+        {
+            size *= 2;
+        }
+        grown = realloc(memprof->intervals, sizeof(APEX_Memprof_Interval) * size);
+        if (!grown)
+        {
+            return FALSE;
+        }
+        memprof->intervals = grown;
+        memprof->max_intervals = size;
+    }
+    while (memprof->num_intervals <= interval)
+    {
+        APEX_Memprof_Interval *next = &memprof->intervals[memprof->num_intervals];
+
+        next->first_cycle = memprof->num_intervals * memprof->interval_cycles + 1;
+        next->accesses = 0;
+        next->blocks = 0;
+        memprof->num_intervals++;
+    }
+    return TRUE;
+}
+
+static void
+memprof_access(APEX_Memprof *memprof, int pc, int opcode, int address, int cycle)
+{
+    APEX_Memprof_Entry *entry = NULL;
+    int index = (pc - 4000) / 4, block = address / memprof->line_words;
+    int distance, bucket, interval = (cycle - 1) / memprof->interval_cycles;
+
+    if (pc % 4 == 0 && index >= 0 && index < memprof->code_memory_size)
+    {
+        entry = &memprof->entries[index];
+        if (opcode == OPCODE_STORE || opcode == OPCODE_STOREP)
+        {
+            entry->stores++;
+        }
+        else
+        {
+            entry->loads++;
+        }
+        if (entry->last_address >= 0)
+        {
+            entry->transitions++;
+            stride_update(entry, address - entry->last_address);
+        }
+        entry->last_address = address;
+    }
+
+    distance = reuse_access(memprof, block);
+    bucket = distance < 0 ? APEX_REUSE_COLD : reuse_bucket(distance);
+    memprof->reuse[bucket]++;
+    if (entry)
+    {
+        entry->reuse[bucket]++;
+    }
+
+    if (interval_reserve(memprof, interval))
+    {
+        memprof->intervals[interval].accesses++;
+        if (memprof->interval_stamp[block] != interval + 1)
+        {
+            memprof->interval_stamp[block] = interval + 1;
+            memprof->intervals[interval].blocks++;
+        }
+    }
+}
+
+/*
+ * This function creates a memory profile for the program loaded in cpu,
+ * with blocks of line_words words and working sets over interval_cycles
+ */
+APEX_Memprof *
+APEX_memprof_create(const APEX_CPU *cpu, int line_words, int interval_cycles)
+{
+    APEX_Memprof *memprof = calloc(1, sizeof(APEX_Memprof));
+    int i;
+
+    if (!memprof)
+    {
+        return NULL;
+    }
+    memprof->code_memory = cpu->code_memory;
+    memprof->code_memory_size = cpu->code_memory_size;
+    memprof->cycle = APEX_cpu_cycle_variant(cpu);
+    memprof->line_words = line_words > 0 ? line_words : 1;
+    memprof->num_blocks = (DATA_MEMORY_SIZE + memprof->line_words - 1) / memprof->line_words;
+    memprof->interval_cycles = interval_cycles > 0 ? interval_cycles : 1000;
+    memprof->entries = calloc(cpu->code_memory_size, sizeof(APEX_Memprof_Entry));
+    memprof->last_time = calloc(memprof->num_blocks, sizeof(long));
+    memprof->tree = calloc(APEX_REUSE_CLOCK + 1, sizeof(int));
+    memprof->interval_stamp = calloc(memprof->num_blocks, sizeof(int));
+    if (!memprof->entries || !memprof->last_time || !memprof->tree
+        || !memprof->interval_stamp)
+    {
+        APEX_memprof_destroy(memprof);
+        return NULL;
+    }
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        memprof->entries[i].last_address = -1;
+    }
+    return memprof;
+}
+
+/*
+ * Simulates one cycle and records the data memory access made in it
+ *
+ * Returns TRUE if HALT retired, like APEX_cpu_cycle
+ */
+int
+APEX_memprof_cycle(APEX_Memprof *memprof, APEX_CPU *cpu)
+{
+    if (cpu->memory.has_insn && is_memory_access(cpu->memory.opcode)
+        && cpu->memory.memory_address >= 0
+        && cpu->memory.memory_address < DATA_MEMORY_SIZE)
+    {
+        memprof_access(memprof, cpu->memory.pc, cpu->memory.opcode,
+                       cpu->memory.memory_address, cpu->clock + 1);
+    }
+    return memprof->cycle(cpu);
+}
+
+static void
+bucket_label(char *buf, int bucket)
+{
+    if (bucket == APEX_REUSE_COLD)
+    {
+        strcpy(buf, "cold");
+    }
+    else if (bucket <= 1)
+    {
+        sprintf(buf, "%d", bucket);
+    }
+    else
+    {
+        sprintf(buf, "%d-%d", 1 << (bucket - 1), (1 << bucket) - 1);
+    }
+}
+
+/* Bucket holding the median warm access of a histogram, -1 if all cold */
+static int
+reuse_median(const long *reuse)
+{
+    long warm = 0, seen = 0;
+    int i;
+
+    for (i = 0; i < APEX_REUSE_COLD; ++i)
+    {
+        warm += reuse[i];
+    }
+    for (i = 0; i < APEX_REUSE_COLD && warm > 0; ++i)
+    {
+        seen += reuse[i];
+        if (2 * seen >= warm)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Prints the per-instruction streams, the reuse distance histogram with the
+ * miss ratio it predicts for LRU caches, and the working set time series
+ */
+void
+APEX_memprof_print(APEX_Memprof *memprof, const APEX_CPU *cpu, FILE *out)
+{
+    const APEX_Memprof_Entry *entry;
+    char text[192], label[32], stride[32];
+    long accesses = 0, loads = 0, stores = 0, prefetchable = 0, cumulative, misses;
+    double share;
+    int i, slot, median, blocks;
+
+    if (cpu->clock > 0)
+    {
+        interval_reserve(memprof, (cpu->clock - 1) / memprof->interval_cycles);
+    }
+    for (i = 0; i < memprof->code_memory_size; ++i)
+    {
+        loads += memprof->entries[i].loads;
+        stores += memprof->entries[i].stores;
+    }
+    accesses = loads + stores;
+
+    fprintf(out, "APEX_MEMPROF: cycles = %d accesses = %ld loads = %ld stores = %ld "
+            "blocks touched = %d block = %d words\n", cpu->clock, accesses, loads,
+            stores, memprof->distinct, memprof->line_words);
+
+    fprintf(out, "%-5s %-24s %9s %9s %9s %8s %7s %9s %12s\n", "pc", "instruction",
+            "accesses", "loads", "stores", "stride", "share", "cold", "reuse median");
+    for (i = 0; i < memprof->code_memory_size; ++i)
+    {
+        entry = &memprof->entries[i];
+        if (entry->loads + entry->stores == 0)
+        {
+            continue;
+        }
+        APEX_format_instruction(text, sizeof(text), &memprof->code_memory[i]);
+
+        slot = stride_dominant(entry);
+        share = slot >= 0 ? (double)entry->stride_counts[slot] / entry->transitions : 0.0;
+        if (slot >= 0)
+        {
+            sprintf(stride, "%+d", entry->strides[slot]);
+            if (share >= APEX_STRIDE_CONSTANT && entry->strides[slot] != 0)
+            {
+                prefetchable += entry->loads + entry->stores;
+            }
+        }
+        else
+        {
+            strcpy(stride, "-");
+        }
+
+        median = reuse_median(entry->reuse);
+        if (median >= 0)
+        {
+            bucket_label(label, median);
+        }
+        else
+        {
+            strcpy(label, "-");
+        }
+
+        fprintf(out, "%-5d %-24s %9ld %9ld %9ld %8s %6.1f%% %9ld %12s%s\n",
+                4000 + 4 * i, text, entry->loads + entry->stores, entry->loads,
+                entry->stores, stride, 100.0 * share, entry->reuse[APEX_REUSE_COLD],
+                label, share >= APEX_STRIDE_CONSTANT ? "  constant stride" : "");
+    }
+    fprintf(out, "Constant-stride accesses (prefetchable): %ld of %ld (%.1f%%)\n",
+            prefetchable, accesses, accesses ? 100.0 * prefetchable / accesses : 0.0);
+
+    fprintf(out, "\nReuse distance (distinct blocks in between):\n");
+    fprintf(out, "%-11s %9s %7s %7s\n", "distance", "accesses", "share", "cumul");
+    cumulative = 0;
+    for (i = 0; i < APEX_REUSE_BUCKETS; ++i)
+    {
+        if (memprof->reuse[i] == 0)
+        {
+            continue;
+        }
+        cumulative += memprof->reuse[i];
+        bucket_label(label, i);
+        fprintf(out, "%-11s %9ld %6.1f%% %6.1f%%\n", label, memprof->reuse[i],
+                100.0 * memprof->reuse[i] / accesses, 100.0 * cumulative / accesses);
+    }
+
+    /* A fully associative LRU cache of 2^k blocks hits distances below 2^k,
+     * which are exactly buckets 0..k */
+    fprintf(out, "\nPredicted fully associative LRU miss ratio:\n");
+    fprintf(out, "%-11s %9s %7s\n", "blocks", "misses", "ratio");
+    for (blocks = 1, i = 0; blocks <= memprof->num_blocks && accesses > 0; blocks *= 2, ++i)
+    {
+        misses = accesses;
+        for (slot = 0; slot <= i && slot < APEX_REUSE_COLD; ++slot)
+        {
+            misses -= memprof->reuse[slot];
+        }
+        fprintf(out, "%-11d %9ld %6.1f%%\n", blocks, misses, 100.0 * misses / accesses);
+    }
+
+    fprintf(out, "\nWorking set per %d cycles:\n", memprof->interval_cycles);
+    fprintf(out, "%-11s %9s %7s\n", "cycle", "accesses", "blocks");
+    for (i = 0; i < memprof->num_intervals; ++i)
+    {
+        fprintf(out, "%-11d %9ld %7d\n", memprof->intervals[i].first_cycle,
+                memprof->intervals[i].accesses, memprof->intervals[i].blocks);
+    }
+}
+
+/*
+ * This function deallocates the memory profile
+ */
+void
+APEX_memprof_destroy(APEX_Memprof *memprof)
+{
+    free(memprof->entries);
+    free(memprof->last_time);
+    free(memprof->tree);
+    free(memprof->interval_stamp);
+    free(memprof->intervals);
+    free(memprof);
+}
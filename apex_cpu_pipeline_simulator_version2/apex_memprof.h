@@ -0,0 +1,77 @@
+/*
+ * apex_memprof.h
+ * Contains declarations of the data memory access profiler
+ */
+#ifndef _APEX_MEMPROF_H_
+#define _APEX_MEMPROF_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+/* Reuse distances go in power of two buckets: 0, 1, 2-3, 4-7, ... up to the
+ * number of blocks in data memory, and the last bucket counts first touches */
+#define APEX_REUSE_BUCKETS 15
+#define APEX_REUSE_COLD (APEX_REUSE_BUCKETS - 1)
+
+/* Strides tracked per instruction to find the dominant one */
+#define APEX_STRIDE_SLOTS 4
+
+/* A stride covering this share of an instruction's accesses is constant */
+#define APEX_STRIDE_CONSTANT 0.9
+
+/* Reuse clock range before the timestamps are renumbered */
+#define APEX_REUSE_CLOCK (1 << 16)
+
+/* Access stream of one static load or store */
+typedef struct APEX_Memprof_Entry
+{
+    long loads;
+    long stores;
+    int last_address;              /* -1 before the first access */
+    long transitions;              /* Consecutive access pairs seen */
+    int strides[APEX_STRIDE_SLOTS]; /* Frequent strides, Misra-Gries */
+    long stride_counts[APEX_STRIDE_SLOTS];
+    long reuse[APEX_REUSE_BUCKETS];
+} APEX_Memprof_Entry;
+
+/* Distinct blocks touched in one interval of the run */
+typedef struct APEX_Memprof_Interval
+{
+    int first_cycle;
+    long accesses;
+    int blocks;
+} APEX_Memprof_Interval;
+
+typedef struct APEX_Memprof
+{
+    const APEX_Instruction *code_memory;
+    int code_memory_size;
+    APEX_Cycle_Fn cycle;           /* Variant of the cpu profiled */
+    APEX_Memprof_Entry *entries;   /* One per code memory slot */
+    int line_words;                /* Words per block */
+    int num_blocks;
+    long reuse[APEX_REUSE_BUCKETS];
+
+    /* Exact LRU stack distance: each block's last access time, and a
+     * Fenwick tree over time holding a 1 at every block's last access */
+    long *last_time;
+    int *tree;
+    long now;
+    int distinct;
+
+    int interval_cycles;
+    int interval;                  /* Index of the interval being counted */
+    int *interval_stamp;           /* Per block, last interval touched + 1 */
+    APEX_Memprof_Interval *intervals;
+    int num_intervals;
+    int max_intervals;
+} APEX_Memprof;
+
+APEX_Memprof *APEX_memprof_create(const APEX_CPU *cpu, int line_words,
+                                  int interval_cycles);
+int APEX_memprof_cycle(APEX_Memprof *memprof, APEX_CPU *cpu);
+void APEX_memprof_print(APEX_Memprof *memprof, const APEX_CPU *cpu, FILE *out);
+void APEX_memprof_destroy(APEX_Memprof *memprof);
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * apex_observer.c
+ * Contains the pipeline observer hooks and the plugin loader
+ *
+ * The cycle variants built with hooks raise every event, a cpu picks them
+ * as soon as it has an observer. The events are derived from the latches
+ * around the stage calls, so the stage functions themselves know nothing
+ * about observers.
+ */
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_observer.h"
+
+/*
+ * Adds an observer of the events in the mask to a cpu. Loops that took
+ * APEX_cpu_cycle_variant before must take it again.
+ *
+ * Returns 0 on success, -1 if the cpu has no room or memory ran out
+ */
+int
+APEX_observer_add(APEX_CPU *cpu, unsigned events, APEX_Observer_Fn fn, void *context)
+{
+    APEX_Observers *observers = cpu->observers;
+
+    if (!fn)
+    {
+        return -1;
+    }
+    if (!observers)
+    {
+        observers = calloc(1, sizeof(APEX_Observers));
+        if (!observers)
+        {
+            return -1;
+        }
+        cpu->observers = observers;
+    }
+    if (observers->count == APEX_MAX_OBSERVERS)
+    {
+        return -1;
+    }
+
+    observers->list[observers->count].events = events & APEX_EVENTS_ALL;
+    observers->list[observers->count].fn = fn;
+    observers->list[observers->count].context = context;
+    observers->count++;
+    observers->events |= events & APEX_EVENTS_ALL;
+    return 0;
+}
+
+/*
+ * Removes an observer added with the same function and context. The cpu
+ * goes back to the variants without hooks once the last one is gone.
+ *
+ * Returns 0 on success, -1 if no such observer was added
+ */
+int
+APEX_observer_remove(APEX_CPU *cpu, APEX_Observer_Fn fn, void *context)
+{
+    APEX_Observers *observers = cpu->observers;
+    int i, found = -1;
+
+    for (i = 0; observers && i < observers->count; ++i)
+    {
+        if (observers->list[i].fn == fn && observers->list[i].context == context)
+        {
+            found = i;
+            break;
+        }
+    }
+    if (found < 0)
+    {
+        return -1;
+    }
+
+    observers->count--;
+    memmove(&observers->list[found], &observers->list[found + 1],
+            (observers->count - found) * sizeof(observers->list[0]));
+    observers->events = 0;
+    for (i = 0; i < observers->count; ++i)
+    {
+        observers->events |= observers->list[i].events;
+    }
+    if (observers->count == 0)
+    {
+        APEX_observer_destroy(cpu);
+    }
+    return 0;
+}
+
+/* Calls every observer of the event, in the order they were added */
+void
+APEX_observer_notify(const APEX_CPU *cpu, const APEX_Event *event)
+{
+    const APEX_Observers *observers = cpu->observers;
+    unsigned mask = APEX_EVENT_MASK(event->type);
+    int i;
+
+    for (i = 0; i < observers->count; ++i)
+    {
+        if (observers->list[i].events & mask)
+        {
+            observers->list[i].fn(observers->list[i].context, cpu, event);
+        }
+    }
+}
+
+void
+APEX_observer_destroy(APEX_CPU *cpu)
+{
+    free(cpu->observers);
+    cpu->observers = NULL;
+}
+
+/* The operand decode is still waiting for, or -1 */
+static int
+waiting_register(const CPU_Stage *stage)
+{
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+        case OPCODE_CMP:
+            return !stage->rs1_f ? stage->rs1 : !stage->rs2_f ? stage->rs2 : -1;
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_CML:
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+            return !stage->rs1_f ? stage->rs1 : -1;
+    }
+    return -1;
+}
+
+/*
+ * Tells what a stalled decode latch waits on. When decode runs, the latest
+ * producers are in the memory and writeback latches.
+ *
+ * Returns APEX_WAIT_LOAD, APEX_WAIT_DEPENDENCY or APEX_WAIT_NONE
+ */
+int
+APEX_observer_stall_cause(const APEX_CPU *cpu, const CPU_Stage *stalled)
+{
+    const CPU_Stage *producers[2] = {&cpu->memory, &cpu->writeback};
+    int reg = waiting_register(stalled), i;
+
+    for (i = 0; reg >= 0 && i < 2; ++i)
+    {
+        if (producers[i]->has_insn && APEX_writes_register(producers[i], reg))
+        {
+            return producers[i]->opcode == OPCODE_LOAD || producers[i]->opcode == OPCODE_LOADP
+                       ? APEX_WAIT_LOAD
+                       : APEX_WAIT_DEPENDENCY;
+        }
+    }
+    return APEX_WAIT_NONE;
+}
+
+/* A loaded plugin */
+typedef struct APEX_Plugin
+{
+    void *handle;
+    void (*fini)(const APEX_CPU *cpu);
+} APEX_Plugin;
+
+/*
+ * Loads the plugin "<shared_object>[:<args>]" and lets it attach to cpu
+ *
+ * Returns 0 on success, -1 on failure
+ */
+static int
+load_plugin(APEX_Plugin *plugin, APEX_CPU *cpu, const char *spec)
+{
+    char path[4096];
+    const char *args = strchr(spec, ':');
+    int (*init)(APEX_CPU *cpu, const char *args);
+
+    snprintf(path, sizeof(path), "%.*s", args ? (int)(args - spec) : (int)strlen(spec), spec);
+    args = args ? args + 1 : "";
+
+    /* dlopen searches the library path for a name without a slash */
+    if (!strchr(path, '/') && strlen(path) + 2 < sizeof(path))
+    {
+        memmove(path + 2, path, strlen(path) + 1);
+        memcpy(path, "./", 2);
+    }
+
+    plugin->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!plugin->handle)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load plugin: %s\n", dlerror());
+        return -1;
+    }
+    *(void **)&init = dlsym(plugin->handle, "apex_plugin_init");
+    *(void **)&plugin->fini = dlsym(plugin->handle, "apex_plugin_fini");
+    if (!init)
+    {
+        fprintf(stderr, "APEX_Error: %s does not export apex_plugin_init\n", path);
+        dlclose(plugin->handle);
+        return -1;
+    }
+    if (init(cpu, args) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Plugin %s failed to initialize\n", path);
+        dlclose(plugin->handle);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> plugin <option>... <plugin>...".
+ * Options are data=<image>, forwarding=<none|ex|mem|all> and
+ * max_cycles=<n>; every other argument is a shared object, optionally
+ * followed by :<args> for its init. Runs quietly with the plugins attached
+ * and calls their fini at the end. Exits with 1 if HALT did not retire.
+ */
+int
+APEX_plugin_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Plugin plugins[APEX_MAX_PLUGINS];
+    APEX_Mode_Options options;
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+    const char *specs[APEX_MAX_PLUGINS];
+    int num_specs = 0, num_plugins = 0, halted = FALSE, status = 0, i;
+
+    APEX_mode_defaults(&options, 100000000L);
+    for (i = 0; i < argc; ++i)
+    {
+        /* A plugin has no '=' ahead of its arguments */
+        if (argv[i][strcspn(argv[i], "=:")] == '=')
+        {
+            if (!APEX_mode_option(&options, "plugin", argv[i]))
+            {
+                return 1;
+            }
+        }
+        else if (num_specs < APEX_MAX_PLUGINS)
+        {
+            specs[num_specs++] = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "APEX_Error: At most %d plugins\n", APEX_MAX_PLUGINS);
+            return 1;
+        }
+    }
+    if (num_specs == 0)
+    {
+        fprintf(stderr, "APEX_Error: No plugin given\n");
+        return 1;
+    }
+
+    cpu = APEX_mode_cpu(filename, &options);
+    if (!cpu)
+    {
+        return 1;
+    }
+
+    for (i = 0; i < num_specs; ++i)
+    {
+        if (load_plugin(&plugins[num_plugins], cpu, specs[i]) < 0)
+        {
+            status = 1;
+            break;
+        }
+        num_plugins++;
+    }
+
+    if (status == 0)
+    {
+        cycle = APEX_cpu_cycle_variant(cpu);
+        while (cpu->clock < options.max_cycles && !(halted = cycle(cpu)))
+            ;
+        if (halted)
+        {
+            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n",
+                   cpu->clock, cpu->insn_completed);
+        }
+        else
+        {
+            fprintf(stderr, "APEX_Error: No HALT within %ld cycles\n",
+                    options.max_cycles);
+            status = 1;
+        }
+        for (i = 0; i < num_plugins; ++i)
+        {
+            if (plugins[i].fini)
+            {
+                plugins[i].fini(cpu);
+            }
+        }
+    }
+
+    /* Observers may point into the plugins, so those stay until the cpu is gone */
+    APEX_cpu_stop(cpu);
+    for (i = 0; i < num_plugins; ++i)
+    {
+        dlclose(plugins[i].handle);
+    }
+    return status;
+}
@@ -0,0 +1,88 @@
+/*
+ * apex_observer.h
+ * Contains declarations of the pipeline observer hooks and plugin loader
+ *
+ * An observer is a function called with a const view of the cpu and of the
+ * latch an event is about. A cpu without observers runs the cycle variants
+ * compiled without any of the hooks, so they cost nothing until the first
+ * observer is added.
+ */
+#ifndef _APEX_OBSERVER_H_
+#define _APEX_OBSERVER_H_
+
+#include "apex_cpu.h"
+
+/* Observers one cpu can carry */
+#define APEX_MAX_OBSERVERS 16
+
+/* Events. Within a cycle the stages run from writeback back to fetch */
+#define APEX_EVENT_CYCLE_START 0x0 /* Clock advanced, no stage has run yet */
+#define APEX_EVENT_STAGE_ENTER 0x1 /* A stage is about to process its latch */
+#define APEX_EVENT_RETIRE 0x2      /* Writeback retired the latch's instruction */
+#define APEX_EVENT_MEMORY 0x3      /* The memory stage loaded or stored a word */
+#define APEX_EVENT_FLUSH 0x4       /* A taken branch or jump left execute */
+#define APEX_EVENT_FORWARD 0x5     /* Decode issued an operand read off a bus */
+#define APEX_EVENT_STALL 0x6       /* Decode held its instruction back */
+#define APEX_EVENT_CYCLE_END 0x7   /* Every stage has run */
+#define APEX_NUM_EVENTS 8
+
+#define APEX_EVENT_MASK(event) (1u << (event))
+#define APEX_EVENTS_ALL ((1u << APEX_NUM_EVENTS) - 1)
+
+/* One event. Fields a type does not list are 0, latch is NULL for the
+ * cycle events. */
+typedef struct APEX_Event
+{
+    int type;                      /* APEX_EVENT_* */
+    int cycle;
+    int stage;                     /* APEX_STAGE_* the latch belongs to */
+    const CPU_Stage *latch;
+    int reg;                       /* FORWARD: register read off the bus */
+    int source;                    /* FORWARD: OPERAND_EX_FB or OPERAND_MEM_FB */
+    int address;                   /* MEMORY: data word, FLUSH: target pc */
+    int value;                     /* FORWARD, MEMORY: the word moved */
+    int is_store;                  /* MEMORY: TRUE for stores */
+} APEX_Event;
+
+typedef void (*APEX_Observer_Fn)(void *context, const APEX_CPU *cpu,
+                                 const APEX_Event *event);
+
+/* Observers of one cpu, with the union of their event masks */
+typedef struct APEX_Observers
+{
+    unsigned events;
+    int count;
+    struct
+    {
+        unsigned events;
+        APEX_Observer_Fn fn;
+        void *context;
+    } list[APEX_MAX_OBSERVERS];
+} APEX_Observers;
+
+int APEX_observer_add(APEX_CPU *cpu, unsigned events, APEX_Observer_Fn fn,
+                      void *context);
+int APEX_observer_remove(APEX_CPU *cpu, APEX_Observer_Fn fn, void *context);
+void APEX_observer_notify(const APEX_CPU *cpu, const APEX_Event *event);
+void APEX_observer_destroy(APEX_CPU *cpu);
+
+/* What a stalled decode waits on */
+#define APEX_WAIT_NONE 0x0             /* A register nothing in flight writes */
+#define APEX_WAIT_LOAD 0x1             /* The result of a load */
+#define APEX_WAIT_DEPENDENCY 0x2       /* ... of any other instruction */
+
+int APEX_observer_stall_cause(const APEX_CPU *cpu, const CPU_Stage *stalled);
+
+/*
+ * A plugin is a shared object exporting
+ *
+ *   int apex_plugin_init(APEX_CPU *cpu, const char *args);
+ *   void apex_plugin_fini(const APEX_CPU *cpu);     (optional)
+ *
+ * init adds its observers and returns 0, fini reports once the run is over.
+ */
+#define APEX_MAX_PLUGINS 8
+
+int APEX_plugin_main(const char *filename, int argc, char const *argv[]);
+
+#endif
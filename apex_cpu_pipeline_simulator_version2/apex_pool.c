@@ -0,0 +1,188 @@
+/*
+ * apex_pool.c
+ * Contains the work-stealing thread pool used by the parallel drivers
+ *
+ * Task indices are dealt out as one contiguous range per worker. A worker
+ * takes tasks from the front of its own range and, once that is empty,
+ * steals the back half of the fullest other range, so long tasks on one
+ * worker do not leave the others idle.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "apex_pool.h"
+#include "apex_macros.h"
+
+typedef struct APEX_Worker
+{
+    pthread_mutex_t lock;
+    int head;                      /* Next task to run */
+    int tail;                      /* One past the last task owned */
+    int id;
+    struct APEX_Pool *pool;
+    pthread_t thread;
+} APEX_Worker;
+
+typedef struct APEX_Pool
+{
+    APEX_Worker *workers;
+    int num_workers;
+    APEX_Task task;
+    void *context;
+} APEX_Pool;
+
+/* Takes the next task from the worker's own range, -1 when empty */
+static int
+pool_take(APEX_Worker *worker)
+{
+    int index = -1;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->head < worker->tail)
+    {
+        index = worker->head++;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return index;
+}
+
+/* Moves the back half of the fullest other range to the thief */
+static int
+pool_steal(APEX_Worker *thief)
+{
+    APEX_Pool *pool = thief->pool;
+    APEX_Worker *victim = NULL;
+    int i, left, best = 0, mid;
+
+    for (i = 1; i < pool->num_workers; ++i)
+    {
+        APEX_Worker *w = &pool->workers[(thief->id + i) % pool->num_workers];
+
+        left = w->tail - w->head; /* Racy peek, re-checked under the lock */
+        if (left > best)
+        {
+            best = left;
+            victim = w;
+        }
+    }
+
+    if (!victim)
+    {
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&victim->lock);
+    left = victim->tail - victim->head;
+    if (left <= 0)
+    {
+        pthread_mutex_unlock(&victim->lock);
+        return TRUE; /* Lost the race, look again */
+    }
+    mid = victim->tail - (left + 1) / 2;
+    pthread_mutex_lock(&thief->lock);
+    thief->head = mid;
+    thief->tail = victim->tail;
+    pthread_mutex_unlock(&thief->lock);
+    victim->tail = mid;
+    pthread_mutex_unlock(&victim->lock);
+    return TRUE;
+}
+
+static void *
+pool_worker(void *arg)
+{
+    APEX_Worker *worker = arg;
+    int index;
+
+    for (;;)
+    {
+        while ((index = pool_take(worker)) >= 0)
+        {
+            worker->pool->task(worker->pool->context, index);
+        }
+
+        if (!pool_steal(worker))
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Number of online processors, used when the user does not pick a count
+ */
+int
+APEX_pool_default_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int)n : 1;
+}
+
+/*
+ * Runs task(context, i) for every i in [0, num_tasks) on num_threads
+ * threads and waits for all of them. Tasks must not depend on each other.
+ *
+ * Returns 0 on success, -1 if out of memory
+ */
+int
+APEX_pool_run(int num_threads, int num_tasks, APEX_Task task, void *context)
+{
+    APEX_Pool pool;
+    int i, started;
+
+    if (num_threads > num_tasks)
+    {
+        num_threads = num_tasks;
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    pool.workers = calloc(num_threads, sizeof(APEX_Worker));
+    if (!pool.workers)
+    {
+        return -1;
+    }
+    pool.num_workers = num_threads;
+    pool.task = task;
+    pool.context = context;
+
+    for (i = 0; i < num_threads; ++i)
+    {
+        pthread_mutex_init(&pool.workers[i].lock, NULL);
+        pool.workers[i].head = (int)((long)num_tasks * i / num_threads);
+        pool.workers[i].tail = (int)((long)num_tasks * (i + 1) / num_threads);
+        pool.workers[i].id = i;
+        pool.workers[i].pool = &pool;
+    }
+
+    /* The calling thread acts as worker 0. Ranges of threads that could not
+     * be started are stolen like any other, since a worker only returns once
+     * every range is empty */
+    for (started = 1; started < num_threads; ++started)
+    {
+        if (pthread_create(&pool.workers[started].thread, NULL, pool_worker,
+                           &pool.workers[started]))
+        {
+            break;
+        }
+    }
+    pool_worker(&pool.workers[0]);
+
+    for (i = 1; i < started; ++i)
+    {
+        pthread_join(pool.workers[i].thread, NULL);
+    }
+
+    for (i = 0; i < num_threads; ++i)
+    {
+        pthread_mutex_destroy(&pool.workers[i].lock);
+    }
+    free(pool.workers);
+    return 0;
+}
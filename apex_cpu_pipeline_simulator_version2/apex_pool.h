@@ -0,0 +1,15 @@
+/*
+ * apex_pool.h
+ * Contains declarations of the work-stealing thread pool
+ */
+#ifndef _APEX_POOL_H_
+#define _APEX_POOL_H_
+
+/* A task is called once for every index in [0, num_tasks) */
+typedef void (*APEX_Task)(void *context, int index);
+
+int APEX_pool_run(int num_threads, int num_tasks, APEX_Task task,
+                  void *context);
+int APEX_pool_default_threads(void);
+
+#endif
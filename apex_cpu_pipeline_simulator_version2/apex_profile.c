@@ -0,0 +1,223 @@
+/*
+ * apex_profile.c
+ * Contains the per-instruction pipeline profiler
+ *
+ * The profiler wraps APEX_cpu_cycle and charges every cycle to static
+ * instructions by looking at the latches around it: the writeback latch
+ * before the cycle is what retires, the execute latch is what may redirect
+ * fetch, and the decode latch after the cycle is what stalled.
+ */
+#include <stdlib.h>
+
+#include "apex_profile.h"
+
+static int
+entry_index(const APEX_Profile *profile, int pc)
+{
+    int index = (pc - 4000) / 4;
+
+    return (pc % 4 == 0 && index >= 0 && index < profile->code_memory_size)
+               ? index : -1;
+}
+
+static int
+reads_rs2(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+        case OPCODE_CMP:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/* Cycles charged to an instruction: its issue slots plus what it cost */
+static long
+entry_cost(const APEX_Profile_Entry *entry)
+{
+    return entry->executed + entry->stall_cycles + entry->flush_bubbles;
+}
+
+/*
+ * This function creates a profile for the program loaded in cpu
+ */
+APEX_Profile *
+APEX_profile_create(const APEX_CPU *cpu)
+{
+    APEX_Profile *profile = calloc(1, sizeof(APEX_Profile));
+
+    if (!profile)
+    {
+        return NULL;
+    }
+    profile->code_memory = cpu->code_memory;
+    profile->code_memory_size = cpu->code_memory_size;
+    profile->cycle = APEX_cpu_cycle_variant(cpu);
+    profile->entries = calloc(cpu->code_memory_size, sizeof(APEX_Profile_Entry));
+    if (!profile->entries)
+    {
+        free(profile);
+        return NULL;
+    }
+    return profile;
+}
+
+/*
+ * Simulates one cycle and charges it to the instructions involved
+ *
+ * Returns TRUE if HALT retired, like APEX_cpu_cycle
+ */
+int
+APEX_profile_cycle(APEX_Profile *profile, APEX_CPU *cpu)
+{
+    APEX_Profile_Entry *entry;
+    int retiring = -1, redirecting = -1, squashed, flushes, index;
+    int rs1_src = OPERAND_NONE, rs2_src = OPERAND_NONE;
+
+    if (cpu->writeback.has_insn)
+    {
+        retiring = entry_index(profile, cpu->writeback.pc);
+        rs1_src = cpu->writeback.rs1_src;
+        rs2_src = cpu->writeback.rs2_src;
+    }
+    if (cpu->execute.has_insn)
+    {
+        redirecting = entry_index(profile, cpu->execute.pc);
+    }
+    squashed = cpu->decode.has_insn;
+    flushes = cpu->branch_flushes;
+
+    if (profile->cycle(cpu))
+    {
+        if (retiring >= 0)
+        {
+            profile->entries[retiring].executed++;
+        }
+        return TRUE;
+    }
+
+    if (retiring >= 0)
+    {
+        entry = &profile->entries[retiring];
+        entry->executed++;
+        entry->sources[0][rs1_src]++;
+        entry->sources[1][rs2_src]++;
+    }
+
+    /* A redirect squashes what decode held and costs the next fetch slot */
+    if (cpu->branch_flushes != flushes && redirecting >= 0)
+    {
+        entry = &profile->entries[redirecting];
+        entry->flushes++;
+        entry->flush_bubbles += 1 + squashed;
+    }
+
+    if (cpu->decode.has_insn && cpu->decode.stalled)
+    {
+        index = entry_index(profile, cpu->decode.pc);
+        if (index >= 0)
+        {
+            entry = &profile->entries[index];
+            entry->stall_cycles++;
+            if (!cpu->decode.rs1_f && reads_rs2(cpu->decode.opcode) && !cpu->decode.rs2_f)
+            {
+                entry->stall_operand[APEX_STALL_BOTH]++;
+            }
+            else if (!cpu->decode.rs1_f)
+            {
+                entry->stall_operand[APEX_STALL_RS1]++;
+            }
+            else
+            {
+                entry->stall_operand[APEX_STALL_RS2]++;
+            }
+        }
+    }
+    return FALSE;
+}
+
+static const APEX_Profile *sort_profile;
+
+static int
+compare_cost(const void *a, const void *b)
+{
+    long cost_a = entry_cost(&sort_profile->entries[*(const int *)a]);
+    long cost_b = entry_cost(&sort_profile->entries[*(const int *)b]);
+
+    if (cost_a != cost_b)
+    {
+        return cost_a < cost_b ? 1 : -1;
+    }
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Prints the annotated listing, costliest instruction first
+ */
+void
+APEX_profile_print(const APEX_Profile *profile, const APEX_CPU *cpu, FILE *out)
+{
+    const APEX_Profile_Entry *entry;
+    char text[192];
+    int *order, i;
+    long stalls = 0, bubbles = 0;
+
+    order = malloc(sizeof(int) * (profile->code_memory_size + 1));
+    if (!order)
+    {
+        return;
+    }
+    for (i = 0; i < profile->code_memory_size; ++i)
+    {
+        order[i] = i;
+        stalls += profile->entries[i].stall_cycles;
+        bubbles += profile->entries[i].flush_bubbles;
+    }
+    sort_profile = profile;
+    qsort(order, profile->code_memory_size, sizeof(int), compare_cost);
+
+    fprintf(out, "APEX_PROFILE: cycles = %d instructions = %d stall_cycles = %ld "
+            "flush_bubbles = %ld\n", cpu->clock, cpu->insn_completed, stalls, bubbles);
+    fprintf(out, "%7s %9s %9s %9s %17s %6s %7s %17s %17s  %-5s %s\n",
+            "cost%", "cost", "exec", "stalled", "rs1/rs2/both", "flush",
+            "bubbles", "rs1 rf/ex/mem", "rs2 rf/ex/mem", "pc", "instruction");
+
+    for (i = 0; i < profile->code_memory_size; ++i)
+    {
+        entry = &profile->entries[order[i]];
+        APEX_format_instruction(text, sizeof(text), &profile->code_memory[order[i]]);
+        fprintf(out, "%6.2f%% %9ld %9ld %9ld %5ld/%5ld/%5ld %6ld %7ld "
+                "%5ld/%5ld/%5ld %5ld/%5ld/%5ld  %-5d %s\n",
+                cpu->clock > 0 ? 100.0 * entry_cost(entry) / cpu->clock : 0.0,
+                entry_cost(entry), entry->executed, entry->stall_cycles,
+                entry->stall_operand[APEX_STALL_RS1],
+                entry->stall_operand[APEX_STALL_RS2],
+                entry->stall_operand[APEX_STALL_BOTH],
+                entry->flushes, entry->flush_bubbles,
+                entry->sources[0][OPERAND_RF], entry->sources[0][OPERAND_EX_FB],
+                entry->sources[0][OPERAND_MEM_FB],
+                entry->sources[1][OPERAND_RF], entry->sources[1][OPERAND_EX_FB],
+                entry->sources[1][OPERAND_MEM_FB],
+                4000 + 4 * order[i], text);
+    }
+    free(order);
+}
+
+/*
+ * This function deallocates the profile
+ */
+void
+APEX_profile_destroy(APEX_Profile *profile)
+{
+    free(profile->entries);
+    free(profile);
+}
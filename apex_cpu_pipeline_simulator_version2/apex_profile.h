@@ -0,0 +1,41 @@
+/*
+ * apex_profile.h
+ * Contains declarations of the per-instruction pipeline profiler
+ */
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+/* Operands that can hold an instruction back in decode */
+#define APEX_STALL_RS1 0x0
+#define APEX_STALL_RS2 0x1
+#define APEX_STALL_BOTH 0x2
+
+/* Counters of one static instruction */
+typedef struct APEX_Profile_Entry
+{
+    long executed;                 /* Times retired */
+    long stall_cycles;             /* Cycles held in decode */
+    long stall_operand[3];         /* Split of stall_cycles by APEX_STALL_* */
+    long flushes;                  /* Times it redirected fetch */
+    long flush_bubbles;            /* Fetch slots lost to those redirects */
+    long sources[2][NUM_OPERAND_SOURCES]; /* rs1, rs2 by OPERAND_* at retire */
+} APEX_Profile_Entry;
+
+typedef struct APEX_Profile
+{
+    const APEX_Instruction *code_memory;
+    int code_memory_size;
+    APEX_Cycle_Fn cycle;           /* Variant of the cpu profiled */
+    APEX_Profile_Entry *entries;   /* One per code memory slot */
+} APEX_Profile;
+
+APEX_Profile *APEX_profile_create(const APEX_CPU *cpu);
+int APEX_profile_cycle(APEX_Profile *profile, APEX_CPU *cpu);
+void APEX_profile_print(const APEX_Profile *profile, const APEX_CPU *cpu, FILE *out);
+void APEX_profile_destroy(APEX_Profile *profile);
+
+#endif
@@ -0,0 +1,469 @@
+/*
+ * apex_sample.c
+ * Contains the sampled simulation mode
+ *
+ * Systematic sampling in the style of SMARTS: the functional model fast
+ * forwards between samples, and each sample loads its architectural state
+ * into a fresh pipeline, runs a warm-up that fills the latches and the
+ * scoreboard, then measures the cycles of a short unit of instructions.
+ * The mean of the unit CPIs estimates the CPI of the whole run, and the
+ * spread of the units sizes the number of samples needed for a target
+ * error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "apex_sample.h"
+#include "apex_func.h"
+
+/* P(|T| < t) for Student's t with df degrees of freedom, by the finite
+ * sums of Abramowitz and Stegun 26.7.3 and 26.7.4 */
+static double
+t_coverage(double t, long df)
+{
+    double theta = atan(t / sqrt((double)df)), c2 = cos(theta) * cos(theta);
+    double term, sum;
+    long k;
+
+    if (df % 2 == 0)
+    {
+        term = sum = 1.0;
+        for (k = 2; k <= df - 2; k += 2)
+        {
+            term *= c2 * (k - 1) / k;
+            sum += term;
+        }
+        return sin(theta) * sum;
+    }
+
+    term = sum = df > 1 ? cos(theta) : 0.0;
+    for (k = 3; k <= df - 2; k += 2)
+    {
+        term *= c2 * (k - 1) / k;
+        sum += term;
+    }
+    return 2.0 / M_PI * (theta + sin(theta) * sum);
+}
+
+/*
+ * Two-sided Student's t quantile of a confidence level for the mean of
+ * samples values, by bisection. The normal quantile understates the
+ * interval of a few samples.
+ *
+ * Returns HUGE_VAL for fewer than two samples, whose spread is unknown
+ */
+static double
+confidence_t(double confidence, long samples)
+{
+    double low = 0.0, high = 1.0, mid;
+    int i;
+
+    if (samples < 2)
+    {
+        return HUGE_VAL;
+    }
+    while (t_coverage(high, samples - 1) < confidence && high < 1e12)
+    {
+        high *= 2;
+    }
+    for (i = 0; i < 64; ++i)
+    {
+        mid = (low + high) / 2;
+        if (t_coverage(mid, samples - 1) < confidence)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return (low + high) / 2;
+}
+
+/*
+ * Measures one sample on a fresh pipeline loaded from the functional state,
+ * which is left untouched
+ *
+ * Returns the cycles of the measured unit, or -1 if the run halted first
+ */
+static long
+measure_sample(const APEX_Func *func, int forwarding, long warmup, long unit,
+               long *detailed_insns)
+{
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+    long start = -1;
+    int halted = FALSE;
+
+    cpu = APEX_cpu_create_quiet(func->code_memory, func->code_memory_size, forwarding, NULL);
+    if (!cpu)
+    {
+        return -1;
+    }
+    APEX_func_load_cpu(func, cpu);
+    cycle = APEX_cpu_cycle_variant(cpu);
+
+    while (!halted && cpu->insn_completed < warmup)
+    {
+        halted = cycle(cpu);
+    }
+    start = cpu->clock;
+    while (!halted && cpu->insn_completed < warmup + unit)
+    {
+        halted = cycle(cpu);
+    }
+    if (cpu->insn_completed < warmup + unit)
+    {
+        start = -1;
+    }
+    else
+    {
+        start = cpu->clock - start;
+    }
+
+    *detailed_insns += cpu->insn_completed;
+    APEX_cpu_stop(cpu);
+    return start;
+}
+
+/*
+ * This function fills in the default sampling parameters
+ */
+void
+APEX_sample_config_default(APEX_Sample_Config *config)
+{
+    config->forwarding = FORWARD_ALL;
+    config->unit = APEX_SAMPLE_UNIT;
+    config->warmup = APEX_SAMPLE_WARMUP;
+    config->samples = APEX_SAMPLE_COUNT;
+    config->error = APEX_SAMPLE_ERROR;
+    config->confidence = APEX_SAMPLE_CONFIDENCE;
+}
+
+/*
+ * Returns how many samples fit in a run of num_insns instructions without
+ * the warm-up of one overlapping the unit of the previous one
+ */
+long
+APEX_sample_max_samples(const APEX_Sample_Config *config, long num_insns)
+{
+    if (num_insns <= config->warmup)
+    {
+        return 0;
+    }
+    return (num_insns - config->warmup) / (config->unit + config->warmup);
+}
+
+/*
+ * Takes config->samples samples evenly spread over a run of num_insns
+ * instructions, each unit centred in its period
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int
+APEX_sample_run(const APEX_Instruction *code_memory, int code_memory_size,
+                const int *data_memory, long num_insns,
+                const APEX_Sample_Config *config, APEX_Sample_Result *result)
+{
+    APEX_Func *func;
+    long period, start, cycles;
+    double sum = 0.0, sum_squares = 0.0, cpi, t;
+    int k;
+
+    memset(result, 0, sizeof(*result));
+    if (config->samples < 1 || config->unit < 1 || config->warmup < 0
+        || config->samples > APEX_sample_max_samples(config, num_insns))
+    {
+        return -1;
+    }
+    func = APEX_func_create(code_memory, code_memory_size, data_memory);
+    if (!func)
+    {
+        return -1;
+    }
+
+    period = (num_insns - config->warmup) / config->samples;
+    for (k = 0; k < config->samples; ++k)
+    {
+        start = k * period + (period - config->unit) / 2;
+
+        t = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID);
+        APEX_func_run(func, start - func->insn_completed);
+        result->functional_seconds += APEX_seconds(CLOCK_PROCESS_CPUTIME_ID) - t;
+        if (func->status != APEX_FUNC_RUNNING)
+        {
+            break;
+        }
+
+        t = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID);
+        cycles = measure_sample(func, config->forwarding, config->warmup, config->unit,
+                                &result->detailed_insns);
+        result->detailed_seconds += APEX_seconds(CLOCK_PROCESS_CPUTIME_ID) - t;
+        if (cycles < 0)
+        {
+            continue;
+        }
+
+        cpi = (double)cycles / config->unit;
+        sum += cpi;
+        sum_squares += cpi * cpi;
+        result->samples++;
+    }
+    APEX_func_destroy(func);
+
+    if (result->samples == 0)
+    {
+        return -1;
+    }
+    result->mean_cpi = sum / result->samples;
+    if (result->samples > 1)
+    {
+        result->stddev = sqrt(fmax(0.0, (sum_squares - sum * result->mean_cpi)
+                                            / (result->samples - 1)));
+    }
+    result->half_width = result->samples > 1
+                             ? confidence_t(config->confidence, result->samples)
+                                   * result->stddev / sqrt(result->samples)
+                             : HUGE_VAL;
+    return 0;
+}
+
+/*
+ * Simulates the whole run in detail, for checking an estimate
+ *
+ * Returns its cycles, 0 if HALT did not retire within max_cycles or -1 if
+ * the cpu could not be created
+ */
+static long
+run_detailed(const APEX_Instruction *code_memory, int code_memory_size,
+             const int *data_memory, int forwarding, long max_cycles, double *seconds)
+{
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+    long cycles;
+    int halted = FALSE;
+    double t;
+
+    cpu = APEX_cpu_create_quiet(code_memory, code_memory_size, forwarding, data_memory);
+    if (!cpu)
+    {
+        return -1;
+    }
+    cycle = APEX_cpu_cycle_variant(cpu);
+
+    t = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    while (cpu->clock < max_cycles && !(halted = cycle(cpu)))
+        ;
+    *seconds = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID) - t;
+
+    cycles = halted ? cpu->clock : 0;
+    APEX_cpu_stop(cpu);
+    return cycles;
+}
+
+/*
+ * Sizes the population with a functional pass, samples it in rounds and
+ * reports the estimate
+ */
+static int
+sample_program(const char *filename, const APEX_Instruction *code_memory,
+               int code_memory_size, const int *data_memory,
+               APEX_Sample_Config *config, int verify, long max_cycles)
+{
+    APEX_Sample_Result result;
+    APEX_Func *func;
+    int round, halted;
+    long num_insns, max_samples, needed, cycles;
+    double t, total_seconds, detailed_rate, projected, verify_seconds, cpi;
+
+    t = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    func = APEX_func_create(code_memory, code_memory_size, data_memory);
+    if (!func)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize functional model\n");
+        return 1;
+    }
+    APEX_func_run(func, APEX_FUNC_MAX_INSNS);
+    num_insns = func->insn_completed;
+    halted = func->status == APEX_FUNC_HALTED;
+    APEX_func_destroy(func);
+    if (!halted)
+    {
+        fprintf(stderr, "APEX_Error: %s did not halt within %ld instructions\n",
+                filename, num_insns);
+        return 1;
+    }
+    total_seconds = APEX_seconds(CLOCK_PROCESS_CPUTIME_ID) - t;
+
+    max_samples = APEX_sample_max_samples(config, num_insns);
+    if (max_samples < 2)
+    {
+        fprintf(stderr, "APEX_Error: %s retires %ld instructions, too few to "
+                "sample with unit=%ld and warmup=%ld\n", filename, num_insns,
+                config->unit, config->warmup);
+        return 1;
+    }
+    if (config->samples > max_samples)
+    {
+        config->samples = max_samples;
+    }
+
+    printf("APEX_SAMPLE: %s, %ld instructions, forwarding=%s, unit=%ld, "
+           "warmup=%ld, %.1f%% confidence\n", filename, num_insns,
+           APEX_forwarding_name(config->forwarding), config->unit, config->warmup,
+           config->confidence * 100);
+    printf("round,samples,cpi,stddev,half_width,relative_error,detailed_insns,seconds\n");
+    for (round = 1;; ++round)
+    {
+        if (APEX_sample_run(code_memory, code_memory_size, data_memory, num_insns,
+                            config, &result) < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to sample %s\n", filename);
+            return 1;
+        }
+        total_seconds += result.functional_seconds + result.detailed_seconds;
+        printf("%d,%d,%.4f,%.4f,%.4f,%.4f,%ld,%.6f\n", round, result.samples,
+               result.mean_cpi, result.stddev, result.half_width,
+               result.half_width / result.mean_cpi, result.detailed_insns,
+               result.functional_seconds + result.detailed_seconds);
+
+        /* n = (t * CV / error)^2 samples meet the target, taking the t
+         * quantile of this round's sample count */
+        needed = result.samples > 1
+                     ? (long)ceil(pow(confidence_t(config->confidence, result.samples)
+                                      * result.stddev / result.mean_cpi / config->error, 2))
+                     : 2 * config->samples;
+        if (needed < 2)
+        {
+            needed = 2;
+        }
+        if (result.half_width <= config->error * result.mean_cpi
+            || config->samples >= max_samples || round == APEX_SAMPLE_MAX_ROUNDS)
+        {
+            break;
+        }
+        config->samples = needed < max_samples ? needed : max_samples;
+    }
+
+    printf("APEX_SAMPLE: CPI %.4f +- %.4f (%.2f%%), %ld cycles estimated\n",
+           result.mean_cpi, result.half_width,
+           result.half_width / result.mean_cpi * 100,
+           (long)(result.mean_cpi * num_insns + 0.5));
+    if (result.half_width > config->error * result.mean_cpi)
+    {
+        printf("APEX_SAMPLE: target error %.2f%% not met, %ld samples needed\n",
+               config->error * 100, needed);
+    }
+
+    /* A detailed run is projected at the detailed rate of the samples */
+    detailed_rate = result.detailed_seconds > 0.0
+                        ? result.detailed_insns / result.detailed_seconds : 0.0;
+    projected = detailed_rate > 0.0 ? num_insns / detailed_rate : 0.0;
+    printf("APEX_SAMPLE: %.2f%% of instructions detailed, %.6f s sampled, "
+           "%.6f s projected detailed, %.1fx speedup\n",
+           100.0 * result.detailed_insns / num_insns, total_seconds, projected,
+           total_seconds > 0.0 ? projected / total_seconds : 0.0);
+
+    if (verify)
+    {
+        cycles = run_detailed(code_memory, code_memory_size, data_memory,
+                              config->forwarding, max_cycles, &verify_seconds);
+        if (cycles < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+            return 1;
+        }
+        if (cycles == 0)
+        {
+            fprintf(stderr, "APEX_Error: No HALT within %ld cycles\n", max_cycles);
+            return 1;
+        }
+        /* Unit CPIs are multiples of 1 / unit, hence the slack */
+        cpi = (double)cycles / num_insns;
+        printf("APEX_SAMPLE: detailed CPI %.4f in %ld cycles, error %+.2f%% %s "
+               "the interval, %.6f s detailed, %.1fx speedup\n", cpi, cycles,
+               (result.mean_cpi - cpi) / cpi * 100,
+               fabs(result.mean_cpi - cpi) <= result.half_width + 0.5 / config->unit
+                   ? "inside" : "outside",
+               verify_seconds, total_seconds > 0.0 ? verify_seconds / total_seconds : 0.0);
+    }
+    return 0;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> sample <option>...". Options are
+ *   data=<image>   forwarding=<none|ex|mem|all>   unit=<n>   warmup=<n>
+ *   samples=<n>   error=<fraction>   confidence=<fraction>   verify
+ *   max_cycles=<n>, which bounds the detailed run of verify
+ * Rounds are repeated with the sample count the previous one called for
+ * until the interval is within the target error.
+ */
+int
+APEX_sample_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Sample_Config config;
+    APEX_Instruction *code_memory;
+    int *data_memory;
+    APEX_Mode_Options options;
+    int code_memory_size, verify = FALSE, status, i;
+
+    APEX_sample_config_default(&config);
+    APEX_mode_defaults(&options, APEX_FUNC_MAX_INSNS);
+    options.forwarding = config.forwarding;
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "unit=", 5) == 0)
+        {
+            config.unit = atol(argv[i] + 5);
+        }
+        else if (strncmp(argv[i], "warmup=", 7) == 0)
+        {
+            config.warmup = atol(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "samples=", 8) == 0)
+        {
+            config.samples = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "error=", 6) == 0)
+        {
+            config.error = atof(argv[i] + 6);
+        }
+        else if (strncmp(argv[i], "confidence=", 11) == 0)
+        {
+            config.confidence = atof(argv[i] + 11);
+        }
+        else if (strcmp(argv[i], "verify") == 0)
+        {
+            verify = TRUE;
+        }
+        else if (!APEX_mode_option(&options, "sample", argv[i]))
+        {
+            return 1;
+        }
+    }
+    config.forwarding = options.forwarding;
+    if (config.unit < 1 || config.warmup < 0 || config.samples < 2
+        || config.error <= 0.0 || config.confidence <= 0.0 || config.confidence >= 1.0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid sampling parameters\n");
+        return 1;
+    }
+
+    data_memory = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    code_memory = data_memory ? APEX_mode_load(filename, &options, &code_memory_size,
+                                               data_memory) : NULL;
+    if (!code_memory)
+    {
+        free(data_memory);
+        return 1;
+    }
+
+    status = sample_program(filename, code_memory, code_memory_size, data_memory,
+                            &config, verify, options.max_cycles);
+    free(data_memory);
+    free(code_memory);
+    return status;
+}
@@ -0,0 +1,50 @@
+/*
+ * apex_sample.h
+ * Contains declarations of the sampled simulation mode
+ */
+#ifndef _APEX_SAMPLE_H_
+#define _APEX_SAMPLE_H_
+
+#include "apex_cpu.h"
+
+/* Defaults of the sampling parameters */
+#define APEX_SAMPLE_UNIT 1000          /* Instructions measured per sample */
+#define APEX_SAMPLE_WARMUP 200         /* Instructions of detailed warm-up */
+#define APEX_SAMPLE_COUNT 30           /* Samples of the first round */
+#define APEX_SAMPLE_ERROR 0.03         /* Target relative half-width */
+#define APEX_SAMPLE_CONFIDENCE 0.95
+
+/* Rounds of sample count tuning before the estimate is taken as is */
+#define APEX_SAMPLE_MAX_ROUNDS 4
+
+typedef struct APEX_Sample_Config
+{
+    int forwarding;                /* FORWARD_* of the detailed samples */
+    long unit;
+    long warmup;
+    int samples;
+    double error;
+    double confidence;
+} APEX_Sample_Config;
+
+/* Outcome of one round of systematic sampling */
+typedef struct APEX_Sample_Result
+{
+    int samples;                   /* Samples taken */
+    double mean_cpi;
+    double stddev;                 /* Of the per-sample CPI */
+    double half_width;             /* Of the confidence interval on mean_cpi */
+    long detailed_insns;           /* Retired in detail, warm-up included */
+    double functional_seconds;
+    double detailed_seconds;
+} APEX_Sample_Result;
+
+void APEX_sample_config_default(APEX_Sample_Config *config);
+long APEX_sample_max_samples(const APEX_Sample_Config *config, long num_insns);
+int APEX_sample_run(const APEX_Instruction *code_memory, int code_memory_size,
+                    const int *data_memory, long num_insns,
+                    const APEX_Sample_Config *config, APEX_Sample_Result *result);
+
+int APEX_sample_main(const char *filename, int argc, char const *argv[]);
+
+#endif
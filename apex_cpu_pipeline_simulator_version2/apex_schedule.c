@@ -0,0 +1,719 @@
+/*
+ * apex_schedule.c
+ * Contains the basic block instruction scheduler
+ *
+ * Every basic block is list scheduled on its own. A branch, jump or HALT
+ * that ends a block stays last, so blocks keep their addresses and branch
+ * offsets and jump targets stay valid. An instruction may move past
+ * another unless one writes a register the other reads or writes, one is
+ * a store and the other a load or store that may touch the same word, or
+ * the other is the block's last flag setter. Each slot is given to the
+ * ready instruction decode would issue earliest under the hazard
+ * analyser's model, the one with the longest path to the end of the block
+ * on ties. A block keeps its order unless the new one issues its last
+ * instruction earlier.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_schedule.h"
+#include "apex_hazard.h"
+#include "apex_simpoint.h"
+#include "apex_fuzz.h"
+#include "apex_func.h"
+
+/* What the scheduler knows about one instruction of a block */
+typedef struct Node
+{
+    int reads[2];
+    int writes[2];
+    int kinds[2];                  /* APEX_HAZARD_* of each write */
+    int num_writes;
+    int base;                      /* Base register of a load or store, else -1 */
+    int store;
+    int base_def;                  /* Block offset of the last writer of base
+                                    * before it, -1 if set before the block */
+    int height;                    /* Cycles from its issue to the block end */
+    int preds;                     /* Predecessors not scheduled yet */
+    int placed;
+} Node;
+
+static int
+sets_flags(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_CML:
+        case OPCODE_CMP:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static int
+transfers_control(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+        case OPCODE_HALT:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static void
+describe(const APEX_Instruction *ins, Node *node)
+{
+    memset(node, 0, sizeof(Node));
+    APEX_hazard_reads(ins, node->reads);
+    node->num_writes = APEX_hazard_writes(ins, node->writes, node->kinds);
+    node->base = -1;
+    switch (ins->opcode)
+    {
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+            node->base = ins->rs1;
+            break;
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            node->base = ins->rs2;
+            node->store = TRUE;
+            break;
+    }
+}
+
+static int
+writes_register(const Node *node, int reg)
+{
+    int w;
+
+    for (w = 0; w < node->num_writes; ++w)
+    {
+        if (node->writes[w] == reg)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Tells how many cycles after the earlier instruction a the later one b
+ * can issue if b must stay behind a, 0 if they may swap
+ */
+static int
+dependence(const APEX_Instruction *ia, const Node *a, const APEX_Instruction *ib,
+           const Node *b, int b_is_last_setter, int forwarding)
+{
+    int latency = 0, s, w;
+
+    /* Read after write */
+    for (s = 0; s < 2; ++s)
+    {
+        for (w = 0; w < a->num_writes; ++w)
+        {
+            if (b->reads[s] >= 0 && b->reads[s] == a->writes[w]
+                && APEX_hazard_ready(a->kinds[w], forwarding) > latency)
+            {
+                latency = APEX_hazard_ready(a->kinds[w], forwarding);
+            }
+        }
+    }
+    if (latency > 0)
+    {
+        return latency;
+    }
+
+    /* Write after read and write after write */
+    for (w = 0; w < b->num_writes; ++w)
+    {
+        if (b->writes[w] == a->reads[0] || b->writes[w] == a->reads[1]
+            || writes_register(a, b->writes[w]))
+        {
+            return 1;
+        }
+    }
+
+    /* Words a store may touch, unless both use one base value at other offsets */
+    if (a->base >= 0 && b->base >= 0 && (a->store || b->store)
+        && !(a->base == b->base && a->base_def == b->base_def && ia->imm != ib->imm))
+    {
+        return 1;
+    }
+
+    return sets_flags(ia->opcode) && b_is_last_setter ? 1 : 0;
+}
+
+/* Predicted decode stalls of the program walked as if branches fell through */
+static int
+predicted_stalls(const APEX_Instruction *code_memory, int code_memory_size,
+                 int forwarding, int *issue)
+{
+    int stalls = 0, i;
+
+    for (i = 0; i < code_memory_size; ++i)
+    {
+        issue[i] = APEX_hazard_issue(code_memory, issue, i, forwarding);
+        stalls += issue[i] == 0 ? 0 : issue[i] - (i > 0 ? issue[i - 1] : 0) - 1;
+    }
+    return stalls;
+}
+
+/*
+ * Schedules the block from first to last of code_memory into the same
+ * slots of the scheduled program, after the blocks before it
+ *
+ * Returns TRUE if its order changed
+ */
+static int
+schedule_block(const APEX_Instruction *code_memory, APEX_Schedule *schedule,
+               int *issue, int first, int last, Node *nodes, unsigned char *edges)
+{
+    APEX_Instruction *out = schedule->code_memory;
+    int n = last - first + 1, last_setter = -1, pinned, best, best_cycle, cycle;
+    int moved = FALSE, i, j, k;
+
+    for (i = 0; i < n; ++i)
+    {
+        describe(&code_memory[first + i], &nodes[i]);
+        if (sets_flags(code_memory[first + i].opcode))
+        {
+            last_setter = i;
+        }
+    }
+    for (i = 0; i < n; ++i)
+    {
+        nodes[i].base_def = -1;
+        for (j = i - 1; j >= 0 && nodes[i].base >= 0; --j)
+        {
+            if (writes_register(&nodes[j], nodes[i].base))
+            {
+                nodes[i].base_def = j;
+                break;
+            }
+        }
+    }
+    for (i = n - 1; i >= 0; --i)
+    {
+        for (j = i + 1; j < n; ++j)
+        {
+            edges[i * n + j] = dependence(&code_memory[first + i], &nodes[i],
+                                          &code_memory[first + j], &nodes[j],
+                                          j == last_setter, schedule->forwarding);
+            if (edges[i * n + j])
+            {
+                nodes[j].preds++;
+                if (edges[i * n + j] + nodes[j].height > nodes[i].height)
+                {
+                    nodes[i].height = edges[i * n + j] + nodes[j].height;
+                }
+            }
+        }
+    }
+
+    /* List schedule everything but the instruction that ends the block */
+    pinned = transfers_control(code_memory[last].opcode);
+    for (k = 0; k < n - pinned; ++k)
+    {
+        best = -1;
+        best_cycle = 0;
+        for (i = 0; i < n - pinned; ++i)
+        {
+            if (nodes[i].placed || nodes[i].preds > 0)
+            {
+                continue;
+            }
+            out[first + k] = code_memory[first + i];
+            cycle = APEX_hazard_issue(out, issue, first + k, schedule->forwarding);
+            if (best < 0 || cycle < best_cycle
+                || (cycle == best_cycle && nodes[i].height > nodes[best].height))
+            {
+                best = i;
+                best_cycle = cycle;
+            }
+        }
+        out[first + k] = code_memory[first + best];
+        issue[first + k] = best_cycle;
+        schedule->origin[first + k] = first + best;
+        moved |= best != k;
+        nodes[best].placed = TRUE;
+        for (j = best + 1; j < n; ++j)
+        {
+            nodes[j].preds -= edges[best * n + j] != 0;
+        }
+    }
+    if (pinned)
+    {
+        out[last] = code_memory[last];
+        issue[last] = APEX_hazard_issue(out, issue, last, schedule->forwarding);
+        schedule->origin[last] = last;
+    }
+    if (!moved)
+    {
+        return FALSE;
+    }
+
+    /* Keep the new order only if the block ends earlier */
+    cycle = issue[last];
+    for (k = 0; k < n; ++k)
+    {
+        out[first + k] = code_memory[first + k];
+        issue[first + k] = APEX_hazard_issue(out, issue, first + k, schedule->forwarding);
+    }
+    if (cycle >= issue[last])
+    {
+        for (k = 0; k < n; ++k)
+        {
+            schedule->origin[first + k] = first + k;
+        }
+        return FALSE;
+    }
+    for (k = 0; k < n; ++k)
+    {
+        out[first + k] = code_memory[schedule->origin[first + k]];
+        issue[first + k] = APEX_hazard_issue(out, issue, first + k, schedule->forwarding);
+    }
+    return TRUE;
+}
+
+/*
+ * Reorders the instructions of every basic block of a program to make
+ * decode stall less under the forwarding paths given. Every block is
+ * applied.
+ *
+ * Returns NULL if memory ran out
+ */
+APEX_Schedule *
+APEX_schedule_create(const APEX_Instruction *code_memory, int code_memory_size,
+                     int forwarding)
+{
+    APEX_Schedule *schedule = calloc(1, sizeof(APEX_Schedule));
+    int *block_of = NULL;
+    Node *nodes = NULL;
+    unsigned char *edges = NULL;
+    int first, last, longest = 0, b;
+
+    if (!schedule)
+    {
+        return NULL;
+    }
+    schedule->code_memory_size = code_memory_size;
+    schedule->forwarding = forwarding;
+    schedule->code_memory = calloc(code_memory_size + 1, sizeof(APEX_Instruction));
+    schedule->origin = calloc(code_memory_size + 1, sizeof(int));
+    schedule->order = calloc(code_memory_size + 1, sizeof(int));
+    schedule->issue = calloc(code_memory_size + 1, sizeof(int));
+    schedule->blocks = calloc(code_memory_size + 1, sizeof(APEX_Schedule_Block));
+    block_of = malloc((code_memory_size + 1) * sizeof(int));
+    if (!schedule->code_memory || !schedule->origin || !schedule->order || !schedule->issue
+        || !schedule->blocks || !block_of)
+    {
+        goto fail;
+    }
+    schedule->num_blocks = APEX_simpoint_blocks(code_memory, code_memory_size, block_of);
+    for (first = 0, b = 0; first < code_memory_size; first = last + 1, ++b)
+    {
+        for (last = first; last + 1 < code_memory_size && block_of[last + 1] == block_of[first];
+             ++last)
+            ;
+        schedule->blocks[b].first = first;
+        schedule->blocks[b].last = last;
+        longest = last - first + 1 > longest ? last - first + 1 : longest;
+    }
+    nodes = malloc((longest + 1) * sizeof(Node));
+    edges = calloc((size_t)(longest + 1) * (longest + 1), 1);
+    if (!nodes || !edges)
+    {
+        goto fail;
+    }
+
+    schedule->stalls_before = predicted_stalls(code_memory, code_memory_size, forwarding,
+                                               schedule->issue);
+    for (b = 0; b < schedule->num_blocks; ++b)
+    {
+        APEX_Schedule_Block *block = &schedule->blocks[b];
+        int n = block->last - block->first + 1;
+
+        memset(edges, 0, (size_t)n * n);
+        block->rescheduled = schedule_block(code_memory, schedule, schedule->issue,
+                                            block->first, block->last, nodes, edges);
+        block->applied = block->rescheduled;
+        schedule->num_rescheduled += block->rescheduled;
+    }
+    memcpy(schedule->order, schedule->origin, code_memory_size * sizeof(int));
+    schedule->stalls_after = predicted_stalls(schedule->code_memory, code_memory_size,
+                                              forwarding, schedule->issue);
+
+    free(block_of);
+    free(nodes);
+    free(edges);
+    return schedule;
+
+fail:
+    free(block_of);
+    free(nodes);
+    free(edges);
+    APEX_schedule_destroy(schedule);
+    return NULL;
+}
+
+/*
+ * This function puts a block of the program in its new order, or back in
+ * the old one
+ */
+void
+APEX_schedule_apply(APEX_Schedule *schedule, const APEX_Instruction *code_memory,
+                    int block, int apply)
+{
+    APEX_Schedule_Block *b = &schedule->blocks[block];
+    int i;
+
+    for (i = b->first; i <= b->last; ++i)
+    {
+        schedule->origin[i] = apply ? schedule->order[i] : i;
+        schedule->code_memory[i] = code_memory[schedule->origin[i]];
+    }
+    b->applied = apply && b->rescheduled;
+    schedule->stalls_after = predicted_stalls(schedule->code_memory,
+                                              schedule->code_memory_size,
+                                              schedule->forwarding, schedule->issue);
+}
+
+/*
+ * This function prints the program as scheduled, with where every moved
+ * instruction came from and the cycle decode is predicted to issue it
+ */
+void
+APEX_schedule_print(const APEX_Schedule *schedule, FILE *out)
+{
+    char text[128];
+    int applied = 0, i;
+
+    for (i = 0; i < schedule->num_blocks; ++i)
+    {
+        applied += schedule->blocks[i].applied;
+    }
+    fprintf(out, "APEX_SCHEDULE: %d instructions, %d basic blocks, %d rescheduled, "
+            "%d applied, forwarding=%s\n", schedule->code_memory_size, schedule->num_blocks,
+            schedule->num_rescheduled, applied, APEX_forwarding_name(schedule->forwarding));
+    fprintf(out, "pc    from  issue  instruction\n");
+    for (i = 0; i < schedule->code_memory_size; ++i)
+    {
+        APEX_format_instruction(text, sizeof(text), &schedule->code_memory[i]);
+        if (schedule->origin[i] == i)
+        {
+            fprintf(out, "%-4d  %-4s  %5d  %s\n", 4000 + 4 * i, "", schedule->issue[i], text);
+        }
+        else
+        {
+            fprintf(out, "%-4d  %-4d  %5d  %s\n", 4000 + 4 * i, 4000 + 4 * schedule->origin[i],
+                    schedule->issue[i], text);
+        }
+    }
+    fprintf(out, "APEX_SCHEDULE: predicted %d stall cycles per pass, was %d\n",
+            schedule->stalls_after, schedule->stalls_before);
+}
+
+/*
+ * This function deallocates a schedule
+ */
+void
+APEX_schedule_destroy(APEX_Schedule *schedule)
+{
+    if (!schedule)
+    {
+        return;
+    }
+    free(schedule->code_memory);
+    free(schedule->origin);
+    free(schedule->order);
+    free(schedule->issue);
+    free(schedule->blocks);
+    free(schedule);
+}
+
+/* Runs a program on the pipeline, NULL if it could not be started */
+static APEX_CPU *
+simulate(const APEX_Instruction *code_memory, int code_memory_size, int forwarding,
+         const int *data_memory, long max_cycles, int *halted)
+{
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+
+    cpu = APEX_cpu_create_quiet(code_memory, code_memory_size, forwarding, data_memory);
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    cycle = APEX_cpu_cycle_variant(cpu);
+    *halted = FALSE;
+    while (cpu->clock < max_cycles && !(*halted = cycle(cpu)))
+        ;
+    return cpu;
+}
+
+/*
+ * Compares the final state of a pipeline run with the functional model's,
+ * printing every register, flag and data memory word that differs if out
+ * is given
+ *
+ * Returns the number of differences
+ */
+static int
+diff_state(const APEX_Func *reference, const APEX_CPU *cpu, FILE *out)
+{
+    int i, differences = 0;
+
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (reference->regs[i] != cpu->regs[i])
+        {
+            if (out)
+            {
+                fprintf(out, "  R%-14d %-24d %d\n", i, reference->regs[i], cpu->regs[i]);
+            }
+            differences++;
+        }
+    }
+    if (reference->cc.z != cpu->cc.z || reference->cc.p != cpu->cc.p
+        || reference->cc.n != cpu->cc.n)
+    {
+        if (out)
+        {
+            fprintf(out, "  %-15s z=%d p=%d n=%-14d z=%d p=%d n=%d\n", "flags",
+                    reference->cc.z, reference->cc.p, reference->cc.n,
+                    cpu->cc.z, cpu->cc.p, cpu->cc.n);
+        }
+        differences++;
+    }
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (reference->data_memory[i] != cpu->data_memory[i])
+        {
+            if (out)
+            {
+                fprintf(out, "  M%-14d %-24d %d\n", i, reference->data_memory[i],
+                        cpu->data_memory[i]);
+            }
+            differences++;
+        }
+    }
+    return differences;
+}
+
+/* TRUE if two functional runs end in the same state */
+static int
+same_state(const APEX_Func *a, const APEX_Func *b)
+{
+    return a->status == b->status && a->insn_completed == b->insn_completed
+           && memcmp(a->regs, b->regs, sizeof(a->regs)) == 0
+           && a->cc.z == b->cc.z && a->cc.p == b->cc.p && a->cc.n == b->cc.n
+           && memcmp(a->data_memory, b->data_memory, sizeof(a->data_memory)) == 0;
+}
+
+/*
+ * Runs the program as scheduled on the pipeline and checks it against
+ * the reference
+ *
+ * Returns the stopped cpu if it halted in the reference state, else NULL
+ */
+static APEX_CPU *
+validate(const APEX_Schedule *schedule, const APEX_Func *reference,
+         const int *data_memory, long max_cycles)
+{
+    APEX_CPU *cpu;
+    int halted;
+
+    cpu = simulate(schedule->code_memory, schedule->code_memory_size, schedule->forwarding,
+                   data_memory, max_cycles, &halted);
+    if (cpu && (!halted || cpu->insn_completed != reference->insn_completed
+                || diff_state(reference, cpu, NULL) > 0))
+    {
+        APEX_cpu_stop(cpu);
+        cpu = NULL;
+    }
+    return cpu;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> schedule <output_file> <option>...".
+ * Options are data=<image>, forwarding=<none|ex|mem|all> and max_cycles=<n>.
+ *
+ * The reference is the final state of the functional model running the
+ * input. The scheduled program must reach it on the functional model and
+ * on the pipeline. A block whose new order the pipeline ends elsewhere
+ * with is put back in its old one, and the program is only written once
+ * it validates. Exits with 1 if it does not.
+ */
+int
+APEX_schedule_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Instruction *code_memory;
+    APEX_Schedule *schedule = NULL;
+    APEX_Func *reference = NULL, *check = NULL;
+    APEX_CPU *before = NULL, *after = NULL;
+    APEX_Mode_Options options;
+    const char *output;
+    int *data_memory;
+    int code_memory_size, forwarding, halted, status = 1, b, i;
+    long max_cycles, budget;
+
+    if (argc < 1)
+    {
+        fprintf(stderr, "APEX_Error: schedule needs an output file\n");
+        return 1;
+    }
+    output = argv[0];
+    APEX_mode_defaults(&options, 100000000L);
+    for (i = 1; i < argc; ++i)
+    {
+        if (!APEX_mode_option(&options, "schedule", argv[i]))
+        {
+            return 1;
+        }
+    }
+    forwarding = options.forwarding;
+    max_cycles = options.max_cycles;
+
+    data_memory = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    code_memory = data_memory ? APEX_mode_load(filename, &options, &code_memory_size,
+                                               data_memory) : NULL;
+    if (!code_memory)
+    {
+        free(data_memory);
+        return 1;
+    }
+    schedule = APEX_schedule_create(code_memory, code_memory_size, forwarding);
+    reference = APEX_func_create(code_memory, code_memory_size, data_memory);
+    if (!schedule || !reference)
+    {
+        fprintf(stderr, "APEX_Error: Unable to schedule %s\n", filename);
+        goto cleanup;
+    }
+
+    /* The functional model says what the program computes */
+    APEX_func_run(reference, APEX_FUNC_MAX_INSNS);
+    if (reference->status != APEX_FUNC_HALTED)
+    {
+        fprintf(stderr, "APEX_Error: %s does not halt on the functional model\n", filename);
+        goto cleanup;
+    }
+    check = APEX_func_create(schedule->code_memory, code_memory_size, data_memory);
+    if (!check)
+    {
+        fprintf(stderr, "APEX_Error: Unable to schedule %s\n", filename);
+        goto cleanup;
+    }
+    APEX_func_run(check, APEX_FUNC_MAX_INSNS);
+    if (!same_state(reference, check))
+    {
+        fprintf(stderr, "APEX_Error: Scheduled program computes something else\n");
+        goto cleanup;
+    }
+
+    before = simulate(code_memory, code_memory_size, forwarding, data_memory, max_cycles,
+                      &halted);
+    if (!before || !halted)
+    {
+        fprintf(stderr, "APEX_Error: No HALT within %ld cycles\n", max_cycles);
+        goto cleanup;
+    }
+    if (before->insn_completed != reference->insn_completed
+        || diff_state(reference, before, NULL) > 0)
+    {
+        printf("APEX_SCHEDULE: the pipeline does not run %s to the functional model's "
+               "state\n", filename);
+    }
+
+    /* A scheduled program that runs much longer has hung the pipeline */
+    budget = 2L * before->clock + 1000 < max_cycles ? 2L * before->clock + 1000 : max_cycles;
+    after = validate(schedule, reference, data_memory, budget);
+    if (!after)
+    {
+        for (b = 0; b < schedule->num_blocks; ++b)
+        {
+            APEX_schedule_apply(schedule, code_memory, b, FALSE);
+        }
+        for (b = 0; b < schedule->num_blocks; ++b)
+        {
+            if (!schedule->blocks[b].rescheduled)
+            {
+                continue;
+            }
+            APEX_schedule_apply(schedule, code_memory, b, TRUE);
+            if ((after = validate(schedule, reference, data_memory, budget)))
+            {
+                APEX_cpu_stop(after);
+                continue;
+            }
+            APEX_schedule_apply(schedule, code_memory, b, FALSE);
+            printf("APEX_SCHEDULE: block %d-%d keeps its order, the pipeline ends in "
+                   "another state with the new one\n", 4000 + 4 * schedule->blocks[b].first,
+                   4000 + 4 * schedule->blocks[b].last);
+        }
+        after = validate(schedule, reference, data_memory, budget);
+    }
+    APEX_schedule_print(schedule, stdout);
+    if (!after)
+    {
+        after = simulate(schedule->code_memory, code_memory_size, forwarding, data_memory,
+                         budget, &halted);
+        fprintf(stderr, "APEX_Error: The pipeline does not run %s to the functional "
+                "model's state, %s not written\n", filename, output);
+        if (after)
+        {
+            diff_state(reference, after, stderr);
+        }
+        goto cleanup;
+    }
+
+    printf("APEX_SCHEDULE: simulated %d cycles, was %d, saved %d (%.2f%%)\n",
+           after->clock, before->clock, before->clock - after->clock,
+           100.0 * (before->clock - after->clock) / before->clock);
+    printf("APEX_SCHEDULE: simulated %d stall cycles, was %d\n", after->stall_cycles,
+           before->stall_cycles);
+    printf("APEX_SCHEDULE: final registers, flags and data memory match the functional "
+           "model\n");
+    if (APEX_fuzz_write(output, schedule->code_memory, code_memory_size) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", output);
+        goto cleanup;
+    }
+    printf("APEX_SCHEDULE: wrote %s\n", output);
+    status = 0;
+
+cleanup:
+    if (before)
+    {
+        APEX_cpu_stop(before);
+    }
+    if (after)
+    {
+        APEX_cpu_stop(after);
+    }
+    APEX_func_destroy(reference);
+    APEX_func_destroy(check);
+    APEX_schedule_destroy(schedule);
+    free(data_memory);
+    free(code_memory);
+    return status;
+}
@@ -0,0 +1,45 @@
+/*
+ * apex_schedule.h
+ * Contains declarations of the basic block instruction scheduler
+ */
+#ifndef _APEX_SCHEDULE_H_
+#define _APEX_SCHEDULE_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+typedef struct APEX_Schedule_Block
+{
+    int first;
+    int last;
+    int rescheduled;               /* TRUE if the scheduler changed its order */
+    int applied;                   /* TRUE if code_memory has the new order */
+} APEX_Schedule_Block;
+
+/* A program with the instructions of its basic blocks reordered */
+typedef struct APEX_Schedule
+{
+    APEX_Instruction *code_memory; /* Program with the applied blocks reordered */
+    int code_memory_size;
+    int *origin;                   /* Code memory index each slot came from */
+    int *order;                    /* The same with every block applied */
+    int *issue;                    /* Predicted issue cycle of each slot */
+    int forwarding;                /* FORWARD_* it was scheduled for */
+    int num_blocks;
+    int num_rescheduled;
+    APEX_Schedule_Block *blocks;
+    int stalls_before;             /* Predicted decode stalls of one pass */
+    int stalls_after;              /* through every block, fall-through */
+} APEX_Schedule;
+
+APEX_Schedule *APEX_schedule_create(const APEX_Instruction *code_memory,
+                                    int code_memory_size, int forwarding);
+void APEX_schedule_apply(APEX_Schedule *schedule, const APEX_Instruction *code_memory,
+                         int block, int apply);
+void APEX_schedule_print(const APEX_Schedule *schedule, FILE *out);
+void APEX_schedule_destroy(APEX_Schedule *schedule);
+
+int APEX_schedule_main(const char *filename, int argc, char const *argv[]);
+
+#endif
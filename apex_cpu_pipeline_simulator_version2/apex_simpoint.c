@@ -0,0 +1,884 @@
+/*
+ * apex_simpoint.c
+ * Contains basic block vector profiling and simulation point selection
+ *
+ * A functional pass splits the run into intervals of a fixed number of
+ * instructions and records, per interval, how many instructions retired in
+ * every basic block of code memory. The vectors are normalised, randomly
+ * projected to a few dimensions and clustered with k-means, k picked by
+ * the Bayesian information criterion. The interval nearest each centroid
+ * is simulated in detail from a functional checkpoint, and the CPIs of
+ * those intervals, weighted by the instructions of their clusters, stand
+ * in for the whole run.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_simpoint.h"
+#include "apex_pool.h"
+
+static unsigned long
+mix(unsigned long x)
+{
+    x += 0x9e3779b97f4a7c15UL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+    return x ^ (x >> 31);
+}
+
+/* Returns a number in [0, 1) */
+static double
+random_unit(unsigned long *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return ((*state * 0x2545f4914f6cdd1dUL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int
+ends_block(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+        case OPCODE_HALT:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/*
+ * Splits code memory into basic blocks. Blocks start at the first
+ * instruction, after every branch, jump and HALT, and at branch targets.
+ * Jump targets are only known at run time; a jump into the middle of a
+ * block counts towards that block.
+ *
+ * Returns the number of blocks, block_of is set per code memory index
+ */
+int
+APEX_simpoint_blocks(const APEX_Instruction *code_memory, int code_memory_size,
+                     int *block_of)
+{
+    int i, target, num_blocks = 0;
+
+    memset(block_of, 0, code_memory_size * sizeof(int));
+    for (i = 0; i < code_memory_size; ++i)
+    {
+        if (!ends_block(code_memory[i].opcode))
+        {
+            continue;
+        }
+        if (i + 1 < code_memory_size)
+        {
+            block_of[i + 1] = TRUE;
+        }
+        if (code_memory[i].opcode != OPCODE_JUMP && code_memory[i].opcode != OPCODE_JALR
+            && code_memory[i].opcode != OPCODE_HALT && code_memory[i].imm % 4 == 0)
+        {
+            target = i + code_memory[i].imm / 4;
+            if (target >= 0 && target < code_memory_size)
+            {
+                block_of[target] = TRUE;
+            }
+        }
+    }
+
+    /* Leaders marked, number the blocks */
+    for (i = 0; i < code_memory_size; ++i)
+    {
+        if (i > 0 && block_of[i])
+        {
+            num_blocks++;
+        }
+        block_of[i] = num_blocks;
+    }
+    return code_memory_size > 0 ? num_blocks + 1 : 0;
+}
+
+/* Normalises the counts of an interval and projects them into vector */
+static void
+project(const APEX_Simpoint_Profile *profile, const double *matrix, long *counts,
+        long num_insns, double *vector)
+{
+    int b, d;
+
+    memset(vector, 0, profile->dims * sizeof(double));
+    for (b = 0; b < profile->num_blocks; ++b)
+    {
+        double share = (double)counts[b] / num_insns;
+
+        if (!counts[b])
+        {
+            continue;
+        }
+        if (!matrix)
+        {
+            vector[b] = share;
+        }
+        else
+        {
+            for (d = 0; d < profile->dims; ++d)
+            {
+                vector[d] += share * matrix[b * profile->dims + d];
+            }
+        }
+        counts[b] = 0;
+    }
+}
+
+/*
+ * Runs the program functionally and records a basic block vector for
+ * every interval instructions. Programs with more blocks than
+ * APEX_SIMPOINT_DIMS are projected with a random matrix drawn from seed.
+ *
+ * Returns NULL if memory ran out or the program does not halt
+ */
+APEX_Simpoint_Profile *
+APEX_simpoint_profile(const APEX_Instruction *code_memory, int code_memory_size,
+                      const int *data_memory, long interval, unsigned long seed)
+{
+    APEX_Simpoint_Profile *profile = calloc(1, sizeof(APEX_Simpoint_Profile));
+    APEX_Func *func = APEX_func_create(code_memory, code_memory_size, data_memory);
+    double *matrix = NULL, *grown_vectors;
+    long *counts = NULL, *grown_insns, n = 0;
+    unsigned long state = mix(seed);
+    int max_intervals = 0, ok = FALSE, index, i;
+
+    if (!profile || !func || interval < 1 || code_memory_size < 1)
+    {
+        goto done;
+    }
+    profile->interval = interval;
+    profile->block_of = malloc(code_memory_size * sizeof(int));
+    if (!profile->block_of)
+    {
+        goto done;
+    }
+    profile->num_blocks = APEX_simpoint_blocks(code_memory, code_memory_size,
+                                               profile->block_of);
+    profile->dims = profile->num_blocks <= APEX_SIMPOINT_DIMS ? profile->num_blocks
+                                                              : APEX_SIMPOINT_DIMS;
+    counts = calloc(profile->num_blocks, sizeof(long));
+    if (!counts)
+    {
+        goto done;
+    }
+    if (profile->num_blocks > APEX_SIMPOINT_DIMS)
+    {
+        matrix = malloc(profile->num_blocks * profile->dims * sizeof(double));
+        if (!matrix)
+        {
+            goto done;
+        }
+        for (i = 0; i < profile->num_blocks * profile->dims; ++i)
+        {
+            matrix[i] = 2.0 * random_unit(&state) - 1.0;
+        }
+    }
+
+    while (func->status == APEX_FUNC_RUNNING)
+    {
+        index = (func->pc - 4000) / 4;
+        APEX_func_step(func);
+        if (func->status != APEX_FUNC_RUNNING && func->status != APEX_FUNC_HALTED)
+        {
+            goto done;
+        }
+        counts[profile->block_of[index]]++;
+        if (++n < interval && func->status == APEX_FUNC_RUNNING)
+        {
+            continue;
+        }
+
+        if (profile->num_intervals == max_intervals)
+        {
+            max_intervals = max_intervals ? 2 * max_intervals : 64;
+            grown_insns = realloc(profile->interval_insns, max_intervals * sizeof(long));
+            if (grown_insns)
+            {
+                profile->interval_insns = grown_insns;
+            }
+            grown_vectors = realloc(profile->vectors,
+                                    max_intervals * profile->dims * sizeof(double));
+            if (grown_vectors)
+            {
+                profile->vectors = grown_vectors;
+            }
+            if (!grown_insns || !grown_vectors)
+            {
+                goto done;
+            }
+        }
+        project(profile, matrix, counts, n,
+                &profile->vectors[profile->num_intervals * profile->dims]);
+        profile->interval_insns[profile->num_intervals++] = n;
+        n = 0;
+        if (func->insn_completed > APEX_FUNC_MAX_INSNS)
+        {
+            goto done;
+        }
+    }
+    profile->num_insns = func->insn_completed;
+    ok = TRUE;
+
+done:
+    free(matrix);
+    free(counts);
+    APEX_func_destroy(func);
+    if (!ok)
+    {
+        APEX_simpoint_profile_free(profile);
+        return NULL;
+    }
+    return profile;
+}
+
+void
+APEX_simpoint_profile_free(APEX_Simpoint_Profile *profile)
+{
+    if (profile)
+    {
+        free(profile->block_of);
+        free(profile->interval_insns);
+        free(profile->vectors);
+        free(profile);
+    }
+}
+
+static double
+distance2(const double *a, const double *b, int dims)
+{
+    double sum = 0.0;
+    int d;
+
+    for (d = 0; d < dims; ++d)
+    {
+        sum += (a[d] - b[d]) * (a[d] - b[d]);
+    }
+    return sum;
+}
+
+/*
+ * Clusters the vectors into k clusters, seeded k-means++ style
+ *
+ * Returns the sum of squared distances to the centers
+ */
+static double
+kmeans(const APEX_Simpoint_Profile *profile, int k, unsigned long seed,
+       double *centers, int *assign, double *nearest)
+{
+    const double *x = profile->vectors;
+    int n = profile->num_intervals, dims = profile->dims;
+    unsigned long state = mix(seed ^ mix(k));
+    double total, pick, distortion = 0.0, d;
+    int *sizes = calloc(k, sizeof(int));
+    int c, i, iteration, changed = TRUE;
+
+    if (!sizes)
+    {
+        return -1.0;
+    }
+
+    memcpy(centers, &x[(int)(random_unit(&state) * n) * dims], dims * sizeof(double));
+    for (i = 0; i < n; ++i)
+    {
+        nearest[i] = distance2(&x[i * dims], centers, dims);
+    }
+    for (c = 1; c < k; ++c)
+    {
+        for (total = 0.0, i = 0; i < n; ++i)
+        {
+            total += nearest[i];
+        }
+        pick = random_unit(&state) * total;
+        for (i = 0; i < n - 1 && (pick -= nearest[i]) >= 0.0; ++i)
+            ;
+        memcpy(&centers[c * dims], &x[i * dims], dims * sizeof(double));
+        for (i = 0; i < n; ++i)
+        {
+            d = distance2(&x[i * dims], &centers[c * dims], dims);
+            nearest[i] = d < nearest[i] ? d : nearest[i];
+        }
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        assign[i] = -1;
+    }
+    for (iteration = 0; changed && iteration < APEX_SIMPOINT_ITERATIONS; ++iteration)
+    {
+        changed = FALSE;
+        distortion = 0.0;
+        for (i = 0; i < n; ++i)
+        {
+            int best = 0;
+
+            nearest[i] = distance2(&x[i * dims], centers, dims);
+            for (c = 1; c < k; ++c)
+            {
+                d = distance2(&x[i * dims], &centers[c * dims], dims);
+                if (d < nearest[i])
+                {
+                    nearest[i] = d;
+                    best = c;
+                }
+            }
+            changed |= assign[i] != best;
+            assign[i] = best;
+            distortion += nearest[i];
+        }
+        if (!changed)
+        {
+            break;
+        }
+
+        /* An emptied cluster keeps its old center */
+        memset(sizes, 0, k * sizeof(int));
+        for (i = 0; i < n; ++i)
+        {
+            if (sizes[assign[i]]++ == 0)
+            {
+                memset(&centers[assign[i] * dims], 0, dims * sizeof(double));
+            }
+        }
+        for (i = 0; i < n; ++i)
+        {
+            for (c = 0; c < dims; ++c)
+            {
+                centers[assign[i] * dims + c] += x[i * dims + c] / sizes[assign[i]];
+            }
+        }
+    }
+    free(sizes);
+    return distortion;
+}
+
+/* BIC of a clustering under the spherical Gaussian model of X-means */
+static double
+bic(const APEX_Simpoint_Profile *profile, int k, const int *assign, double distortion)
+{
+    int n = profile->num_intervals, dims = profile->dims, c, i;
+    double variance, likelihood = 0.0, params, size;
+
+    variance = n > k ? distortion / (n - k) : 0.0;
+    variance = variance > 1e-12 ? variance : 1e-12;
+    for (c = 0; c < k; ++c)
+    {
+        for (size = 0.0, i = 0; i < n; ++i)
+        {
+            size += assign[i] == c;
+        }
+        if (size > 0.0)
+        {
+            likelihood += size * log(size) - size * log((double)n)
+                          - size / 2.0 * log(2.0 * M_PI)
+                          - size * dims / 2.0 * log(variance) - (size - k) / 2.0;
+        }
+    }
+    params = (k - 1) + k * dims + 1;
+    return likelihood - params / 2.0 * log((double)n);
+}
+
+static int
+compare_points(const void *a, const void *b)
+{
+    const APEX_Simpoint *p = a, *q = b;
+
+    return (p->first_insn > q->first_insn) - (p->first_insn < q->first_insn);
+}
+
+/*
+ * Picks one simulation point per cluster of the profile. A k of 0 tries 1
+ * to max_k clusters and takes the smallest k with a BIC close to the best.
+ *
+ * Returns the number of points, sorted by first instruction, or -1
+ */
+int
+APEX_simpoint_cluster(const APEX_Simpoint_Profile *profile, int k, int max_k,
+                      unsigned long seed, APEX_Simpoint **points)
+{
+    int n = profile->num_intervals, dims = profile->dims;
+    double *centers, *nearest, *scores = NULL, lowest, highest, distortion;
+    int *assign, *best, count = 0, c, i, status = -1;
+    long first_insn;
+    APEX_Simpoint *list = NULL;
+
+    max_k = k > 0 ? k : max_k;
+    max_k = max_k < n ? max_k : n;
+    centers = malloc((max_k > 0 ? max_k : 1) * dims * sizeof(double));
+    nearest = malloc(n * sizeof(double));
+    assign = malloc(n * sizeof(int));
+    best = malloc((max_k > 0 ? max_k : 1) * sizeof(int));
+    if (!centers || !nearest || !assign || !best || max_k < 1)
+    {
+        goto done;
+    }
+
+    if (k <= 0)
+    {
+        scores = malloc(max_k * sizeof(double));
+        if (!scores)
+        {
+            goto done;
+        }
+        for (k = 1; k <= max_k; ++k)
+        {
+            if ((distortion = kmeans(profile, k, seed, centers, assign, nearest)) < 0.0)
+            {
+                goto done;
+            }
+            scores[k - 1] = bic(profile, k, assign, distortion);
+        }
+        lowest = highest = scores[0];
+        for (k = 1; k < max_k; ++k)
+        {
+            lowest = scores[k] < lowest ? scores[k] : lowest;
+            highest = scores[k] > highest ? scores[k] : highest;
+        }
+        for (k = 1; k < max_k
+                    && scores[k - 1] < lowest + APEX_SIMPOINT_BIC_SHARE * (highest - lowest);
+             ++k)
+            ;
+    }
+    if (kmeans(profile, k, seed, centers, assign, nearest) < 0.0)
+    {
+        goto done;
+    }
+
+    list = calloc(k, sizeof(APEX_Simpoint));
+    if (!list)
+    {
+        goto done;
+    }
+    for (c = 0; c < k; ++c)
+    {
+        best[c] = -1;
+    }
+    for (i = 0; i < n; ++i)
+    {
+        c = assign[i];
+        if (best[c] < 0 || nearest[i] < nearest[best[c]])
+        {
+            best[c] = i;
+        }
+        list[c].weight += (double)profile->interval_insns[i] / profile->num_insns;
+    }
+    for (c = 0; c < k; ++c)
+    {
+        if (best[c] < 0)
+        {
+            continue;
+        }
+        for (first_insn = 0, i = 0; i < best[c]; ++i)
+        {
+            first_insn += profile->interval_insns[i];
+        }
+        list[count].interval = best[c];
+        list[count].first_insn = first_insn;
+        list[count].num_insns = profile->interval_insns[best[c]];
+        list[count].weight = list[c].weight;
+        count++;
+    }
+    qsort(list, count, sizeof(APEX_Simpoint), compare_points);
+    *points = list;
+    list = NULL;
+    status = count;
+
+done:
+    free(list);
+    free(scores);
+    free(centers);
+    free(nearest);
+    free(assign);
+    free(best);
+    return status;
+}
+
+/*
+ * Writes the points as a specification, one "<interval> <first_insn>
+ * <instructions> <weight>" line per point after # comments
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int
+APEX_simpoint_write(const char *path, const char *program,
+                    const APEX_Simpoint_Profile *profile,
+                    const APEX_Simpoint *points, int num_points)
+{
+    FILE *fp = fopen(path, "w");
+    int i;
+
+    if (!fp)
+    {
+        return -1;
+    }
+    fprintf(fp, "# Simulation points of %s, %ld instructions, %d intervals of %ld, "
+            "%d basic blocks\n", program, profile->num_insns, profile->num_intervals,
+            profile->interval, profile->num_blocks);
+    fprintf(fp, "# interval first_insn instructions weight\n");
+    for (i = 0; i < num_points; ++i)
+    {
+        fprintf(fp, "%d %ld %ld %.6f\n", points[i].interval, points[i].first_insn,
+                points[i].num_insns, points[i].weight);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/*
+ * Reads a specification written by APEX_simpoint_write. Weights are
+ * rescaled to add up to one.
+ *
+ * Returns the number of points, sorted by first instruction, or -1
+ */
+int
+APEX_simpoint_read(const char *path, APEX_Simpoint **points)
+{
+    APEX_Simpoint *list = NULL, *grown, point;
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    double total = 0.0;
+    int count = 0, max_count = 0, i;
+
+    if (!fp)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+        {
+            continue;
+        }
+        if (sscanf(line, "%d %ld %ld %lf", &point.interval, &point.first_insn,
+                   &point.num_insns, &point.weight) != 4
+            || point.first_insn < 0 || point.num_insns < 1 || point.weight < 0.0)
+        {
+            goto fail;
+        }
+        if (count == max_count)
+        {
+            max_count = max_count ? 2 * max_count : 16;
+            grown = realloc(list, max_count * sizeof(APEX_Simpoint));
+            if (!grown)
+            {
+                goto fail;
+            }
+            list = grown;
+        }
+        list[count++] = point;
+        total += point.weight;
+    }
+    if (count == 0 || total <= 0.0)
+    {
+        goto fail;
+    }
+    fclose(fp);
+    for (i = 0; i < count; ++i)
+    {
+        list[i].weight /= total;
+    }
+    qsort(list, count, sizeof(APEX_Simpoint), compare_points);
+    *points = list;
+    return count;
+
+fail:
+    fclose(fp);
+    free(list);
+    return -1;
+}
+
+/*
+ * Runs the program functionally, checkpointing it warmup instructions
+ * before every point, and on to HALT. The points must be sorted.
+ *
+ * Returns 0 on success, -1 on failure or if a point lies past HALT.
+ * num_insns is set to the length of the run.
+ */
+int
+APEX_simpoint_checkpoints(const APEX_Instruction *code_memory,
+                          int code_memory_size, const int *data_memory,
+                          const APEX_Simpoint *points, int num_points,
+                          long warmup, APEX_Interval **intervals, long *num_insns)
+{
+    APEX_Interval *list = calloc(num_points, sizeof(APEX_Interval));
+    APEX_Func *func = APEX_func_create(code_memory, code_memory_size, data_memory);
+    long take;
+    int count = 0, i;
+
+    if (!list || !func)
+    {
+        goto fail;
+    }
+    for (i = 0; i < num_points; ++i)
+    {
+        take = points[i].first_insn > warmup ? points[i].first_insn - warmup : 0;
+        APEX_func_run(func, take - func->insn_completed);
+        if (func->status != APEX_FUNC_RUNNING)
+        {
+            goto fail;
+        }
+        list[i].checkpoint = APEX_func_clone(func);
+        if (!list[i].checkpoint)
+        {
+            goto fail;
+        }
+        count++;
+        list[i].first_insn = points[i].first_insn;
+        list[i].num_insns = points[i].num_insns;
+        list[i].warmup = points[i].first_insn - take;
+    }
+    APEX_func_run(func, APEX_FUNC_MAX_INSNS);
+    *num_insns = func->insn_completed;
+    if (func->status != APEX_FUNC_HALTED)
+    {
+        goto fail;
+    }
+    for (i = 0; i < num_points; ++i)
+    {
+        if (points[i].first_insn + points[i].num_insns > *num_insns)
+        {
+            goto fail;
+        }
+    }
+    APEX_func_destroy(func);
+    *intervals = list;
+    return 0;
+
+fail:
+    APEX_func_destroy(func);
+    if (list)
+    {
+        APEX_checkpoint_free(list, count);
+    }
+    return -1;
+}
+
+/*
+ * Simulates the whole run in detail, for checking an estimate
+ *
+ * Returns its cycles, 0 if HALT did not retire within max_cycles or -1 if
+ * the cpu could not be created
+ */
+static long
+run_detailed(const APEX_Instruction *code_memory, int code_memory_size,
+             const int *data_memory, int forwarding, long max_cycles)
+{
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+    long cycles;
+    int halted = FALSE;
+
+    cpu = APEX_cpu_create_quiet(code_memory, code_memory_size, forwarding, data_memory);
+    if (!cpu)
+    {
+        return -1;
+    }
+    cycle = APEX_cpu_cycle_variant(cpu);
+    while (cpu->clock < max_cycles && !(halted = cycle(cpu)))
+        ;
+    cycles = halted ? cpu->clock : 0;
+    APEX_cpu_stop(cpu);
+    return cycles;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> simpoint <option>...". Options are
+ *   data=<image>   forwarding=<none|ex|mem|all>   interval=<n>   warmup=<n>
+ *   k=<n>   max_k=<n>   seed=<n>   out=<file>   points=<file>   threads=<n>
+ *   verify   max_cycles=<n>, which bounds the detailed run of verify
+ * points= simulates the points of a specification instead of profiling,
+ * out= writes the points picked.
+ */
+int
+APEX_simpoint_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Instruction *code_memory;
+    APEX_Simpoint_Profile *profile = NULL;
+    APEX_Simpoint *points = NULL;
+    APEX_Interval *intervals = NULL;
+    int *data_memory;
+    APEX_Mode_Options options;
+    const char *out = NULL, *spec = NULL;
+    int code_memory_size, forwarding, verify = FALSE, status = 1;
+    int threads = APEX_pool_default_threads(), k = 0, max_k = APEX_SIMPOINT_MAX_K;
+    int num_points = 0, i;
+    long interval = APEX_SIMPOINT_INTERVAL, warmup = APEX_SIMPOINT_WARMUP;
+    long num_insns, detailed_insns = 0, detailed;
+    unsigned long seed = 1;
+    double t, functional_seconds, detailed_seconds, cpi = 0.0;
+
+    APEX_mode_defaults(&options, APEX_FUNC_MAX_INSNS);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "interval=", 9) == 0)
+        {
+            interval = atol(argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "warmup=", 7) == 0)
+        {
+            warmup = atol(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "k=", 2) == 0)
+        {
+            k = atoi(argv[i] + 2);
+        }
+        else if (strncmp(argv[i], "max_k=", 6) == 0)
+        {
+            max_k = atoi(argv[i] + 6);
+        }
+        else if (strncmp(argv[i], "seed=", 5) == 0)
+        {
+            seed = strtoul(argv[i] + 5, NULL, 0);
+        }
+        else if (strncmp(argv[i], "out=", 4) == 0)
+        {
+            out = argv[i] + 4;
+        }
+        else if (strncmp(argv[i], "points=", 7) == 0)
+        {
+            spec = argv[i] + 7;
+        }
+        else if (strncmp(argv[i], "threads=", 8) == 0)
+        {
+            threads = atoi(argv[i] + 8);
+        }
+        else if (strcmp(argv[i], "verify") == 0)
+        {
+            verify = TRUE;
+        }
+        else if (!APEX_mode_option(&options, "simpoint", argv[i]))
+        {
+            return 1;
+        }
+    }
+    forwarding = options.forwarding;
+    if (interval < 1 || warmup < 0 || threads < 1 || k < 0 || max_k < 1)
+    {
+        fprintf(stderr, "APEX_Error: Invalid simpoint parameters\n");
+        return 1;
+    }
+
+    data_memory = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    code_memory = data_memory ? APEX_mode_load(filename, &options, &code_memory_size,
+                                               data_memory) : NULL;
+    if (!code_memory)
+    {
+        free(data_memory);
+        return 1;
+    }
+
+    t = APEX_seconds(CLOCK_MONOTONIC);
+    if (spec)
+    {
+        num_points = APEX_simpoint_read(spec, &points);
+        if (num_points < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to read simulation points %s\n", spec);
+            goto done;
+        }
+        printf("APEX_SIMPOINT: %s, %d points from %s\n", filename, num_points, spec);
+    }
+    else
+    {
+        profile = APEX_simpoint_profile(code_memory, code_memory_size, data_memory,
+                                        interval, seed);
+        if (!profile)
+        {
+            fprintf(stderr, "APEX_Error: Unable to profile %s, it did not halt "
+                    "within %ld instructions\n", filename, APEX_FUNC_MAX_INSNS);
+            goto done;
+        }
+        num_points = APEX_simpoint_cluster(profile, k, max_k, seed, &points);
+        if (num_points < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to cluster %s\n", filename);
+            goto done;
+        }
+        printf("APEX_SIMPOINT: %s, %ld instructions, %d basic blocks, %d intervals "
+               "of %ld, %d points\n", filename, profile->num_insns,
+               profile->num_blocks, profile->num_intervals, interval, num_points);
+        if (out && APEX_simpoint_write(out, filename, profile, points, num_points) < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write %s\n", out);
+            goto done;
+        }
+    }
+    if (APEX_simpoint_checkpoints(code_memory, code_memory_size, data_memory, points,
+                                  num_points, warmup, &intervals, &num_insns) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to checkpoint the simulation points\n");
+        goto done;
+    }
+    functional_seconds = APEX_seconds(CLOCK_MONOTONIC) - t;
+
+    t = APEX_seconds(CLOCK_MONOTONIC);
+    if (APEX_checkpoint_simulate(intervals, num_points, forwarding, threads) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to start detailed simulation\n");
+        goto done;
+    }
+    detailed_seconds = APEX_seconds(CLOCK_MONOTONIC) - t;
+
+    printf("point,interval,first_insn,instructions,weight,cycles,cpi\n");
+    for (i = 0; i < num_points; ++i)
+    {
+        if (intervals[i].status != APEX_INTERVAL_COMPLETE)
+        {
+            fprintf(stderr, "APEX_Error: Unable to simulate point %d\n", i);
+            goto done;
+        }
+        cpi += points[i].weight * intervals[i].cycles / intervals[i].num_insns;
+        detailed_insns += intervals[i].warmup + intervals[i].num_insns;
+        printf("%d,%d,%ld,%ld,%.6f,%ld,%.4f\n", i, points[i].interval,
+               points[i].first_insn, points[i].num_insns, points[i].weight,
+               intervals[i].cycles, (double)intervals[i].cycles / intervals[i].num_insns);
+    }
+    printf("APEX_SIMPOINT: forwarding=%s, estimated %.0f cycles, CPI %.4f, from %ld "
+           "detailed instructions (%.2f%% of the run)\n",
+           APEX_forwarding_name(forwarding), cpi * num_insns, cpi, detailed_insns,
+           100.0 * detailed_insns / num_insns);
+    printf("APEX_SIMPOINT: %.6f s functional, %.6f s detailed on %d threads\n",
+           functional_seconds, detailed_seconds, threads);
+
+    if (verify)
+    {
+        detailed = run_detailed(code_memory, code_memory_size, data_memory, forwarding,
+                                options.max_cycles);
+        if (detailed < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+            goto done;
+        }
+        if (detailed == 0)
+        {
+            fprintf(stderr, "APEX_Error: No HALT within %ld cycles\n", options.max_cycles);
+            goto done;
+        }
+        printf("APEX_SIMPOINT: detailed %ld cycles, CPI %.4f, estimate off by "
+               "%+.2f%%\n", detailed, (double)detailed / num_insns,
+               100.0 * (cpi * num_insns - detailed) / detailed);
+    }
+    status = 0;
+
+done:
+    if (intervals)
+    {
+        APEX_checkpoint_free(intervals, num_points);
+    }
+    free(points);
+    APEX_simpoint_profile_free(profile);
+    free(data_memory);
+    free(code_memory);
+    return status;
+}
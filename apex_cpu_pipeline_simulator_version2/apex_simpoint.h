@@ -0,0 +1,70 @@
+/*
+ * apex_simpoint.h
+ * Contains declarations of basic block vector profiling and simulation
+ * point selection
+ */
+#ifndef _APEX_SIMPOINT_H_
+#define _APEX_SIMPOINT_H_
+
+#include "apex_cpu.h"
+#include "apex_checkpoint.h"
+
+/* Defaults of the selection parameters */
+#define APEX_SIMPOINT_INTERVAL 1000    /* Instructions per interval */
+#define APEX_SIMPOINT_WARMUP 1000      /* Instructions of detailed warm-up */
+#define APEX_SIMPOINT_MAX_K 10         /* Most clusters tried */
+
+/* Dimensions the basic block vectors are randomly projected down to */
+#define APEX_SIMPOINT_DIMS 15
+
+/* Lloyd iterations of one k-means run before it is taken as converged */
+#define APEX_SIMPOINT_ITERATIONS 100
+
+/* The smallest k whose BIC reaches this share of the range of BICs wins */
+#define APEX_SIMPOINT_BIC_SHARE 0.9
+
+/* Basic block vectors of a functional run, one per interval, projected to
+ * dims dimensions. An element counts the instructions retired in a block. */
+typedef struct APEX_Simpoint_Profile
+{
+    int num_blocks;
+    int *block_of;                 /* Per code memory index */
+    long interval;
+    long num_insns;                /* Of the whole run, HALT included */
+    int num_intervals;
+    long *interval_insns;          /* Only the last interval may be short */
+    int dims;
+    double *vectors;               /* num_intervals rows of dims */
+} APEX_Simpoint_Profile;
+
+/* A representative interval, standing for the intervals of its cluster */
+typedef struct APEX_Simpoint
+{
+    int interval;
+    long first_insn;
+    long num_insns;
+    double weight;                 /* Share of the run's instructions */
+} APEX_Simpoint;
+
+int APEX_simpoint_blocks(const APEX_Instruction *code_memory, int code_memory_size,
+                         int *block_of);
+APEX_Simpoint_Profile *APEX_simpoint_profile(const APEX_Instruction *code_memory,
+                                             int code_memory_size,
+                                             const int *data_memory, long interval,
+                                             unsigned long seed);
+void APEX_simpoint_profile_free(APEX_Simpoint_Profile *profile);
+int APEX_simpoint_cluster(const APEX_Simpoint_Profile *profile, int k, int max_k,
+                          unsigned long seed, APEX_Simpoint **points);
+int APEX_simpoint_write(const char *path, const char *program,
+                        const APEX_Simpoint_Profile *profile,
+                        const APEX_Simpoint *points, int num_points);
+int APEX_simpoint_read(const char *path, APEX_Simpoint **points);
+int APEX_simpoint_checkpoints(const APEX_Instruction *code_memory,
+                              int code_memory_size, const int *data_memory,
+                              const APEX_Simpoint *points, int num_points,
+                              long warmup, APEX_Interval **intervals,
+                              long *num_insns);
+
+int APEX_simpoint_main(const char *filename, int argc, char const *argv[]);
+
+#endif
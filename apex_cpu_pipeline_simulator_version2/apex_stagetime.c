@@ -0,0 +1,308 @@
+/*
+ * apex_stagetime.c
+ * Contains the host time instrumentation of the pipeline
+ *
+ * Every thread accumulates into its own table, so simulations on pool
+ * threads pay no synchronisation per stage call. A table is folded into
+ * the total when its thread exits, and the main thread's at exit, right
+ * before the summary is printed.
+ */
+#ifdef APEX_STAGE_TIMING
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if APEX_STAGE_TIMING >= 2
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "apex_stagetime.h"
+
+/* Opcode handlers listed in the summary */
+#define APEX_STAGETIME_TOP 16
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TICK_UNIT "TSC ticks"
+#else
+#define TICK_UNIT "ns"
+#endif
+
+typedef struct APEX_Stagetime_Table
+{
+    unsigned long long ticks[APEX_STAGETIME_STAGES][APEX_STAGETIME_SLOTS];
+    unsigned long long calls[APEX_STAGETIME_STAGES][APEX_STAGETIME_SLOTS];
+    char names[APEX_STAGETIME_SLOTS][16];
+} APEX_Stagetime_Table;
+
+static const char *stage_names[APEX_STAGETIME_STAGES] = {"fetch", "decode", "execute",
+                                                         "memory", "writeback"};
+
+static __thread APEX_Stagetime_Table *local;
+static APEX_Stagetime_Table total;
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t table_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static unsigned long long start_ticks;
+static unsigned long long call_overhead; /* Ticks of an empty timed call */
+
+#if APEX_STAGE_TIMING >= 2
+static const struct
+{
+    const char *name;
+    unsigned int type;
+    unsigned long long config;
+} perf_counters[] = {
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"L1D read misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+#define NUM_PERF_COUNTERS (int)(sizeof(perf_counters) / sizeof(perf_counters[0]))
+static int perf_fds[NUM_PERF_COUNTERS];
+static int perf_errors[NUM_PERF_COUNTERS];
+#endif
+
+static void
+fold_table(void *table)
+{
+    APEX_Stagetime_Table *t = table;
+    int stage, slot;
+
+    pthread_mutex_lock(&total_lock);
+    for (stage = 0; stage < APEX_STAGETIME_STAGES; ++stage)
+    {
+        for (slot = 0; slot < APEX_STAGETIME_SLOTS; ++slot)
+        {
+            total.ticks[stage][slot] += t->ticks[stage][slot];
+            total.calls[stage][slot] += t->calls[stage][slot];
+        }
+    }
+    for (slot = 0; slot < APEX_STAGETIME_SLOTS; ++slot)
+    {
+        if (!total.names[slot][0])
+        {
+            memcpy(total.names[slot], t->names[slot], sizeof(total.names[slot]));
+        }
+    }
+    pthread_mutex_unlock(&total_lock);
+    free(t);
+}
+
+static void
+create_key(void)
+{
+    pthread_key_create(&table_key, fold_table);
+}
+
+static APEX_Stagetime_Table *
+local_table(void)
+{
+    if (!local)
+    {
+        pthread_once(&key_once, create_key);
+        local = calloc(1, sizeof(APEX_Stagetime_Table));
+        if (!local)
+        {
+            fprintf(stderr, "APEX_Error: Unable to allocate stage timing table\n");
+            exit(1);
+        }
+        pthread_setspecific(table_key, local);
+    }
+    return local;
+}
+
+/* Returns the slot of the instruction in a latch, recording its name the
+ * first time it is seen */
+int
+APEX_stagetime_slot(const CPU_Stage *latch)
+{
+    APEX_Stagetime_Table *t;
+    int slot;
+
+    if (!latch->has_insn || latch->opcode < 0 || latch->opcode >= APEX_STAGETIME_OPCODES)
+    {
+        return APEX_STAGETIME_IDLE;
+    }
+    slot = latch->opcode;
+    t = local_table();
+    if (!t->names[slot][0] && latch->opcode_str)
+    {
+        snprintf(t->names[slot], sizeof(t->names[slot]), "%.15s", latch->opcode_str);
+    }
+    return slot;
+}
+
+void
+APEX_stagetime_add(int stage, int slot, unsigned long long ticks)
+{
+    APEX_Stagetime_Table *t = local_table();
+
+    t->ticks[stage][slot] += ticks;
+    t->calls[stage][slot]++;
+}
+
+#if APEX_STAGE_TIMING >= 2
+static void
+open_perf_counters(void)
+{
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perf_counters[i].type;
+        attr.config = perf_counters[i].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;          /* Pool threads started later count too */
+        perf_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        perf_errors[i] = errno;
+    }
+}
+
+static void
+print_perf_counters(void)
+{
+    unsigned long long value;
+    int i;
+
+    fprintf(stderr, "APEX_STAGETIME: perf counters of the run:");
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if (perf_fds[i] >= 0 && read(perf_fds[i], &value, sizeof(value)) == sizeof(value))
+        {
+            fprintf(stderr, "%s %s %llu", i ? "," : "", perf_counters[i].name, value);
+        }
+        else
+        {
+            fprintf(stderr, "%s %s unavailable (%s)", i ? "," : "", perf_counters[i].name,
+                    strerror(perf_errors[i]));
+        }
+    }
+    fprintf(stderr, "\n");
+}
+#endif
+
+/* The cheapest of many empty timed calls, which is what the two clock reads
+ * around every stage function add to it */
+static unsigned long long
+calibrate(void)
+{
+    unsigned long long best = ~0ULL, start, ticks;
+    int i;
+
+    for (i = 0; i < 10000; ++i)
+    {
+        start = APEX_stagetime_now();
+        ticks = APEX_stagetime_now() - start;
+        if (ticks < best)
+        {
+            best = ticks;
+        }
+    }
+    return best;
+}
+
+/* Ticks of a stage or handler with the clock reads taken out */
+static unsigned long long
+net_ticks(unsigned long long ticks, unsigned long long calls)
+{
+    return ticks > calls * call_overhead ? ticks - calls * call_overhead : 0;
+}
+
+static int
+compare_handlers(const void *a, const void *b)
+{
+    const int *x = a, *y = b;
+    unsigned long long tx = net_ticks(total.ticks[x[0]][x[1]], total.calls[x[0]][x[1]]);
+    unsigned long long ty = net_ticks(total.ticks[y[0]][y[1]], total.calls[y[0]][y[1]]);
+
+    return tx < ty ? 1 : tx > ty ? -1 : 0;
+}
+
+static void
+print_summary(void)
+{
+    unsigned long long elapsed = APEX_stagetime_now() - start_ticks;
+    unsigned long long stage_ticks[APEX_STAGETIME_STAGES], stage_calls[APEX_STAGETIME_STAGES];
+    unsigned long long all = 0, ticks, calls;
+    int handlers[APEX_STAGETIME_STAGES * APEX_STAGETIME_SLOTS][2];
+    int num_handlers = 0, stage, slot, i;
+
+    fflush(stdout);
+    if (local)
+    {
+        pthread_setspecific(table_key, NULL);
+        fold_table(local);
+        local = NULL;
+    }
+
+    for (stage = 0; stage < APEX_STAGETIME_STAGES; ++stage)
+    {
+        stage_ticks[stage] = stage_calls[stage] = 0;
+        for (slot = 0; slot < APEX_STAGETIME_SLOTS; ++slot)
+        {
+            stage_ticks[stage] += net_ticks(total.ticks[stage][slot],
+                                            total.calls[stage][slot]);
+            stage_calls[stage] += total.calls[stage][slot];
+            if (total.calls[stage][slot])
+            {
+                handlers[num_handlers][0] = stage;
+                handlers[num_handlers][1] = slot;
+                num_handlers++;
+            }
+        }
+        all += stage_ticks[stage];
+    }
+
+    fprintf(stderr, "APEX_STAGETIME: %llu %s since start, %.1f%% in stage functions, "
+            "%llu per call of clock reads taken out\n", elapsed, TICK_UNIT,
+            elapsed ? 100.0 * all / elapsed : 0.0, call_overhead);
+    fprintf(stderr, "  %-10s %-8s %14s %16s %10s %7s\n", "stage", "opcode", "calls",
+            "ticks", "ticks/call", "share");
+    for (stage = 0; stage < APEX_STAGETIME_STAGES; ++stage)
+    {
+        fprintf(stderr, "  %-10s %-8s %14llu %16llu %10.1f %6.1f%%\n", stage_names[stage],
+                "*", stage_calls[stage], stage_ticks[stage],
+                stage_calls[stage] ? (double)stage_ticks[stage] / stage_calls[stage] : 0.0,
+                all ? 100.0 * stage_ticks[stage] / all : 0.0);
+    }
+
+    qsort(handlers, num_handlers, sizeof(handlers[0]), compare_handlers);
+    for (i = 0; i < num_handlers && i < APEX_STAGETIME_TOP; ++i)
+    {
+        stage = handlers[i][0];
+        slot = handlers[i][1];
+        calls = total.calls[stage][slot];
+        ticks = net_ticks(total.ticks[stage][slot], calls);
+        fprintf(stderr, "  %-10s %-8s %14llu %16llu %10.1f %6.1f%%\n", stage_names[stage],
+                slot == APEX_STAGETIME_IDLE ? "(empty)" : total.names[slot], calls, ticks,
+                (double)ticks / calls, all ? 100.0 * ticks / all : 0.0);
+    }
+
+#if APEX_STAGE_TIMING >= 2
+    print_perf_counters();
+#endif
+}
+
+/* Starts the clock and the counters, and arranges for the summary at exit */
+void
+APEX_stagetime_start(void)
+{
+    pthread_once(&key_once, create_key);
+#if APEX_STAGE_TIMING >= 2
+    open_perf_counters();
+#endif
+    call_overhead = calibrate();
+    start_ticks = APEX_stagetime_now();
+    atexit(print_summary);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * apex_stagetime.h
+ * Contains declarations of the host time instrumentation of the pipeline
+ *
+ * Build with CFLAGS+=-DAPEX_STAGE_TIMING to count host ticks (the TSC on
+ * x86) and calls per stage function and per opcode in the stage, or with
+ * CFLAGS+=-DAPEX_STAGE_TIMING=2 to also read the perf_event_open counters
+ * of the whole run. The summary goes to stderr at exit. Without the flag
+ * every hook expands to the bare call.
+ */
+#ifndef _APEX_STAGETIME_H_
+#define _APEX_STAGETIME_H_
+
+#include "apex_cpu.h"
+
+#ifdef APEX_STAGE_TIMING
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/* Stage functions, in pipeline order */
+#define APEX_STAGETIME_FETCH 0
+#define APEX_STAGETIME_DECODE 1
+#define APEX_STAGETIME_EXECUTE 2
+#define APEX_STAGETIME_MEMORY 3
+#define APEX_STAGETIME_WRITEBACK 4
+#define APEX_STAGETIME_STAGES 5
+
+/* One slot per opcode, and one for a stage entered with an empty latch */
+#define APEX_STAGETIME_OPCODES 32
+#define APEX_STAGETIME_IDLE APEX_STAGETIME_OPCODES
+#define APEX_STAGETIME_SLOTS (APEX_STAGETIME_OPCODES + 1)
+
+static inline unsigned long long
+APEX_stagetime_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void APEX_stagetime_start(void);
+int APEX_stagetime_slot(const CPU_Stage *latch);
+void APEX_stagetime_add(int stage, int slot, unsigned long long ticks);
+
+/* Runs call, one stage function, charging its ticks to the stage and the
+ * opcode its latch held on entry */
+#define APEX_STAGETIME_CALL(stage, latch, call)                              \
+    do                                                                       \
+    {                                                                        \
+        int slot_ = APEX_stagetime_slot(latch);                              \
+        unsigned long long start_ = APEX_stagetime_now();                    \
+        call;                                                                \
+        APEX_stagetime_add(stage, slot_, APEX_stagetime_now() - start_);     \
+    } while (0)
+
+#else
+
+#define APEX_stagetime_start() ((void)0)
+#define APEX_STAGETIME_CALL(stage, latch, call) call
+
+#endif
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * apex_sweep.c
+ * Contains the parallel design-space sweep driver
+ *
+ * The program and every data image are parsed once and shared read-only by
+ * all points. Each point only allocates its own APEX_CPU, which lives for
+ * the duration of its run on a pool worker.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_sweep.h"
+#include "apex_pool.h"
+#include "apex_loop.h"
+#include "apex_watchdog.h"
+#include "apex_macros.h"
+
+#define APEX_SWEEP_MAX_VALUES 64
+
+typedef struct APEX_Sweep
+{
+    const APEX_Instruction *code_memory;
+    int code_memory_size;
+    APEX_Sweep_Point *points;
+} APEX_Sweep;
+
+/*
+ * Pool task, simulates one configuration point to completion. A watchdog
+ * ends points that repeat a state, or run out of cycles or time, so a
+ * runaway program frees its worker at once.
+ */
+static void
+sweep_run_point(void *context, int index)
+{
+    APEX_Sweep *sweep = context;
+    APEX_Sweep_Point *point = &sweep->points[index];
+    APEX_Watchdog *watchdog;
+    APEX_Loop *loop = NULL;
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+
+    cpu = APEX_cpu_create(sweep->code_memory, sweep->code_memory_size,
+                          &point->config);
+    if (!cpu)
+    {
+        return;
+    }
+
+    if (point->data_memory)
+    {
+        memcpy(cpu->data_memory, point->data_memory,
+               sizeof(int) * DATA_MEMORY_SIZE);
+    }
+
+    watchdog = APEX_watchdog_create(cpu, point->max_cycles, point->max_seconds);
+    if (!watchdog)
+    {
+        APEX_cpu_stop(cpu);
+        return;
+    }
+    if (point->extrapolate)
+    {
+        loop = APEX_loop_create(cpu, point->max_cycles);
+    }
+
+    cycle = APEX_cpu_cycle_variant(cpu);
+    while (TRUE)
+    {
+        if (loop ? APEX_loop_cycle(loop, cpu) : cycle(cpu))
+        {
+            point->halted = TRUE;
+            break;
+        }
+        if ((point->watchdog = APEX_watchdog_check(watchdog, cpu))
+            != APEX_WATCHDOG_RUNNING)
+        {
+            break;
+        }
+    }
+
+    point->cycles = cpu->clock;
+    point->insn_completed = cpu->insn_completed;
+    point->stall_cycles = cpu->stall_cycles;
+    point->branch_flushes = cpu->branch_flushes;
+    if (loop)
+    {
+        APEX_loop_destroy(loop);
+    }
+    APEX_watchdog_destroy(watchdog);
+    APEX_cpu_stop(cpu);
+}
+
+/*
+ * Simulates every point on a work-stealing pool of num_threads threads.
+ * Points must have debug messages and single stepping turned off.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int
+APEX_sweep_run(const APEX_Instruction *code_memory, int code_memory_size,
+               APEX_Sweep_Point *points, int num_points, int num_threads)
+{
+    APEX_Sweep sweep;
+
+    sweep.code_memory = code_memory;
+    sweep.code_memory_size = code_memory_size;
+    sweep.points = points;
+    return APEX_pool_run(num_threads, num_points, sweep_run_point, &sweep);
+}
+
+/*
+ * Prints one row per point as CSV, or as a JSON array of objects
+ */
+void
+APEX_sweep_print(const APEX_Sweep_Point *points, int num_points, int json)
+{
+    int i;
+    double ipc;
+
+    if (json)
+    {
+        printf("[\n");
+    }
+    else
+    {
+        printf("point,forwarding,data_image,status,cycles,instructions,ipc,"
+               "stall_cycles,branch_flushes\n");
+    }
+
+    for (i = 0; i < num_points; ++i)
+    {
+        const APEX_Sweep_Point *p = &points[i];
+
+        ipc = p->cycles ? (double)p->insn_completed / p->cycles : 0.0;
+        if (json)
+        {
+            printf("  {\"point\": %d, \"forwarding\": \"%s\", "
+                   "\"data_image\": \"%s\", \"status\": \"%s\", "
+                   "\"cycles\": %d, \"instructions\": %d, \"ipc\": %.4f, "
+                   "\"stall_cycles\": %d, \"branch_flushes\": %d}%s\n",
+                   i, APEX_forwarding_name(p->config.forwarding), p->data_image,
+                   p->halted ? "halted" : APEX_watchdog_name(p->watchdog), p->cycles,
+                   p->insn_completed, ipc, p->stall_cycles, p->branch_flushes,
+                   i + 1 < num_points ? "," : "");
+        }
+        else
+        {
+            printf("%d,%s,%s,%s,%d,%d,%.4f,%d,%d\n", i,
+                   APEX_forwarding_name(p->config.forwarding), p->data_image,
+                   p->halted ? "halted" : APEX_watchdog_name(p->watchdog), p->cycles,
+                   p->insn_completed, ipc, p->stall_cycles, p->branch_flushes);
+        }
+    }
+
+    if (json)
+    {
+        printf("]\n");
+    }
+}
+
+/* Splits a comma separated list in place, returns the number of values */
+static int
+split_values(char *list, char *values[])
+{
+    int n = 0;
+    char *token = strtok(list, ",");
+
+    while (token != NULL && n < APEX_SWEEP_MAX_VALUES)
+    {
+        values[n++] = token;
+        token = strtok(NULL, ",");
+    }
+    return n;
+}
+
+/*
+ * Entry point of "apex_sim <input_file> sweep <option>...". Options are
+ *   forwarding=<none|ex|mem|all>,...   data=<image>,...
+ *   threads=<n>   max_cycles=<n>   max_seconds=<s>   format=<csv|json>
+ *   extrapolate
+ * and every combination of the listed values becomes one point.
+ */
+int
+APEX_sweep_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Instruction *code_memory;
+    APEX_Sweep_Point *points;
+    char *fwd_values[APEX_SWEEP_MAX_VALUES];
+    char *data_values[APEX_SWEEP_MAX_VALUES];
+    int *images[APEX_SWEEP_MAX_VALUES];
+    char *args[argc > 0 ? argc : 1];
+    char fwd_default[] = "all";
+    int num_fwd = 0, num_data = 0, num_points, i, j;
+    int code_memory_size, threads = APEX_pool_default_threads();
+    int max_cycles = APEX_SWEEP_MAX_CYCLES, json = FALSE, extrapolate = FALSE;
+    double max_seconds = 0.0;
+    int status = 0;
+
+    for (i = 0; i < argc; ++i)
+    {
+        args[i] = strdup(argv[i]);
+        if (strncmp(args[i], "forwarding=", 11) == 0)
+        {
+            num_fwd = split_values(args[i] + 11, fwd_values);
+        }
+        else if (strncmp(args[i], "data=", 5) == 0)
+        {
+            num_data = split_values(args[i] + 5, data_values);
+        }
+        else if (strncmp(args[i], "threads=", 8) == 0)
+        {
+            threads = atoi(args[i] + 8);
+        }
+        else if (strncmp(args[i], "max_cycles=", 11) == 0)
+        {
+            max_cycles = atoi(args[i] + 11);
+        }
+        else if (strncmp(args[i], "max_seconds=", 12) == 0)
+        {
+            max_seconds = atof(args[i] + 12);
+        }
+        else if (strcmp(args[i], "format=json") == 0)
+        {
+            json = TRUE;
+        }
+        else if (strcmp(args[i], "extrapolate") == 0)
+        {
+            extrapolate = TRUE;
+        }
+        else if (strcmp(args[i], "format=csv") != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown sweep option %s\n", args[i]);
+            return 1;
+        }
+    }
+
+    if (num_fwd == 0)
+    {
+        fwd_values[num_fwd++] = fwd_default;
+    }
+
+    code_memory = create_code_memory(filename, &code_memory_size);
+    if (!code_memory)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+        return 1;
+    }
+
+    for (j = 0; j < num_data; ++j)
+    {
+        images[j] = calloc(DATA_MEMORY_SIZE, sizeof(int));
+        if (!images[j] || load_data_image(data_values[j], images[j]) < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to load data image %s\n",
+                    data_values[j]);
+            return 1;
+        }
+    }
+
+    num_points = num_fwd * (num_data ? num_data : 1);
+    points = calloc(num_points, sizeof(APEX_Sweep_Point));
+    if (!points)
+    {
+        return 1;
+    }
+
+    for (i = 0; i < num_points; ++i)
+    {
+        APEX_Sweep_Point *p = &points[i];
+        int d = num_data ? i % num_data : -1;
+
+        APEX_config_default(&p->config);
+        p->config.debug_messages = FALSE;
+        p->config.single_step = FALSE;
+        p->config.forwarding = APEX_parse_forwarding(fwd_values[num_data ? i / num_data : i]);
+        if (p->config.forwarding < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown forwarding policy %s\n",
+                    fwd_values[num_data ? i / num_data : i]);
+            return 1;
+        }
+        p->data_memory = d >= 0 ? images[d] : NULL;
+        p->data_image = d >= 0 ? data_values[d] : "-";
+        p->max_cycles = max_cycles;
+        p->max_seconds = max_seconds;
+        p->extrapolate = extrapolate;
+    }
+
+    if (APEX_sweep_run(code_memory, code_memory_size, points, num_points,
+                       threads) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to start sweep\n");
+        status = 1;
+    }
+    else
+    {
+        APEX_sweep_print(points, num_points, json);
+    }
+
+    for (j = 0; j < num_data; ++j)
+    {
+        free(images[j]);
+    }
+    for (i = 0; i < argc; ++i)
+    {
+        free(args[i]);
+    }
+    free(points);
+    free(code_memory);
+    return status;
+}
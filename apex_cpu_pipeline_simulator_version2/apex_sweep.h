@@ -0,0 +1,37 @@
+/*
+ * apex_sweep.h
+ * Contains declarations of the parallel design-space sweep driver
+ */
+#ifndef _APEX_SWEEP_H_
+#define _APEX_SWEEP_H_
+
+#include "apex_cpu.h"
+
+/* Cycle budget of a point when the sweep does not set max_cycles */
+#define APEX_SWEEP_MAX_CYCLES 10000000
+
+/* One configuration point and the counters it produced */
+typedef struct APEX_Sweep_Point
+{
+    APEX_Config config;
+    const int *data_memory;        /* Shared initial image, NULL for zeroes */
+    const char *data_image;        /* Name of that image, for the report */
+    int max_cycles;
+    double max_seconds;            /* Wall time budget, 0 for none */
+    int extrapolate;               /* Extrapolate steady-state loops */
+
+    int halted;                    /* TRUE if HALT retired within budget */
+    int watchdog;                  /* APEX_WATCHDOG_* verdict otherwise */
+    int cycles;
+    int insn_completed;
+    int stall_cycles;
+    int branch_flushes;
+} APEX_Sweep_Point;
+
+int APEX_sweep_run(const APEX_Instruction *code_memory, int code_memory_size,
+                   APEX_Sweep_Point *points, int num_points, int num_threads);
+void APEX_sweep_print(const APEX_Sweep_Point *points, int num_points,
+                      int json);
+int APEX_sweep_main(const char *filename, int argc, char const *argv[]);
+
+#endif
@@ -0,0 +1,1465 @@
+/*
+ * apex_trace.c
+ * Contains the committed instruction trace and the trace-driven timing model
+ *
+ * Recording wraps APEX_cpu_cycle like the profilers and writes one record
+ * per retired instruction. Replay streams the records back through a copy of
+ * the five stage pipeline that only moves register specifiers: it keeps the
+ * latches, the regs_writing scoreboard and the two forwarding buses exactly
+ * as apex_cpu.c updates them, takes every branch outcome from the trace, and
+ * so reproduces the stalls and flushes of the real pipeline without
+ * computing a single value.
+ *
+ * A trace is either raw, a dump of APEX_Trace_Record, or packed. A packed
+ * record is a tag byte followed by varints: the pc delta when the pc is not
+ * the predicted one, the static fields the first time a pc shows up in the
+ * block, and the address delta of loads and stores that break their stride.
+ * The pc after a taken branch is predicted to be its last target, so loops
+ * and strided accesses take one byte per instruction. Blocks have a
+ * fixed size and start from a clean codec, so a reader finds the block of
+ * any record with a binary search over the block headers. Blocks of packed
+ * traces are written and read by a background thread.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "apex_trace.h"
+#include "apex_pool.h"
+
+static int
+is_memory_access(int opcode)
+{
+    return opcode == OPCODE_LOAD || opcode == OPCODE_LOADP
+           || opcode == OPCODE_STORE || opcode == OPCODE_STOREP;
+}
+
+static void
+codec_reset(APEX_Trace_Codec *codec)
+{
+    int i;
+
+    codec->pc = 4000 - 4;
+    codec->next_pc = 4000;
+    codec->branch = -1;
+    memset(codec->base_address, 0, sizeof(codec->base_address));
+    for (i = 0; i < APEX_TRACE_SLOTS; ++i)
+    {
+        codec->slots[i].pc = -1;
+    }
+}
+
+/* Register the effective address of a load or store is formed from */
+static int
+base_register(int opcode, int rs1, int rs2)
+{
+    return opcode == OPCODE_STORE || opcode == OPCODE_STOREP ? rs2 : rs1;
+}
+
+static int
+put_varint(unsigned char *out, unsigned value)
+{
+    int n = 0;
+
+    while (value >= 0x80)
+    {
+        out[n++] = value | 0x80;
+        value >>= 7;
+    }
+    out[n++] = value;
+    return n;
+}
+
+static unsigned
+get_varint(const unsigned char *in, int *position)
+{
+    unsigned value = 0;
+    int shift = 0;
+
+    while (in[*position] & 0x80)
+    {
+        value |= (unsigned)(in[(*position)++] & 0x7f) << shift;
+        shift += 7;
+    }
+    return value | (unsigned)in[(*position)++] << shift;
+}
+
+/* Signed deltas are zigzag mapped so small negative ones stay short */
+static unsigned
+zigzag(int delta)
+{
+    return ((unsigned)delta << 1) ^ (unsigned)(delta >> 31);
+}
+
+static int
+unzigzag(unsigned value)
+{
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+/* Moves the pc prediction on past the record in slot index */
+static void
+codec_advance(APEX_Trace_Codec *codec, int index, int flags)
+{
+    codec->branch = flags & APEX_TRACE_TAKEN ? index : -1;
+    codec->next_pc = codec->branch >= 0 && codec->slots[index].target >= 0
+                     ? codec->slots[index].target : codec->pc + 4;
+}
+
+/* Appends record to out, returns the number of bytes written */
+static int
+encode_record(APEX_Trace_Codec *codec, unsigned char *out, const APEX_Trace_Record *record)
+{
+    unsigned char tag = record->flags;
+    int n = 1, index = (record->pc >> 2) & (APEX_TRACE_SLOTS - 1), base;
+
+    if (record->pc == codec->next_pc)
+    {
+        tag |= APEX_TRACE_NEXT_PC;
+    }
+    else
+    {
+        n += put_varint(out + n, zigzag(record->pc - codec->next_pc));
+    }
+    if (codec->branch >= 0)
+    {
+        codec->slots[codec->branch].target = record->pc;
+    }
+    codec->pc = record->pc;
+
+    if (codec->slots[index].pc != record->pc)
+    {
+        tag |= APEX_TRACE_STATIC;
+        codec->slots[index].pc = record->pc;
+        codec->slots[index].target = -1;
+        codec->slots[index].memory_address = 0;
+        codec->slots[index].stride = 0;
+        codec->slots[index].opcode = out[n++] = record->opcode;
+        codec->slots[index].rd = out[n++] = record->rd;
+        codec->slots[index].rs1 = out[n++] = record->rs1;
+        codec->slots[index].rs2 = out[n++] = record->rs2;
+    }
+
+    if (is_memory_access(record->opcode))
+    {
+        base = base_register(record->opcode, record->rs1, record->rs2);
+        if (record->memory_address
+            == codec->slots[index].memory_address + codec->slots[index].stride)
+        {
+            tag |= APEX_TRACE_STRIDE;
+        }
+        else
+        {
+            n += put_varint(out + n, zigzag(record->memory_address
+                                            - codec->base_address[base]));
+        }
+        codec->slots[index].stride = record->memory_address
+                                     - codec->slots[index].memory_address;
+        codec->slots[index].memory_address = record->memory_address;
+        codec->base_address[base] = record->memory_address;
+    }
+    codec_advance(codec, index, record->flags);
+    out[0] = tag;
+    return n;
+}
+
+static void
+decode_record(APEX_Trace_Codec *codec, const unsigned char *in, int *position,
+              APEX_Trace_Record *record)
+{
+    unsigned char tag = in[(*position)++];
+    int index, base;
+
+    record->pc = codec->next_pc;
+    if (!(tag & APEX_TRACE_NEXT_PC))
+    {
+        record->pc += unzigzag(get_varint(in, position));
+    }
+    if (codec->branch >= 0)
+    {
+        codec->slots[codec->branch].target = record->pc;
+    }
+    codec->pc = record->pc;
+    index = (record->pc >> 2) & (APEX_TRACE_SLOTS - 1);
+
+    if (tag & APEX_TRACE_STATIC)
+    {
+        codec->slots[index].pc = record->pc;
+        codec->slots[index].target = -1;
+        codec->slots[index].memory_address = 0;
+        codec->slots[index].stride = 0;
+        codec->slots[index].opcode = in[(*position)++];
+        codec->slots[index].rd = in[(*position)++];
+        codec->slots[index].rs1 = in[(*position)++];
+        codec->slots[index].rs2 = in[(*position)++];
+    }
+    record->opcode = codec->slots[index].opcode;
+    record->rd = codec->slots[index].rd;
+    record->rs1 = codec->slots[index].rs1;
+    record->rs2 = codec->slots[index].rs2;
+    record->flags = tag & APEX_TRACE_TAKEN;
+    record->memory_address = 0;
+
+    if (is_memory_access(record->opcode))
+    {
+        base = base_register(record->opcode, record->rs1, record->rs2);
+        if (tag & APEX_TRACE_STRIDE)
+        {
+            record->memory_address = codec->slots[index].memory_address
+                                     + codec->slots[index].stride;
+        }
+        else
+        {
+            record->memory_address = codec->base_address[base]
+                                     + unzigzag(get_varint(in, position));
+        }
+        codec->slots[index].stride = record->memory_address
+                                     - codec->slots[index].memory_address;
+        codec->slots[index].memory_address = record->memory_address;
+        codec->base_address[base] = record->memory_address;
+    }
+    codec_advance(codec, index, record->flags);
+}
+
+/* Allocates the blocks of a queue and starts its thread on routine */
+static int
+queue_start(APEX_Trace_Queue *queue, void *(*routine)(void *), void *context)
+{
+    int i;
+
+    for (i = 0; i < APEX_TRACE_QUEUE; ++i)
+    {
+        if (!queue->blocks[i] && !(queue->blocks[i] = malloc(APEX_TRACE_BLOCK_SIZE)))
+        {
+            return -1;
+        }
+    }
+    queue->head = 0;
+    queue->count = 0;
+    queue->stop = FALSE;
+    queue->done = FALSE;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    if (pthread_create(&queue->thread, NULL, routine, context) != 0)
+    {
+        pthread_mutex_destroy(&queue->lock);
+        pthread_cond_destroy(&queue->changed);
+        return -1;
+    }
+    queue->running = TRUE;
+    return 0;
+}
+
+/* Tells the thread to stop, waits for it and leaves the blocks allocated */
+static void
+queue_stop(APEX_Trace_Queue *queue)
+{
+    if (!queue->running)
+    {
+        return;
+    }
+    queue->running = FALSE;
+    pthread_mutex_lock(&queue->lock);
+    queue->stop = TRUE;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    pthread_join(queue->thread, NULL);
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+}
+
+static void
+queue_free(APEX_Trace_Queue *queue)
+{
+    int i;
+
+    for (i = 0; i < APEX_TRACE_QUEUE; ++i)
+    {
+        free(queue->blocks[i]);
+    }
+}
+
+/*
+ * Writer thread, writes full blocks in order. Every block takes
+ * APEX_TRACE_BLOCK_SIZE bytes of the file except the last one, which is
+ * queued after the stop request.
+ */
+static void *
+writer_thread(void *context)
+{
+    APEX_Trace_Writer *writer = context;
+    APEX_Trace_Queue *queue = &writer->queue;
+    const APEX_Trace_Block *block;
+    size_t size;
+
+    pthread_mutex_lock(&queue->lock);
+    while (TRUE)
+    {
+        while (queue->count == 0 && !queue->stop)
+        {
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        }
+        if (queue->count == 0)
+        {
+            break;
+        }
+        block = (const APEX_Trace_Block *)queue->blocks[queue->head];
+        size = APEX_TRACE_BLOCK_SIZE;
+        if (queue->stop && queue->count == 1)
+        {
+            size = sizeof(APEX_Trace_Block) + block->bytes;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (fwrite(block, size, 1, writer->file) != 1)
+        {
+            queue->error = TRUE;
+        }
+
+        pthread_mutex_lock(&queue->lock);
+        queue->head = (queue->head + 1) % APEX_TRACE_QUEUE;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/* Opens the block after the queued ones, waiting for a free one */
+static void
+writer_next_block(APEX_Trace_Writer *writer)
+{
+    APEX_Trace_Queue *queue = &writer->queue;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == APEX_TRACE_QUEUE)
+    {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    writer->block = queue->blocks[(queue->head + queue->count) % APEX_TRACE_QUEUE];
+    pthread_mutex_unlock(&queue->lock);
+
+    memset(writer->block, 0, APEX_TRACE_BLOCK_SIZE);
+    ((APEX_Trace_Block *)writer->block)->first_record = writer->header.num_records;
+    writer->bytes = 0;
+    codec_reset(&writer->codec);
+}
+
+/* Hands the block being filled to the writer thread */
+static void
+writer_queue_block(APEX_Trace_Writer *writer, int last)
+{
+    APEX_Trace_Queue *queue = &writer->queue;
+
+    ((APEX_Trace_Block *)writer->block)->bytes = writer->bytes;
+    pthread_mutex_lock(&queue->lock);
+    queue->count++;
+    queue->stop = last;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void
+trace_write(APEX_Trace_Writer *writer, const APEX_Trace_Record *record)
+{
+    if (!writer->packed)
+    {
+        fwrite(record, sizeof(APEX_Trace_Record), 1, writer->file);
+    }
+    else
+    {
+        if (sizeof(APEX_Trace_Block) + writer->bytes + APEX_TRACE_MAX_PACKED
+            > APEX_TRACE_BLOCK_SIZE)
+        {
+            writer_queue_block(writer, FALSE);
+            writer_next_block(writer);
+        }
+        writer->bytes += encode_record(&writer->codec,
+                                       writer->block + sizeof(APEX_Trace_Block)
+                                           + writer->bytes,
+                                       record);
+        ((APEX_Trace_Block *)writer->block)->num_records++;
+    }
+    writer->header.num_records++;
+}
+
+/*
+ * This function creates the trace file for a run of cpu, packed or raw
+ */
+APEX_Trace_Writer *
+APEX_trace_writer_create(const char *path, const APEX_CPU *cpu, int packed)
+{
+    APEX_Trace_Writer *writer = calloc(1, sizeof(APEX_Trace_Writer));
+
+    if (!writer)
+    {
+        return NULL;
+    }
+    writer->file = fopen(path, "wb");
+    if (!writer->file)
+    {
+        free(writer);
+        return NULL;
+    }
+    writer->packed = packed;
+    writer->cycle = APEX_cpu_cycle_variant(cpu);
+    memcpy(writer->header.magic, packed ? APEX_TRACE_PACKED_MAGIC : APEX_TRACE_MAGIC,
+           sizeof(writer->header.magic));
+    writer->header.record_size = packed ? APEX_TRACE_BLOCK_SIZE : sizeof(APEX_Trace_Record);
+    writer->header.forwarding = cpu->forwarding;
+
+    /* Filled in on close; readers go by the file size until then */
+    writer->header.num_records = -1;
+    fwrite(&writer->header, sizeof(APEX_Trace_Header), 1, writer->file);
+    writer->header.num_records = 0;
+
+    if (packed)
+    {
+        if (queue_start(&writer->queue, writer_thread, writer) < 0)
+        {
+            queue_free(&writer->queue);
+            fclose(writer->file);
+            free(writer);
+            return NULL;
+        }
+        writer_next_block(writer);
+    }
+    return writer;
+}
+
+/*
+ * Simulates one cycle and appends the instruction that retired in it
+ *
+ * Returns TRUE if HALT retired, like APEX_cpu_cycle
+ */
+int
+APEX_trace_cycle(APEX_Trace_Writer *writer, APEX_CPU *cpu)
+{
+    APEX_Trace_Record record;
+    int retiring = cpu->writeback.has_insn, flushes = cpu->branch_flushes;
+    int halted;
+
+    if (retiring)
+    {
+        memset(&record, 0, sizeof(record));
+        record.pc = cpu->writeback.pc;
+        record.opcode = cpu->writeback.opcode;
+        record.rd = cpu->writeback.rd;
+        record.rs1 = cpu->writeback.rs1;
+        record.rs2 = cpu->writeback.rs2;
+        if (is_memory_access(cpu->writeback.opcode))
+        {
+            record.memory_address = cpu->writeback.memory_address;
+        }
+    }
+
+    halted = writer->cycle(cpu);
+
+    /* What retires now was in execute two cycles ago, with nothing in
+     * between able to stall it */
+    writer->taken[cpu->clock & 3] = cpu->branch_flushes != flushes;
+    if (retiring)
+    {
+        if (writer->taken[(cpu->clock - 2) & 3])
+        {
+            record.flags |= APEX_TRACE_TAKEN;
+        }
+        trace_write(writer, &record);
+    }
+    return halted;
+}
+
+/*
+ * Flushes the last block, completes the header and closes the trace file
+ *
+ * Returns 0 on success, -1 if anything could not be written
+ */
+int
+APEX_trace_writer_close(APEX_Trace_Writer *writer, const APEX_CPU *cpu)
+{
+    int status = 0;
+
+    if (writer->packed)
+    {
+        writer_queue_block(writer, TRUE);
+        queue_stop(&writer->queue);
+        queue_free(&writer->queue);
+        status = writer->queue.error ? -1 : 0;
+    }
+
+    writer->header.cycles = cpu->clock;
+    if (ferror(writer->file) || fseek(writer->file, 0, SEEK_SET) != 0
+        || fwrite(&writer->header, sizeof(APEX_Trace_Header), 1, writer->file) != 1)
+    {
+        status = -1;
+    }
+    if (fclose(writer->file) != 0)
+    {
+        status = -1;
+    }
+    free(writer);
+    return status;
+}
+
+/*
+ * Reader thread, reads the blocks of a packed trace ahead of the decoder
+ * from next_block on. The decoder owns the block at the head of the queue.
+ */
+static void *
+reader_thread(void *context)
+{
+    APEX_Trace_Reader *reader = context;
+    APEX_Trace_Queue *queue = &reader->queue;
+    unsigned char *block;
+    long offset;
+    ssize_t size;
+
+    pthread_mutex_lock(&queue->lock);
+    while (reader->next_block < reader->num_blocks)
+    {
+        while (queue->count == APEX_TRACE_QUEUE && !queue->stop)
+        {
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        }
+        if (queue->stop)
+        {
+            break;
+        }
+        block = queue->blocks[(queue->head + queue->count) % APEX_TRACE_QUEUE];
+        offset = sizeof(APEX_Trace_Header) + reader->next_block * APEX_TRACE_BLOCK_SIZE;
+        pthread_mutex_unlock(&queue->lock);
+
+        size = pread(reader->fd, block, APEX_TRACE_BLOCK_SIZE, offset);
+
+        pthread_mutex_lock(&queue->lock);
+        if (size < (ssize_t)sizeof(APEX_Trace_Block)
+            || ((APEX_Trace_Block *)block)->bytes
+                   > size - (ssize_t)sizeof(APEX_Trace_Block))
+        {
+            queue->error = TRUE;
+            break;
+        }
+        reader->next_block++;
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    queue->done = TRUE;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/* Reads the header of block index of a packed trace */
+static int
+read_block_header(const APEX_Trace_Reader *reader, long index, APEX_Trace_Block *block)
+{
+    return pread(reader->fd, block, sizeof(APEX_Trace_Block),
+                 sizeof(APEX_Trace_Header) + index * APEX_TRACE_BLOCK_SIZE)
+           == sizeof(APEX_Trace_Block) ? 0 : -1;
+}
+
+/*
+ * Settles how many records the reader returns given that the file holds
+ * records of them. An unfinished trace (num_records < 0) returns all of
+ * them; a finished one that holds fewer than its header claims is marked
+ * truncated and returns what is there.
+ */
+static void
+mark_truncated(APEX_Trace_Reader *reader, long records)
+{
+    reader->claimed_records = reader->header.num_records;
+    if (reader->header.num_records < 0)
+    {
+        reader->header.num_records = records;
+    }
+    else if (reader->header.num_records > records)
+    {
+        reader->truncated = TRUE;
+        reader->header.num_records = records;
+    }
+}
+
+/*
+ * Opens a trace for reading. Nothing of a raw trace is mapped until the
+ * first record is read, and at most APEX_TRACE_WINDOW bytes are mapped at
+ * any time. A packed trace gets its reader thread started.
+ */
+APEX_Trace_Reader *
+APEX_trace_reader_open(const char *path)
+{
+    APEX_Trace_Reader *reader = calloc(1, sizeof(APEX_Trace_Reader));
+    APEX_Trace_Block last;
+    struct stat st;
+    long records, end;
+
+    if (!reader)
+    {
+        return NULL;
+    }
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0 || fstat(reader->fd, &st) < 0
+        || pread(reader->fd, &reader->header, sizeof(APEX_Trace_Header), 0)
+               != sizeof(APEX_Trace_Header))
+    {
+        goto fail;
+    }
+
+    if (memcmp(reader->header.magic, APEX_TRACE_PACKED_MAGIC, sizeof(reader->header.magic)) == 0
+        && reader->header.record_size == APEX_TRACE_BLOCK_SIZE)
+    {
+        reader->packed = TRUE;
+        reader->num_blocks = (st.st_size - sizeof(APEX_Trace_Header)
+                              + APEX_TRACE_BLOCK_SIZE - 1) / APEX_TRACE_BLOCK_SIZE;
+
+        /* The records present end with the last block written in full. An
+         * unfinished trace holds just those, a finished one must hold as
+         * many as its header claims. */
+        records = 0;
+        while (reader->num_blocks > 0)
+        {
+            end = (long)sizeof(APEX_Trace_Header)
+                  + (reader->num_blocks - 1) * APEX_TRACE_BLOCK_SIZE
+                  + (long)sizeof(APEX_Trace_Block);
+            if (read_block_header(reader, reader->num_blocks - 1, &last) == 0
+                && last.bytes >= 0 && last.bytes <= APEX_TRACE_BLOCK_SIZE
+                && end + last.bytes <= st.st_size)
+            {
+                records = last.first_record + last.num_records;
+                break;
+            }
+            reader->num_blocks--;
+        }
+        mark_truncated(reader, records);
+        if (APEX_trace_seek(reader, 0) < 0)
+        {
+            goto fail;
+        }
+        return reader;
+    }
+
+    if (memcmp(reader->header.magic, APEX_TRACE_MAGIC, sizeof(reader->header.magic)) != 0
+        || reader->header.record_size != sizeof(APEX_Trace_Record))
+    {
+        goto fail;
+    }
+
+    records = (st.st_size - (long)sizeof(APEX_Trace_Header)) / sizeof(APEX_Trace_Record);
+    mark_truncated(reader, records < 0 ? 0 : records);
+    reader->file_size = sizeof(APEX_Trace_Header)
+                        + reader->header.num_records * sizeof(APEX_Trace_Record);
+    return reader;
+
+fail:
+    if (reader->fd >= 0)
+    {
+        close(reader->fd);
+    }
+    queue_free(&reader->queue);
+    free(reader);
+    return NULL;
+}
+
+/* Maps the window of a raw trace starting at offset, which is a multiple of
+ * APEX_TRACE_WINDOW */
+static int
+map_window(APEX_Trace_Reader *reader, long offset)
+{
+    void *window;
+
+    if (reader->window)
+    {
+        munmap((void *)reader->window, reader->window_size);
+        reader->window = NULL;
+    }
+    reader->window_offset = offset;
+    reader->window_size = 0;
+    reader->next = reader->end = NULL;
+    if (offset >= reader->file_size)
+    {
+        return FALSE;
+    }
+
+    /* Windows are page aligned, and so are the records in them */
+    reader->window_size = reader->file_size - offset;
+    if (reader->window_size > APEX_TRACE_WINDOW)
+    {
+        reader->window_size = APEX_TRACE_WINDOW;
+    }
+    window = mmap(NULL, reader->window_size, PROT_READ, MAP_PRIVATE, reader->fd, offset);
+    if (window == MAP_FAILED)
+    {
+        reader->window_offset = reader->file_size;
+        reader->window_size = 0;
+        return FALSE;
+    }
+    madvise(window, reader->window_size, MADV_SEQUENTIAL);
+
+    reader->window = window;
+    reader->next = (const APEX_Trace_Record *)(reader->window
+                   + (offset == 0 ? sizeof(APEX_Trace_Header) : 0));
+    reader->end = (const APEX_Trace_Record *)(reader->window + reader->window_size);
+    return TRUE;
+}
+
+/* Moves the decoder of a packed trace on to the next block read */
+static int
+next_block(APEX_Trace_Reader *reader)
+{
+    APEX_Trace_Queue *queue = &reader->queue;
+
+    pthread_mutex_lock(&queue->lock);
+    if (reader->block)
+    {
+        queue->head = (queue->head + 1) % APEX_TRACE_QUEUE;
+        queue->count--;
+        reader->block = NULL;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    while (queue->count == 0 && !queue->done)
+    {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    if (queue->count > 0)
+    {
+        reader->block = queue->blocks[queue->head];
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    if (!reader->block)
+    {
+        return FALSE;
+    }
+    reader->position = sizeof(APEX_Trace_Block);
+    reader->remaining = ((const APEX_Trace_Block *)reader->block)->num_records;
+    codec_reset(&reader->codec);
+    return TRUE;
+}
+
+/*
+ * Returns the next record, or NULL at the end of the trace. The record
+ * stays valid until the next call.
+ */
+const APEX_Trace_Record *
+APEX_trace_read(APEX_Trace_Reader *reader)
+{
+    if (reader->packed)
+    {
+        while (reader->remaining == 0)
+        {
+            if (!next_block(reader))
+            {
+                return NULL;
+            }
+        }
+        decode_record(&reader->codec, reader->block, &reader->position, &reader->record);
+        reader->remaining--;
+        return &reader->record;
+    }
+
+    if (reader->next == reader->end
+        && !map_window(reader, reader->window_offset + reader->window_size))
+    {
+        return NULL;
+    }
+    return reader->next++;
+}
+
+/*
+ * Positions the reader so that the next record read is number record,
+ * counting from 0
+ *
+ * Returns 0 on success, -1 if the trace has no such record
+ */
+int
+APEX_trace_seek(APEX_Trace_Reader *reader, long record)
+{
+    APEX_Trace_Block block;
+    long low = 0, high, offset;
+
+    if (record < 0 || record > reader->header.num_records)
+    {
+        return -1;
+    }
+
+    if (!reader->packed)
+    {
+        offset = sizeof(APEX_Trace_Header) + record * sizeof(APEX_Trace_Record);
+        map_window(reader, offset - offset % APEX_TRACE_WINDOW);
+        if (reader->next)
+        {
+            reader->next = (const APEX_Trace_Record *)(reader->window
+                           + offset % APEX_TRACE_WINDOW);
+        }
+        return 0;
+    }
+
+    /* Last block starting at or before record */
+    high = reader->num_blocks - 1;
+    while (low < high)
+    {
+        long middle = (low + high + 1) / 2;
+
+        if (read_block_header(reader, middle, &block) < 0)
+        {
+            return -1;
+        }
+        if (block.first_record <= record)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    queue_stop(&reader->queue);
+    reader->block = NULL;
+    reader->remaining = 0;
+    reader->next_block = low;
+    reader->queue.error = FALSE;
+    if (queue_start(&reader->queue, reader_thread, reader) < 0)
+    {
+        return -1;
+    }
+
+    if (read_block_header(reader, low, &block) == 0)
+    {
+        for (offset = block.first_record; offset < record; ++offset)
+        {
+            APEX_trace_read(reader);
+        }
+    }
+    return 0;
+}
+
+void
+APEX_trace_reader_close(APEX_Trace_Reader *reader)
+{
+    if (reader->packed)
+    {
+        queue_stop(&reader->queue);
+        queue_free(&reader->queue);
+    }
+    if (reader->window)
+    {
+        munmap((void *)reader->window, reader->window_size);
+    }
+    close(reader->fd);
+    free(reader);
+}
+
+/* Latch of the timing model, the register specifiers of a CPU_Stage */
+typedef struct Timing_Stage
+{
+    int opcode;
+    int rd;
+    int rs1;
+    int rs2;
+    int rs1_f;
+    int rs2_f;
+    int taken;
+    int has_insn;
+    int stalled;
+} Timing_Stage;
+
+typedef struct Timing_Model
+{
+    APEX_Trace_Reader *reader;
+    long remaining;                /* Records still to fetch, -1 for all */
+    int forwarding;
+    int regs_writing[REG_FILE_SIZE];
+    int ex_fb;                     /* Register on each forwarding bus */
+    int mem_fb;
+    int fetch_from_next_cycle;
+    int wrong_path;                /* Next fetch is the slot behind a taken branch */
+    Timing_Stage fetch;
+    Timing_Stage decode;
+    Timing_Stage execute;
+    Timing_Stage memory;
+    Timing_Stage writeback;
+    long clock;
+    long insn_completed;
+    long stall_cycles;
+    long branch_flushes;
+} Timing_Model;
+
+static void
+timing_fetch(Timing_Model *model)
+{
+    const APEX_Trace_Record *record;
+
+    if (!model->fetch.has_insn)
+    {
+        return;
+    }
+    if (model->fetch_from_next_cycle)
+    {
+        model->fetch_from_next_cycle = FALSE;
+        return;
+    }
+
+    /* A stalled fetch keeps the instruction it holds */
+    if (model->fetch.stalled)
+    {
+        return;
+    }
+
+    /* The wrong path is squashed in decode before it is ever decoded, so
+     * all that matters is the slot it takes */
+    if (model->wrong_path)
+    {
+        model->wrong_path = FALSE;
+        model->fetch.opcode = OPCODE_NOP;
+        model->fetch.taken = FALSE;
+    }
+    else
+    {
+        record = model->remaining != 0 ? APEX_trace_read(model->reader) : NULL;
+        model->remaining--;
+        if (!record)
+        {
+            /* A trace cut short has no HALT behind it, so let decode drain
+             * instead of issuing its last instruction again */
+            model->fetch.has_insn = FALSE;
+            model->decode.has_insn = FALSE;
+            return;
+        }
+        model->fetch.opcode = record->opcode;
+        model->fetch.rd = record->rd;
+        model->fetch.rs1 = record->rs1;
+        model->fetch.rs2 = record->rs2;
+        model->fetch.taken = record->flags & APEX_TRACE_TAKEN;
+        model->wrong_path = model->fetch.taken;
+    }
+    model->decode = model->fetch;
+
+    if (model->fetch.opcode == OPCODE_HALT)
+    {
+        model->fetch.has_insn = FALSE;
+    }
+}
+
+/* Looks an operand up the way APEX_decode does: EX bus, MEM bus, then
+ * the register file once nothing is writing it */
+static void
+timing_read(const Timing_Model *model, int reg, int *found, int mem_when_writing)
+{
+    if (!*found
+        && (reg == model->ex_fb
+            || (reg == model->mem_fb && (!mem_when_writing || model->regs_writing[reg]))
+            || !model->regs_writing[reg]))
+    {
+        *found = TRUE;
+    }
+}
+
+static void
+timing_decode(Timing_Model *model)
+{
+    Timing_Stage *stage = &model->decode;
+
+    if (!stage->has_insn)
+    {
+        return;
+    }
+
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+            timing_read(model, stage->rs1, &stage->rs1_f, FALSE);
+            timing_read(model, stage->rs2, &stage->rs2_f, TRUE);
+            stage->stalled = !(stage->rs1_f && stage->rs2_f);
+            if (!stage->stalled)
+            {
+                model->regs_writing[stage->rd] = 1;
+            }
+            break;
+
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_JALR:
+        case OPCODE_LOAD:
+            timing_read(model, stage->rs1, &stage->rs1_f, FALSE);
+            stage->stalled = !stage->rs1_f;
+            if (!stage->stalled)
+            {
+                model->regs_writing[stage->rd] = 1;
+            }
+            break;
+
+        case OPCODE_LOADP:
+            timing_read(model, stage->rs1, &stage->rs1_f, FALSE);
+            stage->stalled = !stage->rs1_f;
+            if (!stage->stalled)
+            {
+                model->regs_writing[stage->rs1] = 1;
+                model->regs_writing[stage->rd] = 1;
+            }
+            break;
+
+        case OPCODE_CML:
+        case OPCODE_JUMP:
+            timing_read(model, stage->rs1, &stage->rs1_f, FALSE);
+            stage->stalled = !stage->rs1_f;
+            if (!stage->stalled)
+            {
+                model->regs_writing[stage->rs1] = 1;
+            }
+            break;
+
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+        case OPCODE_CMP:
+            timing_read(model, stage->rs1, &stage->rs1_f, FALSE);
+            timing_read(model, stage->rs2, &stage->rs2_f, FALSE);
+            stage->stalled = !(stage->rs1_f && stage->rs2_f);
+            break;
+
+        case OPCODE_MOVC:
+            model->regs_writing[stage->rd] = 1;
+            break;
+    }
+
+    if (!stage->stalled)
+    {
+        model->execute = *stage;
+        model->fetch.stalled = 0;
+    }
+    else
+    {
+        model->fetch.stalled = 1;
+    }
+}
+
+/* As APEX_writes_register, for a timing latch */
+static int
+timing_writes(const Timing_Stage *stage, int reg)
+{
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_LOAD:
+        case OPCODE_MOVC:
+        case OPCODE_JALR:
+            return stage->rd == reg;
+        case OPCODE_LOADP:
+            return stage->rd == reg || stage->rs1 == reg;
+        case OPCODE_STOREP:
+            return stage->rs2 == reg;
+        default:
+            return FALSE;
+    }
+}
+
+static void
+timing_execute(Timing_Model *model)
+{
+    Timing_Stage *stage = &model->execute;
+
+    if (!stage->has_insn)
+    {
+        return;
+    }
+
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_MOVC:
+            model->regs_writing[stage->rd] = 1;
+            model->ex_fb = stage->rd;
+            break;
+
+        case OPCODE_LOAD:
+            model->regs_writing[stage->rd] = 1;
+            break;
+
+        case OPCODE_LOADP:
+            model->regs_writing[stage->rd] = 1;
+            model->regs_writing[stage->rs1] = 1;
+            model->ex_fb = stage->rs2;
+            break;
+
+        case OPCODE_STOREP:
+            model->regs_writing[stage->rs2] = 1;
+            model->ex_fb = stage->rs2;
+            break;
+
+        case OPCODE_JALR:
+            /* Marks the destination left in the memory latch */
+            model->regs_writing[model->memory.rd] = 1;
+            break;
+    }
+
+    if (stage->taken)
+    {
+        model->fetch_from_next_cycle = TRUE;
+        model->wrong_path = FALSE;
+        model->decode.has_insn = FALSE;
+        model->fetch.has_insn = TRUE;
+    }
+
+    if (!(model->forwarding & FORWARD_EX))
+    {
+        model->ex_fb = -1;
+        if (timing_writes(stage, model->mem_fb))
+        {
+            model->mem_fb = -1;
+        }
+    }
+    model->memory = *stage;
+    stage->has_insn = FALSE;
+}
+
+static void
+timing_memory(Timing_Model *model)
+{
+    Timing_Stage *stage = &model->memory;
+
+    if (!stage->has_insn)
+    {
+        return;
+    }
+
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_MOVC:
+        case OPCODE_LOAD:
+            model->regs_writing[stage->rd] = 1;
+            model->mem_fb = stage->rd;
+            break;
+
+        case OPCODE_LOADP:
+            model->regs_writing[stage->rd] = 1;
+            model->regs_writing[stage->rs1] = 1;
+            model->mem_fb = stage->rd;
+            break;
+
+        case OPCODE_STORE:
+            model->mem_fb = -1;
+            break;
+
+        case OPCODE_STOREP:
+            model->regs_writing[stage->rs2] = 1;
+            model->mem_fb = -1;
+            break;
+
+        case OPCODE_JALR:
+            model->regs_writing[stage->rd] = 1;
+            break;
+    }
+
+    if (!(model->forwarding & FORWARD_MEM))
+    {
+        model->mem_fb = -1;
+    }
+    model->writeback = *stage;
+    stage->has_insn = FALSE;
+}
+
+static int
+timing_writeback(Timing_Model *model)
+{
+    Timing_Stage *stage = &model->writeback;
+
+    if (!stage->has_insn)
+    {
+        return FALSE;
+    }
+
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_LOAD:
+        case OPCODE_MOVC:
+        case OPCODE_JALR:
+            model->regs_writing[stage->rd] = 0;
+            break;
+
+        case OPCODE_LOADP:
+            model->regs_writing[stage->rd] = 0;
+            model->regs_writing[stage->rs1] = 0;
+            break;
+
+        case OPCODE_STOREP:
+            model->regs_writing[stage->rs2] = 0;
+            break;
+    }
+
+    model->insn_completed++;
+    stage->has_insn = FALSE;
+    return stage->opcode == OPCODE_HALT;
+}
+
+/* Same stage order and counters as APEX_cpu_cycle */
+static int
+timing_cycle(Timing_Model *model)
+{
+    model->clock++;
+
+    if (timing_writeback(model))
+    {
+        return TRUE;
+    }
+    timing_memory(model);
+    timing_execute(model);
+    if (model->fetch_from_next_cycle)
+    {
+        model->branch_flushes++;
+    }
+    timing_decode(model);
+    if (model->decode.has_insn && model->decode.stalled)
+    {
+        model->stall_cycles++;
+    }
+    timing_fetch(model);
+    return FALSE;
+}
+
+static int
+timing_drained(const Timing_Model *model)
+{
+    return !model->fetch.has_insn && !model->decode.has_insn
+           && !model->execute.has_insn && !model->memory.has_insn
+           && !model->writeback.has_insn;
+}
+
+/*
+ * Replays count records of the trace at path from record first on, or all
+ * of them if count is negative, through the timing model under a forwarding
+ * policy. The model starts with an empty pipeline. A trace that does not
+ * end in HALT, such as one cut short, is replayed until its last
+ * instruction retires.
+ *
+ * Returns 0 on success, -1 if the trace cannot be read
+ */
+int
+APEX_timing_replay(const char *path, int forwarding, long first, long count,
+                   APEX_Timing_Result *result)
+{
+    Timing_Model *model = calloc(1, sizeof(Timing_Model));
+    struct timespec start, end;
+    long last_retired = 0, retired = 0;
+
+    if (!model)
+    {
+        return -1;
+    }
+    model->reader = APEX_trace_reader_open(path);
+    if (!model->reader || APEX_trace_seek(model->reader, first) < 0)
+    {
+        if (model->reader)
+        {
+            APEX_trace_reader_close(model->reader);
+        }
+        free(model);
+        return -1;
+    }
+    model->remaining = count;
+    model->forwarding = forwarding;
+    model->fetch.has_insn = TRUE;
+
+    memset(result, 0, sizeof(APEX_Timing_Result));
+    result->forwarding = forwarding;
+    result->halted = TRUE;
+    result->truncated = model->reader->truncated;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!timing_cycle(model) && !timing_drained(model))
+    {
+        if (model->insn_completed != retired)
+        {
+            retired = model->insn_completed;
+            last_retired = model->clock;
+        }
+        else if (model->clock - last_retired > APEX_TIMING_STALL_LIMIT)
+        {
+            result->halted = FALSE;
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    result->cycles = model->clock;
+    result->insn_completed = model->insn_completed;
+    result->stall_cycles = model->stall_cycles;
+    result->branch_flushes = model->branch_flushes;
+    result->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    APEX_trace_reader_close(model->reader);
+    free(model);
+    return 0;
+}
+
+typedef struct Replay_Job
+{
+    const char *path;
+    long first;
+    long count;
+    APEX_Timing_Result *results;
+    int *status;
+} Replay_Job;
+
+/* Pool task, replays the trace under one forwarding policy */
+static void
+replay_task(void *context, int index)
+{
+    Replay_Job *job = context;
+
+    job->status[index] = APEX_timing_replay(job->path, job->results[index].forwarding,
+                                            job->first, job->count, &job->results[index]);
+}
+
+/*
+ * Entry point of "apex_sim <trace_file> replay <option>...". Options are
+ *   forwarding=<none|ex|mem|all>,...   threads=<n>   from=<record>   count=<n>
+ * and the trace is replayed once per policy, in parallel. A finished trace
+ * missing records at its end replays what it holds, reports "truncated"
+ * and exits 1.
+ */
+int
+APEX_trace_replay_main(const char *path, int argc, char const *argv[])
+{
+    APEX_Timing_Result results[FORWARD_ALL + 1];
+    int status[FORWARD_ALL + 1];
+    APEX_Trace_Reader *reader;
+    Replay_Job job;
+    char list[64], *name;
+    int num_results = 0, threads = APEX_pool_default_threads(), forwarding, truncated, i;
+    long first = 0, count = -1;
+    const APEX_Timing_Result *r;
+
+    reader = APEX_trace_reader_open(path);
+    if (!reader)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read trace %s\n", path);
+        return 1;
+    }
+    forwarding = reader->header.forwarding;
+    truncated = reader->truncated;
+
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "forwarding=", 11) == 0)
+        {
+            snprintf(list, sizeof(list), "%s", argv[i] + 11);
+            for (name = strtok(list, ","); name; name = strtok(NULL, ","))
+            {
+                if (APEX_parse_forwarding(name) < 0 || num_results > FORWARD_ALL)
+                {
+                    fprintf(stderr, "APEX_Error: Unknown forwarding policy %s\n", name);
+                    APEX_trace_reader_close(reader);
+                    return 1;
+                }
+                results[num_results++].forwarding = APEX_parse_forwarding(name);
+            }
+        }
+        else if (strncmp(argv[i], "threads=", 8) == 0)
+        {
+            threads = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "from=", 5) == 0)
+        {
+            first = atol(argv[i] + 5);
+        }
+        else if (strncmp(argv[i], "count=", 6) == 0)
+        {
+            count = atol(argv[i] + 6);
+        }
+        else
+        {
+            fprintf(stderr, "APEX_Error: Unknown replay option %s\n", argv[i]);
+            APEX_trace_reader_close(reader);
+            return 1;
+        }
+    }
+    if (num_results == 0)
+    {
+        for (i = 0; i <= FORWARD_ALL; ++i)
+        {
+            results[num_results++].forwarding = i;
+        }
+    }
+
+    printf("APEX_TRACE: %s, %s, %ld instructions recorded with forwarding=%s "
+           "in %ld cycles\n", path, reader->packed ? "packed" : "raw",
+           reader->header.num_records, APEX_forwarding_name(forwarding),
+           reader->header.cycles);
+    if (reader->truncated)
+    {
+        fprintf(stderr, "APEX_Error: Trace %s is truncated, it holds %ld of the "
+                "%ld instructions recorded\n", path, reader->header.num_records,
+                reader->claimed_records);
+    }
+    APEX_trace_reader_close(reader);
+
+    job.path = path;
+    job.first = first;
+    job.count = count;
+    job.results = results;
+    job.status = status;
+    if (APEX_pool_run(threads, num_results, replay_task, &job) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to start replay\n");
+        return 1;
+    }
+
+    printf("forwarding,status,cycles,instructions,cpi,stall_cycles,"
+           "branch_flushes,seconds,minsn_per_s\n");
+    for (i = 0; i < num_results; ++i)
+    {
+        r = &results[i];
+        if (status[i] < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to replay %s\n", path);
+            return 1;
+        }
+        printf("%s,%s,%ld,%ld,%.4f,%ld,%ld,%.6f,%.2f\n",
+               APEX_forwarding_name(r->forwarding),
+               !r->halted ? "deadlock" : r->truncated ? "truncated" : "complete",
+               r->cycles, r->insn_completed,
+               r->insn_completed ? (double)r->cycles / r->insn_completed : 0.0,
+               r->stall_cycles, r->branch_flushes, r->seconds,
+               r->seconds > 0.0 ? r->insn_completed / r->seconds / 1e6 : 0.0);
+    }
+    return truncated ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * apex_trace.h
+ * Contains declarations of the committed instruction trace and the
+ * trace-driven timing model
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "apex_cpu.h"
+
+#define APEX_TRACE_MAGIC "APEXTRC1"
+#define APEX_TRACE_PACKED_MAGIC "APEXTRZ2"
+
+/* Record flags */
+#define APEX_TRACE_TAKEN 0x1       /* Redirected fetch from execute */
+
+/* Bytes of the trace file mapped at a time by a reader */
+#define APEX_TRACE_WINDOW (64 << 20)
+
+/* Packed traces are a sequence of blocks of this size, only the last one
+ * is cut short. Each block decodes on its own. */
+#define APEX_TRACE_BLOCK_SIZE (64 << 10)
+
+/* Most bytes one record can take in a block: tag, pc delta, opcode and
+ * register specifiers, address delta */
+#define APEX_TRACE_MAX_PACKED 15
+
+/* Per-pc slots of the packed codec, indexed by pc / 4 */
+#define APEX_TRACE_SLOTS 4096
+
+/* Blocks in flight between the background thread and its user */
+#define APEX_TRACE_QUEUE 4
+
+/* Tag bits of a packed record, the low bits are the record flags */
+#define APEX_TRACE_NEXT_PC 0x2     /* pc is the one predicted after the previous */
+#define APEX_TRACE_STATIC 0x4      /* Opcode and register specifiers follow */
+#define APEX_TRACE_STRIDE 0x8      /* Address repeats the last stride of its pc */
+
+/* Cycle budget of a recording run when it does not set max_cycles */
+#define APEX_TRACE_MAX_CYCLES 10000000
+
+/* Cycles the timing model may go without retiring before it gives up */
+#define APEX_TIMING_STALL_LIMIT 4096
+
+/* One retired instruction. Register specifiers are all the timing model
+ * needs of the operands; their values are never replayed. */
+typedef struct APEX_Trace_Record
+{
+    int pc;
+    int memory_address;            /* Effective address of loads and stores */
+    unsigned char opcode;
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
+    unsigned char flags;           /* APEX_TRACE_* */
+    unsigned char pad[3];
+} APEX_Trace_Record;
+
+/* File header, followed by num_records records or by the blocks */
+typedef struct APEX_Trace_Header
+{
+    char magic[8];
+    int record_size;               /* Bytes per record, or per packed block */
+    int forwarding;                /* Configuration the trace was recorded with */
+    long num_records;
+    long cycles;                   /* Cycles of the recording run */
+} APEX_Trace_Header;
+
+/* Start of every packed block, the index readers seek with */
+typedef struct APEX_Trace_Block
+{
+    long first_record;
+    int num_records;
+    int bytes;                     /* Encoded bytes after this header */
+} APEX_Trace_Block;
+
+/* Delta state of the packed codec. pcs are predicted as the fall-through
+ * of the previous one, or as its last target when it was a taken branch.
+ * Addresses are predicted as the last address of their pc plus its last
+ * stride, and otherwise encoded against the last address formed from the
+ * same base register. */
+typedef struct APEX_Trace_Codec
+{
+    int pc;
+    int next_pc;                   /* Predicted pc of the next record */
+    int branch;                    /* Slot of the previous record if taken, or -1 */
+    int base_address[REG_FILE_SIZE]; /* Last address formed from each register */
+    struct
+    {
+        int pc;
+        int target;                /* pc after the last time it was taken, or -1 */
+        int memory_address;
+        int stride;
+        unsigned char opcode;
+        unsigned char rd;
+        unsigned char rs1;
+        unsigned char rs2;
+    } slots[APEX_TRACE_SLOTS];
+} APEX_Trace_Codec;
+
+/* Blocks handed between the user of a trace and its I/O thread */
+typedef struct APEX_Trace_Queue
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned char *blocks[APEX_TRACE_QUEUE];
+    int head;                      /* Oldest full block */
+    int count;                     /* Full blocks */
+    int running;
+    int stop;
+    int done;                      /* The thread has nothing more to give */
+    int error;
+} APEX_Trace_Queue;
+
+typedef struct APEX_Trace_Writer
+{
+    FILE *file;
+    APEX_Trace_Header header;
+    APEX_Cycle_Fn cycle;           /* Variant of the cpu traced */
+    int taken[4];                  /* Per clock & 3, a branch redirected */
+
+    /* Packed traces only */
+    int packed;
+    APEX_Trace_Queue queue;
+    unsigned char *block;          /* Block being filled */
+    int bytes;
+    APEX_Trace_Codec codec;
+} APEX_Trace_Writer;
+
+/* Streams records out of consecutive windows mapped from a raw trace, or
+ * out of the blocks of a packed one read ahead by a background thread */
+typedef struct APEX_Trace_Reader
+{
+    int fd;
+    APEX_Trace_Header header;      /* num_records is what the file holds */
+    long claimed_records;          /* What a finished header claimed */
+    int truncated;                 /* TRUE if that many are not all there */
+    long file_size;
+    long window_offset;            /* File offset of the mapped window */
+    long window_size;
+    const unsigned char *window;
+    const APEX_Trace_Record *next;
+    const APEX_Trace_Record *end;  /* End of the records in the window */
+
+    /* Packed traces only */
+    int packed;
+    long num_blocks;
+    long next_block;               /* Next block the thread reads */
+    APEX_Trace_Queue queue;
+    const unsigned char *block;    /* Block being decoded, NULL if none */
+    int position;
+    int remaining;                 /* Records left in the block */
+    APEX_Trace_Codec codec;
+    APEX_Trace_Record record;
+} APEX_Trace_Reader;
+
+/* What one replay of a trace produced */
+typedef struct APEX_Timing_Result
+{
+    int forwarding;
+    int halted;                    /* FALSE if the model stopped retiring */
+    int truncated;                 /* TRUE if the trace lost records at its end */
+    long cycles;
+    long insn_completed;
+    long stall_cycles;
+    long branch_flushes;
+    double seconds;
+} APEX_Timing_Result;
+
+APEX_Trace_Writer *APEX_trace_writer_create(const char *path, const APEX_CPU *cpu,
+                                            int packed);
+int APEX_trace_cycle(APEX_Trace_Writer *writer, APEX_CPU *cpu);
+int APEX_trace_writer_close(APEX_Trace_Writer *writer, const APEX_CPU *cpu);
+
+APEX_Trace_Reader *APEX_trace_reader_open(const char *path);
+const APEX_Trace_Record *APEX_trace_read(APEX_Trace_Reader *reader);
+int APEX_trace_seek(APEX_Trace_Reader *reader, long record);
+void APEX_trace_reader_close(APEX_Trace_Reader *reader);
+
+int APEX_timing_replay(const char *path, int forwarding, long first, long count,
+                       APEX_Timing_Result *result);
+
+int APEX_trace_replay_main(const char *path, int argc, char const *argv[]);
+
+#endif
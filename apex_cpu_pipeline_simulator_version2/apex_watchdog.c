@@ -0,0 +1,362 @@
+/*
+ * apex_watchdog.c
+ * Contains the runaway program watchdog
+ *
+ * The pipeline is deterministic, so a program that brings the whole
+ * machine back to a state it was in before can never halt. The watchdog
+ * looks for that with Brent's algorithm on states taken every
+ * APEX_WATCHDOG_INTERVAL cycles: the state at every power of two of them
+ * is saved and every following one is compared with it, which finds any
+ * repetition within a few periods of its start. A hash of each state
+ * filters the comparisons; the data memory part of it is kept up to date
+ * store by store. Cycle and wall time budgets catch the
+ * programs that run away without repeating.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_watchdog.h"
+
+static unsigned long
+mix(unsigned long x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdUL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53UL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Term of one data memory word in the memory hash */
+static unsigned long
+memory_term(int address, int value)
+{
+    return mix(((unsigned long)address << 32) | (unsigned int)value);
+}
+
+static void
+copy_latch(int *out, const CPU_Stage *stage)
+{
+    out[0] = stage->pc;
+    out[1] = stage->opcode;
+    out[2] = stage->rs1;
+    out[3] = stage->rs2;
+    out[4] = stage->rs1_f;
+    out[5] = stage->rs2_f;
+    out[6] = stage->rd;
+    out[7] = stage->imm;
+    out[8] = stage->rs1_value;
+    out[9] = stage->rs2_value;
+    out[10] = stage->rs1_src;
+    out[11] = stage->rs2_src;
+    out[12] = stage->result_buffer;
+    out[13] = stage->memory_address;
+    out[14] = stage->has_insn;
+    out[15] = stage->stalled;
+}
+
+static void
+make_state(const APEX_CPU *cpu, APEX_Watchdog_State *state)
+{
+    memset(state, 0, sizeof(APEX_Watchdog_State));
+    state->pc = cpu->pc;
+    state->zero_flag = cpu->zero_flag;
+    state->fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+    state->cc = cpu->cc;
+    state->ex_fb = cpu->ex_fb;
+    state->mem_fb = cpu->mem_fb;
+    memcpy(state->regs, cpu->regs, sizeof(state->regs));
+    memcpy(state->regs_writing, cpu->regs_writing, sizeof(state->regs_writing));
+    copy_latch(state->latches[0], &cpu->fetch);
+    copy_latch(state->latches[1], &cpu->decode);
+    copy_latch(state->latches[2], &cpu->execute);
+    copy_latch(state->latches[3], &cpu->memory);
+    copy_latch(state->latches[4], &cpu->writeback);
+}
+
+static unsigned long
+hash_state(const APEX_Watchdog_State *state, unsigned long memory_hash)
+{
+    const int *words = (const int *)state;
+    unsigned long h = memory_hash;
+    size_t i;
+
+    for (i = 0; i < sizeof(APEX_Watchdog_State) / sizeof(int); ++i)
+    {
+        h = (h ^ (unsigned int)words[i]) * 0x100000001b3UL;
+    }
+    return mix(h);
+}
+
+/* Rebuilds the memory hash and its copy from scratch */
+static void
+hash_memory(APEX_Watchdog *watchdog, const APEX_CPU *cpu)
+{
+    int i;
+
+    memcpy(watchdog->memory, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+    watchdog->memory_hash = 0;
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        watchdog->memory_hash += memory_term(i, watchdog->memory[i]);
+    }
+}
+
+/*
+ * Brings the memory hash up to date after one cycle. Only the store that
+ * went through memory in that cycle, now in writeback, can have changed a
+ * word. Anything that moved the pipeline more than a cycle at once gets
+ * the memory hashed again.
+ */
+static void
+update_memory(APEX_Watchdog *watchdog, const APEX_CPU *cpu)
+{
+    const CPU_Stage *stage = &cpu->writeback;
+    int address = stage->memory_address;
+
+    if (cpu->clock != watchdog->clock + 1)
+    {
+        hash_memory(watchdog, cpu);
+        return;
+    }
+    if (!stage->has_insn
+        || (stage->opcode != OPCODE_STORE && stage->opcode != OPCODE_STOREP)
+        || address < 0 || address >= DATA_MEMORY_SIZE
+        || cpu->data_memory[address] == watchdog->memory[address])
+    {
+        return;
+    }
+    watchdog->memory_hash -= memory_term(address, watchdog->memory[address]);
+    watchdog->memory[address] = cpu->data_memory[address];
+    watchdog->memory_hash += memory_term(address, watchdog->memory[address]);
+}
+
+static double
+elapsed_seconds(const APEX_Watchdog *watchdog)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - watchdog->start.tv_sec)
+           + (now.tv_nsec - watchdog->start.tv_nsec) / 1e9;
+}
+
+/* Makes the current state the one later states are compared with */
+static void
+save_state(APEX_Watchdog *watchdog, const APEX_CPU *cpu,
+           const APEX_Watchdog_State *state, unsigned long hash)
+{
+    watchdog->saved = *state;
+    memcpy(watchdog->saved_memory, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+    watchdog->saved_hash = hash;
+    watchdog->saved_clock = cpu->clock;
+}
+
+/*
+ * Creates a watchdog for a cpu about to run. A budget of 0 is no budget;
+ * repetition is always looked for.
+ */
+APEX_Watchdog *
+APEX_watchdog_create(const APEX_CPU *cpu, long max_cycles, double max_seconds)
+{
+    APEX_Watchdog *watchdog = calloc(1, sizeof(APEX_Watchdog));
+    APEX_Watchdog_State state;
+
+    if (!watchdog)
+    {
+        return NULL;
+    }
+    watchdog->memory = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    watchdog->saved_memory = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    if (!watchdog->memory || !watchdog->saved_memory)
+    {
+        APEX_watchdog_destroy(watchdog);
+        return NULL;
+    }
+
+    watchdog->max_cycles = max_cycles;
+    watchdog->max_seconds = max_seconds;
+    clock_gettime(CLOCK_MONOTONIC, &watchdog->start);
+    watchdog->clock = cpu->clock;
+    watchdog->next_check = cpu->clock + APEX_WATCHDOG_INTERVAL;
+    watchdog->power = 1;
+    watchdog->length = 1;
+    hash_memory(watchdog, cpu);
+    make_state(cpu, &state);
+    save_state(watchdog, cpu, &state, hash_state(&state, watchdog->memory_hash));
+    return watchdog;
+}
+
+/*
+ * Checks the cpu after a cycle that did not halt it
+ *
+ * Returns APEX_WATCHDOG_RUNNING, or the reason to stop the run
+ */
+int
+APEX_watchdog_check(APEX_Watchdog *watchdog, const APEX_CPU *cpu)
+{
+    APEX_Watchdog_State state;
+    unsigned long hash;
+
+    if (watchdog->status != APEX_WATCHDOG_RUNNING)
+    {
+        return watchdog->status;
+    }
+
+    update_memory(watchdog, cpu);
+    watchdog->clock = cpu->clock;
+
+    if (watchdog->max_cycles > 0 && cpu->clock >= watchdog->max_cycles)
+    {
+        return watchdog->status = APEX_WATCHDOG_CYCLES;
+    }
+    if (cpu->clock < watchdog->next_check)
+    {
+        return APEX_WATCHDOG_RUNNING;
+    }
+    watchdog->next_check = cpu->clock + APEX_WATCHDOG_INTERVAL;
+
+    make_state(cpu, &state);
+    hash = hash_state(&state, watchdog->memory_hash);
+    if (hash == watchdog->saved_hash
+        && memcmp(&state, &watchdog->saved, sizeof(APEX_Watchdog_State)) == 0
+        && memcmp(cpu->data_memory, watchdog->saved_memory,
+                  sizeof(int) * DATA_MEMORY_SIZE) == 0)
+    {
+        watchdog->loop_clock = watchdog->saved_clock;
+        watchdog->loop_cycles = cpu->clock - watchdog->saved_clock;
+        return watchdog->status = APEX_WATCHDOG_LOOP;
+    }
+    if (watchdog->length == watchdog->power)
+    {
+        save_state(watchdog, cpu, &state, hash);
+        watchdog->power *= 2;
+        watchdog->length = 0;
+    }
+    watchdog->length++;
+
+    if (watchdog->max_seconds > 0.0 && elapsed_seconds(watchdog) >= watchdog->max_seconds)
+    {
+        return watchdog->status = APEX_WATCHDOG_TIME;
+    }
+    return APEX_WATCHDOG_RUNNING;
+}
+
+const char *
+APEX_watchdog_name(int status)
+{
+    switch (status)
+    {
+        case APEX_WATCHDOG_LOOP:
+            return "infinite-loop";
+        case APEX_WATCHDOG_CYCLES:
+            return "cycle-limit";
+        case APEX_WATCHDOG_TIME:
+            return "time-limit";
+        default:
+            return "running";
+    }
+}
+
+/* Prints why the watchdog stopped the run */
+void
+APEX_watchdog_print(const APEX_Watchdog *watchdog, const APEX_CPU *cpu, FILE *out)
+{
+    fprintf(out, "APEX_WATCHDOG: %s at cycle %d, instructions = %d, pc = %d\n",
+            APEX_watchdog_name(watchdog->status), cpu->clock,
+            cpu->insn_completed, cpu->pc);
+    switch (watchdog->status)
+    {
+        case APEX_WATCHDOG_LOOP:
+            fprintf(out, "APEX_WATCHDOG: the state of cycle %ld recurs %ld "
+                    "cycles later, the program can never halt\n",
+                    watchdog->loop_clock, watchdog->loop_cycles);
+            break;
+        case APEX_WATCHDOG_CYCLES:
+            fprintf(out, "APEX_WATCHDOG: no HALT within %ld cycles\n",
+                    watchdog->max_cycles);
+            break;
+        case APEX_WATCHDOG_TIME:
+            fprintf(out, "APEX_WATCHDOG: no HALT within %.3f s\n",
+                    watchdog->max_seconds);
+            break;
+    }
+}
+
+void
+APEX_watchdog_destroy(APEX_Watchdog *watchdog)
+{
+    free(watchdog->memory);
+    free(watchdog->saved_memory);
+    free(watchdog);
+}
+
+/*
+ * Entry point of "apex_sim <input_file> watchdog <option>...". Options are
+ * data=<image>, forwarding=<none|ex|mem|all>, max_cycles=<n> and
+ * max_seconds=<s>. Runs quietly and exits with 0 once HALT retires, or
+ * with the APEX_WATCHDOG_* verdict that stopped the program.
+ */
+int
+APEX_watchdog_main(const char *filename, int argc, char const *argv[])
+{
+    APEX_Mode_Options options;
+    APEX_Watchdog *watchdog;
+    APEX_CPU *cpu;
+    APEX_Cycle_Fn cycle;
+    int status = APEX_WATCHDOG_RUNNING, i;
+    double max_seconds = 0.0;
+
+    /* No cycle limit unless given, the watchdog catches a hang */
+    APEX_mode_defaults(&options, 0);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "max_seconds=", 12) == 0)
+        {
+            max_seconds = atof(argv[i] + 12);
+        }
+        else if (!APEX_mode_option(&options, "watchdog", argv[i]))
+        {
+            return 1;
+        }
+    }
+
+    cpu = APEX_mode_cpu(filename, &options);
+    if (!cpu)
+    {
+        return 1;
+    }
+
+    watchdog = APEX_watchdog_create(cpu, options.max_cycles, max_seconds);
+    if (!watchdog)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize watchdog\n");
+        APEX_cpu_stop(cpu);
+        return 1;
+    }
+
+    cycle = APEX_cpu_cycle_variant(cpu);
+    while (!cycle(cpu))
+    {
+        if ((status = APEX_watchdog_check(watchdog, cpu)) != APEX_WATCHDOG_RUNNING)
+        {
+            break;
+        }
+    }
+
+    if (status == APEX_WATCHDOG_RUNNING)
+    {
+        printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n",
+               cpu->clock, cpu->insn_completed);
+    }
+    else
+    {
+        APEX_watchdog_print(watchdog, cpu, stderr);
+    }
+
+    APEX_watchdog_destroy(watchdog);
+    APEX_cpu_stop(cpu);
+    return status;
+}
@@ -0,0 +1,79 @@
+/*
+ * apex_watchdog.h
+ * Contains declarations of the runaway program watchdog
+ */
+#ifndef _APEX_WATCHDOG_H_
+#define _APEX_WATCHDOG_H_
+
+#include <stdio.h>
+#include <time.h>
+
+#include "apex_cpu.h"
+
+/* Verdicts, also the exit status of the watchdog mode. 1 is left to errors
+ * and 0 to a program that halted. */
+#define APEX_WATCHDOG_RUNNING 0
+#define APEX_WATCHDOG_LOOP 2       /* The whole state repeated */
+#define APEX_WATCHDOG_CYCLES 3     /* Cycle budget exhausted */
+#define APEX_WATCHDOG_TIME 4       /* Wall time budget exhausted */
+
+/* Cycles between two states compared for repetition, and two reads of the
+ * wall clock. Any repetition of the pipeline also shows in states this far
+ * apart, and hashing them this rarely keeps the cost per cycle to the
+ * store check. */
+#define APEX_WATCHDOG_INTERVAL 256
+
+/* Every field of the pipeline that decides the next cycle, apart from the
+ * data memory. Counters, the store log and the opcode strings are left
+ * out. Filled field by field so that padding never differs. */
+typedef struct APEX_Watchdog_State
+{
+    int pc;
+    int zero_flag;
+    int fetch_from_next_cycle;
+    condition_code cc;
+    forward_bus ex_fb;
+    forward_bus mem_fb;
+    int regs[REG_FILE_SIZE];
+    int regs_writing[REG_FILE_SIZE];
+    int latches[5][16];            /* Fetch to writeback */
+} APEX_Watchdog_State;
+
+typedef struct APEX_Watchdog
+{
+    long max_cycles;               /* 0 for no budget */
+    double max_seconds;
+    struct timespec start;
+
+    /* Brent's cycle detection over the states APEX_WATCHDOG_INTERVAL
+     * cycles apart. The state saved at the last power of two is compared
+     * with every later one; a hash rules most of them out. */
+    long next_check;               /* Cycle of the next state compared */
+    APEX_Watchdog_State saved;
+    int *saved_memory;
+    unsigned long saved_hash;
+    long saved_clock;
+    long power;
+    long length;
+
+    /* Hash of the data memory, updated store by store against a copy */
+    int *memory;
+    unsigned long memory_hash;
+    long clock;                    /* Last cycle checked */
+
+    int status;                    /* APEX_WATCHDOG_* */
+    long loop_clock;               /* Cycle the repeated state was first seen */
+    long loop_cycles;              /* Cycles until it was seen again */
+} APEX_Watchdog;
+
+APEX_Watchdog *APEX_watchdog_create(const APEX_CPU *cpu, long max_cycles,
+                                    double max_seconds);
+int APEX_watchdog_check(APEX_Watchdog *watchdog, const APEX_CPU *cpu);
+const char *APEX_watchdog_name(int status);
+void APEX_watchdog_print(const APEX_Watchdog *watchdog, const APEX_CPU *cpu,
+                         FILE *out);
+void APEX_watchdog_destroy(APEX_Watchdog *watchdog);
+
+int APEX_watchdog_main(const char *filename, int argc, char const *argv[]);
+
+#endif
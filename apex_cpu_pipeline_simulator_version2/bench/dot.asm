@@ -0,0 +1,16 @@
+MOVC R1,#0
+LOAD R9,R1,#1
+MOVC R5,#0
+LOAD R2,R1,#0
+MOVC R3,#64
+MOVC R4,#2080
+LOADP R6,R3,#0
+LOADP R7,R4,#0
+MUL R8,R6,R7
+ADD R5,R5,R8
+SUBL R2,R2,#1
+BNZ #-20
+SUBL R9,R9,#1
+BNZ #-40
+STORE R5,R1,#2
+HALT
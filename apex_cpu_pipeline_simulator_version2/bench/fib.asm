@@ -0,0 +1,13 @@
+MOVC R1,#0
+LOAD R2,R1,#0
+MOVC R3,#0
+MOVC R4,#1
+MOVC R9,#65535
+ADD R5,R3,R4
+AND R5,R5,R9
+ADDL R3,R4,#0
+ADDL R4,R5,#0
+SUBL R2,R2,#1
+BNZ #-20
+STORE R3,R1,#1
+HALT
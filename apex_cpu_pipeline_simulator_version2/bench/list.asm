@@ -0,0 +1,16 @@
+MOVC R1,#0
+LOAD R6,R1,#1
+MOVC R3,#0
+MOVC R4,#0
+LOAD R2,R1,#0
+LOAD R5,R2,#0
+ADD R3,R3,R5
+ADDL R4,R4,#1
+LOAD R2,R2,#1
+CMP R2,R1
+BNZ #-20
+SUBL R6,R6,#1
+BNZ #-32
+STORE R3,R1,#2
+STORE R4,R1,#3
+HALT
@@ -0,0 +1,28 @@
+MOVC R1,#0
+LOAD R2,R1,#0
+MOVC R10,#100
+MOVC R12,#2148
+ADDL R3,R2,#0
+MOVC R11,#1124
+ADDL R4,R2,#0
+ADDL R6,R10,#0
+ADDL R7,R11,#0
+MOVC R8,#0
+ADDL R5,R2,#0
+LOAD R13,R6,#0
+LOAD R14,R7,#0
+MUL R15,R13,R14
+ADD R8,R8,R15
+ADDL R6,R6,#1
+ADD R7,R7,R2
+SUBL R5,R5,#1
+BNZ #-28
+STORE R8,R12,#0
+ADDL R12,R12,#1
+ADDL R11,R11,#1
+SUBL R4,R4,#1
+BNZ #-64
+ADD R10,R10,R2
+SUBL R3,R3,#1
+BNZ #-84
+HALT
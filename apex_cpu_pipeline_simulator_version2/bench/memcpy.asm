@@ -0,0 +1,12 @@
+MOVC R1,#0
+LOAD R6,R1,#1
+LOAD R2,R1,#0
+MOVC R3,#64
+MOVC R4,#2080
+LOADP R5,R3,#0
+STOREP R5,R4,#0
+SUBL R2,R2,#1
+BNZ #-12
+SUBL R6,R6,#1
+BNZ #-32
+HALT
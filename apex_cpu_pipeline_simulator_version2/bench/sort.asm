@@ -0,0 +1,17 @@
+MOVC R1,#0
+LOAD R2,R1,#0
+SUBL R3,R2,#1
+MOVC R4,#100
+ADDL R5,R3,#0
+LOAD R6,R4,#0
+LOAD R7,R4,#1
+CMP R7,R6
+BNN #12
+STORE R7,R4,#0
+STORE R6,R4,#1
+ADDL R4,R4,#1
+SUBL R5,R5,#1
+BNZ #-32
+SUBL R3,R3,#1
+BNZ #-48
+HALT
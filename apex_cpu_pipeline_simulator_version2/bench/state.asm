@@ -0,0 +1,36 @@
+MOVC R1,#0
+LOAD R15,R1,#1
+MOVC R11,#0
+MOVC R12,#1
+MOVC R13,#2
+MOVC R14,#3
+LOAD R2,R1,#0
+MOVC R3,#100
+MOVC R10,#0
+LOAD R5,R3,#0
+ADDL R3,R3,#1
+CMP R5,R12
+BZ #68
+CMP R10,R12
+BZ #20
+CMP R10,R13
+BZ #28
+CMP R1,R1
+BZ #48
+CMP R5,R13
+BNZ #24
+MOVC R10,#2
+BZ #32
+CMP R5,R14
+BNZ #8
+ADDL R11,R11,#1
+MOVC R10,#0
+CMP R1,R1
+BZ #8
+MOVC R10,#1
+SUBL R2,R2,#1
+BNZ #-88
+SUBL R15,R15,#1
+BNZ #-108
+STORE R11,R1,#2
+HALT
@@ -466,4 +466,61 @@ create_code_memory(const char *filename, int *size)
     free(line);
     fclose(fp);
     return code_memory;
+}
+
+/*
+ * This function loads an initial data memory image. Every line of the image
+ * holds a start address followed by one or more values that are stored at
+ * consecutive addresses, e.g. "1000 5 7 9" sets Memory[1000..1002]
+ *
+ * Returns the number of words loaded, or -1 on error
+ */
+int
+load_data_image(const char *filename, int *data_memory)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    int words = 0;
+
+    if (!filename)
+    {
+        return -1;
+    }
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    while (getline(&line, &len, fp) != -1)
+    {
+        char *token = strtok(line, " ,\t\r\n");
+        int address;
+
+        if (token == NULL || token[0] == '#')
+        {
+            continue;
+        }
+
+        address = atoi(token);
+        while ((token = strtok(NULL, " ,\t\r\n")) != NULL)
+        {
+            if (address < 0 || address >= DATA_MEMORY_SIZE)
+            {
+                fprintf(stderr, "APEX_Error: data image address %d out of range\n",
+                        address);
+                free(line);
+                fclose(fp);
+                return -1;
+            }
+            data_memory[address++] = atoi(token);
+            words++;
+        }
+    }
+
+    free(line);
+    fclose(fp);
+    return words;
 }
\ No newline at end of file
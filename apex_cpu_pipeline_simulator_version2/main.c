@@ -8,7 +8,251 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include<string.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "apex_cpu.h"
+#include "apex_batch.h"
+#include "apex_sweep.h"
+#include "apex_debugger.h"
+#include "apex_gdb.h"
+#include "apex_profile.h"
+#include "apex_memprof.h"
+#include "apex_trace.h"
+#include "apex_sample.h"
+#include "apex_checkpoint.h"
+#include "apex_loop.h"
+#include "apex_watchdog.h"
+#include "apex_cosim.h"
+#include "apex_fuzz.h"
+#include "apex_bench.h"
+#include "apex_observer.h"
+#include "apex_stagetime.h"
+#include "apex_interval.h"
+#include "apex_simpoint.h"
+#include "apex_cpistack.h"
+#include "apex_hazard.h"
+#include "apex_schedule.h"
+
+static const char *batch_status_str[] = {"idle", "running", "halted",
+                                         "bad-pc", "bad-address", "step-limit"};
+
+/*
+ * Runs one program over many data memory images, APEX_BATCH_LANES images at
+ * a time, and prints the final registers of every instance
+ */
+static int
+run_batch(const char *filename, int num_images, char const *images[])
+{
+    APEX_Instruction *code_memory;
+    APEX_Batch *batch;
+    int code_memory_size, first, lane, i;
+    int regs[REG_FILE_SIZE];
+    int *image;
+    long total_insns = 0;
+    double elapsed = 0.0;
+    struct timespec start, end;
+
+    code_memory = create_code_memory(filename, &code_memory_size);
+    image = malloc(sizeof(int) * DATA_MEMORY_SIZE);
+    if (!code_memory || !image)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+        return 1;
+    }
+
+    for (first = 0; first < num_images; first += APEX_BATCH_LANES)
+    {
+        batch = APEX_batch_init(code_memory, code_memory_size);
+        if (!batch)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize batch\n");
+            return 1;
+        }
+
+        for (lane = 0; lane < APEX_BATCH_LANES && first + lane < num_images; ++lane)
+        {
+            memset(image, 0, sizeof(int) * DATA_MEMORY_SIZE);
+            if (load_data_image(images[first + lane], image) < 0)
+            {
+                fprintf(stderr, "APEX_Error: Unable to load data image %s\n",
+                        images[first + lane]);
+                return 1;
+            }
+            APEX_batch_load_lane(batch, lane, image);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        APEX_batch_run(batch, APEX_BATCH_MAX_STEPS);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        elapsed += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        for (lane = 0; lane < APEX_BATCH_LANES && first + lane < num_images; ++lane)
+        {
+            APEX_batch_read_lane(batch, lane, regs, NULL);
+            total_insns += batch->insn_completed[lane];
+            printf("%s: %s, instructions = %d\n", images[first + lane],
+                   batch_status_str[batch->status[lane]],
+                   batch->insn_completed[lane]);
+            for (i = 0; i < REG_FILE_SIZE; ++i)
+            {
+                printf("R%-3d[%-3d] ", i, regs[i]);
+                if (i == REG_FILE_SIZE / 2 - 1)
+                {
+                    printf("\n");
+                }
+            }
+            printf("\n");
+        }
+        APEX_batch_stop(batch);
+    }
+
+    printf("APEX_BATCH: %d instances, %d lanes, instructions = %ld, "
+           "time = %.6f s, %.2f MIPS\n",
+           num_images, APEX_BATCH_LANES, total_insns, elapsed,
+           elapsed > 0.0 ? total_insns / elapsed / 1e6 : 0.0);
+
+    free(image);
+    free(code_memory);
+    return 0;
+}
+
+/*
+ * Runs a program to completion under the profiler and prints the annotated
+ * listing
+ */
+static int
+run_profile(const char *filename, const char *image)
+{
+    APEX_Mode_Options options;
+    APEX_Profile *profile;
+    APEX_CPU *cpu;
+
+    APEX_mode_defaults(&options, 0);
+    options.image = image;
+    cpu = APEX_mode_cpu(filename, &options);
+    if (!cpu || !(profile = APEX_profile_create(cpu)))
+    {
+        return 1;
+    }
+    while (!APEX_profile_cycle(profile, cpu))
+        ;
+    APEX_profile_print(profile, cpu, stdout);
+
+    APEX_profile_destroy(profile);
+    APEX_cpu_stop(cpu);
+    return 0;
+}
+
+/*
+ * Runs a program to completion under the memory profiler. Options are
+ * data=<image>, forwarding=<none|ex|mem|all>, max_cycles=<n>, line=<words>
+ * and interval=<cycles>.
+ */
+static int
+run_memprofile(const char *filename, int argc, char const *argv[])
+{
+    APEX_Mode_Options options;
+    APEX_Memprof *memprof;
+    APEX_CPU *cpu;
+    int line_words = 1, interval_cycles = 1000, i;
+
+    APEX_mode_defaults(&options, 100000000L);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "line=", 5) == 0)
+        {
+            line_words = atoi(argv[i] + 5);
+        }
+        else if (strncmp(argv[i], "interval=", 9) == 0)
+        {
+            interval_cycles = atoi(argv[i] + 9);
+        }
+        else if (!APEX_mode_option(&options, "memprofile", argv[i]))
+        {
+            return 1;
+        }
+    }
+
+    cpu = APEX_mode_cpu(filename, &options);
+    if (!cpu || !(memprof = APEX_memprof_create(cpu, line_words, interval_cycles)))
+    {
+        return 1;
+    }
+    while (cpu->clock < options.max_cycles && !APEX_memprof_cycle(memprof, cpu))
+        ;
+    APEX_memprof_print(memprof, cpu, stdout);
+
+    APEX_memprof_destroy(memprof);
+    APEX_cpu_stop(cpu);
+    return 0;
+}
+
+/*
+ * Runs a program to completion and records its committed instruction trace
+ * for replay. Options are data=<image>, forwarding=<none|ex|mem|all>,
+ * format=<packed|raw> and max_cycles=<n>; a run cut short by max_cycles
+ * still leaves a usable trace.
+ */
+static int
+run_record(const char *filename, const char *path, int argc, char const *argv[])
+{
+    APEX_Mode_Options options;
+    APEX_Trace_Writer *writer;
+    APEX_CPU *cpu;
+    int packed = TRUE, i;
+    struct stat st;
+
+    APEX_mode_defaults(&options, APEX_TRACE_MAX_CYCLES);
+    for (i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "format=raw") == 0)
+        {
+            packed = FALSE;
+        }
+        else if (strcmp(argv[i], "format=packed") == 0)
+        {
+            packed = TRUE;
+        }
+        else if (!APEX_mode_option(&options, "record", argv[i]))
+        {
+            return 1;
+        }
+    }
+
+    cpu = APEX_mode_cpu(filename, &options);
+    if (!cpu)
+    {
+        return 1;
+    }
+    writer = APEX_trace_writer_create(path, cpu, packed);
+    if (!writer)
+    {
+        fprintf(stderr, "APEX_Error: Unable to create trace %s\n", path);
+        APEX_cpu_stop(cpu);
+        return 1;
+    }
+    while (cpu->clock < options.max_cycles && !APEX_trace_cycle(writer, cpu))
+        ;
+    if (APEX_trace_writer_close(writer, cpu) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write trace %s\n", path);
+        APEX_cpu_stop(cpu);
+        return 1;
+    }
+    printf("APEX_TRACE: %s, %s, %d instructions recorded with forwarding=%s "
+           "in %d cycles\n", path, packed ? "packed" : "raw", cpu->insn_completed,
+           APEX_forwarding_name(cpu->forwarding), cpu->clock);
+    if (packed && stat(path, &st) == 0 && cpu->insn_completed > 0)
+    {
+        printf("APEX_TRACE: %ld bytes, %.2f bytes per instruction, %.1fx smaller than raw\n",
+               (long)st.st_size, (double)st.st_size / cpu->insn_completed,
+               (sizeof(APEX_Trace_Header) + (double)cpu->insn_completed
+                * sizeof(APEX_Trace_Record)) / st.st_size);
+    }
+
+    APEX_cpu_stop(cpu);
+    return 0;
+}
 
 int
 main(int argc, char const *argv[])
@@ -16,12 +260,131 @@ main(int argc, char const *argv[])
     APEX_CPU *cpu;
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
+    APEX_stagetime_start();
+
+    if (argc >= 4 && strcmp(argv[2], "batch") == 0)
+    {
+        return run_batch(argv[1], argc - 3, &argv[3]);
+    }
+
+    if ((argc == 3 || argc == 4) && strcmp(argv[2], "profile") == 0)
+    {
+        return run_profile(argv[1], argc == 4 ? argv[3] : NULL);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "memprofile") == 0)
+    {
+        return run_memprofile(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 4 && strcmp(argv[2], "record") == 0)
+    {
+        return run_record(argv[1], argv[3], argc - 4, &argv[4]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "replay") == 0)
+    {
+        return APEX_trace_replay_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "sample") == 0)
+    {
+        return APEX_sample_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "parallel") == 0)
+    {
+        return APEX_checkpoint_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "extrapolate") == 0)
+    {
+        return APEX_loop_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "watchdog") == 0)
+    {
+        return APEX_watchdog_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "cosim") == 0)
+    {
+        return APEX_cosim_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "fuzz") == 0)
+    {
+        return APEX_fuzz_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "bench") == 0)
+    {
+        return APEX_bench_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "sweep") == 0)
+    {
+        return APEX_sweep_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "plugin") == 0)
+    {
+        return APEX_plugin_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 4 && strcmp(argv[2], "intervals") == 0)
+    {
+        return APEX_interval_main(argv[1], argv[3], argc - 4, &argv[4]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "simpoint") == 0)
+    {
+        return APEX_simpoint_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "cpistack") == 0)
+    {
+        return APEX_cpistack_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[2], "hazards") == 0)
+    {
+        return APEX_hazard_main(argv[1], argc - 3, &argv[3]);
+    }
+
+    if (argc >= 4 && strcmp(argv[2], "schedule") == 0)
+    {
+        return APEX_schedule_main(argv[1], argc - 3, &argv[3]);
+    }
 
-    if (argc != 2 && (argc != 4 || strcmp(argv[2], "simulate") != 0))
+    if (argc != 2
+        && (argc != 4 || (strcmp(argv[2], "simulate") != 0 && strcmp(argv[2], "gdb") != 0))
+        && (argc != 3 || strcmp(argv[2], "debug") != 0))
     {
         fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
         fprintf(stderr, "  To run the code: %s <input_file>\n", argv[0]);
         fprintf(stderr, "  To simulate with a specific number of cycles: %s <input_file> simulate <num_cycles>\n", argv[0]);
+        fprintf(stderr, "  To debug interactively: %s <input_file> debug\n", argv[0]);
+        fprintf(stderr, "  To debug with gdb: %s <input_file> gdb <port>|unix:<path>\n", argv[0]);
+        fprintf(stderr, "  To profile per instruction: %s <input_file> profile [<data_image>]\n", argv[0]);
+        fprintf(stderr, "  To profile data memory accesses: %s <input_file> memprofile [data=<image>] [forwarding=<none|ex|mem|all>] [max_cycles=<n>] [line=<words>] [interval=<cycles>]\n", argv[0]);
+        fprintf(stderr, "  To record the committed instruction trace: %s <input_file> record <trace_file> [data=<image>] [forwarding=<none|ex|mem|all>] [format=<packed|raw>] [max_cycles=<n>]\n", argv[0]);
+        fprintf(stderr, "  To replay a trace through the timing model: %s <trace_file> replay [forwarding=<none|ex|mem|all>,...] [threads=<n>] [from=<record>] [count=<n>]\n", argv[0]);
+        fprintf(stderr, "  To estimate CPI by sampling: %s <input_file> sample [data=<image>] [forwarding=<none|ex|mem|all>] [unit=<n>] [warmup=<n>] [samples=<n>] [error=<fraction>] [confidence=<fraction>] [verify] [max_cycles=<n>]\n", argv[0]);
+        fprintf(stderr, "  To simulate intervals of one run in parallel: %s <input_file> parallel [data=<image>] [forwarding=<none|ex|mem|all>] [interval=<n>] [warmup=<n>] [threads=<n>] [verify] [max_cycles=<n>]\n", argv[0]);
+        fprintf(stderr, "  To run with steady-state loops extrapolated: %s <input_file> extrapolate [data=<image>] [forwarding=<none|ex|mem|all>] [max_cycles=<n>] [verify]\n", argv[0]);
+        fprintf(stderr, "  To run under a watchdog, exit status 2/3/4 for a loop/cycle/time runaway: %s <input_file> watchdog [data=<image>] [forwarding=<none|ex|mem|all>] [max_cycles=<n>] [max_seconds=<s>]\n", argv[0]);
+        fprintf(stderr, "  To find the first divergence of two models: %s <input_file> cosim [data=<image>] [forwarding=<none|ex|mem|all>] [ref=<func|none|ex|mem|all>] [max_cycles=<n>]\n", argv[0]);
+        fprintf(stderr, "  To fuzz a pipeline against a reference: %s <output_prefix> fuzz [count=<n>] [seed=<n>] [threads=<n>] [reports=<n>] [length=<n>] [distance=<n>] [dependency=<percent>] [branches=<percent>] [memory=<percent>] [alias=<percent>] [loop=<n>] [forwarding=<none|ex|mem|all>] [ref=<func|none|ex|mem|all>]\n", argv[0]);
+        fprintf(stderr, "  To time a kernel over data images: %s <input_file> bench [repeat=<n>] [forwarding=<none|ex|mem|all>] [max_cycles=<n>] [data=<image>] <data_image>...\n", argv[0]);
+        fprintf(stderr, "  To run many data images in lockstep: %s <input_file> batch <data_image>...\n", argv[0]);
+        fprintf(stderr, "  To sweep configurations in parallel: %s <input_file> sweep [forwarding=<none|ex|mem|all>,...] [data=<image>,...] [threads=<n>] [max_cycles=<n>] [max_seconds=<s>] [format=<csv|json>] [extrapolate]\n", argv[0]);
+        fprintf(stderr, "  To run with observer plugins attached: %s <input_file> plugin [data=<image>] [forwarding=<none|ex|mem|all>] [max_cycles=<n>] <shared_object>[:<args>]...\n", argv[0]);
+        fprintf(stderr, "  To write counters every N cycles or instructions: %s <input_file> intervals <output_file> [data=<image>] [forwarding=<none|ex|mem|all>] [cycles=<n>|insns=<n>] [format=<csv|binary>] [max_cycles=<n>]\n", argv[0]);
+        fprintf(stderr, "  To simulate only representative intervals: %s <input_file> simpoint [data=<image>] [forwarding=<none|ex|mem|all>] [interval=<n>] [warmup=<n>] [k=<n>|max_k=<n>] [seed=<n>] [out=<file>|points=<file>] [threads=<n>] [verify] [max_cycles=<n>]\n", argv[0]);
+        fprintf(stderr, "  To break the cycles down into a CPI stack: %s <input_file> cpistack [data=<image>] [forwarding=<none|ex|mem|all>] [format=<text|json>] [max_cycles=<n>]\n", argv[0]);
+        fprintf(stderr, "  To predict hazards statically and check them: %s <input_file> hazards [data=<image>] [forwarding=<none|ex|mem|all>] [max_cycles=<n>] [static]\n", argv[0]);
+        fprintf(stderr, "  To reorder basic blocks to stall less: %s <input_file> schedule <output_file> [data=<image>] [forwarding=<none|ex|mem|all>] [max_cycles=<n>]\n", argv[0]);
         exit(1);
     }
 
@@ -31,13 +394,17 @@ main(int argc, char const *argv[])
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
         exit(1);
     }
-    if (argc == 4) {
+    if (argc == 4 && strcmp(argv[2], "gdb") == 0) {
+        APEX_gdb_main(cpu, argv[3]);
+    } else if (argc == 4) {
         int num_cycles = atoi(argv[3]);
         if (num_cycles <= 0) {
             fprintf(stderr, "APEX_Error: Invalid number of cycles\n");
             exit(1);
         }
         simulate_cpu_for_cycles(cpu, num_cycles);
+    } else if (argc == 3) {
+        APEX_debugger_main(cpu);
     } else {
         APEX_cpu_run(cpu);
     }
@@ -45,4 +412,4 @@ main(int argc, char const *argv[])
     //APEX_cpu_run(cpu);
     APEX_cpu_stop(cpu);
     return 0;
-}
\ No newline at end of file
+}
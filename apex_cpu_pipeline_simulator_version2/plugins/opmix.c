@@ -0,0 +1,97 @@
+/*
+ * opmix.c
+ * Example plugin: the retired instruction mix and the stall, flush,
+ * forwarding and memory events of a run
+ *
+ * Build with "make plugins" and run with
+ *   ./apex_sim <input_file> plugin plugins/opmix.so
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_observer.h"
+
+/* Opcodes are below this */
+#define OPMIX_OPCODES 32
+
+typedef struct Opmix
+{
+    long retired[OPMIX_OPCODES];
+    const char *names[OPMIX_OPCODES];
+    long stalls;
+    long flushes;
+    long forwards[NUM_OPERAND_SOURCES];
+    long loads;
+    long stores;
+} Opmix;
+
+static Opmix mix;
+
+static void
+on_event(void *context, const APEX_CPU *cpu, const APEX_Event *event)
+{
+    Opmix *m = context;
+
+    switch (event->type)
+    {
+        case APEX_EVENT_RETIRE:
+            if (event->latch->opcode >= 0 && event->latch->opcode < OPMIX_OPCODES)
+            {
+                m->retired[event->latch->opcode]++;
+                m->names[event->latch->opcode] = event->latch->opcode_str;
+            }
+            break;
+        case APEX_EVENT_STALL:
+            m->stalls++;
+            break;
+        case APEX_EVENT_FLUSH:
+            m->flushes++;
+            break;
+        case APEX_EVENT_FORWARD:
+            m->forwards[event->source]++;
+            break;
+        case APEX_EVENT_MEMORY:
+            if (event->is_store)
+            {
+                m->stores++;
+            }
+            else
+            {
+                m->loads++;
+            }
+            break;
+    }
+}
+
+int
+apex_plugin_init(APEX_CPU *cpu, const char *args)
+{
+    return APEX_observer_add(cpu,
+                             APEX_EVENT_MASK(APEX_EVENT_RETIRE)
+                                 | APEX_EVENT_MASK(APEX_EVENT_STALL)
+                                 | APEX_EVENT_MASK(APEX_EVENT_FLUSH)
+                                 | APEX_EVENT_MASK(APEX_EVENT_FORWARD)
+                                 | APEX_EVENT_MASK(APEX_EVENT_MEMORY),
+                             on_event, &mix);
+}
+
+void
+apex_plugin_fini(const APEX_CPU *cpu)
+{
+    int i;
+
+    printf("OPMIX: %d instructions in %d cycles\n", cpu->insn_completed, cpu->clock);
+    for (i = 0; i < OPMIX_OPCODES; ++i)
+    {
+        if (mix.retired[i])
+        {
+            printf("  %-8s %10ld %6.1f%%\n", mix.names[i] ? mix.names[i] : "?",
+                   mix.retired[i],
+                   cpu->insn_completed ? 100.0 * mix.retired[i] / cpu->insn_completed : 0.0);
+        }
+    }
+    printf("  stall cycles %ld, flushes %ld, forwarded operands %ld (EX) %ld (MEM), "
+           "loads %ld, stores %ld\n", mix.stalls, mix.flushes,
+           mix.forwards[OPERAND_EX_FB], mix.forwards[OPERAND_MEM_FB], mix.loads,
+           mix.stores);
+}